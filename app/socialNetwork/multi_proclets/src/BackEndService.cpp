@@ -1,6 +1,7 @@
 #include "../gen-cpp/BackEndService.h"
 
 #include <thread.h>
+#include <timer.h>
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/server/TThreadedServer.h>
 #include <thrift/transport/TBufferTransports.h>
@@ -8,8 +9,11 @@
 
 #include <future>
 #include <iostream>
+#include <map>
 #include <mutex>
 #include <nlohmann/json.hpp>
+#include <nu/call_graph_profiler.hpp>
+#include <nu/ctrl_client.hpp>
 #include <nu/runtime.hpp>
 #include <string>
 
@@ -22,6 +26,10 @@ using apache::thrift::transport::TFramedTransportFactory;
 using apache::thrift::transport::TServerSocket;
 
 constexpr static uint32_t kNumEntries = 1;
+// Prints the cluster-wide local and remote proclet calls every interval, so
+// that runs with and without call-graph-aware placement can be compared.
+constexpr static bool kDumpRpcCounts = true;
+constexpr static uint64_t kDumpRpcCountsIntervalUs = 1000 * 1000;
 
 namespace social_network {
 
@@ -286,6 +294,46 @@ class ServiceEntry {
 
 }  // namespace social_network
 
+// Pinned to a node to read the calls issued by the proclets running there.
+class RpcCounter {
+ public:
+  std::pair<uint64_t, uint64_t> get() {
+    auto *profiler = nu::get_runtime()->call_graph_profiler();
+    return {profiler->get_num_local_calls(), profiler->get_num_remote_calls()};
+  }
+};
+
+void dump_rpc_counts() {
+  std::map<nu::NodeIP, nu::Proclet<RpcCounter>> counters;
+  uint64_t last_num_local_calls = 0;
+  uint64_t last_num_remote_calls = 0;
+
+  std::cout << "time_us num_local_calls num_remote_calls" << std::endl;
+  while (true) {
+    timer_sleep(kDumpRpcCountsIntervalUs);
+
+    auto *ctrl_client = nu::get_runtime()->controller_client();
+    for (auto &[_, ip] : ctrl_client->get_proclet_locations()) {
+      if (!counters.contains(ip)) {
+        counters.emplace(ip,
+                         nu::make_proclet<RpcCounter>(true, std::nullopt, ip));
+      }
+    }
+
+    uint64_t num_local_calls = 0;
+    uint64_t num_remote_calls = 0;
+    for (auto &[_, counter] : counters) {
+      auto [num_local, num_remote] = counter.run(&RpcCounter::get);
+      num_local_calls += num_local;
+      num_remote_calls += num_remote;
+    }
+    std::cout << microtime() << " " << num_local_calls - last_num_local_calls
+              << " " << num_remote_calls - last_num_remote_calls << std::endl;
+    last_num_local_calls = num_local_calls;
+    last_num_remote_calls = num_remote_calls;
+  }
+}
+
 void do_work() {
   auto states = social_network::make_states();
 
@@ -296,6 +344,10 @@ void do_work() {
           std::forward_as_tuple(states), true);
     }));
   }
+
+  if constexpr (kDumpRpcCounts) {
+    dump_rpc_counts();
+  }
 }
 
 int main(int argc, char **argv) {
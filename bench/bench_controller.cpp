@@ -1,14 +1,18 @@
 #include <thread.h>
 
+#include <algorithm>
 #include <atomic>
 #include <functional>
 #include <iostream>
 #include <random>
 #include <vector>
 
+#include "nu/ctrl.hpp"
 #include "nu/ctrl_client.hpp"
+#include "nu/proclet.hpp"
 #include "nu/runtime.hpp"
 #include "nu/utils/perf.hpp"
+#include "nu/utils/time.hpp"
 
 using namespace nu;
 
@@ -16,6 +20,9 @@ constexpr uint32_t kNumThreads = 18;
 constexpr uint32_t kTargetMops = 2;
 constexpr uint64_t kPerfDurationUs = 10 * kOneSecond;
 constexpr uint32_t kNumProclets = 65566;
+constexpr uint32_t kNumCreatedProclets = 8192;
+constexpr uint32_t kNumLocalProclets = 4096;
+constexpr uint32_t kNumLocalOpsPerThread = 1 << 20;
 
 namespace nu {
 
@@ -159,9 +166,109 @@ class Test {
       std::cout << "update_location() mops = " << perf.get_real_mops()
                 << std::endl;
     }
+
+    {
+      std::vector<Proclet<ErasedType>> proclets;
+      auto start_us = Time::microtime();
+      for (uint32_t i = 0; i < kNumCreatedProclets; i++) {
+        proclets.emplace_back(make_proclet<ErasedType>());
+      }
+      auto end_us = Time::microtime();
+      std::cout << "make_proclet() x " << kNumCreatedProclets
+                << " us = " << end_us - start_us << std::endl;
+    }
+
+    {
+      auto start_us = Time::microtime();
+      auto proclets = make_proclets<ErasedType>(kNumCreatedProclets);
+      auto end_us = Time::microtime();
+      BUG_ON(proclets.size() != kNumCreatedProclets);
+      std::cout << "make_proclets(" << kNumCreatedProclets
+                << ") us = " << end_us - start_us << std::endl;
+
+      // What a node goes through when it first touches a sharded container.
+      std::vector<ProcletID> ids;
+      for (auto &proclet : proclets) {
+        ids.push_back(proclet.get_id());
+      }
+      auto *client = get_runtime()->controller_client();
+      start_us = Time::microtime();
+      for (auto id : ids) {
+        BUG_ON(!client->resolve_proclet(id));
+      }
+      end_us = Time::microtime();
+      std::cout << "resolve_proclet() x " << kNumCreatedProclets
+                << " us = " << end_us - start_us << std::endl;
+      start_us = Time::microtime();
+      auto ips = client->resolve_proclets(ids);
+      end_us = Time::microtime();
+      BUG_ON(std::ranges::count(ips, 0));
+      std::cout << "resolve_proclets(" << kNumCreatedProclets
+                << ") us = " << end_us - start_us << std::endl;
+    }
+
+    run_local_controller();
   }
 
  private:
+  // Drives a Controller instance within this process, so that the numbers
+  // show how its state scales with cores instead of with the network.
+  void run_local_controller() {
+    auto ctrl = std::make_unique<Controller>();
+    auto optional = ctrl->register_node(get_cfg_ip(), 0, get_self_md5(),
+                                        /* isol = */ false);
+    BUG_ON(!optional);
+    auto lpid = optional->first;
+    auto proclets = ctrl->allocate_proclets(
+        kNumLocalProclets, kMinProcletHeapSize, lpid, /* ip_hint = */ 0);
+    BUG_ON(proclets.size() != kNumLocalProclets);
+
+    for (uint32_t num_threads = 1; num_threads <= kNumThreads;
+         num_threads *= 2) {
+      auto resolve_mops = run_local_op(num_threads, [&](uint32_t i) {
+        BUG_ON(!ctrl->resolve_proclet(proclets[i % kNumLocalProclets].first));
+      });
+      auto update_mops = run_local_op(num_threads, [&](uint32_t i) {
+        auto &[id, ip] = proclets[i % kNumLocalProclets];
+        ctrl->update_location(id, ip);
+      });
+      auto report_mops = run_local_op(num_threads, [&](uint32_t i) {
+        ctrl->report_free_resource(lpid, get_cfg_ip(), Resource{0, 0},
+                                   /* known_view_version = */ 0);
+      });
+      // Nodes whose resource and view haven't changed.
+      auto view_version =
+          ctrl->report_free_resource(lpid, get_cfg_ip(), std::nullopt, 0).first;
+      auto unchanged_report_mops = run_local_op(num_threads, [&](uint32_t i) {
+        ctrl->report_free_resource(lpid, get_cfg_ip(), std::nullopt,
+                                   view_version);
+      });
+      std::cout << "local controller, " << num_threads
+                << " cores: resolve_proclet() mops = " << resolve_mops
+                << ", update_location() mops = " << update_mops
+                << ", report_free_resource() mops = " << report_mops
+                << ", unchanged report_free_resource() mops = "
+                << unchanged_report_mops << std::endl;
+    }
+  }
+
+  double run_local_op(uint32_t num_threads, std::function<void(uint32_t)> op) {
+    std::vector<rt::Thread> threads;
+    auto start_us = Time::microtime();
+    for (uint32_t i = 0; i < num_threads; i++) {
+      threads.emplace_back([&, i] {
+        for (uint32_t j = 0; j < kNumLocalOpsPerThread; j++) {
+          op(i * kNumLocalOpsPerThread + j);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.Join();
+    }
+    auto duration_us = Time::microtime() - start_us;
+    return static_cast<double>(num_threads) * kNumLocalOpsPerThread /
+           duration_us;
+  }
 };
 
 }  // namespace nu
@@ -1,11 +1,13 @@
 #include <algorithm>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <numeric>
 #include <optional>
 #include <random>
 #include <set>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -19,6 +21,7 @@ extern "C" {
 #include "nu/proclet.hpp"
 #include "nu/runtime.hpp"
 #include "nu/utils/farmhash.hpp"
+#include "nu/utils/slab.hpp"
 #include "nu/utils/trace_logger.hpp"
 
 using namespace nu;
@@ -31,6 +34,10 @@ constexpr uint32_t kDeletePercentage = 10;
 
 constexpr auto kIPServer = MAKE_IP_ADDR(18, 18, 1, 4);
 
+constexpr uint64_t kSlabBufSize = 4ULL << 30;
+constexpr uint32_t kNumSizedAllocs = 1 << 20;
+constexpr uint32_t kMaxSizedAllocSize = 64 << 10;
+
 bool use_local;
 
 struct Key {
@@ -226,7 +233,61 @@ uint64_t run_on_dis_hash_table(std::vector<Command> *commands) {
   return mem_usage_end - mem_usage_start;
 }
 
+// Allocates kNumSizedAllocs objects with sizes drawn from gen_size() on a
+// fresh slab and reports its footprint against the bytes actually requested.
+void run_with_size_distribution(
+    std::string_view name, std::function<uint64_t(std::mt19937 &)> gen_size) {
+  rt::Preempt p;
+  rt::PreemptGuard g(&p);
+
+  auto buf = std::make_unique_for_overwrite<uint8_t[]>(kSlabBufSize);
+  SlabAllocator slab(kRuntimeSlabId + 1, buf.get(), kSlabBufSize);
+  std::mt19937 mt(0);
+  std::vector<void *> ptrs;
+  uint64_t requested_bytes = 0;
+
+  for (uint32_t i = 0; i < kNumSizedAllocs; i++) {
+    auto size = std::clamp(gen_size(mt), static_cast<uint64_t>(1),
+                           static_cast<uint64_t>(kMaxSizedAllocSize));
+    auto *ptr = slab.allocate(size);
+    BUG_ON(!ptr);
+    ptrs.push_back(ptr);
+    requested_bytes += size;
+  }
+  auto usage = slab.get_usage();
+  for (auto *ptr : ptrs) {
+    SlabAllocator::free(ptr);
+  }
+
+  std::cout << name << ": requested = " << requested_bytes
+            << ", usage = " << usage << ", overhead = "
+            << static_cast<double>(usage) / requested_bytes - 1 << std::endl;
+}
+
+void run_size_distributions() {
+  // Sizes spread evenly over small objects.
+  run_with_size_distribution("uniform(1, 1024)", [](std::mt19937 &mt) {
+    return std::uniform_int_distribution<uint64_t>(1, 1024)(mt);
+  });
+  // Heavy-tailed sizes resembling strings and serialized blobs.
+  run_with_size_distribution("lognormal(4.5, 1.2)", [](std::mt19937 &mt) {
+    return static_cast<uint64_t>(
+        std::lognormal_distribution<double>(4.5, 1.2)(mt));
+  });
+  // Hash map nodes mixed with their out-of-line payloads.
+  run_with_size_distribution("hash_map_nodes", [](std::mt19937 &mt) {
+    constexpr uint64_t kSizes[] = {24, 40, 56, 72, 136, 264, 520};
+    constexpr double kWeights[] = {30, 25, 15, 10, 10, 7, 3};
+    std::discrete_distribution<uint32_t> dist(std::begin(kWeights),
+                                              std::end(kWeights));
+    return kSizes[dist(mt)];
+  });
+}
+
 void do_work() {
+  std::cout << "run_size_distributions..." << std::endl;
+  run_size_distributions();
+
   std::cout << "gen_commands..." << std::endl;
   std::vector<Command> commands[kNumThreads];
   gen_commands(commands);
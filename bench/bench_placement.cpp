@@ -0,0 +1,126 @@
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "nu/ctrl.hpp"
+#include "nu/placement.hpp"
+#include "nu/runtime.hpp"
+
+using namespace nu;
+
+constexpr uint32_t kNumNodes = 32;
+constexpr float kNodeCores = 16;
+constexpr float kNodeMemMBs = 64 << 10;
+constexpr uint32_t kNumProclets = 6144;
+constexpr uint32_t kNumRounds = 8;
+// Every node reports its free resource once per so many allocations.
+constexpr uint32_t kReportInterval = 64;
+constexpr float kHeavyRatio = 0.05;
+constexpr uint64_t kLightCapacity = kDefaultProcletHeapSize;
+constexpr uint64_t kHeavyCapacity = 8ULL << 30;
+constexpr float kMaxProcletCores = 0.2;
+
+struct SimNode {
+  Resource used{0, 0};
+  std::vector<Resource> proclets;
+
+  Resource get_free() const {
+    return Resource{kNodeCores - used.cores, kNodeMemMBs - used.mem_mbs};
+  }
+  bool fits(Resource usage) const {
+    auto free = get_free();
+    return free.cores >= usage.cores &&
+           free.mem_mbs >= usage.mem_mbs + NodeStatus::kMemLowWaterMarkMBs;
+  }
+};
+
+// Places a random trace of proclets with the policy (or the resource-unaware
+// round robin if it's nullptr), and counts how many proclets the nodes that
+// got overloaded would then have to migrate away.
+uint32_t simulate(PlacementPolicy *policy, uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> dist(0, 1);
+  std::vector<SimNode> nodes(kNumNodes);
+  NodeStatuses node_statuses;
+  auto to_ip = [](uint32_t idx) { return static_cast<NodeIP>(idx + 1); };
+  for (uint32_t i = 0; i < kNumNodes; i++) {
+    auto [iter, _] = node_statuses.try_emplace(to_ip(i), /* isol = */ false);
+    iter->second.free_resource = nodes[i].get_free();
+  }
+
+  uint32_t num_migrations = 0;
+  for (uint32_t i = 0; i < kNumProclets; i++) {
+    auto capacity = dist(gen) < kHeavyRatio ? kHeavyCapacity : kLightCapacity;
+    auto mem_mbs = capacity / static_cast<float>(kOneMB);
+    Resource demand{0, mem_mbs};
+    Resource usage{dist(gen) * kMaxProcletCores,
+                   mem_mbs * (0.5f + 0.5f * dist(gen))};
+
+    auto ip = policy ? policy->select(node_statuses, demand) : 0;
+    if (!ip) {
+      // What the controller falls back to.
+      ip = to_ip(i % kNumNodes);
+    }
+    node_statuses.at(ip).free_resource.mem_mbs -= demand.mem_mbs;
+    auto &node = nodes[ip - 1];
+    node.used += usage;
+    node.proclets.push_back(usage);
+
+    // The pressure handler sheds proclets until the node is healthy again.
+    while (node.get_free().cores < 0 ||
+           node.get_free().mem_mbs < NodeStatus::kMemLowWaterMarkMBs) {
+      auto victim = node.proclets.back();
+      SimNode *dest = nullptr;
+      for (auto &candidate : nodes) {
+        if (&candidate != &node && candidate.fits(victim) &&
+            (!dest || candidate.used.mem_mbs < dest->used.mem_mbs)) {
+          dest = &candidate;
+        }
+      }
+      if (!dest) {
+        break;
+      }
+      node.proclets.pop_back();
+      node.used += Resource{-victim.cores, -victim.mem_mbs};
+      dest->proclets.push_back(victim);
+      dest->used += victim;
+      num_migrations++;
+    }
+
+    if (i % kReportInterval == 0) {
+      for (uint32_t j = 0; j < kNumNodes; j++) {
+        node_statuses.at(to_ip(j)).update_free_resource(nodes[j].get_free());
+      }
+    }
+  }
+
+  return num_migrations;
+}
+
+void do_work() {
+  std::pair<std::string_view, std::unique_ptr<PlacementPolicy>> policies[] = {
+      {"unaware round-robin", nullptr},
+      {"round-robin", std::make_unique<RoundRobinPolicy>()},
+      {"least-loaded", std::make_unique<LeastLoadedPolicy>()},
+      {"power-of-two-choices", std::make_unique<PowerOfTwoChoicesPolicy>()},
+      {"bin-packing", std::make_unique<BinPackingPolicy>(
+                          Controller::kMemHeavyProcletMBs,
+                          std::make_unique<PowerOfTwoChoicesPolicy>())}};
+
+  for (auto &[name, policy] : policies) {
+    uint64_t num_migrations = 0;
+    for (uint32_t round = 0; round < kNumRounds; round++) {
+      num_migrations += simulate(policy.get(), round);
+    }
+    std::cout << name << ": " << num_migrations / kNumRounds
+              << " migrations per " << kNumProclets << " proclets"
+              << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
@@ -0,0 +1,65 @@
+#include <thread.h>
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "nu/runtime.hpp"
+#include "nu/utils/slab.hpp"
+#include "nu/utils/time.hpp"
+
+using namespace nu;
+
+constexpr uint64_t kSlabBufSize = 8ULL << 30;
+constexpr uint32_t kNumThreads = kNumCores;
+constexpr uint32_t kNumRounds = 1000;
+constexpr uint32_t kBatchSize = 64;
+constexpr uint64_t kObjSizes[] = {64, 512, 4096, 8192};
+
+void run_with_size(SlabAllocator *slab, uint64_t obj_size) {
+  std::vector<rt::Thread> threads;
+  auto start_us = Time::microtime();
+
+  for (uint32_t i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&] {
+      void *ptrs[kBatchSize];
+      for (uint32_t j = 0; j < kNumRounds; j++) {
+        for (auto &ptr : ptrs) {
+          ptr = slab->allocate(obj_size);
+          BUG_ON(!ptr);
+        }
+        for (auto ptr : ptrs) {
+          slab->free(ptr);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+
+  auto duration_us = Time::microtime() - start_us;
+  auto num_ops = 2ULL * kNumThreads * kNumRounds * kBatchSize;
+  std::cout << obj_size << " B: " << static_cast<double>(num_ops) / duration_us
+            << " MOPS, cur usage = " << slab->get_cur_usage() << " B"
+            << std::endl;
+}
+
+void do_work() {
+  auto buf = std::make_unique_for_overwrite<uint8_t[]>(kSlabBufSize);
+  auto slab = std::make_unique<SlabAllocator>(kRuntimeSlabId + 1, buf.get(),
+                                              kSlabBufSize);
+
+  for (auto obj_size : kObjSizes) {
+    run_with_size(slab.get(), obj_size);
+  }
+
+  // The caches return their objects once each core touches the slab again.
+  SlabAllocator::shrink_caches();
+  run_with_size(slab.get(), kObjSizes[0]);
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include <sync.h>
+#include <thread.h>
+
+#include "nu/commons.hpp"
+
+namespace nu {
+
+struct CallGraphEdge {
+  ProcletID caller;
+  ProcletID callee;
+  NodeIP callee_ip;  // 0 if the last sampled call was local.
+  uint64_t num_calls;
+  uint64_t num_bytes;
+};
+
+// The aggregated traffic of a proclet, split by where its peers live.
+struct CallAffinity {
+  float local_cost_us;
+  float best_remote_cost_us;
+  NodeIP best_remote_ip;
+
+  // In [-1, 1]. Positive if the proclet mostly talks to local proclets, i.e.,
+  // migrating it would turn its heavy edges into remote ones.
+  float locality() const;
+};
+
+// Samples the caller/callee pairs of proclet invocations into a per-core
+// counter matrix. Counters are updated without cross-core synchronization, so
+// the exported graph is approximate by design (same as CPULoad).
+class CallGraphProfiler {
+ public:
+  constexpr static bool kEnableLogging = false;
+  constexpr static uint64_t kPrintIntervalUs = kOneSecond;
+  constexpr static uint32_t kSampleInterval = 16;  // Be power of 2 for speed.
+  constexpr static uint32_t kNumSlotsPerCore = 1024;  // Be power of 2.
+  constexpr static uint32_t kMaxNumProbes = 4;
+  constexpr static float kDecayFactor = 0.5;
+  static_assert((kSampleInterval & (kSampleInterval - 1)) == 0);
+  static_assert((kNumSlotsPerCore & (kNumSlotsPerCore - 1)) == 0);
+
+  CallGraphProfiler();
+  ~CallGraphProfiler();
+  void record_local_call(ProcletHeader *caller_header, ProcletID callee_id);
+  void record_remote_call(ProcletHeader *caller_header, ProcletID callee_id,
+                          NodeIP callee_ip, uint64_t num_bytes);
+  std::vector<CallGraphEdge> get_call_graph();
+  // Folds the latest samples into per-proclet affinities and ages the matrix.
+  void update_affinities(float fixed_cost_us, float net_bw_gbps);
+  std::optional<CallAffinity> get_affinity(ProcletHeader *header);
+  uint64_t get_num_local_calls() const;
+  uint64_t get_num_remote_calls() const;
+  void dump(std::ostream &os);
+
+ private:
+  struct Slot {
+    ProcletID caller;
+    ProcletID callee;
+    NodeIP callee_ip;
+    uint64_t num_calls;
+    uint64_t num_bytes;
+  };
+
+  struct alignas(kCacheLineBytes) CoreMatrix {
+    uint64_t num_local_calls;
+    uint64_t num_remote_calls;
+    uint64_t num_dropped_samples;
+    // The decay_epoch_ that the slots were last aged to. Only the owner core
+    // ages its slots, so that it never races with sample().
+    uint32_t decay_epoch;
+    Slot slots[kNumSlotsPerCore];
+  };
+
+  CoreMatrix *matrices_;
+  // Bumped by update_affinities() instead of aging every core's slots.
+  std::atomic<uint32_t> decay_epoch_;
+  std::unordered_map<ProcletID, CallAffinity> affinities_;
+  rt::Spin spin_;
+  rt::Thread logging_thread_;
+  bool done_;
+
+  void sample(ProcletHeader *caller_header, ProcletID callee_id,
+              NodeIP callee_ip, uint64_t num_bytes);
+  static uint32_t hash(ProcletID caller, ProcletID callee);
+  static float get_decay(uint32_t num_epochs);
+};
+
+}  // namespace nu
+
+#include "nu/impl/call_graph_profiler.ipp"
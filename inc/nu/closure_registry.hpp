@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+namespace nu {
+
+using ClosureID = uint64_t;
+
+// Names the functions of this binary, e.g., the closures passed to
+// Proclet::run(), by IDs hashed from their mangled symbol names, so that they
+// travel as IDs that are the same in every build of the same code rather than
+// as code addresses. Local symbols are qualified with their source file. A
+// stripped binary has no symbols to go by, so its IDs fall back to the code
+// addresses, which only match across identical binaries.
+class ClosureRegistry {
+ public:
+  // Built from the binary's symbol table on the first call.
+  static ClosureRegistry *get();
+  // Returns 0 if the function has no unique symbol.
+  ClosureID get_id(const void *fn) const;
+  // Returns nullptr if no function of this binary has the ID.
+  void *get_fn(ClosureID id) const;
+  bool has_symbols() const;
+  template <typename FnPtr>
+  ClosureID to_id(FnPtr fn) const;
+  // The ID of the function with the (qualified) symbol name.
+  static ClosureID hash_symbol(std::string_view symbol);
+  template <typename FnPtr>
+  FnPtr from_id(ClosureID id) const;
+
+ private:
+  std::unordered_map<uintptr_t, ClosureID> ids_;
+  // Maps to 0 the IDs shared by multiple functions.
+  std::unordered_map<ClosureID, uintptr_t> fns_;
+  bool has_symbols_;
+
+  ClosureRegistry();
+  void load_symbols();
+};
+
+}  // namespace nu
+
+#include "nu/impl/closure_registry.ipp"
@@ -3,6 +3,7 @@
 #include <cstddef>
 #include <span>
 #include <string>
+#include <vector>
 
 #include "nu/cereal.hpp"
 
@@ -29,6 +30,12 @@ struct Resource {
     mem_mbs += o.mem_mbs;
     return *this;
   }
+
+  Resource &operator-=(const Resource &o) {
+    cores -= o.cores;
+    mem_mbs -= o.mem_mbs;
+    return *this;
+  }
 };
 
 struct VAddrRange {
@@ -40,10 +47,16 @@ struct VAddrRange {
   }
 };
 
+// Its code address travels as a ClosureRegistry ID.
 template <typename T>
 union MethodPtr {
   T ptr;
   uint8_t raw[sizeof(T)];
+
+  template <class Archive>
+  void save(Archive &ar) const;
+  template <class Archive>
+  void load(Archive &ar);
 };
 
 // Default-initialized pair
@@ -92,6 +105,7 @@ constexpr static uint64_t kMinRuntimeHeapVaddr = kMaxStackClusterVAddr;
 constexpr static uint64_t kMaxRuntimeHeapVaddr =
     kMinRuntimeHeapVaddr + kRuntimeHeapSize;
 constexpr static uint32_t kRuntimeSlabId = 1;
+constexpr static uint32_t kMaxNumReplicaPeers = 7;
 constexpr static uint64_t kOneMB = 1ULL << 20;
 constexpr static uint64_t kOneSecond = 1000 * 1000;
 constexpr static uint64_t kOneMilliSecond = 1000;
@@ -103,6 +117,7 @@ constexpr ProcletID to_proclet_id(void *proclet_base);
 constexpr SlabId_t to_slab_id(void *proclet_base);
 constexpr SlabId_t to_slab_id(uint64_t proclet_base_addr);
 constexpr SlabId_t get_max_slab_id();
+constexpr void *slab_id_to_proclet_base(SlabId_t slab_id);
 bool is_copied_on_migration(void *ptr, ProcletHeader *proclet_header);
 template <typename T>
 std::span<std::byte> to_span(T &t);
@@ -111,6 +126,8 @@ T &from_span(std::span<std::byte> span);
 template <typename T>
 const T &from_span(std::span<const std::byte> span);
 uint32_t str_to_ip(std::string ip_str);
+// Comma-separated.
+std::vector<uint32_t> str_to_ips(std::string ips_str);
 template <typename T>
 constexpr T div_round_up_unchecked(T dividend, T divisor);
 constexpr uint64_t round_up_to_power2(uint64_t x);
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <limits>
 #include <list>
 #include <set>
+#include <span>
 #include <stack>
 #include <map>
+#include <memory>
 #include <utility>
+#include <vector>
 
 extern "C" {
 #include <runtime/net.h>
@@ -14,6 +19,8 @@ extern "C" {
 #include <net.h>
 
 #include "nu/commons.hpp"
+#include "nu/ctrl_replication.hpp"
+#include "nu/placement.hpp"
 #include "nu/rpc_client_mgr.hpp"
 #include "nu/utils/cond_var.hpp"
 #include "nu/utils/md5.hpp"
@@ -26,12 +33,18 @@ struct NodeStatus {
   constexpr static float kEWMAWeight = 0.25;
   // Should be consistent with iokernel's IAS_PS_MEM_LOW_MB.
   constexpr static uint32_t kMemLowWaterMarkMBs = 1024;
+  // Should be consistent with iokernel's IAS_RP_INTERVAL_US.
+  constexpr static uint64_t kReportIntervalUs = 250;
 
   NodeStatus(bool isol);
 
   bool isol;
   bool acquired;
   Resource free_resource;
+  // The latest report. Nodes skip the reports that barely changed, so it
+  // also stands for the samples since then.
+  Resource last_sample;
+  uint64_t last_sample_us;
   CondVar cv;
 
   bool has_enough_cpu_resource(Resource resource) const;
@@ -45,14 +58,45 @@ struct Node {
   NodeStatus status;
 };
 
+// Spots the pairs of nodes that keep migrating proclets back and forth.
+struct BounceTracker {
+  // A proclet that moves back within kBounceWindowUs of its last move
+  // bounces. After kMinNumBounces bounces between a pair of nodes, each within
+  // the window of the previous one, migrations between them are avoided for
+  // kPairBanUs.
+  constexpr static uint64_t kBounceWindowUs = 2 * kOneSecond;
+  constexpr static uint32_t kMinNumBounces = 3;
+  constexpr static uint64_t kPairBanUs = 10 * kOneSecond;
+
+  struct PairBounces {
+    uint32_t num_bounces;
+    uint64_t last_bounce_us;
+    uint64_t banned_until_us;
+  };
+
+  // Keyed by the lower IP and then the higher one.
+  std::map<std::pair<NodeIP, NodeIP>, PairBounces> pairs;
+
+  void add_bounce(NodeIP x, NodeIP y, uint64_t now_us);
+  bool is_oscillating(NodeIP x, NodeIP y, uint64_t now_us) const;
+};
+
 struct LPInfo {
   std::map<NodeIP, NodeStatus> node_statuses;
   std::map<NodeIP, NodeStatus>::iterator rr_iter;
   bool destroying;
+  // Bumped whenever the free resources of node_statuses change.
+  uint64_t view_version;
+  BounceTracker bounce_tracker;
 
   LPInfo();
 };
 
+struct MigrationDemand {
+  Resource resource;
+  NodeIP preferred_ip;  // 0 if the proclet has no preference.
+};
+
 struct ProcletHeapSegment {
   VAddrRange range;
   NodeIP prev_host;
@@ -60,45 +104,135 @@ struct ProcletHeapSegment {
 
 class Controller {
  public:
+  // Nodes of an LP must have compatible builds, i.e., the same build MD5 (see
+  // ControllerClient), not necessarily the same binary.
   constexpr static bool kEnableBinaryVerification = true;
-
+  // Proclets whose capacity reaches this are bin-packed by default.
+  constexpr static float kMemHeavyProcletMBs = 1024;
+  // Passed as the known view version by nodes that only report.
+  constexpr static uint64_t kViewNotNeeded =
+      std::numeric_limits<uint64_t>::max();
   Controller();
   ~Controller();
-  std::optional<std::pair<lpid_t, VAddrRange>> register_node(NodeIP ip,
-                                                             lpid_t lpid,
-                                                             MD5Val md5,
-                                                             bool isol);
-  void destroy_lp(lpid_t lpid, NodeIP requestor_ip);
+  // The state-changing calls below take the ID of the client request they
+  // serve. A request that is done already (e.g., retried after a failover)
+  // gets its original result without changing the state again.
+  std::optional<std::pair<lpid_t, VAddrRange>> register_node(
+      NodeIP ip, lpid_t lpid, MD5Val md5, bool isol, CtrlReqID req_id = {});
+  void destroy_lp(lpid_t lpid, NodeIP requestor_ip, CtrlReqID req_id = {});
   std::optional<std::pair<ProcletID, NodeIP>> allocate_proclet(
-      uint64_t capacity, lpid_t lpid, NodeIP ip_hint);
-  void destroy_proclet(VAddrRange heap_segment);
+      uint64_t capacity, lpid_t lpid, NodeIP ip_hint, CtrlReqID req_id = {});
+  // All or nothing: returns an empty vector if not all of them fit.
+  std::vector<std::pair<ProcletID, NodeIP>> allocate_proclets(
+      uint32_t num, uint64_t capacity, lpid_t lpid, NodeIP ip_hint,
+      CtrlReqID req_id = {});
+  void destroy_proclet(VAddrRange heap_segment, CtrlReqID req_id = {});
+  std::optional<VAddrRange> allocate_heap_segment(uint64_t capacity,
+                                                  CtrlReqID req_id = {});
+  void free_heap_segment(VAddrRange segment, CtrlReqID req_id = {});
   NodeIP resolve_proclet(ProcletID id);
+  std::vector<NodeIP> resolve_proclets(std::span<const ProcletID> ids);
+  // Where all the LP's proclets are, for warming up a joining node's cache.
+  std::vector<std::pair<ProcletID, NodeIP>> get_proclet_locations(lpid_t lpid);
   std::pair<NodeIP, Resource> acquire_migration_dest(lpid_t lpid,
                                                      NodeIP requestor_ip,
                                                      bool has_mem_pressure,
-                                                     Resource resource);
+                                                     Resource resource,
+                                                     NodeIP preferred_ip);
+  // Spreads a batch of migration tasks over all candidate destinations,
+  // favoring those with more free resource. Returns each task's destination
+  // (0 if none can take it); every returned destination gets acquired.
+  std::vector<NodeIP> plan_migration(lpid_t lpid, NodeIP requestor_ip,
+                                     bool has_mem_pressure,
+                                     std::span<const MigrationDemand> demands);
   bool acquire_node(lpid_t lpid, NodeIP ip);
   void release_node(lpid_t lpid, NodeIP ip);
   void update_location(ProcletID id, NodeIP proclet_srv_ip);
-  std::vector<std::pair<NodeIP, Resource>> report_free_resource(
-      lpid_t lpid, NodeIP ip, Resource free_resource);
+  // Applies the node's free resource if there is one and returns the version
+  // of the LP's view, along with the view itself unless the node already has
+  // that version.
+  std::pair<uint64_t, std::vector<std::pair<NodeIP, Resource>>>
+  report_free_resource(lpid_t lpid, NodeIP ip,
+                       std::optional<Resource> free_resource,
+                       uint64_t known_view_version);
+  // Must be called before serving any request.
+  void set_placement_policy(std::unique_ptr<PlacementPolicy> policy);
+  // Must be called before serving any request. State changes then go to the
+  // replicator's op log.
+  void set_replicator(ControllerReplicator *replicator);
+  // Takes over from a failed controller; must be called on a fresh one.
+  void restore(const ControllerState &state);
 
  private:
   constexpr static auto kNumProcletSegmentBuckets =
       bsr_64(kMaxProcletHeapSize) - bsr_64(kMinProcletHeapSize) + 1;
-  std::stack<ProcletHeapSegment>
-      free_proclet_heap_segments_[kNumProcletSegmentBuckets];
+  // LP states are sharded by lpid and free heap segments by address, so
+  // unrelated requests don't serialize on a single lock.
+  constexpr static uint32_t kNumLPShards = 16;
+  constexpr static uint32_t kNumSegmentShards = 16;
+  constexpr static uint64_t kSegmentShardSize =
+      (kMaxProcletHeapVAddr - kMinProcletHeapVAddr) / kNumSegmentShards;
+  static_assert(kSegmentShardSize % kMaxProcletHeapSize == 0);
+
+  // Word-sized so that it's updated without locks. The destination is where
+  // the proclet is now, so only the source is kept.
+  struct ProcletMove {
+    NodeIP src;  // 0 if it hasn't moved.
+    uint32_t ms;  // Truncated microtime() / 1000.
+  };
+  static_assert(std::atomic<ProcletMove>::is_always_lock_free);
+
+  struct alignas(kCacheLineBytes) LPShard {
+    std::map<lpid_t, LPInfo> lpid_to_info;
+    Mutex mutex;
+  };
+
+  // A buddy allocator: free segments of each power-of-two size, keyed by
+  // their start addresses and mapped to their prev_hosts. Segments get split
+  // on allocation and coalesced with their free buddies on free.
+  struct alignas(kCacheLineBytes) SegmentShard {
+    std::map<uint64_t, NodeIP> free_segments[kNumProcletSegmentBuckets];
+    Mutex mutex;
+  };
+
+  LPShard lp_shards_[kNumLPShards];
+  SegmentShard segment_shards_[kNumSegmentShards];
+  // Indexed by the slab id of the proclet's heap, 0 if it's not allocated.
+  // Entries are word-sized and never go away, so they are read without locks.
+  std::atomic<NodeIP> proclet_locations_[get_max_slab_id() + 1];
+  // The LPs owning the proclets above; only valid where there is a location.
+  std::atomic<lpid_t> proclet_lpids_[get_max_slab_id() + 1];
+  // The last migration of each proclet; reset when it's destroyed.
+  std::atomic<ProcletMove> proclet_last_moves_[get_max_slab_id() + 1];
+  // Shared by all LPs so that versions are never reused after an LP goes away.
+  std::atomic<uint64_t> view_version_;
+  // Guards the fields below, which only change on node registration and LP
+  // destruction.
   std::stack<VAddrRange> free_stack_cluster_segments_;  // One segment per Node.
   std::set<lpid_t> free_lpids_;
   std::map<lpid_t, MD5Val> lpid_to_md5_;
-  std::map<lpid_t, LPInfo> lpid_to_info_;
-  std::map<ProcletID, NodeIP> proclet_id_to_ip_;
-  bool done_;
   Mutex mutex_;
+  std::unique_ptr<PlacementPolicy> placement_policy_;
+  ControllerReplicator *replicator_;
+  DoneCtrlReqs done_reqs_;
+  Mutex done_reqs_mutex_;
+  bool done_;
 
+  std::optional<std::pair<ProcletID, NodeIP>> __allocate_proclet(
+      uint64_t capacity, lpid_t lpid, NodeIP ip_hint, CtrlReqID req_id);
+  LPShard &get_lp_shard(lpid_t lpid);
+  SegmentShard &get_segment_shard(uint64_t addr);
+  std::optional<ProcletHeapSegment> pop_segment(uint64_t capacity,
+                                                uint32_t first_shard_idx);
+  void push_segment(ProcletHeapSegment segment);
+  // Marks the free range as allocated; used when restoring the state.
+  void take_segment(VAddrRange range);
   NodeIP select_node_for_proclet(lpid_t lpid, NodeIP ip_hint,
                                  const ProcletHeapSegment &segment);
   bool update_node(std::set<Node>::iterator iter);
+  void record_bounce(lpid_t lpid, NodeIP src, NodeIP dest, uint64_t now_us);
+  void log_op(const CtrlOp &op);
+  std::optional<std::vector<CtrlOp>> find_done_req(CtrlReqID req_id);
 };
 }  // namespace nu
 
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <functional>
+#include <list>
 #include <utility>
+#include <vector>
 
 extern "C" {
 #include <net/ip.h>
@@ -10,12 +12,15 @@ extern "C" {
 #include <net.h>
 #include <sync.h>
 
+#include <cstddef>
 #include <memory>
 
 #include "nu/commons.hpp"
 #include "nu/ctrl_server.hpp"
 #include "nu/rpc_server.hpp"
 #include "nu/runtime.hpp"
+#include "nu/utils/cond_var.hpp"
+#include "nu/utils/mutex.hpp"
 #include "nu/utils/rpc.hpp"
 
 namespace nu {
@@ -24,7 +29,7 @@ class ControllerClient;
 
 class NodeGuard {
  public:
-  NodeGuard(ControllerClient *client, NodeIP ip);
+  NodeGuard(ControllerClient *client, NodeIP ip, uint64_t epoch);
   NodeGuard(const NodeGuard &) = delete;
   NodeGuard(NodeGuard &&) = delete;
   NodeGuard &operator=(const NodeGuard &) = delete;
@@ -36,36 +41,86 @@ class NodeGuard {
  private:
   ControllerClient *client_;
   NodeIP ip_;
+  uint64_t epoch_;
+};
+
+struct MigrationPlan {
+  std::vector<NodeIP> dest_ips;  // One per task, 0 if it has no destination.
+  std::list<NodeGuard> dest_guards;
 };
 
 class ControllerClient {
  public:
-  ControllerClient(NodeIP ctrl_server_ip, Runtime::Mode mode, lpid_t lpid,
-                   bool isol);
+  constexpr static uint64_t kHeartbeatIntervalUs = 10 * kOneMilliSecond;
+  // A controller that doesn't answer heartbeats for this long is taken as
+  // failed, and the client fails over to the next one.
+  constexpr static uint64_t kFailoverTimeoutUs = 100 * kOneMilliSecond;
+
+  // The controllers in ctrl_ips are tried in order.
+  ControllerClient(std::vector<NodeIP> ctrl_ips, Runtime::Mode mode,
+                   lpid_t lpid, bool isol);
+  ~ControllerClient();
   std::optional<std::pair<lpid_t, VAddrRange>> register_node(NodeIP ip,
                                                              MD5Val md5,
                                                              bool isol);
   std::optional<std::pair<ProcletID, NodeIP>> allocate_proclet(
       uint64_t capacity, NodeIP ip_hint);
+  std::vector<std::pair<ProcletID, NodeIP>> allocate_proclets(
+      uint32_t num, uint64_t capacity, NodeIP ip_hint);
   void destroy_proclet(VAddrRange heap_segment);
+  // Segments that extend an existing proclet's heap.
+  std::optional<VAddrRange> allocate_heap_segment(uint64_t capacity);
+  void free_heap_segment(VAddrRange segment);
   NodeIP resolve_proclet(ProcletID id);
+  // One round trip for all of them; unknown ids resolve to 0.
+  std::vector<NodeIP> resolve_proclets(std::span<const ProcletID> ids);
+  // See Controller::get_proclet_locations().
+  std::vector<std::pair<ProcletID, NodeIP>> get_proclet_locations();
   NodeGuard acquire_node();
-  std::pair<NodeGuard, Resource> acquire_migration_dest(bool has_mem_pressure,
-                                                        Resource resource);
+  std::pair<NodeGuard, Resource> acquire_migration_dest(
+      bool has_mem_pressure, Resource resource, NodeIP preferred_ip = 0);
+  MigrationPlan plan_migration(bool has_mem_pressure,
+                               const std::vector<MigrationDemand> &demands);
   void update_location(ProcletID id, NodeIP proclet_srv_ip);
   VAddrRange get_stack_cluster() const;
-  std::vector<std::pair<NodeIP, Resource>> report_free_resource(
-      Resource resource);
+  // See Controller::report_free_resource().
+  std::pair<uint64_t, std::vector<std::pair<NodeIP, Resource>>>
+  report_free_resource(std::optional<Resource> resource,
+                       uint64_t known_view_version);
   void destroy_lp();
 
  private:
   lpid_t lpid_;
   VAddrRange stack_cluster_;
-  RPCClient *rpc_client_;
+  std::vector<NodeIP> ctrl_ips_;
+  uint32_t ctrl_idx_;
+  // Bumped on every failover; guarded by both mutex_ and spin_.
+  uint64_t epoch_;
+  // Pooled connections for the blocking requests.
+  std::vector<std::unique_ptr<rt::TcpConn>> conns_;
+  std::vector<rt::TcpConn *> free_conns_;
+  // Connections to the failed controllers, which might still be in use.
+  std::vector<std::unique_ptr<rt::TcpConn>> retired_conns_;
+  Mutex mutex_;
+  CondVar failover_cv_;
+  // For the polled requests, which may be sent with preemption disabled.
   std::unique_ptr<rt::TcpConn> tcp_conn_;
   rt::Spin spin_;
+  std::unique_ptr<rt::TcpConn> heartbeat_conn_;
+  uint64_t last_heartbeat_us_;
+  rt::Thread heartbeat_thread_;
+  rt::Thread watchdog_thread_;
+  // Starts from the boot time so that a restarted node never reuses an ID.
+  std::atomic<uint64_t> next_req_seq_;
+  bool done_;
   friend class NodeGuard;
 
-  void release_node(NodeIP ip);
+  // Requests that change the controller state carry an ID, so that they can
+  // be retried safely by call().
+  CtrlReqID get_req_id();
+  std::vector<std::byte> call(std::span<const std::byte> req);
+  void heartbeat();
+  void failover();
+  void release_node(NodeIP ip, uint64_t epoch);
 };
 }  // namespace nu
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+extern "C" {
+#include <runtime/tcp.h>
+}
+#include <net.h>
+#include <thread.h>
+
+#include "nu/commons.hpp"
+#include "nu/utils/cond_var.hpp"
+#include "nu/utils/md5.hpp"
+#include "nu/utils/mutex.hpp"
+
+namespace nu {
+
+// Identifies a client request, so that a request retried after a failover is
+// answered from its logged ops instead of being applied twice.
+struct CtrlReqID {
+  NodeIP client_ip;
+  uint64_t seq;  // 0 if the op doesn't come from a client request.
+
+  auto operator<=>(const CtrlReqID &) const = default;
+};
+
+// A change to the controller state that has to survive the controller.
+struct CtrlOp {
+  enum Type : uint8_t {
+    kRegisterNode,      // lpid, ip, md5, isol, range = stack cluster.
+    kDestroyLP,         // lpid.
+    kAllocateProclet,   // lpid, range = heap segment, ip = location.
+    kAllocateSegment,   // range = extra heap segment.
+    kFreeSegment,       // range.
+    kUpdateLocation,    // range.start = proclet id, ip = location.
+  };
+
+  Type type;
+  lpid_t lpid;
+  NodeIP ip;
+  bool isol;
+  MD5Val md5;
+  VAddrRange range;
+  CtrlReqID req_id;
+  // Only records the op under req_id; used to ship done requests in snapshots.
+  bool record_only;
+};
+
+// The ops of the latest client requests, oldest ones evicted first.
+struct DoneCtrlReqs {
+  constexpr static uint32_t kMaxNumReqs = 4096;
+
+  std::map<CtrlReqID, std::vector<CtrlOp>> reqs;
+  std::deque<CtrlReqID> order;
+
+  void record(const CtrlOp &op);
+  std::optional<std::vector<CtrlOp>> find(CtrlReqID req_id) const;
+};
+
+struct ReplicatedNode {
+  bool isol;
+  VAddrRange stack_cluster;
+};
+
+struct ReplicatedLP {
+  MD5Val md5;
+  std::map<NodeIP, ReplicatedNode> nodes;
+};
+
+struct ReplicatedSegment {
+  uint64_t end;
+  NodeIP location;  // 0 if it extends another proclet's heap.
+  lpid_t lpid;
+};
+
+// The controller state that can't be rebuilt from the nodes. Everything else,
+// e.g., free segments and free lpids, is derived from it on a restart.
+struct ControllerState {
+  std::map<lpid_t, ReplicatedLP> lps;
+  std::map<uint64_t, ReplicatedSegment> segments;  // Keyed by the start.
+  DoneCtrlReqs done_reqs;
+
+  void apply(const CtrlOp &op);
+  std::vector<CtrlOp> to_ops() const;
+};
+
+// Ships the op log from the primary controller to its standbys.
+class ControllerReplicator {
+ public:
+  constexpr static uint32_t kPort = 2829;
+  constexpr static uint32_t kTCPListenBackLog = 16;
+  constexpr static uint64_t kHeartbeatIntervalUs = 10 * kOneMilliSecond;
+  // A standby that hasn't acked for this long is dropped.
+  constexpr static uint64_t kStandbyTimeoutUs = 100 * kOneMilliSecond;
+
+  ControllerReplicator(ControllerState state);
+  ~ControllerReplicator();
+  void append(const CtrlOp &op);
+  // Waits until all standbys have every op appended so far.
+  void sync();
+
+ private:
+  struct Standby {
+    std::unique_ptr<rt::TcpConn> conn;
+    uint64_t acked_seq;
+    uint64_t last_ack_us;
+    bool failed;
+    // Set by th right before it returns, so that it can be joined.
+    bool exited;
+    rt::Thread th;
+  };
+
+  ControllerState state_;
+  // log_[i] has the sequence number log_start_seq_ + i.
+  std::vector<CtrlOp> log_;
+  uint64_t log_start_seq_;
+  std::list<Standby> standbys_;
+  Mutex mutex_;
+  CondVar log_cv_;
+  CondVar ack_cv_;
+  std::unique_ptr<rt::TcpQueue> tcp_queue_;
+  rt::Thread tcp_queue_thread_;
+  rt::Thread ticker_thread_;
+  bool done_;
+
+  uint64_t get_end_seq() const;
+  void ship(Standby *standby);
+  void trim_log();
+};
+
+// Mirrors the op log of the primary at leader_ip into state until the primary
+// goes away. Returns false if it couldn't reach the primary at all.
+bool follow_controller(NodeIP leader_ip, ControllerState *state);
+
+}  // namespace nu
@@ -10,9 +10,11 @@ extern "C" {
 
 #include <atomic>
 #include <memory>
+#include <vector>
 
 #include "nu/commons.hpp"
 #include "nu/ctrl.hpp"
+#include "nu/ctrl_replication.hpp"
 #include "nu/rpc_server.hpp"
 #include "nu/utils/rpc.hpp"
 
@@ -24,6 +26,7 @@ struct RPCReqRegisterNode {
   lpid_t lpid;
   MD5Val md5;
   bool isol;
+  CtrlReqID req_id;
 } __attribute__((packed));
 
 struct RPCRespRegisterNode {
@@ -37,6 +40,7 @@ struct RPCReqAllocateProclet {
   uint64_t capacity;
   lpid_t lpid;
   NodeIP ip_hint;
+  CtrlReqID req_id;
 } __attribute__((packed));
 
 struct RPCRespAllocateProclet {
@@ -45,9 +49,36 @@ struct RPCRespAllocateProclet {
   NodeIP server_ip;
 } __attribute__((packed));
 
+struct RPCReqAllocateProclets {
+  RPCReqType rpc_type = kAllocateProclets;
+  uint32_t num;
+  uint64_t capacity;
+  lpid_t lpid;
+  NodeIP ip_hint;
+  CtrlReqID req_id;
+} __attribute__((packed));
+
 struct RPCReqDestroyProclet {
   RPCReqType rpc_type = kDestroyProclet;
   VAddrRange heap_segment;
+  CtrlReqID req_id;
+} __attribute__((packed));
+
+struct RPCReqAllocateHeapSegment {
+  RPCReqType rpc_type = kAllocateHeapSegment;
+  uint64_t capacity;
+  CtrlReqID req_id;
+} __attribute__((packed));
+
+struct RPCRespAllocateHeapSegment {
+  bool empty;
+  VAddrRange segment;
+} __attribute__((packed));
+
+struct RPCReqFreeHeapSegment {
+  RPCReqType rpc_type = kFreeHeapSegment;
+  VAddrRange segment;
+  CtrlReqID req_id;
 } __attribute__((packed));
 
 struct RPCReqResolveProclet {
@@ -59,6 +90,18 @@ struct RPCRespResolveProclet {
   NodeIP ip;
 } __attribute__((packed));
 
+// Followed by num_ids ProcletIDs; the response carries one NodeIP per id.
+struct RPCReqResolveProclets {
+  RPCReqType rpc_type = kResolveProclets;
+  uint32_t num_ids;
+} __attribute__((packed));
+
+// The response carries a (ProcletID, NodeIP) pair per proclet of the LP.
+struct RPCReqGetProcletLocations {
+  RPCReqType rpc_type = kGetProcletLocations;
+  lpid_t lpid;
+} __attribute__((packed));
+
 struct RPCReqUpdateLocation {
   RPCReqType rpc_type = kUpdateLocation;
   ProcletID id;
@@ -71,6 +114,7 @@ struct RPCReqAcquireMigrationDest {
   NodeIP src_ip;
   bool has_mem_pressure;
   Resource resource;
+  NodeIP preferred_ip;
 } __attribute__((packed));
 
 struct RPCRespAcquireMigrationDest {
@@ -78,6 +122,16 @@ struct RPCRespAcquireMigrationDest {
   Resource resource;
 } __attribute__((packed));
 
+// Followed by num_demands MigrationDemands; the response carries one NodeIP
+// per demand.
+struct RPCReqPlanMigration {
+  RPCReqType rpc_type = kPlanMigration;
+  lpid_t lpid;
+  NodeIP src_ip;
+  bool has_mem_pressure;
+  uint32_t num_demands;
+} __attribute__((packed));
+
 struct RPCReqAcquireNode {
   RPCReqType rpc_type = kAcquireNode;
   lpid_t lpid;
@@ -98,13 +152,29 @@ struct RPCReqReportFreeResource {
   RPCReqType rpc_type = kReportFreeResource;
   lpid_t lpid;
   NodeIP ip;
+  bool has_resource;
   Resource resource;
+  uint64_t view_version;
+} __attribute__((packed));
+
+// Followed by num_nodes (NodeIP, Resource) pairs.
+struct RPCRespReportFreeResource {
+  uint64_t view_version;
+  uint64_t num_nodes;
 } __attribute__((packed));
 
 struct RPCReqDestroyLP {
   RPCReqType rpc_type = kDestroyLP;
   lpid_t lpid;
   NodeIP ip;
+  CtrlReqID req_id;
+} __attribute__((packed));
+
+// Sent by the clients to tell if the controller is still alive. Its response,
+// like those of the other blocking requests, is a uint64_t length followed by
+// the payload.
+struct RPCReqHeartbeat {
+  RPCReqType rpc_type = kHeartbeat;
 } __attribute__((packed));
 
 class ControllerServer {
@@ -113,18 +183,27 @@ class ControllerServer {
   constexpr static uint64_t kPrintIntervalUs = kOneSecond;
   constexpr static uint32_t kTCPListenBackLog = 64;
   constexpr static uint32_t kPort = 2828;
-
-  ControllerServer();
+  // How long a standby waits for the next controller in line to take over
+  // before assuming it's gone as well. Standbys must therefore be started
+  // within this long after the primary.
+  constexpr static uint64_t kTakeoverTimeoutUs = kOneSecond;
+
+  // The first of ctrl_ips starts as the primary and the others as its
+  // standbys, which take over in order.
+  ControllerServer(std::vector<NodeIP> ctrl_ips);
   ~ControllerServer();
 
  private:
+  std::vector<NodeIP> ctrl_ips_;
   std::unique_ptr<rt::TcpQueue> tcp_queue_;
   Controller ctrl_;
+  std::unique_ptr<ControllerReplicator> replicator_;
   std::atomic<uint64_t> num_register_node_;
   std::atomic<uint64_t> num_allocate_proclet_;
   std::atomic<uint64_t> num_destroy_proclet_;
   std::atomic<uint64_t> num_resolve_proclet_;
   std::atomic<uint64_t> num_acquire_migration_dest_;
+  std::atomic<uint64_t> num_plan_migration_;
   std::atomic<uint64_t> num_acquire_node_;
   std::atomic<uint64_t> num_release_node_;
   std::atomic<uint64_t> num_update_location_;
@@ -132,26 +211,40 @@ class ControllerServer {
   std::atomic<uint64_t> num_destroy_ip_;
   rt::Thread logging_thread_;
   rt::Thread tcp_queue_thread_;
+  rt::Thread standby_thread_;
   std::vector<std::unique_ptr<rt::TcpConn>> tcp_conns_;
   std::vector<rt::Thread> tcp_conn_threads_;
   bool done_;
-  friend class RPCServer;
 
   std::unique_ptr<RPCRespRegisterNode> handle_register_node(
       const RPCReqRegisterNode &req);
   std::unique_ptr<RPCRespAllocateProclet> handle_allocate_proclet(
       const RPCReqAllocateProclet &req);
+  std::vector<std::pair<ProcletID, NodeIP>> handle_allocate_proclets(
+      const RPCReqAllocateProclets &req);
   void handle_destroy_proclet(const RPCReqDestroyProclet &req);
+  std::unique_ptr<RPCRespAllocateHeapSegment> handle_allocate_heap_segment(
+      const RPCReqAllocateHeapSegment &req);
+  void handle_free_heap_segment(const RPCReqFreeHeapSegment &req);
   std::unique_ptr<RPCRespResolveProclet> handle_resolve_proclet(
       const RPCReqResolveProclet &req);
+  std::vector<NodeIP> handle_resolve_proclets(std::span<const ProcletID> ids);
+  std::vector<std::pair<ProcletID, NodeIP>> handle_get_proclet_locations(
+      const RPCReqGetProcletLocations &req);
   RPCRespAcquireMigrationDest handle_acquire_migration_dest(
       const RPCReqAcquireMigrationDest &req);
+  std::vector<NodeIP> handle_plan_migration(
+      const RPCReqPlanMigration &req,
+      std::span<const MigrationDemand> demands);
   RPCRespAcquireNode handle_acquire_node(const RPCReqAcquireNode &req);
   void handle_release_node(const RPCReqReleaseNode &req);
   void handle_update_location(const RPCReqUpdateLocation &req);
-  std::vector<std::pair<NodeIP, Resource>> handle_report_free_resource(
-      const RPCReqReportFreeResource &req);
+  std::pair<uint64_t, std::vector<std::pair<NodeIP, Resource>>>
+  handle_report_free_resource(const RPCReqReportFreeResource &req);
   void handle_destroy_lp(const RPCReqDestroyLP &req);
   void tcp_loop(rt::TcpConn *c);
+  void run_standby(uint32_t rank);
+  void become_primary(ControllerState state);
+  void sync_standbys();
 };
 }  // namespace nu
@@ -83,8 +83,13 @@ class DistributedHashTable {
   uint32_t num_shards_;
   Proclet<RefCnter> ref_cnter_;
   std::vector<WeakProclet<HashTableShard>> shards_;
+  // Not serialized, so every instance resolves the shard locations in bulk
+  // on its first use.
+  bool shards_prefetched_;
 
   uint32_t get_shard_idx(uint64_t key_hash);
+  void prefetch_shards();
+  WeakProclet<HashTableShard> &get_shard(uint32_t shard_idx);
   template <typename X, typename Y, typename H, typename Eq, uint64_t N>
   friend DistributedHashTable<X, Y, H, Eq, N> make_dis_hash_table(
       uint32_t power_num_shards, bool pinned);
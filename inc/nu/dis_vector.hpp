@@ -74,8 +74,13 @@ class DistributedVector {
         uint32_t num_shards_;
         Proclet<RefCnter> ref_cnter_;
         std::vector<WeakProclet<VectorShard> > shards_;
+        // Not serialized, so every instance resolves the shard locations
+        // in bulk on its first use.
+        bool shards_prefetched_;
 
         uint32_t get_shard_idx(uint64_t idx);
+        void prefetch_shards();
+        WeakProclet<VectorShard> &get_shard(uint32_t shard_idx);
         template <typename TT, uint64_t N>
         friend DistributedVector<TT, N> make_dis_vector(
             uint32_t power_num_shards, bool pinned);
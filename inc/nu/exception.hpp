@@ -7,4 +7,10 @@ struct OutOfMemory : public std::exception {
   const char *what() const throw() { return "Out of memory"; }
 };
 
+// The callee's node doesn't have the requested RPC handler, e.g., it runs a
+// different binary during a rolling upgrade.
+struct UnknownHandler : public std::exception {
+  const char *what() const throw() { return "Unknown handler"; }
+};
+
 }  // namespace nu
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace nu {
+
+using HandlerID = uint32_t;
+
+// Assigns every instantiated RPC handler a compact ID. IDs are hashed from the
+// handler's mangled name, which the Itanium C++ ABI fixes, rather than taken
+// from its code address, so they stay the same across builds and compilers as
+// long as the handler exists on both sides. Handlers register themselves at
+// static-initialization time the first time get_id() is instantiated for them.
+//
+// The closures the handlers run travel as ClosureRegistry IDs. A node asked
+// for a handler or closure it doesn't have replies kErrUnknownHandler, which
+// the caller sees as an UnknownHandler exception.
+template <typename Fn>
+class HandlerRegistry {
+ public:
+  constexpr static uint32_t kTableSize = 1 << 13;
+
+  template <auto Handler>
+  static HandlerID get_id();
+  // Returns nullptr if the handler is unknown to this binary.
+  static Fn get_handler(HandlerID id);
+  static uint32_t get_num_handlers();
+  template <typename F>
+  static void for_each_id(F &&f);
+
+ private:
+  struct Entry {
+    HandlerID id;
+    Fn handler;
+  };
+
+  static inline Entry table_[kTableSize];
+  static inline uint32_t num_handlers_;
+
+  static HandlerID hash(std::string_view str);
+  template <auto Handler>
+  static HandlerID compute_id();
+  template <auto Handler>
+  static HandlerID register_handler();
+
+  template <auto Handler>
+  struct Registrar {
+    static inline const HandlerID kId =
+        HandlerRegistry::template register_handler<Handler>();
+  };
+};
+
+}  // namespace nu
+
+#include "nu/impl/handler_registry.ipp"
@@ -0,0 +1,44 @@
+extern "C" {
+#include <runtime/preempt.h>
+}
+
+namespace nu {
+
+inline float CallAffinity::locality() const {
+  auto sum = local_cost_us + best_remote_cost_us;
+  return sum > 0 ? (local_cost_us - best_remote_cost_us) / sum : 0;
+}
+
+inline uint32_t CallGraphProfiler::hash(ProcletID caller, ProcletID callee) {
+  // Proclet IDs are aligned to kMinProcletHeapSize, so drop the zero bits.
+  auto caller_idx = (caller - kMinProcletHeapVAddr) / kMinProcletHeapSize;
+  auto callee_idx = (callee - kMinProcletHeapVAddr) / kMinProcletHeapSize;
+  return (caller_idx * 0x9E3779B1U) ^ callee_idx;
+}
+
+inline void CallGraphProfiler::record_local_call(ProcletHeader *caller_header,
+                                                 ProcletID callee_id) {
+  // Calls issued from outside any proclet have no caller to attribute to.
+  if (unlikely(!caller_header)) {
+    return;
+  }
+  auto &matrix = matrices_[read_cpu()];
+  if (unlikely(matrix.num_local_calls++ % kSampleInterval == 0)) {
+    sample(caller_header, callee_id, 0, 0);
+  }
+}
+
+inline void CallGraphProfiler::record_remote_call(ProcletHeader *caller_header,
+                                                  ProcletID callee_id,
+                                                  NodeIP callee_ip,
+                                                  uint64_t num_bytes) {
+  if (unlikely(!caller_header)) {
+    return;
+  }
+  auto &matrix = matrices_[read_cpu()];
+  if (unlikely(matrix.num_remote_calls++ % kSampleInterval == 0)) {
+    sample(caller_header, callee_id, callee_ip, num_bytes);
+  }
+}
+
+}  // namespace nu
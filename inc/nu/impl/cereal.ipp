@@ -5,7 +5,8 @@ namespace cereal {
 template <class T>
 consteval bool is_memcpy_safe() {
   if constexpr (std::is_trivially_copy_assignable_v<T> &&
-                !std::is_pointer_v<T> && !std::is_reference_v<T>) {
+                !std::is_pointer_v<T> && !std::is_reference_v<T> &&
+                !HasBuiltinSave<BinaryOutputArchive, T>) {
     return true;
   } else if constexpr (nu::is_specialization_of_v<T, std::pair>) {
     return is_memcpy_safe<typename T::first_type>() &&
@@ -0,0 +1,27 @@
+extern "C" {
+#include <base/assert.h>
+}
+
+namespace nu {
+
+inline ClosureRegistry *ClosureRegistry::get() {
+  static ClosureRegistry registry;
+  return &registry;
+}
+
+inline bool ClosureRegistry::has_symbols() const { return has_symbols_; }
+
+template <typename FnPtr>
+inline ClosureID ClosureRegistry::to_id(FnPtr fn) const {
+  auto id = get_id(reinterpret_cast<const void *>(fn));
+  // Only local functions of one source file may share a symbol name.
+  BUG_ON(!id);
+  return id;
+}
+
+template <typename FnPtr>
+inline FnPtr ClosureRegistry::from_id(ClosureID id) const {
+  return reinterpret_cast<FnPtr>(get_fn(id));
+}
+
+}  // namespace nu
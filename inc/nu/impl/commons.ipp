@@ -3,7 +3,11 @@ extern "C" {
 }
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
+#include <type_traits>
+
+#include "nu/closure_registry.hpp"
 
 namespace nu {
 
@@ -33,6 +37,12 @@ inline constexpr SlabId_t get_max_slab_id() {
   return to_slab_id(kMaxProcletHeapVAddr - kMinProcletHeapSize);
 }
 
+inline constexpr void *slab_id_to_proclet_base(SlabId_t slab_id) {
+  return reinterpret_cast<void *>(
+      kMinProcletHeapVAddr +
+      static_cast<uint64_t>(slab_id - 2) * kMinProcletHeapSize);
+}
+
 template <typename T>
 inline std::span<std::byte> to_span(T &t) {
   return std::span<std::byte>(reinterpret_cast<std::byte *>(&t), sizeof(t));
@@ -80,6 +90,41 @@ template <typename K1, typename V1>
 DIPair<K, V>::DIPair(K1 &&k, V1 &&v)
     : first(std::forward<K1>(k)), second(std::forward<V1>(v)) {}
 
+template <typename T>
+template <class Archive>
+void MethodPtr<T>::save(Archive &ar) const {
+  uintptr_t addr;
+  memcpy(&addr, raw, sizeof(addr));
+  // A pointer to a virtual method holds an odd vtable offset instead (Itanium
+  // C++ ABI), which doesn't vary across builds of the same class.
+  bool is_code = !std::is_member_function_pointer_v<T> || !(addr & 1);
+  ar(is_code);
+  ar(is_code ? ClosureRegistry::get()->to_id(reinterpret_cast<void *>(addr))
+             : addr);
+  if constexpr (sizeof(T) > sizeof(addr)) {
+    ar(cereal::binary_data(raw + sizeof(addr), sizeof(T) - sizeof(addr)));
+  }
+}
+
+template <typename T>
+template <class Archive>
+void MethodPtr<T>::load(Archive &ar) {
+  bool is_code;
+  uint64_t id_or_addr;
+  ar(is_code);
+  ar(id_or_addr);
+  auto addr = id_or_addr;
+  if (is_code) {
+    addr = reinterpret_cast<uintptr_t>(ClosureRegistry::get()->get_fn(addr));
+    // The method is gone from this build.
+    BUG_ON(!addr);
+  }
+  memcpy(raw, &addr, sizeof(addr));
+  if constexpr (sizeof(T) > sizeof(addr)) {
+    ar(cereal::binary_data(raw + sizeof(addr), sizeof(T) - sizeof(addr)));
+  }
+}
+
 template <typename K, typename V>
 template <class Archive>
 void DIPair<K, V>::serialize(Archive &ar) {
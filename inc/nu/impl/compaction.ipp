@@ -0,0 +1,58 @@
+#include <cstdint>
+#include <utility>
+
+namespace nu {
+
+template <typename Allocator>
+inline std::allocator_traits<Allocator>::value_type *relocate(
+    RelocationRun *run,
+    typename std::allocator_traits<Allocator>::value_type *obj) {
+  using T = std::allocator_traits<Allocator>::value_type;
+  auto *new_obj = reinterpret_cast<T *>(run->take_below(obj));
+  if (!new_obj) {
+    return obj;
+  }
+  std::construct_at(new_obj, std::move(*obj));
+  std::destroy_at(obj);
+  Allocator allocator;
+  allocator.deallocate(obj, 1);
+  return new_obj;
+}
+
+template <typename Allocator>
+inline RelocatingAllocator<Allocator>::RelocatingAllocator(
+    RelocationTarget *target)
+    : target_(target) {}
+
+template <typename Allocator>
+template <typename A>
+inline RelocatingAllocator<Allocator>::RelocatingAllocator(
+    const RelocatingAllocator<A> &o)
+    : Allocator(o), target_(o.target()) {}
+
+template <typename Allocator>
+inline RelocatingAllocator<Allocator>::value_type *
+RelocatingAllocator<Allocator>::allocate(size_t n) {
+  if (target_ && n == 1) {
+    target_->obj_size = sizeof(value_type);
+    if (unlikely(target_->chunk)) {
+      return reinterpret_cast<value_type *>(
+          std::exchange(target_->chunk, nullptr));
+    }
+  }
+  return Allocator::allocate(n);
+}
+
+template <typename Allocator>
+inline RelocationTarget *RelocatingAllocator<Allocator>::target() const {
+  return target_;
+}
+
+template <typename Allocator>
+template <typename A>
+inline bool RelocatingAllocator<Allocator>::operator==(
+    const RelocatingAllocator<A> &o) const {
+  return target_ == o.target();
+}
+
+}  // namespace nu
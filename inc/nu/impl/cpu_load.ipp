@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 
 #include "nu/runtime.hpp"
@@ -13,7 +15,9 @@ inline CPULoad::CPULoad() {
   last_sum_sample_cnts_ = 0;
   last_decay_tsc_ = rdtsc();
   interval_cycles_ = kDecayIntervalUs * cycles_per_us;
+  refresh_cycles_ = kRefreshIntervalUs * cycles_per_us;
   cpu_load_ = 0;
+  reported_load_ = 0;
   first_call_ = true;
 }
 
@@ -23,6 +27,7 @@ inline void CPULoad::start_monitor() {
   if (unlikely(cnts_[core_id].invocations++ % kSampleInterval == 0 ||
                is_monitoring())) {
     cnts_[core_id].samples++;
+    cnts_[core_id].numa_samples[get_cur_numa_node()]++;
     get_runtime()->caladan()->thread_start_monitor_cycles();
   }
 }
@@ -56,10 +61,46 @@ inline float CPULoad::get_load() const {
   return cpu_load_;
 }
 
+inline bool CPULoad::refresh() {
+  auto now_tsc = rdtsc();
+  if (likely(now_tsc < last_decay_tsc_ + refresh_cycles_)) {
+    return false;
+  }
+  // Someone else is already on it.
+  if (unlikely(!spin_.try_lock())) {
+    return false;
+  }
+
+  bool changed = false;
+  if (likely(now_tsc >= last_decay_tsc_ + refresh_cycles_)) {
+    decay(now_tsc);
+    if (std::abs(cpu_load_ - reported_load_) >= kSignificantChange) {
+      reported_load_ = cpu_load_;
+      changed = true;
+    }
+  }
+  spin_.unlock();
+  return changed;
+}
+
 inline bool CPULoad::is_monitoring() const {
   return get_runtime()->caladan()->thread_monitored();
 }
 
 inline void CPULoad::zero() { cpu_load_ = 0; }
 
+inline uint64_t CPULoad::get_numa_samples(uint32_t node) const {
+  uint64_t sum = 0;
+  for (auto &cnt : cnts_) {
+    sum += cnt.numa_samples[node];
+  }
+  return sum;
+}
+
+inline void CPULoad::zero_numa_samples() {
+  for (auto &cnt : cnts_) {
+    std::fill(std::begin(cnt.numa_samples), std::end(cnt.numa_samples), 0);
+  }
+}
+
 }  // namespace nu
@@ -6,6 +6,8 @@ inline NodeStatus::NodeStatus(bool _isol) {
   isol = _isol;
   acquired = false;
   free_resource.cores = free_resource.mem_mbs = 0;
+  last_sample = free_resource;
+  last_sample_us = 0;
 }
 
 inline bool NodeStatus::has_enough_cpu_resource(Resource resource) const {
@@ -20,4 +22,12 @@ inline bool NodeStatus::has_enough_resource(Resource resource) const {
   return has_enough_cpu_resource(resource) && has_enough_mem_resource(resource);
 }
 
+inline Controller::LPShard &Controller::get_lp_shard(lpid_t lpid) {
+  return lp_shards_[lpid % kNumLPShards];
+}
+
+inline Controller::SegmentShard &Controller::get_segment_shard(uint64_t addr) {
+  return segment_shards_[(addr - kMinProcletHeapVAddr) / kSegmentShardSize];
+}
+
 }  // namespace nu
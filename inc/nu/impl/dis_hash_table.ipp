@@ -18,6 +18,7 @@ inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>
   num_shards_ = o.num_shards_;
   ref_cnter_ = o.ref_cnter_;
   shards_ = o.shards_;
+  shards_prefetched_ = o.shards_prefetched_;
   return *this;
 }
 
@@ -37,6 +38,7 @@ DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>
   num_shards_ = o.num_shards_;
   ref_cnter_ = std::move(o.ref_cnter_);
   shards_ = std::move(o.shards_);
+  shards_prefetched_ = o.shards_prefetched_;
   return *this;
 }
 
@@ -44,7 +46,7 @@ template <typename K, typename V, typename Hash, typename KeyEqual,
           uint64_t NumBuckets>
 inline DistributedHashTable<K, V, Hash, KeyEqual,
                             NumBuckets>::DistributedHashTable()
-    : power_num_shards_(0), num_shards_(0) {}
+    : power_num_shards_(0), num_shards_(0), shards_prefetched_(false) {}
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
           uint64_t NumBuckets>
@@ -81,7 +83,7 @@ DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get(K1 &&k) {
   auto hash = Hash();
   auto key_hash = hash(std::forward<K1>(k));
   auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
+  auto &shard = get_shard(shard_idx);
   return shard.__run(&HashTableShard::template get_copy_with_hash<K>,
                      std::forward<K1>(k), key_hash);
 }
@@ -95,7 +97,7 @@ DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get(K1 &&k,
   auto hash = Hash();
   auto key_hash = hash(std::forward<K1>(k));
   auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
+  auto &shard = get_shard(shard_idx);
   *is_local = shard.is_local();
   return shard.__run(&HashTableShard::template get_copy_with_hash<K>,
                      std::forward<K1>(k), key_hash);
@@ -109,7 +111,7 @@ DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get_with_ip(K1 &&k) {
   auto hash = Hash();
   auto key_hash = hash(std::forward<K1>(k));
   auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
+  auto &shard = get_shard(shard_idx);
   return shard.__run(
       +[](HashTableShard &shard, K1 k, uint64_t key_hash) {
         return std::make_pair(shard.get_copy_with_hash(std::move(k), key_hash),
@@ -126,7 +128,7 @@ inline void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::put(
   auto hash = Hash();
   auto key_hash = hash(std::forward<K1>(k));
   auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
+  auto &shard = get_shard(shard_idx);
   shard.__run(&HashTableShard::template put_with_hash<K, V>,
               std::forward<K1>(k), std::forward<V1>(v), key_hash);
 }
@@ -139,7 +141,7 @@ inline bool DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::remove(
   auto hash = Hash();
   auto key_hash = hash(std::forward<K1>(k));
   auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
+  auto &shard = get_shard(shard_idx);
   return shard.__run(&HashTableShard::template remove_with_hash<K>,
                      std::forward<K1>(k), key_hash);
 }
@@ -152,7 +154,7 @@ inline RetT DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::apply(
   auto hash = Hash();
   auto key_hash = hash(std::forward<K1>(k));
   auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
+  auto &shard = get_shard(shard_idx);
   return shard.__run(
       +[](HashTableShard &shard, K k, uint64_t key_hash,
           RetT (*fn)(std::pair<const K, V> &, A0s...), A0s... args) {
@@ -205,7 +207,7 @@ DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get_all_pairs() {
   std::vector<std::pair<K, V>> vec;
   std::vector<Future<std::vector<std::pair<K, V>>>> futures;
   for (uint32_t i = 0; i < num_shards_; i++) {
-    futures.emplace_back(shards_[i].__run_async(
+    futures.emplace_back(get_shard(i).__run_async(
         +[](HashTableShard &shard) { return shard.get_all_pairs(); }));
   }
   for (auto &future : futures) {
@@ -226,7 +228,7 @@ RetT DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::associative_reduce(
   std::vector<Future<RetT>> futures;
 
   for (uint32_t i = 0; i < num_shards_; i++) {
-    futures.emplace_back(shards_[i].__run_async(
+    futures.emplace_back(get_shard(i).__run_async(
         &HashTableShard::template associative_reduce<RetT>, clear, reduced_val,
         reduce_fn, std::forward<A1s>(args)...));
   }
@@ -250,7 +252,7 @@ DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::associative_reduce(
   std::vector<Future<RetT>> futures;
 
   for (uint32_t i = 0; i < num_shards_; i++) {
-    futures.emplace_back(shards_[i].__run_async(
+    futures.emplace_back(get_shard(i).__run_async(
         &HashTableShard::template associative_reduce<RetT>, clear, reduced_val,
         reduce_fn, std::forward<A1s>(args)...));
   }
@@ -275,6 +277,29 @@ inline void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::serialize(
   ar(shards_);
 }
 
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets>
+inline void
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::prefetch_shards() {
+  std::vector<ProcletID> ids;
+  ids.reserve(shards_.size());
+  for (auto &shard : shards_) {
+    ids.push_back(shard.get_id());
+  }
+  get_runtime()->rpc_client_mgr()->prefetch_locations(ids);
+  rt::access_once(shards_prefetched_) = true;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets>
+inline auto DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get_shard(
+    uint32_t shard_idx) -> WeakProclet<HashTableShard> & {
+  if (unlikely(!rt::access_once(shards_prefetched_))) {
+    prefetch_shards();
+  }
+  return shards_[shard_idx];
+}
+
 template <typename K, typename V, typename Hash, typename KeyEqual,
           uint64_t NumBuckets>
 DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets> make_dis_hash_table(
@@ -288,10 +313,10 @@ DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets> make_dis_hash_table(
       +[](TableType::RefCnter &self, uint32_t num_shards, bool pinned) {
         std::vector<WeakProclet<typename TableType::HashTableShard>>
             weak_shards;
-        for (uint32_t i = 0; i < num_shards; i++) {
-          self.shards.emplace_back(
-              make_proclet<typename TableType::HashTableShard>(pinned));
-          weak_shards.emplace_back(self.shards.back().get_weak());
+        self.shards = make_proclets<typename TableType::HashTableShard>(
+            num_shards, pinned);
+        for (auto &shard : self.shards) {
+          weak_shards.emplace_back(shard.get_weak());
         }
         return weak_shards;
       },
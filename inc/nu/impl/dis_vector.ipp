@@ -14,6 +14,7 @@ inline DistributedVector<T, NumZones> &DistributedVector<T, NumZones>::operator=
   num_shards_ = o.num_shards_;
   ref_cnter_ = o.ref_cnter_;
   shards_ = o.shards_;
+  shards_prefetched_ = o.shards_prefetched_;
   return *this;
 }
 
@@ -29,12 +30,13 @@ inline DistributedVector<T, NumZones> &DistributedVector<T, NumZones>::operator=
     num_shards_ = o.num_shards_;
     ref_cnter_ = std::move(o.ref_cnter_);
     shards_ = std::move(o.shards_);
+    shards_prefetched_ = o.shards_prefetched_;
     return *this;
 }
 
 template <typename T, uint64_t NumZones>
 inline DistributedVector<T, NumZones>::DistributedVector() 
-        : power_num_shards_(0), num_shards_(0) {}
+        : power_num_shards_(0), num_shards_(0), shards_prefetched_(false) {}
 
 template <typename T, uint64_t NumZones>
 inline uint32_t DistributedVector<T, NumZones>::get_shard_idx(uint64_t idx) {
@@ -59,7 +61,7 @@ inline ProcletID
 template <typename T, uint64_t NumZones>
 inline std::optional<T> DistributedVector<T, NumZones>::get(uint64_t &&idx) {
     auto shard_idx = get_shard_idx(idx);
-    auto &shard = shards_[shard_idx];
+    auto &shard = get_shard(shard_idx);
     return shard.__run(&VectorShard::template get_copy, idx);
 }
 
@@ -67,7 +69,7 @@ template <typename T, uint64_t NumZones>
 inline std::optional<T> DistributedVector<T, NumZones>::get(
                     uint64_t &&idx, bool *is_local) {
     auto shard_idx = get_shard_idx(idx);
-    auto &shard = shards_[shard_idx];
+    auto &shard = get_shard(shard_idx);
     *is_local = shard.is_local();
     return shard.__run(&VectorShard::template get_copy, idx);
 }
@@ -76,7 +78,7 @@ template <typename T, uint64_t NumZones>
 inline std::pair<std::optional<T>, uint32_t> 
     DistributedVector<T, NumZones>::get_with_ip(uint64_t &&idx) {
     auto shard_idx = get_shard_idx(idx);
-    auto &shard = shards_[shard_idx];
+    auto &shard = get_shard(shard_idx);
     return shard.__run(
         +[](VectorShard &shard, uint64_t idx) {
             return std::make_pair(shard.get_copy(std::move(idx)),
@@ -89,7 +91,7 @@ template <typename T, uint64_t NumZones>
 template <typename T1>
 void DistributedVector<T, NumZones>::put(uint64_t &&idx, T1 &&v) {
     auto shard_idx = get_shard_idx(idx);
-    auto &shard = shards_[shard_idx];
+    auto &shard = get_shard(shard_idx);
     shard.__run(&VectorShard::template put<T>, idx, std::forward<T1>(v));
 }
 
@@ -97,14 +99,14 @@ template <typename T, uint64_t NumZones>
 template <typename T1>
 inline void DistributedVector<T, NumZones>::push_back(T1 &&v) {
     // auto shard_idx = get_shard_idx(idx);
-    // auto &shard = shards_[shard_idx];
+    // auto &shard = get_shard(shard_idx);
     // shard.__run(&VectorShard::template push_back<T>, std::forward<T1>(v));
 }
 
 template <typename T, uint64_t NumZones>
 inline bool DistributedVector<T, NumZones>::remove(uint64_t &&idx) {
     auto shard_idx = get_shard_idx(idx);
-    auto &shard = shards_[shard_idx];
+    auto &shard = get_shard(shard_idx);
     shard.__run(&VectorShard::template remove, idx);
 }
 
@@ -113,7 +115,7 @@ inline void DistributedVector<T, NumZones>::sort() {
     std::vector<T> vec;
     std::vector<Future<std::vector<T> > > futures;
     for (uint32_t i = 0; i < num_shards_; i++) {
-        futures.emplace_back(shards_[i].__run_async(
+        futures.emplace_back(get_shard(i).__run_async(
             +[](VectorShard &shard) { return shard.get_all_sorted_data(); }));
     }
     for (auto &future : futures) {
@@ -134,16 +136,16 @@ inline void DistributedVector<T, NumZones>::sort() {
 template <typename T, uint64_t NumZones>
 void DistributedVector<T, NumZones>::sort_shard(uint32_t &&idx)
 {
-    shards_[idx].__run(&VectorShard::template sort);
+    get_shard(idx).__run(&VectorShard::template sort);
 }
 
 template <typename T, uint64_t NumZones>
 void DistributedVector<T, NumZones>::sort_shard(
     uint32_t &&idx, bool* is_local)
 {
-    auto &shard = shards_[idx];
+    auto &shard = get_shard(idx);
     *is_local = shard.is_local();
-    shards_[idx].__run(&VectorShard::template sort);
+    get_shard(idx).__run(&VectorShard::template sort);
 }
 
 template <typename T, uint64_t NumZones>
@@ -151,7 +153,7 @@ std::vector<T>
 DistributedVector<T, NumZones>::get_data_in_shard(
     uint32_t &&idx, bool *is_local)
 {
-    auto &shard = shards_[idx];
+    auto &shard = get_shard(idx);
     *is_local = shard.is_local();
     std::vector<T> ret = shard.__run(&VectorShard::template get_all_sorted_data);
     return ret;
@@ -161,7 +163,7 @@ template <typename T, uint64_t NumZones>
 void DistributedVector<T, NumZones>::clear_shard(
     uint32_t &&idx, bool *is_local)
 {
-    auto &shard = shards_[idx];
+    auto &shard = get_shard(idx);
     *is_local = shard.is_local();
     shard.__run(&VectorShard::template clear);
 }
@@ -171,14 +173,14 @@ void DistributedVector<T, NumZones>::clear_all()
 {
     // std::vector<Future<void> > futures;
     // for (uint32_t i = 0; i < num_shards_; i++) {
-    //     futures.emplace_back(shards_[i].__run_async(
+    //     futures.emplace_back(get_shard(i).__run_async(
     //         +[](VectorShard &shard) { return shard.clear(); }));
     // }
     // for (auto &future : futures) {
     //     future.get();
     // }  
     for (uint32_t i = 0; i < num_shards_; i++) {
-        shards_[i].__run(&VectorShard::template clear);
+        get_shard(i).__run(&VectorShard::template clear);
     } 
 }
 
@@ -188,7 +190,7 @@ void DistributedVector<T, NumZones>::reload(std::vector<T> data_)
     // clear_all();
     // std::vector<Future<void> > futures;
     // for (uint32_t i = 0; i < num_shards_; i++) {
-    //     futures.emplace_back(shards_[i].__run_async(
+    //     futures.emplace_back(get_shard(i).__run_async(
     //         &VectorShard::template reload, std::move(data_[i])));
     // }
     
@@ -251,7 +253,7 @@ inline std::vector<T> DistributedVector<T, NumZones>::get_all_data() {
     std::vector<T> vec;
     std::vector<Future<std::vector<T> > > futures;
     for (uint32_t i = 0; i < num_shards_; i++) {
-        futures.emplace_back(shards_[i].__run_async(
+        futures.emplace_back(get_shard(i).__run_async(
             +[](VectorShard &shard) { return shard.get_all_data(); }));
     }
     for (auto &future : futures) {
@@ -270,6 +272,26 @@ inline void DistributedVector<T, NumZones>::serialize(Archive &ar) {
     ar(shards_);
 }
 
+template <typename T, uint64_t NumZones>
+inline void DistributedVector<T, NumZones>::prefetch_shards() {
+    std::vector<ProcletID> ids;
+    ids.reserve(shards_.size());
+    for (auto &shard : shards_) {
+        ids.push_back(shard.get_id());
+    }
+    get_runtime()->rpc_client_mgr()->prefetch_locations(ids);
+    rt::access_once(shards_prefetched_) = true;
+}
+
+template <typename T, uint64_t NumZones>
+inline WeakProclet<typename DistributedVector<T, NumZones>::VectorShard>
+    &DistributedVector<T, NumZones>::get_shard(uint32_t shard_idx) {
+    if (unlikely(!rt::access_once(shards_prefetched_))) {
+        prefetch_shards();
+    }
+    return shards_[shard_idx];
+}
+
 template <typename T, uint64_t NumZones>
 inline DistributedVector<T, NumZones> make_dis_vector(
     uint32_t power_num_shards, bool pinned) {
@@ -282,10 +304,10 @@ inline DistributedVector<T, NumZones> make_dis_vector(
         +[](VectorType::RefCnter &self, uint32_t num_shards, bool pinned) {
             std::vector<WeakProclet<typename VectorType::VectorShard> >
                 weak_shards;
-            for (uint32_t i = 0; i < num_shards; i++) {
-                self.shards.emplace_back(
-                    make_proclet<typename VectorType::VectorShard>(pinned));
-                weak_shards.emplace_back(self.shards.back().get_weak());
+            self.shards = make_proclets<typename VectorType::VectorShard>(
+                num_shards, pinned);
+            for (auto &shard : self.shards) {
+                weak_shards.emplace_back(shard.get_weak());
             }
             return weak_shards;
         },
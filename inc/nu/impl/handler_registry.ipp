@@ -0,0 +1,92 @@
+#include <type_traits>
+#include <typeinfo>
+
+extern "C" {
+#include <base/assert.h>
+}
+
+namespace nu {
+
+template <typename Fn>
+inline HandlerID HandlerRegistry<Fn>::hash(std::string_view str) {
+  // FNV-1a.
+  HandlerID h = 2166136261u;
+  for (auto c : str) {
+    h ^= static_cast<uint8_t>(c);
+    h *= 16777619u;
+  }
+  // 0 marks empty table slots.
+  return h ? h : 1;
+}
+
+template <typename Fn>
+template <auto Handler>
+inline HandlerID HandlerRegistry<Fn>::compute_id() {
+  // The mangled name of the type embeds the handler's mangled name, which
+  // spells out its template arguments.
+  return hash(typeid(std::integral_constant<Fn, Handler>).name());
+}
+
+template <typename Fn>
+template <auto Handler>
+HandlerID HandlerRegistry<Fn>::register_handler() {
+  auto id = compute_id<Handler>();
+  Fn handler = Handler;
+
+  for (uint32_t i = 0; i < kTableSize; i++) {
+    auto &entry = table_[(id + i) % kTableSize];
+    if (!entry.id) {
+      entry.id = id;
+      entry.handler = handler;
+      num_handlers_++;
+      return id;
+    }
+    if (entry.id == id) {
+      // Two different handlers hashed to the same ID.
+      BUG_ON(entry.handler != handler);
+      return id;
+    }
+  }
+  BUG();
+}
+
+template <typename Fn>
+template <auto Handler>
+inline HandlerID HandlerRegistry<Fn>::get_id() {
+  // Referencing the registrar makes sure the handler is registered at static
+  // initialization, even if no one calls this before a request for it comes.
+  (void)Registrar<Handler>::kId;
+  static const HandlerID id = register_handler<Handler>();
+  return id;
+}
+
+template <typename Fn>
+inline Fn HandlerRegistry<Fn>::get_handler(HandlerID id) {
+  for (uint32_t i = 0; i < kTableSize; i++) {
+    auto &entry = table_[(id + i) % kTableSize];
+    if (entry.id == id) {
+      return entry.handler;
+    }
+    if (!entry.id) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+template <typename Fn>
+inline uint32_t HandlerRegistry<Fn>::get_num_handlers() {
+  return num_handlers_;
+}
+
+template <typename Fn>
+template <typename F>
+inline void HandlerRegistry<Fn>::for_each_id(F &&f) {
+  for (auto &entry : table_) {
+    if (entry.id) {
+      f(entry.id);
+    }
+  }
+}
+
+}  // namespace nu
@@ -66,7 +66,8 @@ void Migrator::snapshot_thread_and_ret_val(
         auto buf = std::make_unique_for_overwrite<std::byte[]>(*req_buf_len);
         auto *req = reinterpret_cast<RPCReqMigrateThreadAndRetVal *>(buf.get());
         std::construct_at(req);
-        req->handler = load_thread_and_ret_val<RetT>;
+        req->handler_id =
+            ThreadLoaders::get_id<load_thread_and_ret_val<RetT>>();
         req->dest_proclet_header = dest_proclet_header;
         req->dest_ret_val_ptr = dest_ret_val_ptr;
         req->payload_len = payload_len;
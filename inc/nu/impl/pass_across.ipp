@@ -0,0 +1,131 @@
+#include <utility>
+
+namespace nu {
+
+template <typename P>
+inline PassToken<P>::PassToken(P *from) : from_(from) {}
+
+template <typename T>
+inline decltype(auto) ArgRelay::pass_on(T &t) {
+  if constexpr (requires_pinned_call<T>()) {
+    return PassToken<T>(&t);
+  } else {
+    return std::move(t);
+  }
+}
+
+template <typename T>
+inline decltype(auto) ArgRelay::pass_across(T &&t) {
+  if constexpr (requires_pinned_call<T>()) {
+    return PassToken<std::decay_t<T>>(&t);
+  } else {
+    return pass_across_proclet(std::forward<T>(t));
+  }
+}
+
+template <typename T>
+inline Borrowed<T>::Borrowed() : ptr_(nullptr) {}
+
+template <typename T>
+inline Borrowed<T>::Borrowed(const T *ptr) : ptr_(ptr) {}
+
+template <typename T>
+inline Borrowed<T>::Borrowed(PassToken<Borrowed> token)
+    : ptr_(token.from_->ptr_), owned_(std::move(token.from_->owned_)) {
+  token.from_->ptr_ = nullptr;
+}
+
+template <typename T>
+inline const T &Borrowed<T>::get() const {
+  return owned_ ? *owned_ : *ptr_;
+}
+
+template <typename T>
+inline const T &Borrowed<T>::operator*() const {
+  return get();
+}
+
+template <typename T>
+inline const T *Borrowed<T>::operator->() const {
+  return &get();
+}
+
+template <typename T>
+template <class Archive>
+inline void Borrowed<T>::save(Archive &ar) const {
+  ar(get());
+}
+
+template <typename T>
+template <class Archive>
+inline void Borrowed<T>::load(Archive &ar) {
+  owned_.emplace();
+  ar(*owned_);
+  ptr_ = nullptr;
+}
+
+template <typename T>
+inline Borrowed<T> borrow(const T &t) {
+  return Borrowed<T>(&t);
+}
+
+template <typename T>
+inline Moved<T>::Moved() : foreign_(false) {}
+
+template <typename T>
+inline Moved<T>::Moved(T &&t) : obj_(std::move(t)), foreign_(true) {}
+
+template <typename T>
+inline Moved<T>::Moved(PassToken<Moved> token)
+    : obj_(std::move(token.from_->obj_)), foreign_(token.from_->foreign_) {
+  token.from_->obj_.reset();
+}
+
+template <typename T>
+inline T &Moved<T>::get() {
+  return *obj_;
+}
+
+template <typename T>
+inline T &Moved<T>::operator*() {
+  return get();
+}
+
+template <typename T>
+inline T *Moved<T>::operator->() {
+  return &get();
+}
+
+template <typename T>
+inline T Moved<T>::take() {
+  if (foreign_) {
+    T t(std::as_const(*obj_));
+    obj_.reset();
+    return t;
+  }
+  T t(std::move(*obj_));
+  obj_.reset();
+  return t;
+}
+
+template <typename T>
+template <class Archive>
+inline void Moved<T>::save(Archive &ar) const {
+  ar(*obj_);
+}
+
+template <typename T>
+template <class Archive>
+inline void Moved<T>::load(Archive &ar) {
+  obj_.emplace();
+  ar(*obj_);
+  foreign_ = false;
+}
+
+template <typename T>
+inline Moved<std::decay_t<T>> move_across(T &&t) requires(
+    std::is_rvalue_reference_v<T &&>) {
+  return Moved<std::decay_t<T>>(std::move(t));
+}
+
+}  // namespace nu
@@ -1,16 +1,20 @@
 #include <array>
 #include <concepts>
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 extern "C" {
 #include <base/assert.h>
 #include <runtime/net.h>
 }
 
+#include "nu/call_graph_profiler.hpp"
+#include "nu/closure_registry.hpp"
 #include "nu/ctrl_client.hpp"
 #include "nu/exception.hpp"
 #include "nu/proclet_server.hpp"
@@ -19,6 +23,7 @@ extern "C" {
 #include "nu/rpc_server.hpp"
 #include "nu/runtime.hpp"
 #include "nu/utils/future.hpp"
+#include "nu/utils/thread.hpp"
 
 namespace nu {
 
@@ -64,8 +69,13 @@ retry:
     get_runtime()->rpc_client_mgr()->invalidate_cache(id, client);
     goto retry;
   }
-  assert(rc == kOk);
+  assert(rc == kOk || rc == kErrUnknownHandler);
   get_runtime()->archive_pool()->put_oa_sstream(oa_sstream);
+  if (caller_header) {
+    get_runtime()->call_graph_profiler()->record_remote_call(
+        caller_header, id, client->GetAddr().ip,
+        states_size + return_buf.get_buf().size());
+  }
 
   optional_caller_guard =
       get_runtime()->attach_and_disable_migration(caller_header);
@@ -73,6 +83,9 @@ retry:
     caller_guard = Migrator::migrate_thread_and_ret_val<void>(
         std::move(return_buf), to_proclet_id(caller_header), nullptr, nullptr);
   }
+  if (unlikely(rc == kErrUnknownHandler)) {
+    throw UnknownHandler();
+  }
 }
 
 template <typename T>
@@ -104,11 +117,24 @@ retry:
     get_runtime()->rpc_client_mgr()->invalidate_cache(id, client);
     goto retry;
   }
-  assert(rc == kOk);
+  assert(rc == kOk || rc == kErrUnknownHandler);
   get_runtime()->archive_pool()->put_oa_sstream(oa_sstream);
+  if (caller_header) {
+    get_runtime()->call_graph_profiler()->record_remote_call(
+        caller_header, id, client->GetAddr().ip,
+        states_size + return_buf.get_buf().size());
+  }
 
   optional_caller_guard =
       get_runtime()->attach_and_disable_migration(caller_header);
+  if (unlikely(rc == kErrUnknownHandler)) {
+    if (!optional_caller_guard) {
+      caller_guard = Migrator::migrate_thread_and_ret_val<void>(
+          std::move(return_buf), to_proclet_id(caller_header), nullptr,
+          nullptr);
+    }
+    throw UnknownHandler();
+  }
   if (!optional_caller_guard) {
     caller_guard = Migrator::migrate_thread_and_ret_val<RetT>(
         std::move(return_buf), to_proclet_id(caller_header), &ret, nullptr);
@@ -226,13 +252,94 @@ Proclet<T> Proclet<T>::__create(bool pinned, uint64_t capacity, NodeIP ip_hint,
   }
 
   // Cold path: use RPC.
-  auto *handler = ProcletServer::construct_proclet<T, As...>;
+  auto handler = ProcletServer::Handlers::get_id<
+      ProcletServer::construct_proclet<T, As...>>();
   invoke_remote(std::move(*optional_caller_migration_guard), callee_id, handler,
                 to_proclet_base(callee_id), capacity, pinned,
                 std::forward<As>(args)...);
   return callee_proclet;
 }
 
+template <typename T>
+template <typename... As>
+std::vector<Proclet<T>> Proclet<T>::__create_batch(uint32_t num, bool pinned,
+                                                   uint64_t capacity,
+                                                   NodeIP ip_hint,
+                                                   As &&... args) {
+  std::vector<Proclet<T>> callee_proclets;
+  capacity = std::max(kMinProcletHeapSize, round_up_to_power2(capacity));
+  BUG_ON(capacity > kMaxProcletHeapSize);
+  if (unlikely(!num)) {
+    return callee_proclets;
+  }
+
+  ProcletHeader *caller_header;
+  {
+    MigrationGuard caller_migration_guard;
+
+    caller_header = caller_migration_guard.header();
+    get_runtime()->detach();
+  }
+
+  std::vector<std::pair<ProcletID, NodeIP>> allocated;
+  std::map<NodeIP, std::vector<ProcletID>> ip_to_ids;
+  {
+    RuntimeSlabGuard slab_guard;
+
+    allocated = get_runtime()->controller_client()->allocate_proclets(
+        num, capacity, ip_hint);
+    if (unlikely(allocated.empty())) {
+      throw OutOfMemory();
+    }
+    for (auto [callee_id, server_ip] : allocated) {
+      get_runtime()->rpc_client_mgr()->update_cache(callee_id, server_ip);
+      ip_to_ids[server_ip].push_back(callee_id);
+    }
+
+    auto optional_caller_migration_guard =
+        get_runtime()->attach_and_disable_migration(caller_header);
+    if (!optional_caller_migration_guard) {
+      RPCReturnBuffer return_buf;
+      Migrator::migrate_thread_and_ret_val<void>(
+          std::move(return_buf), to_proclet_id(caller_header), nullptr,
+          nullptr);
+    }
+  }
+
+  // Construct on all nodes in parallel, with one thread and one RPC per
+  // remote node.
+  std::vector<Thread> threads;
+  threads.reserve(ip_to_ids.size());
+  for (auto &[server_ip, ids] : ip_to_ids) {
+    threads.emplace_back([&, server_ip = server_ip, &ids = ids] {
+      if (server_ip == get_cfg_ip()) {
+        for (auto callee_id : ids) {
+          MigrationGuard caller_migration_guard;
+          ProcletServer::construct_proclet_locally<
+              T, const std::decay_t<As> &...>(
+              std::move(caller_migration_guard), to_proclet_base(callee_id),
+              capacity, pinned, args...);
+        }
+      } else {
+        MigrationGuard caller_migration_guard;
+        auto handler = ProcletServer::Handlers::get_id<
+            ProcletServer::construct_proclets<T, std::decay_t<As>...>>();
+        invoke_remote(std::move(caller_migration_guard), ids.front(), handler,
+                      capacity, pinned, ids, args...);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  callee_proclets.resize(allocated.size());
+  for (uint32_t i = 0; i < allocated.size(); i++) {
+    callee_proclets[i].id_ = allocated[i].first;
+  }
+  return callee_proclets;
+}
+
 template <typename T>
 inline Proclet<T>::operator bool() const {
   return id_;
@@ -255,7 +362,9 @@ inline Future<RetT> Proclet<T>::run_async(
     RetT (*fn)(T &, S0s...),
     S1s &&... states) requires ValidInvocationTypes<RetT, S0s...> {
   using fn_states_checker [[maybe_unused]] =
-      decltype(fn(std::declval<T &>(), std::forward<S1s>(states)...));
+      decltype(fn(std::declval<T &>(), std::declval<passed_arg_t<S1s>>()...));
+  static_assert(!requires_pinned_call<S1s...>(),
+                "Borrowed or Moved arguments can't be passed asynchronously.");
 
   return __run_async<MigrEn, CPUMon, CPUSamp>(fn, std::forward<S1s>(states)...);
 }
@@ -265,6 +374,9 @@ template <bool MigrEn, bool CPUMon, bool CPUSamp, typename RetT,
           typename... S0s, typename... S1s>
 inline Future<RetT> Proclet<T>::__run_async(RetT (*fn)(T &, S0s...),
                                             S1s &&... states) {
+  // The async thread may outlive the caller's frame the arguments point to.
+  static_assert(!requires_pinned_call<S1s...>(),
+                "Borrowed or Moved arguments can't be passed asynchronously.");
   return nu::async([&, fn, ... states = std::forward<S1s>(states)]() mutable {
     return __run<MigrEn, CPUMon, CPUSamp>(fn, std::forward<S1s>(states)...);
   });
@@ -277,7 +389,7 @@ inline RetT Proclet<T>::run(
     RetT (*fn)(T &, S0s...),
     S1s &&... states) requires ValidInvocationTypes<RetT, S0s...> {
   using fn_states_checker [[maybe_unused]] =
-      decltype(fn(std::declval<T &>(), std::move(states)...));
+      decltype(fn(std::declval<T &>(), std::declval<passed_arg_t<S1s>>()...));
 
   return __run<MigrEn, CPUMon, CPUSamp>(fn, std::forward<S1s>(states)...);
 }
@@ -286,6 +398,9 @@ template <typename T>
 template <bool MigrEn, bool CPUMon, bool CPUSamp, typename RetT,
           typename... S0s, typename... S1s>
 RetT Proclet<T>::__run(RetT (*fn)(T &, S0s...), S1s &&... states) {
+  static_assert(!MigrEn || !requires_pinned_call<S1s...>(),
+                "Borrowed or Moved arguments require MigrEn = false.");
+
   MigrationGuard caller_migration_guard;
 
   auto *caller_header = caller_migration_guard.header();
@@ -296,6 +411,8 @@ RetT Proclet<T>::__run(RetT (*fn)(T &, S0s...), S1s &&... states) {
                                                       caller_migration_guard);
     if (optional_callee_migration_guard) {
       // Fast path: the callee proclet is actually local, use function call.
+      get_runtime()->call_graph_profiler()->record_local_call(caller_header,
+                                                              id_);
 
       constexpr auto kHasRetVal = !std::is_same_v<RetT, void>;
       std::conditional_t<kHasRetVal, RetT, ErasedType> ret;
@@ -307,8 +424,8 @@ RetT Proclet<T>::__run(RetT (*fn)(T &, S0s...), S1s &&... states) {
         // safe. For copy, we assume the type implements "deep copy".
         auto copied_states =
             reinterpret_cast<StatesTuple *>(alloca(sizeof(StatesTuple)));
-        new (copied_states)
-            StatesTuple(pass_across_proclet(std::forward<S1s>(states))...);
+        new (copied_states) StatesTuple(
+            ArgRelay::pass_across(std::forward<S1s>(states))...);
 
         if constexpr (kHasRetVal) {
           ProcletServer::run_closure_locally<MigrEn, CPUMon, CPUSamp, T, RetT,
@@ -336,14 +453,16 @@ RetT Proclet<T>::__run(RetT (*fn)(T &, S0s...), S1s &&... states) {
   }
 
   // Slow path: the callee proclet is actually remote, use RPC.
-  auto *handler = ProcletServer::run_closure<MigrEn, CPUMon, CPUSamp, T, RetT,
-                                             decltype(fn), S1s...>;
+  auto handler = ProcletServer::Handlers::get_id<
+      ProcletServer::run_closure<MigrEn, CPUMon, CPUSamp, T, RetT,
+                                 decltype(fn), S1s...>>();
+  auto fn_id = ClosureRegistry::get()->to_id(fn);
   if constexpr (!std::is_same<RetT, void>::value) {
     return invoke_remote_with_ret<RetT>(std::move(caller_migration_guard), id_,
-                                        handler, id_, fn,
+                                        handler, id_, fn_id,
                                         std::forward<S1s>(states)...);
   } else {
-    invoke_remote(std::move(caller_migration_guard), id_, handler, id_, fn,
+    invoke_remote(std::move(caller_migration_guard), id_, handler, id_, fn_id,
                   std::forward<S1s>(states)...);
   }
 }
@@ -355,7 +474,10 @@ inline Future<RetT> Proclet<T>::run_async(
     RetT (T::*md)(A0s...),
     A1s &&... args) requires ValidInvocationTypes<RetT, A0s...> {
   using md_args_checker [[maybe_unused]] =
-      decltype((std::declval<T>().*(md))(std::move(args)...));
+      decltype((std::declval<T>().*(md))(
+          std::declval<passed_arg_t<A1s>>()...));
+  static_assert(!requires_pinned_call<A1s...>(),
+                "Borrowed or Moved arguments can't be passed asynchronously.");
 
   return __run_async<MigrEn, CPUMon, CPUSamp>(md, std::forward<A1s>(args)...);
 }
@@ -365,6 +487,8 @@ template <bool MigrEn, bool CPUMon, bool CPUSamp, typename RetT,
           typename... A0s, typename... A1s>
 inline Future<RetT> Proclet<T>::__run_async(RetT (T::*md)(A0s...),
                                             A1s &&... args) {
+  static_assert(!requires_pinned_call<A1s...>(),
+                "Borrowed or Moved arguments can't be passed asynchronously.");
   return nu::async([&, md, ... args = std::forward<A1s>(args)]() mutable {
     return __run<MigrEn, CPUMon, CPUSamp>(md, std::forward<A1s>(args)...);
   });
@@ -377,7 +501,8 @@ inline RetT Proclet<T>::run(
     RetT (T::*md)(A0s...),
     A1s &&... args) requires ValidInvocationTypes<RetT, A0s...> {
   using md_args_checker [[maybe_unused]] =
-      decltype((std::declval<T>().*(md))(std::forward<A1s>(args)...));
+      decltype((std::declval<T>().*(md))(
+          std::declval<passed_arg_t<A1s>>()...));
 
   return __run<MigrEn, CPUMon, CPUSamp>(md, std::forward<A1s>(args)...);
 }
@@ -390,7 +515,7 @@ inline RetT Proclet<T>::__run(RetT (T::*md)(A0s...), A1s &&... args) {
   method_ptr.ptr = md;
   return __run<MigrEn, CPUMon, CPUSamp>(
       +[](T &t, decltype(method_ptr) method_ptr, A0s... args) {
-        return (t.*(method_ptr.ptr))(std::move(args)...);
+        return (t.*(method_ptr.ptr))(ArgRelay::pass_on(args)...);
       },
       method_ptr, std::forward<A1s>(args)...);
 }
@@ -421,7 +546,8 @@ std::optional<Future<void>> Proclet<T>::update_ref_cnt(ProcletID id,
   // Slow path: the proclet is actually remote, use RPC.
   return nu::async([&, id, delta]() mutable {
     MigrationGuard caller_migration_guard;
-    auto *handler = ProcletServer::update_ref_cnt<T>;
+    auto handler =
+        ProcletServer::Handlers::get_id<ProcletServer::update_ref_cnt<T>>();
     invoke_remote(std::move(caller_migration_guard), id, handler, id, delta);
   });
 }
@@ -563,4 +689,28 @@ inline Future<Proclet<T>> make_proclet_async(bool pinned,
   return nu::async([=] { return make_proclet<T>(pinned, capacity, ip_hint); });
 }
 
+template <typename T, typename... As>
+inline std::vector<Proclet<T>> make_proclets(uint32_t num,
+                                             std::tuple<As...> args_tuple,
+                                             bool pinned,
+                                             std::optional<uint64_t> capacity,
+                                             std::optional<NodeIP> ip_hint) {
+  return std::apply(
+      [&](auto &&...args) {
+        return Proclet<T>::__create_batch(
+            num, pinned, capacity.value_or(kDefaultProcletHeapSize),
+            ip_hint.value_or(0), std::forward<As>(args)...);
+      },
+      std::move(args_tuple));
+}
+
+template <typename T>
+inline std::vector<Proclet<T>> make_proclets(uint32_t num, bool pinned,
+                                             std::optional<uint64_t> capacity,
+                                             std::optional<NodeIP> ip_hint) {
+  return Proclet<T>::__create_batch(num, pinned,
+                                    capacity.value_or(kDefaultProcletHeapSize),
+                                    ip_hint.value_or(0));
+}
+
 }  // namespace nu
@@ -24,6 +24,12 @@ inline uint64_t ProcletHeader::total_mem_size() const {
   return heap_size() + stack_size();
 }
 
+inline uint64_t ProcletHeader::resident_mem_size() const {
+  return reinterpret_cast<uint64_t>(slab.get_base()) +
+         slab.get_resident_usage() - reinterpret_cast<uint64_t>(this) +
+         stack_size();
+}
+
 inline uint8_t &ProcletHeader::status() {
   return proclet_statuses[global_idx()];
 }
@@ -52,10 +58,14 @@ inline void ProcletManager::wait_until(ProcletHeader *proclet_header,
 }
 
 inline void ProcletManager::insert(void *proclet_base) {
-  ScopedLock lock(&spin_);
-  reinterpret_cast<ProcletHeader *>(proclet_base)->status() = kPresent;
-  num_present_proclets_++;
-  present_proclets_.push_back(proclet_base);
+  auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
+  {
+    ScopedLock lock(&spin_);
+    proclet_header->status() = kPresent;
+    num_present_proclets_++;
+    present_proclets_.push_back(proclet_base);
+  }
+  update_utility(proclet_header);
 }
 
 inline bool ProcletManager::remove_for_migration(void *proclet_base) {
@@ -68,16 +78,19 @@ inline bool ProcletManager::remove_for_destruction(void *proclet_base) {
 
 inline bool ProcletManager::__remove(void *proclet_base,
                                      ProcletStatus new_status) {
-  ScopedLock lock(&spin_);
   auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
-  auto &status = proclet_header->status();
-  if (status == kPresent) {
+  {
+    ScopedLock lock(&spin_);
+    auto &status = proclet_header->status();
+    if (status != kPresent) {
+      return false;
+    }
     num_present_proclets_--;
     status = new_status;
-    return true;
-  } else {
-    return false;
   }
+  // The index lock is taken before spin_ when picking proclets to migrate.
+  utility_index_.remove(proclet_header);
+  return true;
 }
 
 inline uint32_t ProcletManager::get_num_present_proclets() {
@@ -94,4 +107,6 @@ inline std::optional<RetT> ProcletManager::get_proclet_info(
   return f(header);
 }
 
+inline UtilityIndex *ProcletManager::utility_index() { return &utility_index_; }
+
 }  // namespace nu
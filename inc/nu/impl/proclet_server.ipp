@@ -2,10 +2,13 @@
 #include <type_traits>
 #include <utility>
 #include <optional>
+#include <tuple>
+#include <vector>
 #include <alloca.h>
 
 #include <net.h>
 
+#include "nu/closure_registry.hpp"
 #include "nu/ctrl.hpp"
 #include "nu/ctrl_client.hpp"
 #include "nu/migrator.hpp"
@@ -66,6 +69,54 @@ void ProcletServer::construct_proclet(ArchivePool<>::IASStream *ia_sstream,
   get_runtime()->proclet_manager()->insert(base);
 }
 
+template <typename Cls, typename... As>
+void ProcletServer::__construct_proclet_copied(MigrationGuard *callee_guard,
+                                               Cls *obj,
+                                               std::tuple<As...> *args) {
+  auto *callee_header = callee_guard->header();
+  auto &callee_slab = callee_header->slab;
+  auto obj_space = callee_slab.yield(sizeof(Cls));
+
+  ProcletSlabGuard slab_guard(&callee_slab);
+  std::apply(
+      [&](auto &... args) {
+        new (obj_space) Cls(pass_across_proclet(args)...);
+      },
+      *args);
+}
+
+template <typename Cls, typename... As>
+void ProcletServer::construct_proclets(ArchivePool<>::IASStream *ia_sstream,
+                                       RPCReturner *returner) {
+  uint64_t size;
+  bool pinned;
+  std::vector<ProcletID> ids;
+  ia_sstream->ia >> size >> pinned >> ids;
+
+  // Every proclet gets its own copy of the arguments, so they are only
+  // deserialized once for the whole batch.
+  std::tuple<std::decay_t<As>...> args;
+  std::apply([&](auto &&... args) { ((ia_sstream->ia >> args), ...); }, args);
+
+  for (auto id : ids) {
+    auto *base = to_proclet_base(id);
+    get_runtime()->proclet_manager()->setup(base, size,
+                                            /* migratable = */ !pinned,
+                                            /* from_migration = */ false);
+    auto *proclet_header = reinterpret_cast<ProcletHeader *>(base);
+    proclet_header->status() = kPresent;
+
+    bool proclet_not_found = !get_runtime()->run_within_proclet_env<Cls>(
+        base, __construct_proclet_copied<Cls, std::decay_t<As>...>, &args);
+    BUG_ON(proclet_not_found);
+
+    get_runtime()->proclet_manager()->insert(base);
+  }
+
+  auto *oa_sstream = get_runtime()->archive_pool()->get_oa_sstream();
+  get_runtime()->send_rpc_resp_ok(oa_sstream, ia_sstream, returner);
+}
+
 template <typename Cls, typename... As>
 void ProcletServer::construct_proclet_locally(MigrationGuard &&caller_guard,
                                               void *base, uint64_t size,
@@ -229,6 +280,18 @@ void ProcletServer::update_ref_cnt_locally(MigrationGuard *callee_guard,
   }
 }
 
+template <bool CPUSamp>
+inline void ProcletServer::end_cpu_monitor(ProcletHeader *callee_header) {
+  auto &cpu_load = callee_header->cpu_load;
+  cpu_load.end_monitor();
+  // Keeps the utility index up to date with the load.
+  if constexpr (CPUSamp) {
+    if (unlikely(cpu_load.refresh())) {
+      get_runtime()->proclet_manager()->update_utility(callee_header);
+    }
+  }
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wuninitialized"
 
@@ -236,7 +299,12 @@ template <bool MigrEn, bool CPUMon, bool CPUSamp, typename Cls, typename RetT,
           typename FnPtr, typename... S1s>
 void ProcletServer::__run_closure(MigrationGuard *callee_guard, Cls *obj,
                                   ArchivePool<>::IASStream *ia_sstream,
-                                  RPCReturner returner) {
+                                  RPCReturner returner, FnPtr fn) {
+  if (unlikely(!fn)) {
+    returner.Return(kErrUnknownHandler);
+    return;
+  }
+
   auto *callee_header = callee_guard->header();
   ProcletSlabGuard callee_slab_guard(&callee_header->slab);
 
@@ -252,9 +320,6 @@ void ProcletServer::__run_closure(MigrationGuard *callee_guard, Cls *obj,
   constexpr auto kNonVoidRetT = !std::is_same<RetT, void>::value;
   std::conditional_t<kNonVoidRetT, RetT, ErasedType> ret;
 
-  FnPtr fn;
-  ia_sstream->ia >> fn;
-
   std::tuple<std::decay_t<S1s>...> states;
   std::apply([&](auto &&... states) { ((ia_sstream->ia >> states), ...); },
              states);
@@ -262,9 +327,9 @@ void ProcletServer::__run_closure(MigrationGuard *callee_guard, Cls *obj,
     std::apply(
         [&](auto &&... states) {
           if constexpr (kNonVoidRetT) {
-            ret = fn(*obj, std::move(states)...);
+            ret = fn(*obj, ArgRelay::pass_on(states)...);
           } else {
-            fn(*obj, std::move(states)...);
+            fn(*obj, ArgRelay::pass_on(states)...);
           }
         },
         states);
@@ -286,7 +351,7 @@ void ProcletServer::__run_closure(MigrationGuard *callee_guard, Cls *obj,
 
   callee_header->thread_cnt.dec_unsafe();
   if constexpr (CPUMon) {
-    callee_header->cpu_load.end_monitor();
+    end_cpu_monitor<CPUSamp>(callee_header);
   }
 }
 
@@ -297,14 +362,18 @@ template <bool MigrEn, bool CPUMon, bool CPUSamp, typename Cls, typename RetT,
 void ProcletServer::run_closure(ArchivePool<>::IASStream *ia_sstream,
                                 RPCReturner *returner) {
   ProcletID id;
-  ia_sstream->ia >> id;
+  ClosureID fn_id;
+  ia_sstream->ia >> id >> fn_id;
 
   auto *proclet_header = to_proclet_header(id);
+  // Left to __run_closure() to reject if unknown, as the proclet may not be
+  // here in the first place.
+  auto fn = ClosureRegistry::get()->from_id<FnPtr>(fn_id);
 
   bool proclet_not_found = !get_runtime()->run_within_proclet_env<Cls>(
       proclet_header,
       __run_closure<MigrEn, CPUMon, CPUSamp, Cls, RetT, FnPtr, S1s...>,
-      ia_sstream, *returner);
+      ia_sstream, *returner, fn);
 
   if (proclet_not_found) {
     get_runtime()->send_rpc_resp_wrong_client(returner);
@@ -319,7 +388,10 @@ void ProcletServer::run_closure_locally(
     const ProcletSlabGuard &callee_slab_guard, RetT *caller_ptr,
     ProcletHeader *caller_header, ProcletHeader *callee_header, FnPtr fn_ptr,
     std::tuple<Ss...> *states) {
-  caller_migration_guard->reset();
+  // Keep the caller pinned if the callee may reference its heap.
+  if constexpr (!requires_pinned_call<Ss...>()) {
+    caller_migration_guard->reset();
+  }
 
   if constexpr (CPUMon) {
     if constexpr (CPUSamp) {
@@ -337,17 +409,18 @@ void ProcletServer::run_closure_locally(
     std::apply(
         [&](auto &&...states) {
           if constexpr (MigrEn) {
-            callee_migration_guard->enable_for(
-                [&] { new (ret) RetT(fn_ptr(*obj, std::move(states)...)); });
+            callee_migration_guard->enable_for([&] {
+              new (ret) RetT(fn_ptr(*obj, ArgRelay::pass_on(states)...));
+            });
           } else {
-            new (ret) RetT(fn_ptr(*obj, std::move(states)...));
+            new (ret) RetT(fn_ptr(*obj, ArgRelay::pass_on(states)...));
           }
         },
         std::move(*states));
     std::destroy_at(states);
     callee_header->thread_cnt.dec_unsafe();
     if constexpr (CPUMon) {
-      callee_header->cpu_load.end_monitor();
+      end_cpu_monitor<CPUSamp>(callee_header);
     }
 
     auto optional_caller_guard = get_runtime()->reattach_and_disable_migration(
@@ -384,16 +457,16 @@ void ProcletServer::run_closure_locally(
         [&](auto &&...states) {
           if constexpr (MigrEn) {
             callee_migration_guard->enable_for(
-                [&] { fn_ptr(*obj, std::move(states)...); });
+                [&] { fn_ptr(*obj, ArgRelay::pass_on(states)...); });
           } else {
-            fn_ptr(*obj, std::move(states)...);
+            fn_ptr(*obj, ArgRelay::pass_on(states)...);
           }
         },
         std::move(*states));
     std::destroy_at(states);
     callee_header->thread_cnt.dec_unsafe();
     if constexpr (CPUMon) {
-      callee_header->cpu_load.end_monitor();
+      end_cpu_monitor<CPUSamp>(callee_header);
     }
 
     auto optional_caller_guard = get_runtime()->reattach_and_disable_migration(
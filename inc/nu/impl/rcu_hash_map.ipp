@@ -6,6 +6,9 @@ extern "C" {
 #include <base/assert.h>
 }
 
+#include "nu/utils/compaction.hpp"
+#include "nu/utils/slab.hpp"
+
 namespace nu {
 
 template <typename K, typename V, typename Allocator>
@@ -119,4 +122,52 @@ RetT RCUHashMap<K, V, Allocator>::apply(
   }
 }
 
+template <typename K, typename V, typename Allocator>
+bool RCUHashMap<K, V, Allocator>::compact(size_t num_buckets) {
+  auto *slab = get_compaction_slab();
+  if (!should_compact(slab)) {
+    return false;
+  }
+
+  bool pass_done = false;
+  std::vector<K> keys;
+  lock_.writer_lock();
+  // The node size is only known to the map, which reports it through its
+  // allocator once it holds any.
+  RelocationRun run(slab, relocation_target_.obj_size);
+  for (size_t i = 0; i < num_buckets; i++) {
+    // The bucket count might have changed since the last call.
+    if (compact_cursor_ >= map_.bucket_count()) {
+      compact_cursor_ = 0;
+      pass_done = true;
+      break;
+    }
+    keys.clear();
+    for (auto iter = map_.begin(compact_cursor_);
+         iter != map_.end(compact_cursor_); ++iter) {
+      keys.push_back(iter->first);
+    }
+    for (auto &k : keys) {
+      // A free chunk below the pair is below its whole node too.
+      auto *chunk = run.take_below(&*map_.find(k));
+      if (!chunk) {
+        continue;
+      }
+      // Re-inserting without changing the size never triggers a rehash, so
+      // the only allocation is the new node, which takes the chunk.
+      auto node = map_.extract(k);
+      relocation_target_.chunk = chunk;
+      map_.emplace(std::move(node.key()), std::move(node.mapped()));
+      BUG_ON(relocation_target_.chunk);
+    }
+    compact_cursor_++;
+  }
+  lock_.writer_unlock();
+
+  if (pass_done) {
+    slab->scavenge();
+  }
+  return true;
+}
+
 }  // namespace nu
@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <type_traits>
+
+extern "C" {
+#include <base/assert.h>
+}
+
+#include "nu/proclet_mgr.hpp"
+#include "nu/resource_reporter.hpp"
+#include "nu/rpc_client_mgr.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/scoped_lock.hpp"
+#include "nu/utils/time.hpp"
+
+namespace nu {
+
+template <typename T>
+template <typename... As>
+inline ReplicatedProclet<T>::Replica::Replica(ReplicationMode mode,
+                                              uint64_t max_staleness_us,
+                                              As... args)
+    : obj(std::move(args)...),
+      version(0),
+      mode(mode),
+      max_staleness_us(max_staleness_us),
+      oldest_log_us(0),
+      done(false) {}
+
+template <typename T>
+ReplicatedProclet<T>::Replica::~Replica() {
+  done = true;
+  barrier();
+  if (flusher.joinable()) {
+    flusher.join();
+  }
+}
+
+template <typename T>
+template <typename RetT, typename... S0s>
+RetT ReplicatedProclet<T>::Replica::read(
+    MethodPtr<RetT (*)(const T &, S0s...)> fn, S0s... states) {
+  lock.reader_lock();
+  if constexpr (std::is_void_v<RetT>) {
+    fn.ptr(obj, std::move(states)...);
+    lock.reader_unlock();
+  } else {
+    auto ret = fn.ptr(obj, std::move(states)...);
+    lock.reader_unlock();
+    return ret;
+  }
+}
+
+template <typename T>
+template <typename RetT, typename... S0s>
+RetT ReplicatedProclet<T>::Replica::apply(
+    uint64_t new_version, MethodPtr<RetT (*)(T &, S0s...)> fn,
+    S0s... states) {
+  lock.writer_lock();
+  BUG_ON(new_version != version + 1);
+  version = new_version;
+  if constexpr (std::is_void_v<RetT>) {
+    fn.ptr(obj, std::move(states)...);
+    lock.writer_unlock();
+  } else {
+    auto ret = fn.ptr(obj, std::move(states)...);
+    lock.writer_unlock();
+    return ret;
+  }
+}
+
+template <typename T>
+template <typename RetT, typename... S0s>
+RetT ReplicatedProclet<T>::Replica::write(
+    MethodPtr<RetT (*)(T &, S0s...)> fn, S0s... states) {
+  using FnPtr = decltype(fn);
+
+  ScopedLock guard(&write_mutex);
+  auto new_version = version + 1;
+  if (!followers.empty()) {
+    if (log.empty()) {
+      oldest_log_us = Time::microtime();
+    }
+    log.emplace_back([=](Proclet<Replica> &follower) {
+      follower.run(
+          +[](Replica &r, uint64_t new_version, FnPtr fn, S0s... states) {
+            r.apply(new_version, fn, std::move(states)...);
+          },
+          new_version, fn, states...);
+    });
+  }
+
+  auto flush_if_needed = [&] {
+    if (mode == kSyncReplication || log.size() >= kMaxLogSize ||
+        Time::microtime() - oldest_log_us >= max_staleness_us) {
+      flush(std::move(guard));
+    }
+  };
+
+  if constexpr (std::is_void_v<RetT>) {
+    apply(new_version, fn, std::move(states)...);
+    flush_if_needed();
+  } else {
+    auto ret = apply(new_version, fn, std::move(states)...);
+    flush_if_needed();
+    return ret;
+  }
+}
+
+template <typename T>
+void ReplicatedProclet<T>::Replica::flush(ScopedLock<Mutex> write_guard) {
+  if (log.empty()) {
+    return;
+  }
+
+  // Take the pending entries and let new writes in while they are being
+  // replayed. Acquiring flush_mutex before releasing write_mutex keeps the
+  // flushes in log order.
+  auto pending = std::move(log);
+  log.clear();
+  ScopedLock flush_guard(&flush_mutex);
+  write_guard.reset();
+
+  // Followers are independent of each other, but each of them must replay the
+  // log in order.
+  std::vector<Future<void>> futures;
+  for (auto &follower : followers) {
+    futures.emplace_back(nu::async([&] {
+      for (auto &entry : pending) {
+        entry(follower);
+      }
+    }));
+  }
+  for (auto &future : futures) {
+    future.get();
+  }
+}
+
+template <typename T>
+template <typename... As>
+std::vector<WeakProclet<typename ReplicatedProclet<T>::Replica>>
+ReplicatedProclet<T>::Replica::create_followers(
+    uint32_t num_followers, bool pinned, std::optional<uint64_t> capacity,
+    std::tuple<ReplicationMode, uint64_t, As...> ctor_args) {
+  // Spread the followers over the other nodes, the idlest ones first. There
+  // is at most one follower per node, so num_followers is capped by the
+  // number of the other nodes.
+  NodeIP candidate_ips[kMaxNumReplicas];
+  uint32_t num_candidates = 0;
+  {
+    MigrationGuard migration_guard;
+    RuntimeSlabGuard slab_guard;
+
+    auto free_resources =
+        get_runtime()->resource_reporter()->get_global_free_resources();
+    std::sort(free_resources.begin(), free_resources.end(),
+              [](const auto &x, const auto &y) {
+                return x.second.cores > y.second.cores;
+              });
+    for (auto &[ip, _] : free_resources) {
+      if (ip != get_cfg_ip() && num_candidates < num_followers) {
+        candidate_ips[num_candidates++] = ip;
+      }
+    }
+  }
+
+  std::vector<Future<Proclet<Replica>>> futures;
+  for (uint32_t i = 0; i < num_candidates; i++) {
+    futures.emplace_back(make_proclet_async<Replica>(
+        ctor_args, pinned, capacity, candidate_ips[i]));
+  }
+
+  std::vector<WeakProclet<Replica>> weak_followers;
+  std::vector<ProcletID> ids;
+  ids.push_back(to_proclet_id(get_runtime()->get_current_proclet_header()));
+  for (auto &future : futures) {
+    followers.emplace_back(std::move(future.get()));
+    weak_followers.emplace_back(followers.back().get_weak());
+    ids.push_back(followers.back().get_id());
+  }
+
+  auto set_peers_fn = +[](Replica &, std::vector<ProcletID> ids) {
+    auto *header = get_runtime()->get_current_proclet_header();
+    auto self_id = to_proclet_id(header);
+    auto *peer = header->replica_peers;
+    for (auto id : ids) {
+      if (id != self_id) {
+        *(peer++) = id;
+      }
+    }
+  };
+  set_peers_fn(*this, ids);
+  for (auto &follower : followers) {
+    follower.run(set_peers_fn, ids);
+  }
+
+  if (mode == kBoundedStaleness) {
+    flusher = Thread([&] {
+      while (!rt::access_once(done)) {
+        Time::sleep(max_staleness_us / 2);
+        flush(ScopedLock(&write_mutex));
+      }
+    });
+  }
+
+  return weak_followers;
+}
+
+template <typename T>
+inline ReplicatedProclet<T>::LoadCache::LoadCache()
+    : last_refresh_us(0), next_idx(0) {
+  for (auto &cores : free_cores) {
+    cores.store(0, std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+inline ReplicatedProclet<T>::ReplicatedProclet()
+    : mode_(kSyncReplication), load_cache_(std::make_unique<LoadCache>()) {}
+
+template <typename T>
+inline ReplicatedProclet<T>::ReplicatedProclet(const ReplicatedProclet &o)
+    : primary_(o.primary_),
+      replicas_(o.replicas_),
+      mode_(o.mode_),
+      load_cache_(std::make_unique<LoadCache>()) {}
+
+template <typename T>
+inline ReplicatedProclet<T> &ReplicatedProclet<T>::operator=(
+    const ReplicatedProclet &o) {
+  primary_ = o.primary_;
+  replicas_ = o.replicas_;
+  mode_ = o.mode_;
+  load_cache_ = std::make_unique<LoadCache>();
+  return *this;
+}
+
+template <typename T>
+template <typename RetT, typename... S0s, typename... S1s>
+inline RetT ReplicatedProclet<T>::read(
+    RetT (*fn)(const T &, S0s...),
+    S1s &&... states) requires ValidInvocationTypes<RetT, S0s...> {
+  MethodPtr<decltype(fn)> fn_ptr;
+  fn_ptr.ptr = fn;
+  auto replica = pick_replica();
+  return replica.run(
+      +[](Replica &r, decltype(fn_ptr) fn_ptr, S0s... states) {
+        return r.read(fn_ptr, std::move(states)...);
+      },
+      fn_ptr, std::forward<S1s>(states)...);
+}
+
+template <typename T>
+template <typename RetT, typename... S0s, typename... S1s>
+inline RetT ReplicatedProclet<T>::write(
+    RetT (*fn)(T &, S0s...),
+    S1s &&... states) requires ValidInvocationTypes<RetT, S0s...> {
+  MethodPtr<decltype(fn)> fn_ptr;
+  fn_ptr.ptr = fn;
+  return primary_.run(
+      +[](Replica &r, decltype(fn_ptr) fn_ptr, S0s... states) {
+        return r.write(fn_ptr, std::move(states)...);
+      },
+      fn_ptr, std::forward<S1s>(states)...);
+}
+
+template <typename T>
+template <typename RetT, typename... A0s, typename... A1s>
+inline RetT ReplicatedProclet<T>::run(
+    RetT (T::*md)(A0s...) const,
+    A1s &&... args) requires ValidInvocationTypes<RetT, A0s...> {
+  MethodPtr<decltype(md)> method_ptr;
+  method_ptr.ptr = md;
+  return read(
+      +[](const T &t, decltype(method_ptr) method_ptr, A0s... args) {
+        return (t.*(method_ptr.ptr))(std::move(args)...);
+      },
+      method_ptr, std::forward<A1s>(args)...);
+}
+
+template <typename T>
+template <typename RetT, typename... A0s, typename... A1s>
+inline RetT ReplicatedProclet<T>::run(
+    RetT (T::*md)(A0s...),
+    A1s &&... args) requires ValidInvocationTypes<RetT, A0s...> {
+  MethodPtr<decltype(md)> method_ptr;
+  method_ptr.ptr = md;
+  return write(
+      +[](T &t, decltype(method_ptr) method_ptr, A0s... args) {
+        return (t.*(method_ptr.ptr))(std::move(args)...);
+      },
+      method_ptr, std::forward<A1s>(args)...);
+}
+
+template <typename T>
+inline uint32_t ReplicatedProclet<T>::get_num_replicas() const {
+  return replicas_.size() - 1;
+}
+
+template <typename T>
+inline ReplicationMode ReplicatedProclet<T>::get_mode() const {
+  return mode_;
+}
+
+template <typename T>
+WeakProclet<typename ReplicatedProclet<T>::Replica>
+ReplicatedProclet<T>::pick_replica() {
+  for (auto &replica : replicas_) {
+    if (replica.is_local()) {
+      return replica;
+    }
+  }
+
+  auto now_us = Time::microtime();
+  auto last_refresh_us =
+      load_cache_->last_refresh_us.load(std::memory_order_acquire);
+  if (unlikely(now_us - last_refresh_us >= kLoadRefreshIntervalUs)) {
+    if (load_cache_->refresh_mutex.try_lock()) {
+      // Recheck, another thread might have refreshed it in the meantime.
+      if (load_cache_->last_refresh_us.load(std::memory_order_acquire) ==
+          last_refresh_us) {
+        refresh_free_cores();
+        load_cache_->last_refresh_us.store(Time::microtime(),
+                                           std::memory_order_release);
+      }
+      load_cache_->refresh_mutex.unlock();
+    }
+  }
+
+  // Rotate the starting point to break ties in a round-robin way.
+  auto num_replicas = replicas_.size();
+  auto start_idx =
+      load_cache_->next_idx.fetch_add(1, std::memory_order_relaxed) %
+      num_replicas;
+  auto best_idx = start_idx;
+  auto best_cores =
+      load_cache_->free_cores[start_idx].load(std::memory_order_relaxed);
+  for (uint32_t i = 1; i < num_replicas; i++) {
+    auto idx = (start_idx + i) % num_replicas;
+    auto cores = load_cache_->free_cores[idx].load(std::memory_order_relaxed);
+    if (cores > best_cores) {
+      best_idx = idx;
+      best_cores = cores;
+    }
+  }
+  return replicas_[best_idx];
+}
+
+template <typename T>
+void ReplicatedProclet<T>::refresh_free_cores() {
+  MigrationGuard migration_guard;
+  RuntimeSlabGuard slab_guard;
+
+  auto free_resources =
+      get_runtime()->resource_reporter()->get_global_free_resources();
+  for (uint32_t i = 0; i < replicas_.size(); i++) {
+    auto ip = get_runtime()->rpc_client_mgr()->get_ip_by_proclet_id(
+        replicas_[i].get_id());
+    float cores = 0;
+    for (auto &[node_ip, resource] : free_resources) {
+      if (node_ip == ip) {
+        cores = resource.cores;
+        break;
+      }
+    }
+    load_cache_->free_cores[i].store(cores, std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+template <class Archive>
+inline void ReplicatedProclet<T>::serialize(Archive &ar) {
+  ar(primary_);
+  ar(replicas_);
+  ar(mode_);
+}
+
+template <typename T, typename... As>
+ReplicatedProclet<T> make_replicated_proclet(std::tuple<As...> args_tuple,
+                                             uint32_t num_replicas,
+                                             ReplicationMode mode,
+                                             uint64_t max_staleness_us,
+                                             bool pinned,
+                                             std::optional<uint64_t> capacity) {
+  using Replica = typename ReplicatedProclet<T>::Replica;
+  BUG_ON(num_replicas > ReplicatedProclet<T>::kMaxNumReplicas);
+
+  ReplicatedProclet<T> rp;
+  rp.mode_ = mode;
+  auto ctor_args =
+      std::tuple_cat(std::make_tuple(mode, max_staleness_us), args_tuple);
+  rp.primary_ = make_proclet<Replica>(ctor_args, pinned, capacity);
+  rp.replicas_.emplace_back(rp.primary_.get_weak());
+  auto followers = rp.primary_.run(
+      +[](Replica &r, uint32_t num_followers, bool pinned,
+          std::optional<uint64_t> capacity, decltype(ctor_args) ctor_args) {
+        return r.create_followers(num_followers, pinned, capacity,
+                                  std::move(ctor_args));
+      },
+      num_replicas, pinned, capacity, ctor_args);
+  rp.replicas_.insert(rp.replicas_.end(), followers.begin(), followers.end());
+  return rp;
+}
+
+}  // namespace nu
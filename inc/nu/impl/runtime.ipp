@@ -46,6 +46,10 @@ inline ResourceReporter *Runtime::resource_reporter() {
   return resource_reporter_;
 }
 
+inline CallGraphProfiler *Runtime::call_graph_profiler() {
+  return call_graph_profiler_;
+}
+
 inline Caladan *Runtime::caladan() { return caladan_; }
 
 inline Migrator *Runtime::migrator() { return migrator_; }
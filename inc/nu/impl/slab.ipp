@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 
@@ -18,13 +19,46 @@ inline SlabAllocator::~SlabAllocator() {
 
 inline void SlabAllocator::init(SlabId_t slab_id, void *buf, uint64_t len,
                                 bool aggressive_caching) {
-  register_slab_by_id(this, slab_id);
   slab_id_ = slab_id;
   aggressive_caching_ = aggressive_caching;
   start_ = reinterpret_cast<const uint8_t *>(buf);
   end_ = start_ + len;
   cur_ = const_cast<uint8_t *>(start_);
+  regions_[0] = Region{.start = cur_,
+                       .end = const_cast<uint8_t *>(end_),
+                       .top = nullptr,
+                       .run_map = nullptr,
+                       .run_map_base = 0};
+  num_regions_ = 1;
+  retired_usage_ = 0;
+  region_seq_ = 0;
+  low_space_threshold_ = 0;
+  compaction_ratio_ = kDefaultCompactionRatio;
   global_free_bytes_ = 0;
+  std::fill(std::begin(released_spans_), std::end(released_spans_), nullptr);
+  released_bytes_ = 0;
+  large_spans_ = nullptr;
+  large_live_bytes_ = 0;
+  peak_usage_ = 0;
+  profiling_rate_ = 0;
+  num_dropped_samples_ = 0;
+  std::fill(std::begin(alloc_sites_), std::end(alloc_sites_), AllocSite{});
+
+  // Only the slabs that own a whole proclet heap or the runtime heap can be
+  // found by address, which headerless objects rely on.
+  auto addr = reinterpret_cast<uintptr_t>(buf);
+  if (addr >= kMinProcletHeapVAddr && addr < kMaxProcletHeapVAddr) {
+    headerless_ = (slab_id == to_slab_id(addr));
+  } else {
+    headerless_ = (addr >= kMinRuntimeHeapVaddr &&
+                   addr < kMaxRuntimeHeapVaddr && slab_id == kRuntimeSlabId);
+  }
+  if (headerless_) {
+    std::fill(std::begin(run_curs_), std::end(run_curs_), nullptr);
+    std::fill(std::begin(run_ends_), std::end(run_ends_), nullptr);
+    init_run_map(regions_[0]);
+  }
+  register_slab_by_id(this, slab_id);
 }
 
 inline void *SlabAllocator::allocate(size_t size) {
@@ -41,13 +75,50 @@ inline void SlabAllocator::free(const void *ptr) {
   __free(ptr);
 }
 
-inline uint32_t SlabAllocator::get_slab_shift(uint64_t data_size) {
-  return data_size <= (1ULL << kMinSlabClassShift) ? kMinSlabClassShift - 1
-                                                   : bsr_64(data_size - 1);
+inline uint32_t SlabAllocator::get_size_class(uint64_t data_size) {
+  if (likely(data_size <= kMaxLookupSize)) {
+    return size_to_class_[(data_size + kAlignment - 1) / kAlignment];
+  }
+  // data_size is within (1 << shift, 2 << shift].
+  auto shift = bsr_64(data_size - 1);
+  auto spacing_shift = shift - kLgNumClassesPerDoubling;
+  return kNumLinearClasses +
+         ((shift - kMinSpacedClassShift) << kLgNumClassesPerDoubling) +
+         ((data_size - 1 - (1ULL << shift)) >> spacing_shift);
+}
+
+inline bool SlabAllocator::is_headerless_class(uint32_t size_class) const {
+  return headerless_ && size_class < kNumSmallClasses;
+}
+
+inline uint64_t SlabAllocator::get_chunk_size(uint32_t size_class) const {
+  return class_sizes_[size_class] +
+         (is_headerless_class(size_class) ? 0 : sizeof(PtrHeader));
 }
 
-inline uint64_t SlabAllocator::get_slab_size(uint32_t slab_shift) {
-  return (1ULL << (slab_shift + 1)) + sizeof(PtrHeader);
+inline SlabAllocator *SlabAllocator::get_mapped_slab(uintptr_t addr) {
+  if (addr >= kMinProcletHeapVAddr && addr < kMaxProcletHeapVAddr) {
+    auto granule = (addr - kMinProcletHeapVAddr) / kMinProcletHeapSize;
+    return slabs_[rt::access_once(proclet_heap_slab_ids_[granule])];
+  }
+  if (addr >= kMinRuntimeHeapVaddr && addr < kMaxRuntimeHeapVaddr) {
+    return slabs_[kRuntimeSlabId];
+  }
+  return nullptr;
+}
+
+inline uint32_t SlabAllocator::get_run_class(uintptr_t addr) const {
+  if (!headerless_) {
+    return 0;
+  }
+  for (uint32_t i = 0; i < num_regions_; i++) {
+    auto &region = regions_[i];
+    if (likely(addr >= region.run_map_base &&
+               addr < reinterpret_cast<uintptr_t>(region.end))) {
+      return region.run_map[(addr - region.run_map_base) >> kSmallRunShift];
+    }
+  }
+  return 0;
 }
 
 inline void *SlabAllocator::get_base() const {
@@ -63,26 +134,128 @@ inline size_t SlabAllocator::get_cur_usage() const {
 }
 
 inline size_t SlabAllocator::get_usage() const {
-  return rt::access_once(cur_) - start_;
+  uint32_t seq;
+  size_t usage;
+  do {
+    seq = rt::access_once(region_seq_);
+    barrier();
+    usage = rt::access_once(retired_usage_) +
+            (rt::access_once(cur_) -
+             rt::access_once(regions_[num_regions_ - 1].start));
+    barrier();
+  } while (unlikely((seq & 1) || seq != rt::access_once(region_seq_)));
+  return usage;
+}
+
+inline void SlabAllocator::set_low_space_threshold(size_t bytes) {
+  low_space_threshold_ = bytes;
 }
 
 inline size_t SlabAllocator::get_remaining() const {
-  return end_ - start_ - get_usage();
+  uint32_t seq;
+  size_t remaining;
+  do {
+    seq = rt::access_once(region_seq_);
+    barrier();
+    remaining =
+        rt::access_once(regions_[num_regions_ - 1].end) - rt::access_once(cur_);
+    barrier();
+  } while (unlikely((seq & 1) || seq != rt::access_once(region_seq_)));
+  return remaining;
+}
+
+inline size_t SlabAllocator::get_resident_usage() const {
+  return get_usage() - rt::access_once(released_bytes_);
+}
+
+inline double SlabAllocator::get_fragmentation() const {
+  auto usage = get_usage();
+  return usage ? static_cast<double>(usage - get_cur_usage()) / usage : 0;
+}
+
+inline void SlabAllocator::maybe_sample(const Caladan::PreemptGuard &g,
+                                        size_t size) {
+  auto &countdown = cache_lists_[g.read_cpu()].profile_countdown;
+  if (countdown <= 1) {
+    countdown = rt::access_once(profiling_rate_);
+    record_sample(size);
+  } else {
+    countdown--;
+  }
+}
+
+inline double SlabAllocator::get_compaction_ratio() const {
+  return compaction_ratio_;
+}
+
+inline void SlabAllocator::set_compaction_ratio(double ratio) {
+  compaction_ratio_ = ratio;
+}
+
+inline SlabAllocator::Region &SlabAllocator::cur_region() {
+  return regions_[num_regions_ - 1];
+}
+
+inline bool SlabAllocator::owns(const void *ptr) const {
+  auto addr = reinterpret_cast<uint64_t>(ptr);
+  for (uint32_t i = 0; i < num_regions_; i++) {
+    auto range = get_used_region(i);
+    if (addr >= range.start && addr < range.end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline uint32_t SlabAllocator::get_num_regions() const { return num_regions_; }
+
+inline VAddrRange SlabAllocator::get_region(uint32_t idx) const {
+  auto &region = regions_[idx];
+  return VAddrRange{.start = reinterpret_cast<uint64_t>(region.start),
+                    .end = reinterpret_cast<uint64_t>(region.end)};
+}
+
+inline VAddrRange SlabAllocator::get_used_region(uint32_t idx) const {
+  auto &region = regions_[idx];
+  auto *top = (idx == num_regions_ - 1) ? cur_ : region.top;
+  return VAddrRange{.start = reinterpret_cast<uint64_t>(region.start),
+                    .end = reinterpret_cast<uint64_t>(top)};
 }
 
 inline SlabId_t SlabAllocator::get_id() { return slab_id_; }
 
+inline void SlabAllocator::map_proclet_heap(SlabAllocator *slab,
+                                            SlabId_t slab_id) {
+  for (uint32_t i = 0; i < slab->num_regions_; i++) {
+    auto start = reinterpret_cast<uintptr_t>(slab->regions_[i].start);
+    auto end = reinterpret_cast<uintptr_t>(slab->regions_[i].end);
+    auto first = (start - kMinProcletHeapVAddr) / kMinProcletHeapSize;
+    auto last = (end - 1 - kMinProcletHeapVAddr) / kMinProcletHeapSize;
+    std::fill(proclet_heap_slab_ids_ + first,
+              proclet_heap_slab_ids_ + last + 1, slab_id);
+  }
+}
+
 inline void SlabAllocator::register_slab_by_id(SlabAllocator *slab,
                                                SlabId_t slab_id) {
   BUG_ON(slabs_[slab_id]);
   slabs_[slab_id] = slab;
+  if (slab->headerless_ && slab_id != kRuntimeSlabId) {
+    map_proclet_heap(slab, slab_id);
+  }
 }
 
 inline void SlabAllocator::deregister_slab_by_id(SlabId_t slab_id) {
-  BUG_ON(!slabs_[slab_id]);
+  auto *slab = slabs_[slab_id];
+  BUG_ON(!slab);
+  if (slab->headerless_ && slab_id != kRuntimeSlabId) {
+    map_proclet_heap(slab, 0);
+  }
   slabs_[slab_id] = nullptr;
 }
 
-inline uint64_t SlabAllocator::FreePtrsLinkedList::size() { return size_; }
+inline uint64_t SlabAllocator::FreePtrsLinkedList::size() const {
+  return size_;
+}
 
 }  // namespace nu
@@ -1,4 +1,6 @@
 #include "nu/cereal.hpp"
+#include "nu/utils/compaction.hpp"
+#include "nu/utils/slab.hpp"
 
 namespace nu {
 
@@ -536,6 +538,43 @@ SyncHashMap<NBuckets, K, V, Hash, KeyEqual, Allocator,
   return hashes_and_keys;
 }
 
+template <size_t NBuckets, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+bool SyncHashMap<NBuckets, K, V, Hash, KeyEqual, Allocator, Lock>::compact(
+    size_t num_buckets) {
+  auto *slab = get_compaction_slab();
+  if (!should_compact(slab)) {
+    return false;
+  }
+
+  RelocationRun node_run(slab, sizeof(BucketNode));
+  RelocationRun pair_run(slab, sizeof(Pair));
+  for (size_t i = 0; i < num_buckets; i++) {
+    auto &bucket_head = bucket_heads_[compact_cursor_];
+    auto &lock = bucket_head.lock;
+    auto *bucket_node = &bucket_head.node;
+    BucketNode **prev_next = nullptr;
+    lock.lock();
+    while (bucket_node && bucket_node->pair) {
+      if (prev_next) {
+        bucket_node = *prev_next =
+            relocate<BucketNodeAllocator>(&node_run, bucket_node);
+      }
+      bucket_node->pair = relocate<Allocator>(
+          &pair_run, reinterpret_cast<Pair *>(bucket_node->pair));
+      prev_next = &bucket_node->next;
+      bucket_node = bucket_node->next;
+    }
+    lock.unlock();
+
+    if (++compact_cursor_ == NBuckets) {
+      compact_cursor_ = 0;
+      slab->scavenge();
+    }
+  }
+  return true;
+}
+
 template <size_t NBuckets, typename K, typename V, typename Hash,
           typename KeyEqual, typename Allocator, typename Lock>
 template <class Archive>
@@ -1,4 +1,6 @@
 #include "nu/cereal.hpp"
+#include "nu/utils/compaction.hpp"
+#include "nu/utils/slab.hpp"
 
 namespace nu {
 
@@ -138,6 +140,45 @@ void SyncVector<NZones, T, Allocator, Lock>::resize(uint64_t new_capacity) {
     capacity_ = new_capacity;     
 }
 
+template <size_t NZones, typename T, typename Allocator, typename Lock>
+bool SyncVector<NZones, T, Allocator, Lock>::compact(size_t num_zones) {
+    auto *slab = get_compaction_slab();
+    if (!should_compact(slab)) {
+        return false;
+    }
+
+    VectorAllocator vecAllocator;
+    // Zones of the same capacity share a run.
+    std::map<size_t, RelocationRun> runs;
+    bool pass_done = false;
+    lock_.lock();
+    for (size_t i = 0; i < num_zones; i++) {
+        auto &zone = zones_[compact_cursor_];
+        auto &data_ = zone.data_;
+        zone.lock.lock();
+        auto size = zone.capacity_per_zone_ * sizeof(T);
+        auto &run = runs.try_emplace(size, slab, size).first->second;
+        auto *new_data = reinterpret_cast<T *>(run.take_below(data_));
+        if (new_data) {
+            std::move(data_, data_ + zone.size_per_zone_, new_data);
+            vecAllocator.deallocate(data_, zone.capacity_per_zone_);
+            data_ = new_data;
+        }
+        zone.lock.unlock();
+
+        if (++compact_cursor_ == NZones) {
+            compact_cursor_ = 0;
+            pass_done = true;
+        }
+    }
+    lock_.unlock();
+
+    if (pass_done) {
+        slab->scavenge();
+    }
+    return true;
+}
+
 template <size_t NZones, typename T, typename Allocator, typename Lock>
 T *SyncVector<NZones, T, Allocator, Lock>::get(uint64_t &&idx) {
     // lock_.lock();
@@ -7,6 +7,10 @@ template <typename T>
 class RemUniquePtr;
 template <typename T>
 class RemSharedPtr;
+template <typename T>
+class Borrowed;
+template <typename T>
+class Moved;
 
 template <class T>
 inline consteval bool is_safe_to_move() {
@@ -18,6 +22,13 @@ inline consteval bool is_safe_to_move() {
           std::is_same_v<std::decay_t<T>, DistributedMemPool>);
 }
 
+template <class... Ts>
+inline consteval bool requires_pinned_call() {
+  return ((is_specialization_of_v<std::decay_t<Ts>, Borrowed> ||
+           is_specialization_of_v<std::decay_t<Ts>, Moved>) ||
+          ... || false);
+}
+
 template <typename T>
 inline T &&pass_across_proclet(T &&t) requires(is_safe_to_move<T &&>()) {
   return std::move(t);
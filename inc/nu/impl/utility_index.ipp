@@ -0,0 +1,51 @@
+#include <cmath>
+
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+inline uint32_t UtilityIndex::to_bucket(float util) {
+  if (!(util > 0)) {
+    return 0;
+  }
+  int exp;
+  auto frac = std::frexp(util, &exp);
+  // util is in [2^(exp - 1), 2^exp).
+  auto floor_exp = exp - 1;
+  if (floor_exp < kMinExp) {
+    return 0;
+  }
+  if (floor_exp >= kMaxExp) {
+    return kNumBuckets - 1;
+  }
+  auto sub_bucket =
+      static_cast<uint32_t>((frac * 2 - 1) * kNumBucketsPerDoubling);
+  return 1 + (floor_exp - kMinExp) * kNumBucketsPerDoubling + sub_bucket;
+}
+
+inline uint32_t UtilityIndex::to_idx(ProcletHeader *header) {
+  return (reinterpret_cast<uint64_t>(header) - kMinProcletHeapVAddr) /
+         kMinProcletHeapSize;
+}
+
+inline ProcletHeader *UtilityIndex::to_header(uint32_t idx) {
+  return reinterpret_cast<ProcletHeader *>(kMinProcletHeapVAddr +
+                                           idx * kMinProcletHeapSize);
+}
+
+template <typename F>
+inline void UtilityIndex::for_each_top(Kind kind, F &&f) {
+  ScopedLock lock(&spin_);
+
+  for (auto bucket = kNumBuckets; bucket-- > 0;) {
+    for (auto idx = heads_[kind][bucket]; idx != kNil;) {
+      auto next = entries_[idx].nexts[kind];
+      if (!f(to_header(idx))) {
+        return;
+      }
+      idx = next;
+    }
+  }
+}
+
+}  // namespace nu
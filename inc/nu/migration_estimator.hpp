@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "nu/commons.hpp"
+#include "nu/utility_index.hpp"
+#include "nu/utils/spin_lock.hpp"
+
+namespace nu {
+
+struct MigrationTimeRecord {
+  ProcletID id;
+  NodeIP dest_ip;
+  uint64_t size;
+  float predicted_us;
+  float actual_us;
+};
+
+// Models the time to migrate a proclet as a fixed overhead plus its size over
+// the throughput, both fitted online from the migrations that completed. Every
+// destination gets its own fit besides the one over all destinations, as links
+// differ in speed and in how much they are shared.
+class MigrationEstimator {
+ public:
+  constexpr static double kEWMAWeight = 0.1;
+  // Fitting the fixed overhead as well needs enough samples whose sizes vary
+  // by at least kMinRelSizeStddev.
+  constexpr static uint32_t kMinNumSamplesForFixedCost = 8;
+  constexpr static double kMinRelSizeStddev = 0.1;
+  constexpr static uint32_t kMaxNumRecords = 1024;
+
+  MigrationEstimator();
+  // Uses the fit over all destinations if dest_ip is 0 or not seen yet.
+  float predict_us(NodeIP dest_ip, uint64_t size);
+  void add(const MigrationTimeRecord &record);
+  float get_fixed_cost_us(NodeIP dest_ip);
+  float get_net_bw_gbps(NodeIP dest_ip);
+  // The latest kMaxNumRecords migrations, oldest first.
+  std::vector<MigrationTimeRecord> get_records();
+
+ private:
+  struct Model {
+    // Readable without the lock.
+    std::atomic<float> fixed_cost_us{Utility::kFixedCostUs};
+    std::atomic<float> us_per_byte{8.0f / Utility::kNetBwGbps / 1000};
+    uint32_t num_samples = 0;
+    // Moving averages of the sizes, times, and their products.
+    double mean_size = 0;
+    double mean_us = 0;
+    double mean_size_sq = 0;
+    double mean_size_us = 0;
+
+    float predict_us(uint64_t size) const;
+    void add(uint64_t size, float actual_us);
+  };
+
+  Model global_model_;
+  std::unordered_map<NodeIP, Model> dest_models_;
+  std::deque<MigrationTimeRecord> records_;
+  SpinLock spin_;
+
+  Model *get_model(NodeIP dest_ip);
+};
+
+}  // namespace nu
@@ -17,6 +17,8 @@ extern "C" {
 #include <sync.h>
 
 #include "nu/ctrl_client.hpp"
+#include "nu/handler_registry.hpp"
+#include "nu/migration_estimator.hpp"
 #include "nu/rpc_server.hpp"
 #include "nu/utils/archive_pool.hpp"
 #include "nu/utils/rpc.hpp"
@@ -51,7 +53,7 @@ struct RPCReqForward {
 
 struct RPCReqMigrateThreadAndRetVal {
   RPCReqType rpc_type = kMigrateThreadAndRetVal;
-  RPCReturnCode (*handler)(ProcletHeader *, void *, uint64_t, uint8_t *);
+  HandlerID handler_id;
   ProcletHeader *dest_proclet_header;
   void *dest_ret_val_ptr;
   uint64_t payload_len;
@@ -110,6 +112,10 @@ class Migrator {
 
   static_assert(kTransmitProcletNumThreads > 1);
 
+  using ThreadLoader = RPCReturnCode (*)(ProcletHeader *, void *, uint64_t,
+                                         uint8_t *);
+  using ThreadLoaders = HandlerRegistry<ThreadLoader>;
+
   Migrator();
   ~Migrator();
   uint32_t migrate(
@@ -119,6 +125,7 @@ class Migrator {
                                   uint64_t payload_len, const void *payload,
                                   ArchivePool<>::IASStream *ia_sstream);
   void forward_to_client(RPCReqForward &req);
+  MigrationEstimator *estimator();
   template <typename RetT>
   static MigrationGuard migrate_thread_and_ret_val(
       RPCReturnBuffer &&ret_val_buf, ProcletID dest_id, RetT *dest_ret_val_ptr,
@@ -135,6 +142,7 @@ class Migrator {
   std::set<rt::TcpConn *> callback_conns_;
   bool callback_triggered_;
   std::unordered_set<uint32_t> delayed_srv_ips_;
+  MigrationEstimator estimator_;
   rt::Thread th_;
 
   void run_background_loop();
@@ -173,8 +181,12 @@ class Migrator {
   void aux_handlers_enable_polling(uint32_t dest_ip);
   void aux_handlers_disable_polling();
   void callback();
-  uint32_t __migrate(const NodeGuard &dest_guard, bool mem_pressure,
+  // Streams the tasks already sent over conn to the destination.
+  uint32_t __migrate(rt::TcpConn *conn, NodeIP dest_ip, bool mem_pressure,
                      const std::vector<ProcletMigrationTask> &tasks);
+  bool has_replica_peer_at(
+      ProcletHeader *proclet_header, NodeIP ip,
+      const std::vector<ProcletMigrationTask> &cur_round_tasks);
   void pause_migrating_threads(ProcletHeader *proclet_header);
   void post_migration_cleanup(ProcletHeader *proclet_header);
   template <typename RetT>
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <optional>
+#include <type_traits>
+
+#include "nu/type_traits.hpp"
+
+namespace nu {
+
+// Opt-in argument passing modes that skip the deep copy pass_across_proclet()
+// does on the local fast path; on the slow path they are serialized as usual.
+// As the callee may then reference the caller's heap, a call carrying them
+// only compiles with MigrEn = false (and never through run_async()), and the
+// caller won't be migrated until the call returns. Neither of them may outlive
+// the call, so neither can be moved; only the dispatch path hands them over
+// from one hop to the next through a PassToken.
+
+class ProcletServer;
+template <typename T>
+class Proclet;
+
+template <typename P>
+class PassToken {
+ private:
+  P *from_;
+
+  PassToken(P *from);
+  friend P;
+  friend class ArgRelay;
+};
+
+// The dispatch-side helpers that pass arguments along a call.
+class ArgRelay {
+ private:
+  // Passes an argument stored by the dispatch path on to the next hop.
+  template <typename T>
+  static decltype(auto) pass_on(T &t);
+  // Passes a caller's argument into the callee's proclet.
+  template <typename T>
+  static decltype(auto) pass_across(T &&t);
+
+  friend class ProcletServer;
+  template <typename T>
+  friend class Proclet;
+};
+
+// The type an argument of type T reaches the callee's parameter as.
+template <typename T>
+using passed_arg_t =
+    std::conditional_t<requires_pinned_call<T>(), PassToken<std::decay_t<T>>,
+                       T &&>;
+
+// A read-only view of an object owned by the caller.
+template <typename T>
+class Borrowed {
+ public:
+  Borrowed();
+  Borrowed(PassToken<Borrowed> token);
+  Borrowed(const Borrowed &) = delete;
+  Borrowed &operator=(const Borrowed &) = delete;
+  Borrowed(Borrowed &&) = delete;
+  Borrowed &operator=(Borrowed &&) = delete;
+  const T &operator*() const;
+  const T *operator->() const;
+  const T &get() const;
+
+  template <class Archive>
+  void save(Archive &ar) const;
+  template <class Archive>
+  void load(Archive &ar);
+
+ private:
+  const T *ptr_;
+  std::optional<T> owned_;  // Only set if received through RPC.
+
+  Borrowed(const T *ptr);
+  template <typename U>
+  friend Borrowed<U> borrow(const U &u);
+};
+
+// An object the caller gives up. It stays in the caller's heap until the
+// callee take()s it, so objects that are only consumed during the call are
+// never copied.
+template <typename T>
+class Moved {
+ public:
+  Moved();
+  Moved(PassToken<Moved> token);
+  Moved(const Moved &) = delete;
+  Moved &operator=(const Moved &) = delete;
+  Moved(Moved &&) = delete;
+  Moved &operator=(Moved &&) = delete;
+  T &operator*();
+  T *operator->();
+  T &get();
+  // Returns an object owned by the current proclet's heap.
+  T take();
+
+  template <class Archive>
+  void save(Archive &ar) const;
+  template <class Archive>
+  void load(Archive &ar);
+
+ private:
+  std::optional<T> obj_;
+  bool foreign_;  // Whether obj_ lives in another proclet's heap.
+
+  Moved(T &&t);
+  template <typename U>
+  friend Moved<std::decay_t<U>> move_across(U &&u) requires(
+      std::is_rvalue_reference_v<U &&>);
+};
+
+template <typename T>
+Borrowed<T> borrow(const T &t);
+template <typename T>
+Moved<std::decay_t<T>> move_across(T &&t) requires(
+    std::is_rvalue_reference_v<T &&>);
+
+}  // namespace nu
+
+#include "nu/impl/pass_across.ipp"
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+
+#include "nu/commons.hpp"
+
+namespace nu {
+
+struct NodeStatus;
+using NodeStatuses = std::map<NodeIP, NodeStatus>;
+
+// Picks the node for a new proclet among the nodes of its LP, judging them by
+// the free resources they last reported. Isolated nodes are never picked.
+// Calls may come in concurrently for different LPs.
+class PlacementPolicy {
+ public:
+  virtual ~PlacementPolicy() = default;
+  // Returns 0 if no node has room for demand.
+  virtual NodeIP select(const NodeStatuses &node_statuses,
+                        Resource demand) = 0;
+};
+
+// Cycles through the nodes that have room.
+class RoundRobinPolicy : public PlacementPolicy {
+ public:
+  NodeIP select(const NodeStatuses &node_statuses, Resource demand) override;
+
+ private:
+  std::atomic<NodeIP> last_ip_{0};
+};
+
+// The node with the most free cores, breaking ties by free memory.
+class LeastLoadedPolicy : public PlacementPolicy {
+ public:
+  NodeIP select(const NodeStatuses &node_statuses, Resource demand) override;
+};
+
+// The better of two random nodes that have room, which is almost as good as
+// least-loaded but doesn't send every burst of proclets to the same node.
+class PowerOfTwoChoicesPolicy : public PlacementPolicy {
+ public:
+  NodeIP select(const NodeStatuses &node_statuses, Resource demand) override;
+};
+
+// Packs proclets that need at least min_mem_mbs into the node with the least
+// free memory that still fits them, which leaves the large free spaces for
+// later heavy proclets. The others are left to light_policy.
+class BinPackingPolicy : public PlacementPolicy {
+ public:
+  BinPackingPolicy(float min_mem_mbs,
+                   std::unique_ptr<PlacementPolicy> light_policy);
+  NodeIP select(const NodeStatuses &node_statuses, Resource demand) override;
+
+ private:
+  float min_mem_mbs_;
+  std::unique_ptr<PlacementPolicy> light_policy_;
+};
+
+}  // namespace nu
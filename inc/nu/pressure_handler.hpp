@@ -10,6 +10,7 @@ extern "C" {
 #include <net.h>
 
 #include "nu/migrator.hpp"
+#include "nu/utility_index.hpp"
 
 namespace nu {
 
@@ -23,25 +24,14 @@ struct AuxHandlerState {
   bool done = false;
 };
 
-struct Utility {
-  Utility();
-  Utility(ProcletHeader *proclet_header, uint64_t mem_size, float cpu_load);
-
-  constexpr static uint32_t kFixedCostUs = 25;
-  constexpr static uint32_t kNetBwGbps = 100;
-  ProcletHeader *header;
-  float mem_pressure_util;
-  float cpu_pressure_util;
-};
-
 class PressureHandler {
  public:
   constexpr static uint32_t kNumAuxHandlers =
       Migrator::kTransmitProcletNumThreads - 1;
-  constexpr static uint32_t kSortedProcletsUpdateIntervalMs = 200;
-  constexpr static uint32_t kUpdateBudget = 200;
+  constexpr static uint32_t kAffinitiesUpdateIntervalMs = 200;
   constexpr static uint32_t kHandlerSleepUs = 100;
   constexpr static uint32_t kMinNumProcletsOnCPUPressure = 32;
+  constexpr static uint64_t kMigrationCooldownUs = kOneSecond;
 
   PressureHandler();
   ~PressureHandler();
@@ -59,20 +49,6 @@ class PressureHandler {
   void set_handled();
 
  private:
-  struct CmpMemUtil {
-    bool operator()(const Utility &x, const Utility &y) const {
-      return x.mem_pressure_util > y.mem_pressure_util;
-    }
-  };
-  struct CmpCpuUtil {
-    bool operator()(const Utility &x, const Utility &y) const {
-      return x.cpu_pressure_util > y.cpu_pressure_util;
-    }
-  };
-  std::shared_ptr<std::multiset<Utility, CmpMemUtil>>
-      mem_pressure_sorted_proclets_;
-  std::shared_ptr<std::multiset<Utility, CmpCpuUtil>>
-      cpu_pressure_sorted_proclets_;
   rt::Thread update_th_;
   std::atomic<int> active_handlers_;
   AuxHandlerState aux_handler_states_[kNumAuxHandlers];
@@ -81,10 +57,10 @@ class PressureHandler {
 
   std::vector<std::pair<ProcletMigrationTask, Resource>> pick_tasks(
       uint32_t min_num_proclets, uint32_t min_mem_mbs);
-  void update_sorted_proclets();
   void register_handlers();
   void pause_aux_handlers();
   void __main_handler();
+  void migrate_on_pressure();
   void __aux_handler(AuxHandlerState *state);
   static void main_handler(void *unused);
   static void aux_handler(void *args);
@@ -3,8 +3,11 @@
 #include <cstdint>
 #include <optional>
 #include <functional>
+#include <tuple>
+#include <vector>
 
 #include "nu/commons.hpp"
+#include "nu/pass_across.hpp"
 #include "nu/type_traits.hpp"
 #include "nu/utils/future.hpp"
 
@@ -94,6 +97,10 @@ class Proclet {
   template <typename... As>
   static Proclet __create(bool pinned, uint64_t capacity, NodeIP ip_hint,
                           As &&... args);
+  template <typename... As>
+  static std::vector<Proclet> __create_batch(uint32_t num, bool pinned,
+                                             uint64_t capacity, NodeIP ip_hint,
+                                             As &&... args);
   template <bool MigrEn = true, bool CPUMon = true, bool CPUSamp = true,
             typename RetT, typename... S0s, typename... S1s>
   Future<RetT> __run_async(RetT (*fn)(T &, S0s...), S1s &&... states);
@@ -121,6 +128,14 @@ class Proclet {
   template <typename U>
   friend Future<Proclet<U>> make_proclet_async(bool, std::optional<uint64_t>,
                                                std::optional<NodeIP>);
+  template <typename U, typename... As>
+  friend std::vector<Proclet<U>> make_proclets(uint32_t, std::tuple<As...>,
+                                               bool, std::optional<uint64_t>,
+                                               std::optional<NodeIP>);
+  template <typename U>
+  friend std::vector<Proclet<U>> make_proclets(uint32_t, bool,
+                                               std::optional<uint64_t>,
+                                               std::optional<NodeIP>);
 };
 
 template <typename T>
@@ -164,6 +179,20 @@ template <typename T>
 Future<Proclet<T>> make_proclet_async(
     bool pinned = false, std::optional<uint64_t> capacity = std::nullopt,
     std::optional<uint32_t> ip_hint = std::nullopt);
+// Creates num proclets of the same type, each constructed from its own copy of
+// args_tuple. Much cheaper than num make_proclet() calls, as the heap segments
+// are allocated through a single controller RPC and the constructions are
+// batched per destination node.
+template <typename T, typename... As>
+std::vector<Proclet<T>> make_proclets(
+    uint32_t num, std::tuple<As...> args_tuple, bool pinned = false,
+    std::optional<uint64_t> capacity = std::nullopt,
+    std::optional<uint32_t> ip_hint = std::nullopt);
+template <typename T>
+std::vector<Proclet<T>> make_proclets(
+    uint32_t num, bool pinned = false,
+    std::optional<uint64_t> capacity = std::nullopt,
+    std::optional<uint32_t> ip_hint = std::nullopt);
 
 }  // namespace nu
 
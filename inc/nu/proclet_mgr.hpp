@@ -14,8 +14,10 @@ extern "C" {
 #include <runtime/thread.h>
 }
 #include <sync.h>
+#include <thread.h>
 
 #include "nu/commons.hpp"
+#include "nu/utility_index.hpp"
 #include "nu/utils/blocked_syncer.hpp"
 #include "nu/utils/cond_var.hpp"
 #include "nu/utils/counter.hpp"
@@ -68,6 +70,14 @@ struct ProcletHeader {
   // Logical timer.
   Time time;
 
+  // The NUMA node its heap is bound to.
+  uint32_t numa_node;
+
+  // When (in local microtime) and from where it migrated to this node. Both
+  // are 0 if it was created here.
+  uint64_t migrated_in_us;
+  NodeIP migrated_from_ip;
+
   //--- Fields below will be automatically copied during migration. ---/
   uint8_t copy_start[0];
 
@@ -77,12 +87,21 @@ struct ProcletHeader {
   // Ref cnt related.
   int ref_cnt;
 
+  // How many times it has migrated so far.
+  uint32_t num_migrations;
+
+  // The other members of the replica set this proclet belongs to (if any).
+  // Migration never puts two members onto the same node.
+  ProcletID replica_peers[kMaxNumReplicaPeers];
+
   // Heap mem allocator. Must be the last field.
   Counter slab_ref_cnt;
   SlabAllocator slab;
 
   uint64_t global_idx() const;
   uint64_t total_mem_size() const;
+  // Excludes the heap pages that were returned to the OS.
+  uint64_t resident_mem_size() const;
   uint64_t heap_size() const;
   uint64_t stack_size() const;
   uint8_t &status();
@@ -93,7 +112,27 @@ struct ProcletHeader {
 
 class ProcletManager {
  public:
+  constexpr static uint32_t kScavengeIntervalMs = 1000;
+  // Allocation can't block, so heaps are extended ahead of time: once the
+  // region being carved has less than 1 / kHeapGrowDivisor of the capacity
+  // left, the slab flags itself and another capacity-sized segment is fetched
+  // from the controller within kHeapGrowIntervalMs.
+  constexpr static uint32_t kHeapGrowIntervalMs = 10;
+  constexpr static uint64_t kHeapGrowDivisor = 4;
+  // Loads decay and migration penalties wear off without any event, so every
+  // proclet is also re-scored once per kRescoreIntervalMs, a slice of them
+  // each kHeapGrowIntervalMs.
+  constexpr static uint32_t kRescoreIntervalMs = 100;
+  // A heap is moved to the NUMA node that runs at least kNumaRebalanceRatio of
+  // its proclet's sampled invocations, given at least kMinNumaSamples of them.
+  constexpr static uint64_t kMinNumaSamples = 64;
+  constexpr static float kNumaRebalanceRatio = 0.75;
+  // The pages are copied synchronously, so a rebalance stops after moving
+  // this many bytes.
+  constexpr static uint64_t kMaxNumaRebalanceBytes = 64ULL << 20;
+
   ProcletManager();
+  ~ProcletManager();
 
   static void setup(void *proclet_base, uint64_t capacity, bool migratable,
                     bool from_migration);
@@ -111,14 +150,32 @@ class ProcletManager {
   std::optional<RetT> get_proclet_info(
       const ProcletHeader *header,
       std::function<RetT(const ProcletHeader *)> f);
+  UtilityIndex *utility_index();
+  // Re-indexes the proclet; called whenever its load or memory usage changes
+  // significantly, and periodically otherwise.
+  void update_utility(ProcletHeader *proclet_header);
+  // Moves heaps to the NUMA nodes that mostly run their proclets. Returns the
+  // number of heaps moved, 0 if another rebalance is in progress.
+  uint32_t rebalance_numa();
 
  private:
   std::vector<void *> present_proclets_;
   uint32_t num_present_proclets_;
   SpinLock spin_;
+  UtilityIndex utility_index_;
+  // Where the next slice to re-score starts in present_proclets_.
+  uint32_t rescore_cursor_;
+  Mutex numa_mutex_;
+  rt::Thread scavenge_th_;
+  bool done_;
   friend class Test;
 
   bool __remove(void *proclet_base, ProcletStatus new_status);
+  void scavenge();
+  void grow_heaps();
+  void rescore_some();
+  static bool bind_heap(ProcletHeader *proclet_header, uint32_t node,
+                        bool move);
 };
 
 }  // namespace nu
@@ -9,6 +9,8 @@ extern "C" {
 }
 #include <sync.h>
 
+#include "nu/handler_registry.hpp"
+#include "nu/pass_across.hpp"
 #include "nu/utils/archive_pool.hpp"
 #include "nu/utils/counter.hpp"
 #include "nu/utils/rpc.hpp"
@@ -20,6 +22,10 @@ struct ProcletHeader;
 
 class ProcletServer {
  public:
+  using GenericHandler = void (*)(ArchivePool<>::IASStream *ia_sstream,
+                                  RPCReturner *returner);
+  using Handlers = HandlerRegistry<GenericHandler>;
+
   ProcletServer();
   ~ProcletServer();
   netaddr get_addr() const;
@@ -34,6 +40,9 @@ class ProcletServer {
   static void construct_proclet(ArchivePool<>::IASStream *ia_sstream,
                                 RPCReturner *returner);
   template <typename Cls, typename... As>
+  static void construct_proclets(ArchivePool<>::IASStream *ia_sstream,
+                                 RPCReturner *returner);
+  template <typename Cls, typename... As>
   static void construct_proclet_locally(MigrationGuard &&caller_guard,
                                         void *base, uint64_t size, bool pinned,
                                         As &&... args);
@@ -52,15 +61,14 @@ class ProcletServer {
                                   std::tuple<Ss...> *states);
 
  private:
-  using GenericHandler = void (*)(ArchivePool<>::IASStream *ia_sstream,
-                                  RPCReturner *returner);
-
   TraceLogger trace_logger_;
   Counter ref_cnt_;
   friend class RPCServer;
   friend class Migrator;
 
   void dec_ref_cnt();
+  template <bool CPUSamp>
+  static void end_cpu_monitor(ProcletHeader *callee_header);
   static void forward(RPCReturnCode rc, RPCReturner *returner,
                       const void *payload, uint64_t payload_len);
   void parse_and_run_handler(std::span<std::byte> args, RPCReturner *returner);
@@ -68,6 +76,10 @@ class ProcletServer {
   static void __construct_proclet(MigrationGuard *callee_guard, Cls *obj,
                                   ArchivePool<>::IASStream *ia_sstream,
                                   RPCReturner returner);
+  template <typename Cls, typename... As>
+  static void __construct_proclet_copied(MigrationGuard *callee_guard,
+                                         Cls *obj,
+                                         std::tuple<As...> *args);
   template <typename Cls>
   static void __update_ref_cnt(MigrationGuard *callee_guard, Cls *obj,
                                ArchivePool<>::IASStream *ia_sstream,
@@ -77,7 +89,7 @@ class ProcletServer {
             typename FnPtr, typename... S1s>
   static void __run_closure(MigrationGuard *callee_guard, Cls *obj,
                             ArchivePool<>::IASStream *ia_sstream,
-                            RPCReturner returner);
+                            RPCReturner returner, FnPtr fn);
 };
 }  // namespace nu
 
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+#include "nu/proclet.hpp"
+#include "nu/utils/future.hpp"
+#include "nu/utils/mutex.hpp"
+#include "nu/utils/read_skewed_lock.hpp"
+#include "nu/utils/scoped_lock.hpp"
+#include "nu/utils/thread.hpp"
+
+namespace nu {
+
+enum ReplicationMode {
+  // Mutations return after every replica has applied them.
+  kSyncReplication,
+  // Mutations return after the primary has applied them; replicas catch up
+  // within the staleness bound.
+  kBoundedStaleness,
+};
+
+// A proclet with K read-only replicas placed on different nodes, where K is
+// capped by the number of the other nodes (see get_num_replicas()). Const
+// methods (and read()) run on a local replica if there is one, otherwise on
+// the least-loaded one. Mutations (non-const methods and write()) run on the
+// primary and are replayed on the replicas in the same order, so they must
+// be deterministic.
+template <typename T>
+class ReplicatedProclet {
+ public:
+  constexpr static uint32_t kDefaultNumReplicas = 2;
+  constexpr static uint32_t kMaxNumReplicas = kMaxNumReplicaPeers;
+  constexpr static uint64_t kDefaultMaxStalenessUs = 10 * kOneMilliSecond;
+  constexpr static uint32_t kMaxLogSize = 1024;
+  constexpr static uint64_t kLoadRefreshIntervalUs = 10 * kOneMilliSecond;
+
+  ReplicatedProclet();
+  ReplicatedProclet(const ReplicatedProclet &o);
+  ReplicatedProclet &operator=(const ReplicatedProclet &o);
+  ReplicatedProclet(ReplicatedProclet &&o) = default;
+  ReplicatedProclet &operator=(ReplicatedProclet &&o) = default;
+  template <typename RetT, typename... S0s, typename... S1s>
+  RetT read(RetT (*fn)(const T &, S0s...),
+            S1s &&... states) requires ValidInvocationTypes<RetT, S0s...>;
+  template <typename RetT, typename... S0s, typename... S1s>
+  RetT write(RetT (*fn)(T &, S0s...),
+             S1s &&... states) requires ValidInvocationTypes<RetT, S0s...>;
+  template <typename RetT, typename... A0s, typename... A1s>
+  RetT run(RetT (T::*md)(A0s...) const,
+           A1s &&... args) requires ValidInvocationTypes<RetT, A0s...>;
+  template <typename RetT, typename... A0s, typename... A1s>
+  RetT run(RetT (T::*md)(A0s...),
+           A1s &&... args) requires ValidInvocationTypes<RetT, A0s...>;
+  uint32_t get_num_replicas() const;
+  ReplicationMode get_mode() const;
+
+  template <class Archive>
+  void serialize(Archive &ar);
+
+ private:
+  struct Replica {
+    template <typename... As>
+    Replica(ReplicationMode mode, uint64_t max_staleness_us, As... args);
+    ~Replica();
+
+    T obj;
+    ReadSkewedLock lock;
+    uint64_t version;
+    ReplicationMode mode;
+    uint64_t max_staleness_us;
+
+    // Fields below are only used by the primary.
+    std::vector<Proclet<Replica>> followers;
+    Mutex write_mutex;
+    // Serializes the replays of the log entries taken out under write_mutex.
+    Mutex flush_mutex;
+    std::vector<std::move_only_function<void(Proclet<Replica> &)>> log;
+    uint64_t oldest_log_us;
+    Thread flusher;
+    bool done;
+
+    template <typename RetT, typename... S0s>
+    RetT read(MethodPtr<RetT (*)(const T &, S0s...)> fn, S0s... states);
+    template <typename RetT, typename... S0s>
+    RetT write(MethodPtr<RetT (*)(T &, S0s...)> fn, S0s... states);
+    template <typename RetT, typename... S0s>
+    RetT apply(uint64_t new_version, MethodPtr<RetT (*)(T &, S0s...)> fn,
+               S0s... states);
+    template <typename... As>
+    std::vector<WeakProclet<Replica>> create_followers(
+        uint32_t num_followers, bool pinned, std::optional<uint64_t> capacity,
+        std::tuple<ReplicationMode, uint64_t, As...> ctor_args);
+    void flush(ScopedLock<Mutex> write_guard);
+  };
+
+  // The replicas' load as last seen by this handle. It may be shared by
+  // multiple threads, so every field is updated atomically and only one
+  // thread refreshes it at a time; the others keep using the old values.
+  struct LoadCache {
+    LoadCache();
+
+    std::atomic<float> free_cores[kMaxNumReplicas + 1];
+    std::atomic<uint64_t> last_refresh_us;
+    std::atomic<uint32_t> next_idx;
+    Mutex refresh_mutex;
+  };
+
+  Proclet<Replica> primary_;
+  // Includes the primary at index 0.
+  std::vector<WeakProclet<Replica>> replicas_;
+  ReplicationMode mode_;
+  // Not shared by copies of the handle.
+  std::unique_ptr<LoadCache> load_cache_;
+
+  WeakProclet<Replica> pick_replica();
+  void refresh_free_cores();
+  template <typename U, typename... As>
+  friend ReplicatedProclet<U> make_replicated_proclet(
+      std::tuple<As...> args_tuple, uint32_t num_replicas,
+      ReplicationMode mode, uint64_t max_staleness_us, bool pinned,
+      std::optional<uint64_t> capacity);
+};
+
+template <typename T, typename... As>
+ReplicatedProclet<T> make_replicated_proclet(
+    std::tuple<As...> args_tuple,
+    uint32_t num_replicas = ReplicatedProclet<T>::kDefaultNumReplicas,
+    ReplicationMode mode = kSyncReplication,
+    uint64_t max_staleness_us = ReplicatedProclet<T>::kDefaultMaxStalenessUs,
+    bool pinned = false, std::optional<uint64_t> capacity = std::nullopt);
+
+}  // namespace nu
+
+#include "nu/impl/replicated_proclet.ipp"
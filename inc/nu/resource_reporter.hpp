@@ -1,3 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
 extern "C" {
 #include <runtime/report.h>
 }
@@ -5,22 +12,66 @@ extern "C" {
 #include <thread.h>
 
 #include "nu/commons.hpp"
+#include "nu/rpc_server.hpp"
 
 namespace nu {
 
+struct GossipEntry {
+  NodeIP ip;
+  Resource resource;
+  uint64_t seq;  // Bumped by ip on every change, so the newer entry wins.
+};
+
+struct RPCReqGossipResources {
+  RPCReqType rpc_type = kGossipResources;
+  uint64_t num_entries;
+  GossipEntry entries[0];
+};
+
 class ResourceReporter {
  public:
+  // Changes smaller than these aren't worth a report.
+  constexpr static float kMinReportCoresDelta = 0.5;
+  constexpr static float kMinReportMemMbsDelta = 256;
+  // Report anyway after this many skipped ones, so that the controller's
+  // averages catch up.
+  constexpr static uint32_t kMaxNumSkippedReports = 16;
+  // With gossip (see set_gossip()), nodes push their views to each other
+  // instead of pulling the view from the controller on every report.
+  constexpr static uint64_t kGossipIntervalUs = 10 * kOneMilliSecond;
+  // With gossip on, the controller's view is pulled only this often to track
+  // the nodes joining and leaving.
+  constexpr static uint32_t kGossipViewRefreshInterval = 16;
+
   ResourceReporter();
   ~ResourceReporter();
   std::vector<std::pair<NodeIP, Resource>> get_global_free_resources();
+  void merge_gossip(std::span<const GossipEntry> entries);
+  // Off by default. Only affects this node.
+  void set_gossip(bool enabled);
+  bool is_gossip_enabled() const;
 
  private:
   bool done_;
   rt::Thread th_;
-  std::vector<std::pair<NodeIP, Resource>> global_free_resources_;
+  bool gossip_enabled_;
+  rt::Thread gossip_th_;
+  rt::Mutex gossip_mutex_;
+  // Sorted by ip.
+  std::vector<GossipEntry> view_;
+  uint64_t view_version_;
+  Resource last_reported_;
+  uint32_t num_skipped_reports_;
+  uint32_t num_reports_;
+  uint64_t seq_;
   rt::Spin spin_;
 
   void report_resource();
+  bool should_report(Resource resource);
+  void update_view(std::vector<std::pair<NodeIP, Resource>> &&view,
+                   bool keep_gossiped);
+  void update_self(Resource resource);
+  void gossip();
 };
 
 }  // namespace nu
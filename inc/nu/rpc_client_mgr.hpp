@@ -2,6 +2,7 @@
 
 #include <limits>
 #include <memory>
+#include <span>
 #include <unordered_map>
 #include <utility>
 
@@ -24,6 +25,10 @@ class RPCClientMgr {
   void remove_by_ip(NodeIP ip);
   void update_cache(ProcletID proclet_id, NodeIP ip);
   void invalidate_cache(ProcletID proclet_id, RPCClient *old_client);
+  // Resolves the uncached ones in bulk instead of one by one on first use.
+  void prefetch_locations(std::span<const ProcletID> proclet_ids);
+  // Caches the locations of all proclets of the LP.
+  void warm_up_cache();
 
  private:
   union NodeInfo {  // Supports atomic assignment.
@@ -53,5 +58,6 @@ class RPCClientMgr {
   RPCClient *get_client(NodeInfo info);
   void remove_client(NodeInfo info);
   NodeInfo get_info(ProcletID proclet_id);
+  void fill_cache(ProcletID proclet_id, NodeIP ip);
 };
 }  // namespace nu
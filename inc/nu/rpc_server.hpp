@@ -16,17 +16,25 @@ enum RPCReqEnum {
   // Controller
   kRegisterNode,
   kAllocateProclet,
+  kAllocateProclets,
   kDestroyProclet,
+  kAllocateHeapSegment,
+  kFreeHeapSegment,
   kResolveProclet,
+  kResolveProclets,
+  kGetProcletLocations,
   kAcquireMigrationDest,
+  kPlanMigration,
   kAcquireNode,
   kReleaseNode,
   kUpdateLocation,
   kReportFreeResource,
   kDestroyLP,
+  kHeartbeat,
   // Proclet server,
   kProcletCall,
   kGCStack,
+  kGossipResources,
   kShutdown
 };
 
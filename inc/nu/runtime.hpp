@@ -4,6 +4,7 @@
 #include <functional>
 #include <optional>
 #include <utility>
+#include <vector>
 
 #include "exception.h"
 extern "C" {
@@ -28,6 +29,7 @@ class Migrator;
 class RPCServer;
 class PressureHandler;
 class ResourceReporter;
+class CallGraphProfiler;
 template <typename T>
 class WeakProclet;
 class MigrationGuard;
@@ -61,12 +63,13 @@ class Runtime {
   ControllerServer *controller_server();
   ProcletServer *proclet_server();
   ResourceReporter *resource_reporter();
+  CallGraphProfiler *call_graph_profiler();
   Caladan *caladan();
   void reserve_conns(uint32_t ip);
   void init_base();
   void init_runtime_heap();
-  void init_as_controller();
-  void init_as_server(uint32_t remote_ctrl_ip, lpid_t lpid, bool isol);
+  void init_as_controller(std::vector<uint32_t> ctrl_ips);
+  void init_as_server(std::vector<uint32_t> ctrl_ips, lpid_t lpid, bool isol);
   template <typename Cls, typename... A0s, typename... A1s>
   bool run_within_proclet_env(void *proclet_base, void (*fn)(A0s...),
                               A1s &&... args);
@@ -120,13 +123,15 @@ class Runtime {
   ProcletManager *proclet_manager_;
   PressureHandler *pressure_handler_;
   ResourceReporter *resource_reporter_;
+  CallGraphProfiler *call_graph_profiler_;
   StackManager *stack_manager_;
 
   friend int runtime_main_init(int, char **, std::function<void(int, char **)>);
   friend int ctrl_main(int, char **);
 
   Runtime();
-  Runtime(uint32_t remote_ctrl_ip, Mode mode, lpid_t lpid, bool isol);
+  // ctrl_ips lists the primary controller and then its standbys.
+  Runtime(std::vector<uint32_t> ctrl_ips, Mode mode, lpid_t lpid, bool isol);
   template <typename Cls, typename... A0s, typename... A1s>
   bool __run_within_proclet_env(void *proclet_base, void (*fn)(A0s...),
                                        A1s &&... args);
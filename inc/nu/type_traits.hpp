@@ -95,6 +95,10 @@ concept DeepCopyAble = requires(T t) {
 template <class T>
 consteval bool is_safe_to_move();
 
+// Whether passing the types requires both proclets to stay pinned.
+template <class... Ts>
+consteval bool requires_pinned_call();
+
 template <typename T>
 T &&pass_across_proclet(T &&t) requires(is_safe_to_move<T &&>());
 
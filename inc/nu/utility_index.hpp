@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+#include "nu/commons.hpp"
+#include "nu/utils/spin_lock.hpp"
+
+namespace nu {
+
+struct ProcletHeader;
+
+struct Utility {
+  Utility();
+  Utility(ProcletHeader *proclet_header, float migration_us,
+          uint64_t resident_mem_size, float cpu_load, float locality = 0,
+          uint64_t us_since_migration = std::numeric_limits<uint64_t>::max());
+
+  // The cost model of a remote call, which also seeds the migration one.
+  constexpr static uint32_t kFixedCostUs = 25;
+  constexpr static uint32_t kNetBwGbps = 100;
+  // How much the call-graph locality discounts (or boosts) the utility.
+  constexpr static float kAffinityWeight = 0.5;
+  // A proclet that just migrated in is worth nothing, and regains its full
+  // utility over this period, so that it doesn't bounce right back.
+  constexpr static uint64_t kMigrationPenaltyUs = 10 * kOneSecond;
+  ProcletHeader *header;
+  float mem_pressure_util;
+  float cpu_pressure_util;
+};
+
+// Keeps the local migratable proclets bucketed by their utilities, so that the
+// pressure handler reads the top K in O(K) rather than sorting all proclets.
+// A proclet only moves to another bucket once its utility changes by a
+// bucket's width, i.e., by 1 / kNumBucketsPerDoubling of a doubling.
+class UtilityIndex {
+ public:
+  enum Kind { kCpuPressure = 0, kMemPressure, kNumKinds };
+  constexpr static uint32_t kNumBucketsPerDoubling = 4;
+  // Utilities out of [2^kMinExp, 2^kMaxExp) go to the first or last bucket.
+  constexpr static int32_t kMinExp = -32;
+  constexpr static int32_t kMaxExp = 32;
+  constexpr static uint32_t kNumBuckets =
+      (kMaxExp - kMinExp) * kNumBucketsPerDoubling + 1;
+
+  UtilityIndex();
+  void update(const Utility &utility);
+  void remove(ProcletHeader *header);
+  // Calls f on the indexed proclets from the highest utility down until it
+  // returns false. f must not update the index.
+  template <typename F>
+  void for_each_top(Kind kind, F &&f);
+  static uint32_t to_bucket(float util);
+
+ private:
+  constexpr static uint32_t kNil = std::numeric_limits<uint32_t>::max();
+
+  struct Entry {
+    uint32_t prevs[kNumKinds];
+    uint32_t nexts[kNumKinds];
+    uint16_t buckets[kNumKinds];
+    bool indexed;
+  };
+
+  // Indexed by ProcletHeader::global_idx().
+  std::unique_ptr<Entry[]> entries_;
+  uint32_t heads_[kNumKinds][kNumBuckets];
+  SpinLock spin_;
+
+  static uint32_t to_idx(ProcletHeader *header);
+  static ProcletHeader *to_header(uint32_t idx);
+  void link(uint32_t idx, Kind kind, uint16_t bucket);
+  void unlink(uint32_t idx, Kind kind);
+};
+
+}  // namespace nu
+
+#include "nu/impl/utility_index.ipp"
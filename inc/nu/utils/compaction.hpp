@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "nu/utils/slab.hpp"
+
+namespace nu {
+
+// Returns the heap that the calling thread allocates from.
+SlabAllocator *get_compaction_slab();
+// Whether the heap's fragmentation exceeds its compaction ratio.
+bool should_compact(SlabAllocator *slab);
+
+// Overrides the compaction ratio of the calling proclet's heap, or of the
+// runtime heap outside of proclets, until it goes out of scope, e.g., to force
+// compaction in tests.
+class CompactionRatioGuard {
+ public:
+  explicit CompactionRatioGuard(double ratio);
+  CompactionRatioGuard(const CompactionRatioGuard &) = delete;
+  CompactionRatioGuard &operator=(const CompactionRatioGuard &) = delete;
+  ~CompactionRatioGuard();
+
+ private:
+  SlabAllocator *slab_;
+  double old_ratio_;
+};
+
+// The lowest free chunks of the heap that fit objects of one size, which a
+// compaction batch moves its objects into so that they end up packed densely
+// towards the heap base. The chunks left over are freed on destruction.
+class RelocationRun {
+ public:
+  constexpr static uint32_t kRefillSize = 64;
+
+  RelocationRun(SlabAllocator *slab, size_t size);
+  RelocationRun(const RelocationRun &) = delete;
+  RelocationRun &operator=(const RelocationRun &) = delete;
+  ~RelocationRun();
+  // Takes the lowest chunk left if it sits below addr, returns nullptr
+  // otherwise.
+  void *take_below(const void *addr);
+
+ private:
+  SlabAllocator *slab_;
+  size_t size_;
+  // In descending order, so that the lowest one is at the back.
+  std::vector<void *> chunks_;
+  bool drained_;
+};
+
+// Moves *obj into the run's lowest chunk if that sits below it, and frees the
+// old chunk through Allocator, which must allocate from the slab heaps as
+// std::allocator does. Returns the object's address.
+template <typename Allocator>
+std::allocator_traits<Allocator>::value_type *relocate(
+    RelocationRun *run,
+    typename std::allocator_traits<Allocator>::value_type *obj);
+
+// Lets compaction choose where a standard container reallocates its nodes.
+struct RelocationTarget {
+  // Taken by the next single-object allocation.
+  void *chunk = nullptr;
+  // The size of the single objects allocated so far, 0 if none.
+  size_t obj_size = 0;
+};
+
+// Allocates like Allocator, except that a single-object allocation takes the
+// target's chunk if one was handed over.
+template <typename Allocator>
+class RelocatingAllocator : public Allocator {
+ public:
+  using value_type = std::allocator_traits<Allocator>::value_type;
+  using is_always_equal = std::false_type;
+  template <typename U>
+  struct rebind {
+    using other = RelocatingAllocator<
+        typename std::allocator_traits<Allocator>::template rebind_alloc<U>>;
+  };
+
+  RelocatingAllocator() = default;
+  explicit RelocatingAllocator(RelocationTarget *target);
+  template <typename A>
+  RelocatingAllocator(const RelocatingAllocator<A> &o);
+  value_type *allocate(size_t n);
+  RelocationTarget *target() const;
+  template <typename A>
+  bool operator==(const RelocatingAllocator<A> &o) const;
+
+ private:
+  RelocationTarget *target_ = nullptr;
+};
+
+}  // namespace nu
+
+#include "nu/impl/compaction.ipp"
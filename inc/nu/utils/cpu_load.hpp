@@ -1,6 +1,7 @@
 #pragma once
 
 #include "nu/commons.hpp"
+#include "nu/utils/numa.hpp"
 #include "nu/utils/spin_lock.hpp"
 
 namespace nu {
@@ -10,6 +11,11 @@ class CPULoad {
   constexpr static uint32_t kSampleInterval = 32;  // Be power of 2 for speed.
   constexpr static uint32_t kDecayIntervalUs = 100;
   constexpr static float kEMWAWeight = 0.1;
+  // Sampled invocations fold in the load once it's this stale, so that it's
+  // kept fresh without anyone polling it.
+  constexpr static uint32_t kRefreshIntervalUs = 10 * kOneMilliSecond;
+  // The change of the load, in cores, that is worth reporting.
+  constexpr static float kSignificantChange = 0.1;
 
   CPULoad();
   void start_monitor();
@@ -17,6 +23,12 @@ class CPULoad {
   bool is_monitoring() const;
   float get_load() const;
   void zero();
+  // How many of the sampled invocations ran on the node since the last reset.
+  uint64_t get_numa_samples(uint32_t node) const;
+  void zero_numa_samples();
+  // Refreshes the load if it's kRefreshIntervalUs stale. Returns whether it
+  // moved by kSignificantChange since the last time this returned true.
+  bool refresh();
   static void end_monitor();
   static void flush_all();
 
@@ -25,13 +37,16 @@ class CPULoad {
   struct alignas(kCacheLineBytes) {
     uint64_t invocations;
     uint64_t samples;
+    uint64_t numa_samples[kMaxNumNumaNodes];
   } cnts_[kNumCores];
   uint64_t last_sum_cycles_;
   uint64_t last_sum_invocation_cnts_;
   uint64_t last_sum_sample_cnts_;
   uint64_t last_decay_tsc_;
   uint64_t interval_cycles_;
+  uint64_t refresh_cycles_;
   float cpu_load_;
+  float reported_load_;
   bool first_call_;
   SpinLock spin_;
 
@@ -1,5 +1,9 @@
+#pragma once
+
 #include <openssl/md5.h>
 
+#include <cstddef>
+#include <span>
 #include <string>
 
 namespace nu {
@@ -12,6 +16,7 @@ struct MD5Val {
 };
 
 MD5Val get_md5(std::string file_name);
+MD5Val get_md5(std::span<const std::byte> data);
 MD5Val get_self_md5();
 }  // namespace nu
 
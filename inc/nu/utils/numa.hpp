@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+extern "C" {
+#include <base/limits.h>
+}
+
+namespace nu {
+
+constexpr static uint32_t kMaxNumNumaNodes = NNUMA;
+
+uint32_t get_num_numa_nodes();
+// Returns the node of the core that the calling kthread currently runs on.
+uint32_t get_cur_numa_node();
+// Makes the pages of [addr, addr + len) prefer the node's memory. Pages that
+// are already resident get moved over if move is set. Returns false on
+// failure, e.g., if the node doesn't exist.
+bool bind_to_numa_node(void *addr, uint64_t len, uint32_t node, bool move);
+
+}  // namespace nu
@@ -5,7 +5,9 @@
 #include <optional>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include "nu/utils/compaction.hpp"
 #include "nu/utils/cond_var.hpp"
 #include "nu/utils/read_skewed_lock.hpp"
 
@@ -16,6 +18,12 @@ template <typename K, typename V,
 class RCUHashMap {
  public:
   constexpr static uint32_t kReaderWaitFastPathMaxUs = 20;
+  constexpr static uint32_t kCompactionBatchSize = 64;
+
+  RCUHashMap() = default;
+  // The map's allocator points back to relocation_target_.
+  RCUHashMap(const RCUHashMap &) = delete;
+  RCUHashMap &operator=(const RCUHashMap &) = delete;
 
   template <typename K1>
   V *get(K1 &&k);
@@ -34,13 +42,22 @@ class RCUHashMap {
   void for_each(const std::function<bool(const std::pair<const K, V> &)> &fn);
   template <typename K1, typename RetT>
   RetT apply(K1 &&k, const std::function<RetT(std::pair<const K, V> *)> &f);
+  // Opt-in compaction. If the heap is fragmented, moves the nodes of the next
+  // num_buckets buckets under the writer lock into the lowest free chunks that
+  // sit below them, and releases the vacated pages after each full pass.
+  // Invalidates the pointers returned by get(). Returns whether it did so.
+  bool compact(size_t num_buckets = kCompactionBatchSize);
 
  private:
   using Hash = std::hash<K>;
   using KeyEqual = std::equal_to<K>;
 
   ReadSkewedLock lock_;
-  std::unordered_map<K, V, Hash, KeyEqual, Allocator> map_;
+  RelocationTarget relocation_target_;
+  std::unordered_map<K, V, Hash, KeyEqual, RelocatingAllocator<Allocator>>
+      map_{0, Hash(), KeyEqual(),
+           RelocatingAllocator<Allocator>(&relocation_target_)};
+  size_t compact_cursor_ = 0;
 };
 }  // namespace nu
 
@@ -68,7 +68,12 @@ class RPCReturnBuffer {
   std::move_only_function<void()> deleter_fn_;
 };
 
-enum RPCReturnCode { kErrWrongClient = -2, kErrTimeout = -1, kOk = 0 };
+enum RPCReturnCode {
+  kErrUnknownHandler = -3,
+  kErrWrongClient = -2,
+  kErrTimeout = -1,
+  kOk = 0
+};
 
 class RPCReturner {
  public:
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <limits>
+#include <optional>
+#include <ostream>
 #include <stack>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <vector>
 
 #include "nu/commons.hpp"
 #include "nu/utils/caladan.hpp"
@@ -26,11 +31,74 @@ static_assert(sizeof(PtrHeader) % kAlignment == 0);
 
 class SlabAllocator {
  public:
-  constexpr static uint64_t kMaxSlabClassShift = 35;  // 32 GB.
-  constexpr static uint64_t kMinSlabClassShift = 5;   // 32 B.
-  constexpr static uint64_t kMaxNumCacheEntries = 32;
-  constexpr static uint64_t kCacheSizeCutoff = 1024;
+  // Larger objects get page-granular spans of their own.
+  constexpr static uint64_t kMaxSlabClassShift = 18;  // 256 KB.
+  constexpr static uint64_t kMinSlabClassShift = 4;   // 16 B.
+  // Per-core caches of classes up to kCacheSizeCutoff grow on every trip to
+  // the shared lists (faster if spin_ was contended) within these budgets.
+  constexpr static uint64_t kCacheSizeCutoff = 8192;
+  constexpr static uint64_t kMaxCacheBytesPerClass = 256 << 10;
+  constexpr static uint64_t kMaxCacheBytesPerCore = 1 << 20;
+  constexpr static uint64_t kMaxNumScavengedChunks = 1 << 20;
+  constexpr static uint32_t kNumProfiledFrames = 8;
+  constexpr static uint32_t kMaxNumAllocSites = 64;
+  // The slab's own buffer plus the segments it can grow into.
+  constexpr static uint32_t kMaxNumRegions = 16;
+  // Free bytes over used bytes above which the containers' opt-in compact()
+  // relocates the heap's objects, unless overridden per heap.
+  constexpr static double kDefaultCompactionRatio = 0.25;
   static_assert((1 << kMinSlabClassShift) % kAlignment == 0);
+  // Size classes are kAlignment apart up to (1 << kMinSpacedClassShift), above
+  // which every power of two is split into (1 << kLgNumClassesPerDoubling)
+  // evenly spaced classes.
+  constexpr static uint64_t kMinSpacedClassShift = 7;  // 128 B.
+  constexpr static uint64_t kLgNumClassesPerDoubling = 2;
+  constexpr static uint32_t kNumLinearClasses =
+      ((1 << kMinSpacedClassShift) - (1 << kMinSlabClassShift)) / kAlignment +
+      1;
+  constexpr static uint32_t kNumSizeClasses =
+      kNumLinearClasses +
+      ((kMaxSlabClassShift - kMinSpacedClassShift) << kLgNumClassesPerDoubling);
+  // Sizes up to this are mapped to their classes through a lookup table.
+  constexpr static uint64_t kMaxLookupSize = 4096;
+  static_assert((1 << (kMinSpacedClassShift - kLgNumClassesPerDoubling)) %
+                    kAlignment ==
+                0);
+  // In the proclet and runtime heaps, objects of up to
+  // (1 << kMaxSmallClassShift) bytes carry no PtrHeader. They are carved from
+  // runs of kSmallRunSize bytes that each hold a single size class, which is
+  // looked up from the run's address on free.
+  constexpr static uint64_t kSmallRunShift = 16;  // 64 KB.
+  constexpr static uint64_t kSmallRunSize = 1ULL << kSmallRunShift;
+  constexpr static uint64_t kMaxSmallClassShift = 10;  // 1 KB.
+  constexpr static uint32_t kNumSmallClasses =
+      kNumLinearClasses + ((kMaxSmallClassShift - kMinSpacedClassShift)
+                           << kLgNumClassesPerDoubling);
+
+  // A snapshot taken without stopping the allocating cores, so the counters
+  // may be slightly off from each other.
+  struct Stats {
+    struct SizeClass {
+      uint64_t size;
+      uint64_t num_live;
+      uint64_t num_free;  // In the shared lists.
+    };
+    std::array<SizeClass, kNumSizeClasses> classes;
+    std::array<uint64_t, kNumCores> cached_bytes;
+    std::array<uint64_t, kNumCores> num_transferred;
+    uint64_t large_live_bytes;
+    uint64_t global_free_bytes;
+    uint64_t released_bytes;
+    uint64_t usage;
+    uint64_t peak_usage;
+  };
+
+  struct AllocSite {
+    uint64_t num_samples;
+    uint64_t num_bytes;
+    uint32_t num_frames;
+    void *frames[kNumProfiledFrames];
+  };
 
   SlabAllocator();
   SlabAllocator(SlabId_t slab_id, void *buf, size_t len,
@@ -39,28 +107,70 @@ class SlabAllocator {
   void init(SlabId_t slab_id, void *buf, size_t len,
             bool aggressive_caching = false);
   void *allocate(size_t size);
+  // align must be a power of two. The result is freed through free() as well.
+  void *allocate_aligned(size_t size, size_t align);
   void *yield(size_t size);
   void *get_base() const;
   size_t get_cur_usage() const;
   size_t get_usage() const;
   size_t get_remaining() const;
+  // Usage minus the pages that were returned to the OS.
+  size_t get_resident_usage() const;
+  // Free bytes over used bytes.
+  double get_fragmentation() const;
+  double get_compaction_ratio() const;
+  void set_compaction_ratio(double ratio);
+  // Allocates up to max_num objects of size from the lowest-addressed chunks
+  // in the shared free list of its class, returned in ascending order, for
+  // compaction to pack objects into. Large objects aren't served.
+  std::vector<void *> allocate_lowest(size_t size, uint32_t max_num);
+  // Returns the caches of the cores that haven't used them since the last
+  // call, and then the pages fully covered by free chunks, to the OS.
+  void scavenge();
+  // Drops the pages of the released spans again, e.g., after migration
+  // copied them in.
+  void release_spans();
+  // Moves on to carve from [buf, buf + len) once the current region is used
+  // up. Returns false if the slab already spans kMaxNumRegions regions.
+  bool add_region(void *buf, size_t len);
+  uint32_t get_num_regions() const;
+  VAddrRange get_region(uint32_t idx) const;
+  // The part of the region carved so far.
+  VAddrRange get_used_region(uint32_t idx) const;
+  Stats stats() const;
+  // Records the call stack of one in every rate allocations, 0 turns it off.
+  void set_profiling_rate(uint32_t rate);
+  std::vector<AllocSite> get_profile();
+  void dump_profile(std::ostream &os);
   SlabId_t get_id();
   static SlabAllocator *get_slab_by_id();
   static void free(const void *ptr);
   static void *reallocate(const void *ptr, size_t size);
   static void register_slab_by_id(SlabAllocator *slab, SlabId_t slab_id);
   static void deregister_slab_by_id(SlabId_t slab_id);
+  // Asks every core to return its cached objects to the shared lists and
+  // restart cache sizing. Cores act on it at their next allocation or free.
+  static void shrink_caches();
+  // Flags the slab once the region being carved has fewer than bytes left,
+  // so that its owner can add a region in time. 0 turns it off.
+  void set_low_space_threshold(size_t bytes);
+  // Clears the flags and returns the ids of the slabs that were flagged.
+  static std::vector<SlabId_t> take_low_space_slabs();
 
  private:
+  // Marks the PtrHeader in front of an over-aligned object that was cut out of
+  // a larger chunk; its size field holds the distance back to that chunk.
+  constexpr static SlabId_t kForwardingSlabId = 0;
+
   class FreePtrsLinkedList {
    public:
     void push(void *ptr);
     void *pop();
-    uint64_t size();
+    uint64_t size() const;
 
    private:
     constexpr static uint32_t kBatchSize =
-        ((1 << kMinSlabClassShift) + sizeof(PtrHeader)) / sizeof(void *);
+        (1 << kMinSlabClassShift) / sizeof(void *);
     struct Batch {
       void *p[kBatchSize];
     };
@@ -70,37 +180,140 @@ class SlabAllocator {
   };
 
   struct alignas(kCacheLineBytes) CoreCache {
-    FreePtrsLinkedList lists[kMaxSlabClassShift];
+    // Set by the owner core while it uses the cache. Paired with `draining`
+    // and the membarrier() in drain_idle_caches(), so the owner needs no
+    // atomic instruction to enter the cache.
+    bool busy = false;
+    // Set by drain_idle_caches() while it drains the cache.
+    bool draining = false;
+    // Whether the owner used the cache since the last scavenge().
+    bool active = false;
+    FreePtrsLinkedList lists[kNumSizeClasses];
+    // 0 if not sized yet.
+    uint32_t max_entries[kNumSizeClasses] = {};
+    uint64_t capacity_bytes = 0;
+    uint32_t shrink_epoch = 0;
+    // Allocations minus frees on this core, so it can go negative.
+    int64_t num_live[kNumSizeClasses] = {};
+    uint32_t profile_countdown = 0;
+  };
+
+  // A run of contiguous free chunks of the same class whose pages, except
+  // for the one holding this header, were returned to the OS.
+  struct ReleasedSpan {
+    ReleasedSpan *next;
+    uint8_t *end;
+  };
+
+  struct Region {
+    uint8_t *start;
+    uint8_t *end;
+    // Where cur_ stopped when the slab moved on to the next region.
+    uint8_t *top;
+    // One byte per kSmallRunSize from run_map_base: 0 if it's not a run,
+    // otherwise the run's size class plus one.
+    uint8_t *run_map;
+    uintptr_t run_map_base;
+  };
+
+  // A free page span of the large-object allocator. Free spans are kept
+  // sorted by address.
+  struct LargeSpan {
+    LargeSpan *prev;
+    LargeSpan *next;
+    uint64_t len;
+    bool released;
   };
 
   struct alignas(kCacheLineBytes) TransferredCoreCache {
     SpinLock spin;
-    FreePtrsLinkedList lists[kMaxSlabClassShift];
+    FreePtrsLinkedList lists[kNumSizeClasses];
   };
 
   static SlabAllocator *slabs_[get_max_slab_id() + 1];
+  static std::atomic<uint32_t> cache_shrink_epoch_;
+  static std::atomic<uint64_t> low_space_slabs_[get_max_slab_id() / 64 + 1];
+  static std::atomic<bool> has_low_space_slabs_;
+  // Maps every kMinProcletHeapSize granule of the proclet heap range to the
+  // id of the headerless slab that owns it.
+  static SlabId_t proclet_heap_slab_ids_[(kMaxProcletHeapVAddr -
+                                          kMinProcletHeapVAddr) /
+                                         kMinProcletHeapSize];
+  static const std::array<uint64_t, kNumSizeClasses> class_sizes_;
+  static const std::array<uint8_t, kMaxLookupSize / kAlignment + 1>
+      size_to_class_;
   SlabId_t slab_id_;
   bool aggressive_caching_;
   const uint8_t *start_;
   const uint8_t *end_;
   uint8_t *cur_;
-  FreePtrsLinkedList slab_lists_[kMaxSlabClassShift];
+  Region regions_[kMaxNumRegions];
+  uint32_t num_regions_;
+  // Bytes carved from the regions before the current one.
+  uint64_t retired_usage_;
+  // Odd while add_region() is switching regions.
+  uint32_t region_seq_;
+  uint64_t low_space_threshold_;
+  double compaction_ratio_;
+  bool headerless_;
+  uint8_t *run_curs_[kNumSmallClasses];
+  uint8_t *run_ends_[kNumSmallClasses];
+  FreePtrsLinkedList slab_lists_[kNumSizeClasses];
   uint64_t global_free_bytes_;
+  ReleasedSpan *released_spans_[kNumSizeClasses];
+  uint64_t released_bytes_;
+  LargeSpan *large_spans_;
+  uint64_t large_live_bytes_;
+  uint64_t peak_usage_;
+  uint32_t profiling_rate_;
+  uint64_t num_dropped_samples_;
+  AllocSite alloc_sites_[kMaxNumAllocSites];
+  SpinLock profile_spin_;
   CoreCache cache_lists_[kNumCores];
   TransferredCoreCache transferred_caches_[kNumCores];
   SpinLock spin_;
 
-  uint32_t get_slab_shift(uint64_t data_size);
-  uint64_t get_slab_size(uint32_t slab_shift);
+  static uint32_t get_size_class(uint64_t data_size);
+  uint64_t get_chunk_size(uint32_t size_class) const;
+  bool is_headerless_class(uint32_t size_class) const;
+  static SlabAllocator *get_mapped_slab(uintptr_t addr);
+  static void map_proclet_heap(SlabAllocator *slab, SlabId_t slab_id);
+  uint32_t get_run_class(uintptr_t addr) const;
+  Region &cur_region();
+  bool owns(const void *ptr) const;
+  void init_run_map(Region &region);
+  bool new_run(uint32_t size_class);
+  void hand_out_gap(uint8_t *aligned_cur);
+  void *allocate_large(size_t size);
+  void free_large(PtrHeader *hdr);
+  bool resize_large(PtrHeader *hdr, size_t new_size);
+  void take_from_large_span(LargeSpan *span, uint64_t len);
+  std::optional<VAddrRange> insert_large_span(uint8_t *start, uint64_t len,
+                                              bool released = false);
+  void trim_top(VAddrRange range);
+  void check_low_space();
   void *__allocate(size_t size);
   static void __free(const void *ptr);
   void __do_free(const Caladan::PreemptGuard &g, PtrHeader *ptr,
-                 uint32_t slab_shift);
-  void free_to_cache_list(const Caladan::PreemptGuard &g, PtrHeader *hdr,
-                          uint32_t slab_shift);
-  void free_to_transferred_cache_list(PtrHeader *hdr, uint32_t slab_shift);
+                 uint32_t size_class);
+  void free_to_cache_list(const Caladan::PreemptGuard &g, void *chunk,
+                          uint32_t size_class);
+  void free_to_transferred_cache_list(PtrHeader *hdr, uint32_t size_class);
+  uint32_t get_max_num_cache_entries(CoreCache &cache, uint32_t size_class);
+  void grow_cache(CoreCache &cache, uint32_t size_class, bool contended);
+  CoreCache &enter_cache(const Caladan::PreemptGuard &g);
+  void exit_cache(CoreCache &cache);
+  void check_cache_shrink(const Caladan::PreemptGuard &g);
+  void flush_cache(uint32_t core);
+  void drain_idle_caches();
+  bool lock_spin();
+  void scavenge_class(uint32_t size_class);
+  void maybe_sample(const Caladan::PreemptGuard &g, size_t size);
+  void record_sample(size_t size);
+  void refill_from_released_span(uint32_t size_class, FreePtrsLinkedList &list,
+                                 uint64_t num);
   void drain_transferred_cache(const Caladan::PreemptGuard &g,
-                               uint32_t slab_shift);
+                               uint32_t size_class);
 };
 }  // namespace nu
 
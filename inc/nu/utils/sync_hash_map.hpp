@@ -19,6 +19,8 @@ template <size_t NBuckets, typename K, typename V, typename Hash = std::hash<K>,
           typename Lock = SpinLock>
 class SyncHashMap {
  public:
+  constexpr static size_t kCompactionBatchSize = 64;
+
   SyncHashMap();
   ~SyncHashMap();
   SyncHashMap(const SyncHashMap &) noexcept;
@@ -61,6 +63,11 @@ class SyncHashMap {
   std::optional<V> get_and_remove(K1 &&k);
   std::vector<std::pair<K, V>> get_all_pairs();
   std::vector<std::pair<uint64_t, K>> get_all_hashes_and_keys();
+  // Opt-in compaction. If the heap is fragmented, relocates the pairs of the
+  // next num_buckets buckets into lower addresses, holding one bucket lock at
+  // a time, and releases the vacated pages after each full pass. Invalidates
+  // the pointers returned by get(). Returns whether it relocated anything.
+  bool compact(size_t num_buckets = kCompactionBatchSize);
   template <class Archive>
   void save(Archive &ar) const;
   template <class Archive>
@@ -83,6 +90,7 @@ class SyncHashMap {
       std::allocator_traits<Allocator>::template rebind_alloc<BucketHead>;
 
   BucketHead *bucket_heads_;
+  size_t compact_cursor_ = 0;
 
   template <typename K1>
   V *__get_with_hash(K1 &&k, uint64_t key_hash);
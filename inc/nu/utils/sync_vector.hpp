@@ -4,6 +4,7 @@
 
 #include <cstdlib>
 #include <functional>
+#include <map>
 #include <memory>
 #include <optional>
 #include <utility>
@@ -18,6 +19,8 @@ template <size_t NZones, typename T,
           typename Lock = SpinLock>
 class SyncVector {
     public:
+        constexpr static size_t kCompactionBatchSize = 4;
+
         SyncVector();
         ~SyncVector();
         SyncVector(const SyncVector &) noexcept;
@@ -35,6 +38,11 @@ class SyncVector {
         void sort();
         void clear();
         void reload(std::vector<T>&& all_data);
+        // Opt-in compaction. If the heap is fragmented, moves the next
+        // num_zones zones into lower addresses under the vector's locks and
+        // releases the vacated pages after each full pass. Invalidates the
+        // pointers returned by get(). Returns whether it relocated anything.
+        bool compact(size_t num_zones = kCompactionBatchSize);
                                 
         std::vector<T> get_all_data();
         std::vector<T> get_all_sorted_data();
@@ -62,6 +70,7 @@ class SyncVector {
         uint64_t size_;
         Lock lock_;
         std::vector<T> all_sorted_data;
+        size_t compact_cursor_ = 0;
 
         using VectorAllocator =
             std::allocator_traits<Allocator>::template rebind_alloc<T>;
@@ -0,0 +1,180 @@
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <sync.h>
+#include <timer.h>
+
+#include "nu/runtime.hpp"
+#include "nu/call_graph_profiler.hpp"
+#include "nu/proclet_mgr.hpp"
+#include "nu/utils/caladan.hpp"
+
+namespace nu {
+
+CallGraphProfiler::CallGraphProfiler() : decay_epoch_(0), done_(false) {
+  matrices_ = new CoreMatrix[kNumCores];
+  memset(matrices_, 0, sizeof(CoreMatrix) * kNumCores);
+
+  if constexpr (kEnableLogging) {
+    logging_thread_ = rt::Thread([&] {
+      std::cout << "time_us num_local_calls num_remote_calls" << std::endl;
+      while (!rt::access_once(done_)) {
+        timer_sleep(kPrintIntervalUs);
+        std::cout << microtime() << " " << get_num_local_calls() << " "
+                  << get_num_remote_calls() << std::endl;
+      }
+    });
+  }
+}
+
+CallGraphProfiler::~CallGraphProfiler() {
+  if constexpr (kEnableLogging) {
+    done_ = true;
+    barrier();
+    logging_thread_.Join();
+  }
+  delete[] matrices_;
+}
+
+void CallGraphProfiler::sample(ProcletHeader *caller_header,
+                               ProcletID callee_id, NodeIP callee_ip,
+                               uint64_t num_bytes) {
+  Caladan::PreemptGuard g;
+
+  auto caller_id = to_proclet_id(caller_header);
+  auto &matrix = matrices_[g.read_cpu()];
+  auto epoch = decay_epoch_.load(std::memory_order_relaxed);
+  if (unlikely(matrix.decay_epoch != epoch)) {
+    auto decay = get_decay(epoch - matrix.decay_epoch);
+    for (auto &slot : matrix.slots) {
+      slot.num_calls *= decay;
+      slot.num_bytes *= decay;
+    }
+    matrix.decay_epoch = epoch;
+  }
+  auto idx = hash(caller_id, callee_id);
+  for (uint32_t i = 0; i < kMaxNumProbes; i++) {
+    auto &slot = matrix.slots[(idx + i) & (kNumSlotsPerCore - 1)];
+    if (!slot.num_calls) {
+      slot.caller = caller_id;
+      slot.callee = callee_id;
+    } else if (slot.caller != caller_id || slot.callee != callee_id) {
+      continue;
+    }
+    slot.callee_ip = callee_ip;
+    slot.num_calls += kSampleInterval;
+    slot.num_bytes += num_bytes * kSampleInterval;
+    return;
+  }
+  matrix.num_dropped_samples++;
+}
+
+float CallGraphProfiler::get_decay(uint32_t num_epochs) {
+  // The counters are gone after this many halvings anyway.
+  constexpr uint32_t kMaxNumEpochs = 64;
+  return num_epochs < kMaxNumEpochs ? std::pow(kDecayFactor, num_epochs) : 0;
+}
+
+std::vector<CallGraphEdge> CallGraphProfiler::get_call_graph() {
+  std::unordered_map<ProcletID, std::unordered_map<ProcletID, CallGraphEdge>>
+      edges;
+  auto epoch = decay_epoch_.load(std::memory_order_relaxed);
+  for (uint32_t i = 0; i < kNumCores; i++) {
+    auto &matrix = matrices_[i];
+    // Idle cores haven't aged their slots yet, so do it on the fly.
+    auto decay = get_decay(epoch - rt::access_once(matrix.decay_epoch));
+    for (auto &slot : matrix.slots) {
+      uint64_t num_calls = rt::access_once(slot.num_calls) * decay;
+      if (!num_calls) {
+        continue;
+      }
+      auto &edge = edges[slot.caller][slot.callee];
+      edge.caller = slot.caller;
+      edge.callee = slot.callee;
+      edge.callee_ip = slot.callee_ip;
+      edge.num_calls += num_calls;
+      edge.num_bytes += rt::access_once(slot.num_bytes) * decay;
+    }
+  }
+
+  std::vector<CallGraphEdge> graph;
+  for (auto &[_, callees] : edges) {
+    for (auto &[_, edge] : callees) {
+      graph.push_back(edge);
+    }
+  }
+  return graph;
+}
+
+void CallGraphProfiler::update_affinities(float fixed_cost_us,
+                                          float net_bw_gbps) {
+  std::unordered_map<ProcletID, std::unordered_map<NodeIP, float>> costs;
+
+  for (auto &edge : get_call_graph()) {
+    auto cost_us = edge.num_calls * fixed_cost_us +
+                   edge.num_bytes / (net_bw_gbps / 8) / 1000;
+    auto callee_is_local =
+        to_proclet_header(edge.callee)->status() == kPresent;
+    // The caller ran here, so the callee is local to it iff it is present.
+    costs[edge.caller][callee_is_local ? 0 : edge.callee_ip] += cost_us;
+    if (callee_is_local) {
+      costs[edge.callee][0] += cost_us;
+    }
+  }
+
+  // Age the matrix so that the affinities follow phase changes. Every core
+  // applies it to its own slots on its next sample.
+  decay_epoch_.fetch_add(1, std::memory_order_relaxed);
+
+  rt::SpinGuard guard(&spin_);
+  affinities_.clear();
+  for (auto &[id, ip_to_cost] : costs) {
+    CallAffinity affinity{0, 0, 0};
+    for (auto &[ip, cost_us] : ip_to_cost) {
+      if (!ip) {
+        affinity.local_cost_us = cost_us;
+      } else if (cost_us > affinity.best_remote_cost_us) {
+        affinity.best_remote_cost_us = cost_us;
+        affinity.best_remote_ip = ip;
+      }
+    }
+    affinities_[id] = affinity;
+  }
+}
+
+std::optional<CallAffinity> CallGraphProfiler::get_affinity(
+    ProcletHeader *header) {
+  rt::SpinGuard guard(&spin_);
+  auto iter = affinities_.find(to_proclet_id(header));
+  if (iter == affinities_.end()) {
+    return std::nullopt;
+  }
+  return iter->second;
+}
+
+uint64_t CallGraphProfiler::get_num_local_calls() const {
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < kNumCores; i++) {
+    sum += rt::access_once(matrices_[i].num_local_calls);
+  }
+  return sum;
+}
+
+uint64_t CallGraphProfiler::get_num_remote_calls() const {
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < kNumCores; i++) {
+    sum += rt::access_once(matrices_[i].num_remote_calls);
+  }
+  return sum;
+}
+
+void CallGraphProfiler::dump(std::ostream &os) {
+  os << "caller callee callee_ip num_calls num_bytes" << std::endl;
+  for (auto &edge : get_call_graph()) {
+    os << edge.caller << " " << edge.callee << " " << edge.callee_ip << " "
+       << edge.num_calls << " " << edge.num_bytes << std::endl;
+  }
+}
+
+}  // namespace nu
@@ -0,0 +1,117 @@
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nu/closure_registry.hpp"
+#include "nu/utils/farmhash.hpp"
+
+// Its symbol tells where the binary is loaded.
+extern "C" __attribute__((used, noinline)) void nu_closure_registry_anchor() {}
+
+namespace nu {
+
+ClosureRegistry::ClosureRegistry() : has_symbols_(false) { load_symbols(); }
+
+void ClosureRegistry::load_symbols() {
+  auto fd = open("/proc/self/exe", O_RDONLY);
+  BUG_ON(fd < 0);
+  struct stat statbuf;
+  BUG_ON(fstat(fd, &statbuf) < 0);
+  auto file_size = statbuf.st_size;
+  auto *file_buf = reinterpret_cast<const char *>(
+      mmap(0, file_size, PROT_READ, MAP_SHARED, fd, 0));
+  BUG_ON(file_buf == MAP_FAILED);
+  BUG_ON(close(fd) < 0);
+
+  auto *ehdr = reinterpret_cast<const Elf64_Ehdr *>(file_buf);
+  auto *shdrs = reinterpret_cast<const Elf64_Shdr *>(file_buf + ehdr->e_shoff);
+  std::vector<std::pair<uintptr_t, std::string>> funcs;
+  uintptr_t anchor_addr = 0;
+  for (uint32_t i = 0; i < ehdr->e_shnum; i++) {
+    if (shdrs[i].sh_type != SHT_SYMTAB) {
+      continue;
+    }
+    auto *syms =
+        reinterpret_cast<const Elf64_Sym *>(file_buf + shdrs[i].sh_offset);
+    auto num_syms = shdrs[i].sh_size / sizeof(Elf64_Sym);
+    auto *strs = file_buf + shdrs[shdrs[i].sh_link].sh_offset;
+    // Local symbols follow the file symbol of their source file.
+    std::string_view file_name;
+    for (uint64_t j = 0; j < num_syms; j++) {
+      auto &sym = syms[j];
+      std::string_view name = strs + sym.st_name;
+      if (ELF64_ST_TYPE(sym.st_info) == STT_FILE) {
+        file_name = name;
+        continue;
+      }
+      if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC || !sym.st_value ||
+          sym.st_shndx == SHN_UNDEF) {
+        continue;
+      }
+      if (name == "nu_closure_registry_anchor") {
+        anchor_addr = sym.st_value;
+      }
+      if (ELF64_ST_BIND(sym.st_info) == STB_LOCAL) {
+        funcs.emplace_back(sym.st_value,
+                           std::string(file_name) + ":" + std::string(name));
+      } else {
+        funcs.emplace_back(sym.st_value, name);
+      }
+    }
+  }
+  BUG_ON(munmap(const_cast<char *>(file_buf), file_size) == -1);
+
+  if (!anchor_addr) {
+    return;
+  }
+  has_symbols_ = true;
+  auto load_bias =
+      reinterpret_cast<uintptr_t>(&nu_closure_registry_anchor) - anchor_addr;
+  ids_.reserve(funcs.size());
+  fns_.reserve(funcs.size());
+  for (auto &[value, name] : funcs) {
+    auto addr = value + load_bias;
+    auto id = hash_symbol(name);
+    auto [iter, inserted] = fns_.try_emplace(id, addr);
+    if (unlikely(!inserted && iter->second != addr)) {
+      if (iter->second) {
+        ids_[iter->second] = 0;
+      }
+      iter->second = 0;
+      ids_[addr] = 0;
+      continue;
+    }
+    // Aliases of a function go by the first one of them.
+    ids_.try_emplace(addr, id);
+  }
+}
+
+ClosureID ClosureRegistry::hash_symbol(std::string_view symbol) {
+  // 0 is reserved for the functions without a unique ID.
+  return util::Hash64(symbol.data(), symbol.size()) | 1;
+}
+
+ClosureID ClosureRegistry::get_id(const void *fn) const {
+  auto addr = reinterpret_cast<uintptr_t>(fn);
+  if (unlikely(!has_symbols_)) {
+    return addr;
+  }
+  auto iter = ids_.find(addr);
+  return iter != ids_.end() ? iter->second : 0;
+}
+
+void *ClosureRegistry::get_fn(ClosureID id) const {
+  if (unlikely(!has_symbols_)) {
+    return reinterpret_cast<void *>(id);
+  }
+  auto iter = fns_.find(id);
+  return iter != fns_.end() ? reinterpret_cast<void *>(iter->second) : nullptr;
+}
+
+}  // namespace nu
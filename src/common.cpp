@@ -22,4 +22,18 @@ uint32_t str_to_ip(std::string ip_str) {
   return MAKE_IP_ADDR(addr0, addr1, addr2, addr3);
 }
 
+std::vector<uint32_t> str_to_ips(std::string ips_str) {
+  std::vector<uint32_t> ips;
+  std::size_t pos = 0;
+  while (true) {
+    auto comma_pos = ips_str.find(',', pos);
+    ips.push_back(str_to_ip(ips_str.substr(pos, comma_pos - pos)));
+    if (comma_pos == std::string::npos) {
+      break;
+    }
+    pos = comma_pos + 1;
+  }
+  return ips;
+}
+
 }  // namespace nu
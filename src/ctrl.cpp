@@ -1,4 +1,6 @@
 #include <cereal/archives/binary.hpp>
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <limits>
 
@@ -29,21 +31,41 @@ constexpr NodeIP get_proclet_segment_bucket_id(uint64_t capacity) {
   return bsr_capacity - bsr_min;
 }
 
-LPInfo::LPInfo() : rr_iter(node_statuses.end()), destroying(false) {}
+// Segments are aligned to their sizes, so buddies differ in a single bit.
+constexpr uint64_t get_buddy_addr(uint64_t addr, uint64_t size) {
+  static_assert(kMinProcletHeapVAddr % kMaxProcletHeapSize == 0);
+  return addr ^ size;
+}
+
+LPInfo::LPInfo()
+    : rr_iter(node_statuses.end()), destroying(false), view_version(0) {}
+
+void BounceTracker::add_bounce(NodeIP x, NodeIP y, uint64_t now_us) {
+  auto &bounces = pairs[std::minmax(x, y)];
+  if (now_us - bounces.last_bounce_us >= kBounceWindowUs) {
+    bounces.num_bounces = 0;
+  }
+  bounces.last_bounce_us = now_us;
+  if (++bounces.num_bounces >= kMinNumBounces) {
+    bounces.banned_until_us = now_us + kPairBanUs;
+  }
+}
+
+bool BounceTracker::is_oscillating(NodeIP x, NodeIP y, uint64_t now_us) const {
+  auto iter = pairs.find(std::minmax(x, y));
+  return iter != pairs.end() && now_us < iter->second.banned_until_us;
+}
 
 Controller::Controller() {
   for (lpid_t lpid = 1; lpid < std::numeric_limits<lpid_t>::max(); lpid++) {
     free_lpids_.insert(lpid);
   }
 
-  auto &highest_bucket =
-      free_proclet_heap_segments_[kNumProcletSegmentBuckets - 1];
   for (uint64_t start_addr = kMinProcletHeapVAddr;
        start_addr + kMaxProcletHeapSize <= kMaxProcletHeapVAddr;
        start_addr += kMaxProcletHeapSize) {
-    VAddrRange range = {.start = start_addr,
-                        .end = start_addr + kMaxProcletHeapSize};
-    highest_bucket.push({range, 0});
+    auto &shard = get_segment_shard(start_addr);
+    shard.free_segments[kNumProcletSegmentBuckets - 1].emplace(start_addr, 0);
   }
 
   for (uint64_t start_addr = kMinStackClusterVAddr;
@@ -54,6 +76,10 @@ Controller::Controller() {
     free_stack_cluster_segments_.push(range);
   }
 
+  placement_policy_ = std::make_unique<BinPackingPolicy>(
+      kMemHeavyProcletMBs, std::make_unique<PowerOfTwoChoicesPolicy>());
+  view_version_ = 0;
+  replicator_ = nullptr;
   done_ = false;
 }
 
@@ -63,12 +89,19 @@ Controller::~Controller() {
 }
 
 std::optional<std::pair<lpid_t, VAddrRange>> Controller::register_node(
-    NodeIP ip, lpid_t lpid, MD5Val md5, bool isol) {
+    NodeIP ip, lpid_t lpid, MD5Val md5, bool isol, CtrlReqID req_id) {
+  if (auto done_ops = find_done_req(req_id)) {
+    auto &op = done_ops->front();
+    return std::make_pair(op.lpid, op.range);
+  }
+
   ScopedLock lock(&mutex_);
 
   if (lpid) {
-    auto info_iter = lpid_to_info_.find(lpid);
-    if (info_iter != lpid_to_info_.end()) {
+    auto &shard = get_lp_shard(lpid);
+    ScopedLock shard_lock(&shard.mutex);
+    auto info_iter = shard.lpid_to_info.find(lpid);
+    if (info_iter != shard.lpid_to_info.end()) {
       if (unlikely(info_iter->second.destroying)) {
         return std::nullopt;
       }
@@ -103,7 +136,10 @@ std::optional<std::pair<lpid_t, VAddrRange>> Controller::register_node(
   auto stack_cluster = free_stack_cluster_segments_.top();
   free_stack_cluster_segments_.pop();
 
-  auto &node_statuses = lpid_to_info_[lpid].node_statuses;
+  auto &shard = get_lp_shard(lpid);
+  ScopedLock shard_lock(&shard.mutex);
+  auto &lp_info = shard.lpid_to_info[lpid];
+  auto &node_statuses = lp_info.node_statuses;
   for (const auto &[existing_node_ip, _] : node_statuses) {
     auto *client = get_runtime()->rpc_client_mgr()->get_by_ip(existing_node_ip);
     RPCReqReserveConns req;
@@ -122,26 +158,45 @@ std::optional<std::pair<lpid_t, VAddrRange>> Controller::register_node(
 
   auto [iter, success] = node_statuses.try_emplace(ip, isol);
   BUG_ON(!success);
+  lp_info.view_version = ++view_version_;
+  log_op(CtrlOp{.type = CtrlOp::kRegisterNode,
+                .lpid = lpid,
+                .ip = ip,
+                .isol = isol,
+                .md5 = md5,
+                .range = stack_cluster,
+                .req_id = req_id});
   return std::make_pair(lpid, stack_cluster);
 }
 
-void Controller::destroy_lp(lpid_t lpid, NodeIP requestor_ip) {
+void Controller::destroy_lp(lpid_t lpid, NodeIP requestor_ip,
+                            CtrlReqID req_id) {
+  if (find_done_req(req_id)) {
+    return;
+  }
+
   std::vector<Future<void>> futures;
   std::map<lpid_t, LPInfo>::iterator info_iter;
+  auto &shard = get_lp_shard(lpid);
 
   {
     ScopedLock lock(&mutex_);
 
     BUG_ON(free_lpids_.count(lpid));
     BUG_ON(!lpid_to_md5_.erase(lpid));
+  }
+  log_op(CtrlOp{.type = CtrlOp::kDestroyLP, .lpid = lpid, .req_id = req_id});
 
-    info_iter = lpid_to_info_.find(lpid);
+  {
+    ScopedLock lock(&shard.mutex);
+
+    info_iter = shard.lpid_to_info.find(lpid);
     BUG_ON(info_iter->second.destroying);
     info_iter->second.destroying = true;
 
     for (auto &[ip, status] : info_iter->second.node_statuses) {
       while (unlikely(status.acquired)) {
-        status.cv.wait(&mutex_);
+        status.cv.wait(&shard.mutex);
       }
 
       if (ip != requestor_ip) {
@@ -160,76 +215,256 @@ void Controller::destroy_lp(lpid_t lpid, NodeIP requestor_ip) {
   futures.clear();
 
   {
-    ScopedLock lock(&mutex_);
+    ScopedLock lock(&shard.mutex);
 
-    BUG_ON(!free_lpids_.emplace(lpid).second);
     for (const auto &[ip, _] : info_iter->second.node_statuses) {
       get_runtime()->rpc_client_mgr()->remove_by_ip(ip);
     }
-    lpid_to_info_.erase(info_iter);
+    shard.lpid_to_info.erase(info_iter);
   }
+
+  // Only hand out the lpid again once its old state is gone.
+  ScopedLock lock(&mutex_);
+  BUG_ON(!free_lpids_.emplace(lpid).second);
 }
 
 std::optional<std::pair<ProcletID, NodeIP>> Controller::allocate_proclet(
-    uint64_t capacity, lpid_t lpid, NodeIP ip_hint) {
-  ScopedLock lock(&mutex_);
+    uint64_t capacity, lpid_t lpid, NodeIP ip_hint, CtrlReqID req_id) {
+  if (auto done_ops = find_done_req(req_id)) {
+    auto &op = done_ops->front();
+    return std::make_pair(op.range.start, op.ip);
+  }
+  return __allocate_proclet(capacity, lpid, ip_hint, req_id);
+}
 
-  auto &bucket =
-      free_proclet_heap_segments_[get_proclet_segment_bucket_id(capacity)];
-  if (unlikely(bucket.empty())) {
-    auto &highest_bucket =
-        free_proclet_heap_segments_[kNumProcletSegmentBuckets - 1];
-    if (unlikely(highest_bucket.empty())) {
-      return std::nullopt;
+std::vector<std::pair<ProcletID, NodeIP>> Controller::allocate_proclets(
+    uint32_t num, uint64_t capacity, lpid_t lpid, NodeIP ip_hint,
+    CtrlReqID req_id) {
+  std::vector<std::pair<ProcletID, NodeIP>> allocated;
+  allocated.reserve(num);
+
+  if (auto done_ops = find_done_req(req_id)) {
+    // A batch that got rolled back has fewer ops than proclets.
+    if (done_ops->size() == num) {
+      for (auto &op : *done_ops) {
+        allocated.emplace_back(op.range.start, op.ip);
+      }
     }
-    auto max_segment = highest_bucket.top();
-    highest_bucket.pop();
-    for (auto start_addr = max_segment.range.start;
-         start_addr < max_segment.range.end; start_addr += capacity) {
-      VAddrRange range = {.start = start_addr, .end = start_addr + capacity};
-      bucket.push({range, max_segment.prev_host});
+    return allocated;
+  }
+
+  for (uint32_t i = 0; i < num; i++) {
+    auto optional = __allocate_proclet(capacity, lpid, ip_hint, req_id);
+    if (unlikely(!optional)) {
+      for (auto &[id, _] : allocated) {
+        destroy_proclet(VAddrRange{.start = id, .end = id + capacity});
+      }
+      allocated.clear();
+      break;
     }
+    allocated.push_back(*optional);
   }
+  return allocated;
+}
+
+std::optional<ProcletHeapSegment> Controller::pop_segment(
+    uint64_t capacity, uint32_t first_shard_idx) {
+  auto bucket_id = get_proclet_segment_bucket_id(capacity);
+
+  for (uint32_t i = 0; i < kNumSegmentShards; i++) {
+    auto &shard = segment_shards_[(first_shard_idx + i) % kNumSegmentShards];
+    ScopedLock lock(&shard.mutex);
+
+    auto id = bucket_id;
+    while (id < kNumProcletSegmentBuckets && shard.free_segments[id].empty()) {
+      id++;
+    }
+    if (unlikely(id == kNumProcletSegmentBuckets)) {
+      continue;
+    }
+
+    auto iter = shard.free_segments[id].begin();
+    auto [start_addr, prev_host] = *iter;
+    shard.free_segments[id].erase(iter);
+    // Splits it down to the capacity, freeing the upper halves. They keep the
+    // prev_host hint as they were part of the same heap.
+    for (auto size = capacity << (id - bucket_id); size > capacity;) {
+      size /= 2;
+      shard.free_segments[--id].emplace(start_addr + size, prev_host);
+    }
+    return ProcletHeapSegment{
+        .range = {.start = start_addr, .end = start_addr + capacity},
+        .prev_host = prev_host};
+  }
+
+  return std::nullopt;
+}
 
-  auto segment = bucket.top();
-  bucket.pop();
+void Controller::push_segment(ProcletHeapSegment segment) {
   auto start_addr = segment.range.start;
-  auto id = start_addr;
+  auto size = segment.range.end - start_addr;
+  auto bucket_id = get_proclet_segment_bucket_id(size);
+  auto &shard = get_segment_shard(start_addr);
+  ScopedLock lock(&shard.mutex);
+
+  // Coalesces with the free buddies. The merged segment takes the hint of the
+  // most recently used part.
+  for (; bucket_id < kNumProcletSegmentBuckets - 1; bucket_id++, size *= 2) {
+    auto &bucket = shard.free_segments[bucket_id];
+    auto buddy_iter = bucket.find(get_buddy_addr(start_addr, size));
+    if (buddy_iter == bucket.end()) {
+      break;
+    }
+    bucket.erase(buddy_iter);
+    start_addr = std::min(start_addr, get_buddy_addr(start_addr, size));
+  }
+  BUG_ON(!shard.free_segments[bucket_id]
+              .emplace(start_addr, segment.prev_host)
+              .second);
+}
+
+void Controller::take_segment(VAddrRange range) {
+  auto capacity = range.end - range.start;
+  auto bucket_id = get_proclet_segment_bucket_id(capacity);
+  auto &shard = get_segment_shard(range.start);
+  ScopedLock lock(&shard.mutex);
+
+  // Finds the free segment that contains the range.
+  auto id = bucket_id;
+  auto size = capacity;
+  auto start_addr = range.start;
+  while (!shard.free_segments[id].count(start_addr)) {
+    BUG_ON(++id == kNumProcletSegmentBuckets);
+    size *= 2;
+    start_addr &= ~(size - 1);
+  }
+
+  // Splits it down to the range, freeing the other halves.
+  auto prev_host = shard.free_segments[id].extract(start_addr).mapped();
+  while (size > capacity) {
+    size /= 2;
+    auto lower_half_addr = start_addr;
+    auto upper_half_addr = start_addr + size;
+    if (range.start >= upper_half_addr) {
+      start_addr = upper_half_addr;
+    }
+    shard.free_segments[--id].emplace(
+        start_addr == lower_half_addr ? upper_half_addr : lower_half_addr,
+        prev_host);
+  }
+}
+
+std::optional<std::pair<ProcletID, NodeIP>> Controller::__allocate_proclet(
+    uint64_t capacity, lpid_t lpid, NodeIP ip_hint, CtrlReqID req_id) {
+  auto optional_segment = pop_segment(capacity, lpid % kNumSegmentShards);
+  if (unlikely(!optional_segment)) {
+    return std::nullopt;
+  }
+  auto &segment = *optional_segment;
+  auto id = segment.range.start;
   auto node_ip = select_node_for_proclet(lpid, ip_hint, segment);
   if (unlikely(!node_ip)) {
+    push_segment(segment);
     return std::nullopt;
   }
-  auto [iter, _] = proclet_id_to_ip_.try_emplace(id);
-  iter->second = node_ip;
+  proclet_lpids_[to_slab_id(id)].store(lpid, std::memory_order_relaxed);
+  proclet_locations_[to_slab_id(id)].store(node_ip, std::memory_order_release);
+  log_op(CtrlOp{.type = CtrlOp::kAllocateProclet,
+                .lpid = lpid,
+                .ip = node_ip,
+                .range = segment.range,
+                .req_id = req_id});
   return std::make_pair(id, node_ip);
 }
 
-void Controller::destroy_proclet(VAddrRange proclet_segment) {
-  ScopedLock lock(&mutex_);
+void Controller::destroy_proclet(VAddrRange proclet_segment,
+                                 CtrlReqID req_id) {
+  if (find_done_req(req_id)) {
+    return;
+  }
 
-  auto capacity = proclet_segment.end - proclet_segment.start;
-  auto &bucket =
-      free_proclet_heap_segments_[get_proclet_segment_bucket_id(capacity)];
-  auto proclet_id = proclet_segment.start;
-  auto iter = proclet_id_to_ip_.find(proclet_id);
-  if (unlikely(iter == proclet_id_to_ip_.end())) {
+  auto slab_id = to_slab_id(proclet_segment.start);
+  auto ip = proclet_locations_[slab_id].exchange(0);
+  if (unlikely(!ip)) {
     WARN();
     return;
   }
-  bucket.push({proclet_segment, iter->second});
-  proclet_id_to_ip_.erase(iter);
+  // The segment may be reused by another proclet.
+  proclet_last_moves_[slab_id].store(ProcletMove{}, std::memory_order_relaxed);
+  log_op(CtrlOp{.type = CtrlOp::kFreeSegment,
+                .range = proclet_segment,
+                .req_id = req_id});
+  push_segment({proclet_segment, ip});
+}
+
+std::optional<VAddrRange> Controller::allocate_heap_segment(
+    uint64_t capacity, CtrlReqID req_id) {
+  if (auto done_ops = find_done_req(req_id)) {
+    return done_ops->front().range;
+  }
+
+  auto optional_segment = pop_segment(capacity, read_cpu());
+  if (unlikely(!optional_segment)) {
+    return std::nullopt;
+  }
+  log_op(CtrlOp{.type = CtrlOp::kAllocateSegment,
+                .range = optional_segment->range,
+                .req_id = req_id});
+  return optional_segment->range;
+}
+
+void Controller::free_heap_segment(VAddrRange segment, CtrlReqID req_id) {
+  if (find_done_req(req_id)) {
+    return;
+  }
+
+  log_op(CtrlOp{.type = CtrlOp::kFreeSegment,
+                .range = segment,
+                .req_id = req_id});
+  push_segment({segment, 0});
 }
 
 NodeIP Controller::resolve_proclet(ProcletID id) {
-  ScopedLock lock(&mutex_);
+  if (unlikely(id < kMinProcletHeapVAddr || id >= kMaxProcletHeapVAddr)) {
+    return 0;
+  }
+  return proclet_locations_[to_slab_id(id)].load(std::memory_order_acquire);
+}
 
-  auto iter = proclet_id_to_ip_.find(id);
-  return iter != proclet_id_to_ip_.end() ? iter->second : 0;
+std::vector<NodeIP> Controller::resolve_proclets(
+    std::span<const ProcletID> ids) {
+  std::vector<NodeIP> ips;
+  ips.reserve(ids.size());
+  for (auto id : ids) {
+    ips.push_back(resolve_proclet(id));
+  }
+  return ips;
+}
+
+std::vector<std::pair<ProcletID, NodeIP>> Controller::get_proclet_locations(
+    lpid_t lpid) {
+  std::vector<std::pair<ProcletID, NodeIP>> locations;
+
+  // Proclets are keyed by the slabs at their heaps' starts.
+  for (auto addr = kMinProcletHeapVAddr; addr < kMaxProcletHeapVAddr;
+       addr += kMinProcletHeapSize) {
+    auto slab_id = to_slab_id(addr);
+    auto ip = proclet_locations_[slab_id].load(std::memory_order_acquire);
+    if (ip &&
+        proclet_lpids_[slab_id].load(std::memory_order_relaxed) == lpid) {
+      locations.emplace_back(addr, ip);
+    }
+  }
+  return locations;
 }
 
 NodeIP Controller::select_node_for_proclet(lpid_t lpid, NodeIP ip_hint,
                                            const ProcletHeapSegment &segment) {
-  auto &[node_statuses, rr_iter, _] = lpid_to_info_[lpid];
+  auto &shard = get_lp_shard(lpid);
+  ScopedLock lock(&shard.mutex);
+  auto &lp_info = shard.lpid_to_info[lpid];
+  auto &node_statuses = lp_info.node_statuses;
+  auto &rr_iter = lp_info.rr_iter;
   BUG_ON(node_statuses.empty());
 
   if (ip_hint) {
@@ -240,31 +475,68 @@ NodeIP Controller::select_node_for_proclet(lpid_t lpid, NodeIP ip_hint,
     return ip_hint;
   }
 
+  auto capacity = segment.range.end - segment.range.start;
+  Resource demand{.cores = 0,
+                  .mem_mbs = capacity / static_cast<float>(kOneMB)};
+  NodeIP ip = 0;
+
   if (segment.prev_host) {
-    return segment.prev_host;
+    auto iter = node_statuses.find(segment.prev_host);
+    if (iter != node_statuses.end() && !iter->second.isol &&
+        iter->second.has_enough_mem_resource(demand)) {
+      ip = segment.prev_host;
+    }
   }
 
-  // TODO: adopt a more sophisticated mechanism once we've added more fields.
-  NodeIP ip;
-  do {
-    if (unlikely(rr_iter == node_statuses.end())) {
-      rr_iter = node_statuses.begin();
-    }
-    ip = rr_iter->first;
-  } while (rr_iter++->second.isol);
+  if (!ip) {
+    ip = placement_policy_->select(node_statuses, demand);
+  }
+
+  // No node reported enough free resource (e.g., none has reported yet), so
+  // simply spread the proclets.
+  if (unlikely(!ip)) {
+    do {
+      if (unlikely(rr_iter == node_statuses.end())) {
+        rr_iter = node_statuses.begin();
+      }
+      ip = rr_iter->first;
+    } while (rr_iter++->second.isol);
+  }
 
+  // Count the proclet against the node until its next report, so that a burst
+  // of allocations doesn't pile onto it.
+  auto &free_resource = node_statuses.at(ip).free_resource;
+  free_resource.mem_mbs =
+      std::max(0.0f, free_resource.mem_mbs - demand.mem_mbs);
   return ip;
 }
 
 std::pair<NodeIP, Resource> Controller::acquire_migration_dest(
     lpid_t lpid, NodeIP requestor_ip, bool has_mem_pressure,
-    Resource resource) {
-  ScopedLock lock(&mutex_);
+    Resource resource, NodeIP preferred_ip) {
+  auto &shard = get_lp_shard(lpid);
+  ScopedLock lock(&shard.mutex);
 
-  auto &[node_statuses, rr_iter, destroying] = lpid_to_info_[lpid];
+  auto &[node_statuses, rr_iter, destroying, _, bounce_tracker] =
+      shard.lpid_to_info[lpid];
   if (unlikely(destroying)) {
     return std::make_pair(0, Resource{});
   }
+  auto now_us = microtime();
+
+  // Round 0: honor the requestor's preference (e.g., the node hosting the
+  // proclets' heaviest peers) if it can take the load.
+  if (preferred_ip && preferred_ip != requestor_ip) {
+    auto iter = node_statuses.find(preferred_ip);
+    if (iter != node_statuses.end() && !iter->second.isol &&
+        !iter->second.acquired &&
+        !bounce_tracker.is_oscillating(requestor_ip, preferred_ip, now_us) &&
+        (has_mem_pressure ? iter->second.has_enough_mem_resource(resource)
+                          : iter->second.has_enough_resource(resource))) {
+      iter->second.acquired = true;
+      return std::pair(iter->first, iter->second.free_resource);
+    }
+  }
 
   auto initial_rr_iter = rr_iter;
   BUG_ON(node_statuses.empty());
@@ -275,7 +547,10 @@ std::pair<NodeIP, Resource> Controller::acquire_migration_dest(
         rr_iter = node_statuses.begin();
       }
       if (rr_iter->first != requestor_ip && !rr_iter->second.isol &&
-          !rr_iter->second.acquired && filter_fn(rr_iter->second)) {
+          !rr_iter->second.acquired &&
+          !bounce_tracker.is_oscillating(requestor_ip, rr_iter->first,
+                                         now_us) &&
+          filter_fn(rr_iter->second)) {
         return true;
       }
     } while (++rr_iter != initial_rr_iter);
@@ -310,10 +585,82 @@ found:
   return pair;
 }
 
+std::vector<NodeIP> Controller::plan_migration(
+    lpid_t lpid, NodeIP requestor_ip, bool has_mem_pressure,
+    std::span<const MigrationDemand> demands) {
+  auto &shard = get_lp_shard(lpid);
+  ScopedLock lock(&shard.mutex);
+
+  std::vector<NodeIP> dest_ips(demands.size(), 0);
+  auto &[node_statuses, rr_iter, destroying, _, bounce_tracker] =
+      shard.lpid_to_info[lpid];
+  if (unlikely(destroying)) {
+    return dest_ips;
+  }
+
+  // The free resource each candidate would be left with after taking the
+  // tasks assigned to it so far. Pairs of nodes that keep bouncing proclets
+  // are left out.
+  std::map<NodeIP, Resource> headrooms;
+  auto now_us = microtime();
+  for (auto &[ip, status] : node_statuses) {
+    if (ip != requestor_ip && !status.isol && !status.acquired &&
+        !bounce_tracker.is_oscillating(requestor_ip, ip, now_us)) {
+      headrooms.emplace(ip, status.free_resource);
+    }
+  }
+
+  auto fits = [&](const Resource &headroom, const Resource &demand) {
+    if (headroom.mem_mbs <
+        demand.mem_mbs + NodeStatus::kMemLowWaterMarkMBs) {
+      return false;
+    }
+    return has_mem_pressure || headroom.cores >= demand.cores;
+  };
+  // Under memory pressure it's the memory that has to go somewhere.
+  auto has_more_room = [&](const Resource &x, const Resource &y) {
+    if (has_mem_pressure || x.cores == y.cores) {
+      return x.mem_mbs > y.mem_mbs;
+    }
+    return x.cores > y.cores;
+  };
+
+  for (size_t i = 0; i < demands.size(); i++) {
+    auto &[demand, preferred_ip] = demands[i];
+
+    auto best = headrooms.find(preferred_ip);
+    if (best == headrooms.end() || !fits(best->second, demand)) {
+      // Always taking the roomiest node spreads the tasks in proportion to
+      // the nodes' free resources.
+      best = headrooms.end();
+      for (auto iter = headrooms.begin(); iter != headrooms.end(); ++iter) {
+        if (fits(iter->second, demand) &&
+            (best == headrooms.end() ||
+             has_more_room(iter->second, best->second))) {
+          best = iter;
+        }
+      }
+    }
+
+    if (best != headrooms.end()) {
+      dest_ips[i] = best->first;
+      best->second -= demand;
+    }
+  }
+
+  for (auto ip : dest_ips) {
+    if (ip) {
+      node_statuses.find(ip)->second.acquired = true;
+    }
+  }
+  return dest_ips;
+}
+
 bool Controller::acquire_node(lpid_t lpid, NodeIP ip) {
-  ScopedLock lock(&mutex_);
+  auto &shard = get_lp_shard(lpid);
+  ScopedLock lock(&shard.mutex);
 
-  auto &node_statuses = lpid_to_info_[lpid].node_statuses;
+  auto &node_statuses = shard.lpid_to_info[lpid].node_statuses;
   auto iter = node_statuses.find(ip);
   if (unlikely(iter == node_statuses.end() || iter->second.acquired)) {
     return false;
@@ -323,9 +670,10 @@ bool Controller::acquire_node(lpid_t lpid, NodeIP ip) {
 }
 
 void Controller::release_node(lpid_t lpid, NodeIP ip) {
-  ScopedLock lock(&mutex_);
+  auto &shard = get_lp_shard(lpid);
+  ScopedLock lock(&shard.mutex);
 
-  auto &node_statuses = lpid_to_info_[lpid].node_statuses;
+  auto &node_statuses = shard.lpid_to_info[lpid].node_statuses;
   auto iter = node_statuses.find(ip);
   BUG_ON(iter == node_statuses.end());
   BUG_ON(!iter->second.acquired);
@@ -334,44 +682,167 @@ void Controller::release_node(lpid_t lpid, NodeIP ip) {
 }
 
 void Controller::update_location(ProcletID id, NodeIP proclet_srv_ip) {
-  ScopedLock lock(&mutex_);
+  auto slab_id = to_slab_id(id);
+  auto &location = proclet_locations_[slab_id];
+  auto prev_ip = location.load(std::memory_order_relaxed);
+  BUG_ON(!prev_ip);
+  location.store(proclet_srv_ip, std::memory_order_release);
+  log_op(CtrlOp{.type = CtrlOp::kUpdateLocation,
+                .ip = proclet_srv_ip,
+                .range = {.start = id, .end = id}});
+  if (prev_ip != proclet_srv_ip) {
+    auto now_us = microtime();
+    ProcletMove move{.src = prev_ip,
+                     .ms = static_cast<uint32_t>(now_us / kOneMilliSecond)};
+    auto last_move = proclet_last_moves_[slab_id].exchange(
+        move, std::memory_order_relaxed);
+    if (unlikely(last_move.src == proclet_srv_ip &&
+                 move.ms - last_move.ms <
+                     BounceTracker::kBounceWindowUs / kOneMilliSecond)) {
+      record_bounce(proclet_lpids_[slab_id].load(std::memory_order_relaxed),
+                    prev_ip, proclet_srv_ip, now_us);
+    }
+  }
+}
 
-  auto iter = proclet_id_to_ip_.find(id);
-  BUG_ON(iter == proclet_id_to_ip_.end());
-  iter->second = proclet_srv_ip;
+void Controller::record_bounce(lpid_t lpid, NodeIP src, NodeIP dest,
+                               uint64_t now_us) {
+  auto &shard = get_lp_shard(lpid);
+  ScopedLock lock(&shard.mutex);
+
+  auto iter = shard.lpid_to_info.find(lpid);
+  if (likely(iter != shard.lpid_to_info.end())) {
+    iter->second.bounce_tracker.add_bounce(src, dest, now_us);
+  }
 }
 
-std::vector<std::pair<NodeIP, Resource>> Controller::report_free_resource(
-    lpid_t lpid, NodeIP ip, Resource free_resource) {
+std::pair<uint64_t, std::vector<std::pair<NodeIP, Resource>>>
+Controller::report_free_resource(lpid_t lpid, NodeIP ip,
+                                 std::optional<Resource> free_resource,
+                                 uint64_t known_view_version) {
   std::vector<std::pair<NodeIP, Resource>> global_free_resources;
 
-  ScopedLock lock(&mutex_);
+  auto &shard = get_lp_shard(lpid);
+  ScopedLock lock(&shard.mutex);
 
-  auto lp_info_iter = lpid_to_info_.find(lpid);
-  if (unlikely(lp_info_iter == lpid_to_info_.end())) {
-    return global_free_resources;
+  auto lp_info_iter = shard.lpid_to_info.find(lpid);
+  if (unlikely(lp_info_iter == shard.lpid_to_info.end())) {
+    return std::make_pair(0, global_free_resources);
   }
 
-  auto &node_statuses = lp_info_iter->second.node_statuses;
+  auto &lp_info = lp_info_iter->second;
+  auto &node_statuses = lp_info.node_statuses;
   auto iter = node_statuses.find(ip);
   if (unlikely(iter == node_statuses.end())) {
-    return global_free_resources;
+    return std::make_pair(0, global_free_resources);
   }
 
-  iter->second.update_free_resource(free_resource);
+  if (free_resource) {
+    iter->second.update_free_resource(*free_resource);
+    if (!iter->second.isol) {
+      lp_info.view_version = ++view_version_;
+    }
+  }
 
-  for (auto &[ip, status] : node_statuses) {
-    if (!status.isol) {
-      global_free_resources.emplace_back(ip, status.free_resource);
+  if (known_view_version != kViewNotNeeded &&
+      lp_info.view_version != known_view_version) {
+    for (auto &[ip, status] : node_statuses) {
+      if (!status.isol) {
+        global_free_resources.emplace_back(ip, status.free_resource);
+      }
     }
   }
 
-  return global_free_resources;
+  return std::make_pair(lp_info.view_version, global_free_resources);
+}
+
+void Controller::set_placement_policy(
+    std::unique_ptr<PlacementPolicy> policy) {
+  placement_policy_ = std::move(policy);
+}
+
+void Controller::set_replicator(ControllerReplicator *replicator) {
+  replicator_ = replicator;
+}
+
+void Controller::log_op(const CtrlOp &op) {
+  if (op.req_id.seq) {
+    ScopedLock lock(&done_reqs_mutex_);
+    done_reqs_.record(op);
+  }
+  if (replicator_) {
+    replicator_->append(op);
+  }
+}
+
+std::optional<std::vector<CtrlOp>> Controller::find_done_req(
+    CtrlReqID req_id) {
+  if (!req_id.seq) {
+    return std::nullopt;
+  }
+  ScopedLock lock(&done_reqs_mutex_);
+  return done_reqs_.find(req_id);
+}
+
+void Controller::restore(const ControllerState &state) {
+  ScopedLock lock(&mutex_);
+
+  {
+    ScopedLock done_reqs_lock(&done_reqs_mutex_);
+    done_reqs_ = state.done_reqs;
+  }
+
+  std::set<uint64_t> used_stack_clusters;
+  for (auto &[lpid, lp] : state.lps) {
+    free_lpids_.erase(lpid);
+    lpid_to_md5_[lpid] = lp.md5;
+
+    auto &shard = get_lp_shard(lpid);
+    ScopedLock shard_lock(&shard.mutex);
+    auto &lp_info = shard.lpid_to_info[lpid];
+    for (auto &[ip, node] : lp.nodes) {
+      lp_info.node_statuses.try_emplace(ip, node.isol);
+      used_stack_clusters.insert(node.stack_cluster.start);
+    }
+    lp_info.view_version = ++view_version_;
+  }
+
+  free_stack_cluster_segments_ = {};
+  for (uint64_t start_addr = kMinStackClusterVAddr;
+       start_addr + kStackClusterSize <= kMaxStackClusterVAddr;
+       start_addr += kStackClusterSize) {
+    if (!used_stack_clusters.count(start_addr)) {
+      VAddrRange range = {.start = start_addr,
+                          .end = start_addr + kStackClusterSize};
+      free_stack_cluster_segments_.push(range);
+    }
+  }
+
+  for (auto &[start_addr, segment] : state.segments) {
+    take_segment({.start = start_addr, .end = segment.end});
+    if (segment.location) {
+      proclet_lpids_[to_slab_id(start_addr)].store(segment.lpid);
+      proclet_locations_[to_slab_id(start_addr)].store(segment.location);
+    }
+  }
 }
 
 void NodeStatus::update_free_resource(Resource resource) {
+  auto now_us = microtime();
+  // Fold in the skipped samples first, so that the average moves as if the
+  // node had reported every interval.
+  if (last_sample_us) {
+    auto num_skipped = (now_us - last_sample_us) / kReportIntervalUs;
+    if (num_skipped > 1) {
+      auto weight = 1 - std::pow(1 - kEWMAWeight, num_skipped - 1);
+      ewma(weight, &free_resource.cores, last_sample.cores);
+      ewma(weight, &free_resource.mem_mbs, last_sample.mem_mbs);
+    }
+  }
   ewma(kEWMAWeight, &free_resource.cores, resource.cores);
   ewma(kEWMAWeight, &free_resource.mem_mbs, resource.mem_mbs);
+  last_sample = resource;
+  last_sample_us = now_us;
 }
 
 }  // namespace nu
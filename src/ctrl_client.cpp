@@ -1,34 +1,243 @@
+#include <algorithm>
+#include <cstring>
+#include <set>
+
 extern "C" {
 #include <net/ip.h>
 #include <runtime/net.h>
+#include <runtime/timer.h>
 }
 
+#include "nu/closure_registry.hpp"
 #include "nu/ctrl_client.hpp"
 #include "nu/ctrl_server.hpp"
 #include "nu/migrator.hpp"
+#include "nu/proclet_mgr.hpp"
 #include "nu/proclet_server.hpp"
 #include "nu/runtime.hpp"
 #include "nu/utils/caladan.hpp"
+#include "nu/utils/scoped_lock.hpp"
 
 namespace nu {
 
-ControllerClient::ControllerClient(NodeIP ctrl_server_ip, Runtime::Mode mode,
-                                   lpid_t lpid, bool isol)
+// Closures travel as IDs that stay the same across builds, so nodes only have
+// to agree on the RPC handlers, i.e., the wire format of the calls, rather
+// than run the same binary. Without symbols to derive the IDs from, closures
+// travel as code addresses and only identical binaries are compatible.
+static MD5Val get_build_md5() {
+  if (!ClosureRegistry::get()->has_symbols()) {
+    return get_self_md5();
+  }
+  std::vector<HandlerID> ids;
+  ProcletServer::Handlers::for_each_id(
+      [&](HandlerID id) { ids.push_back(id); });
+  Migrator::ThreadLoaders::for_each_id(
+      [&](HandlerID id) { ids.push_back(id); });
+  std::sort(ids.begin(), ids.end());
+  return get_md5(std::as_bytes(std::span(ids)));
+}
+
+ControllerClient::ControllerClient(std::vector<NodeIP> ctrl_ips,
+                                   Runtime::Mode mode, lpid_t lpid, bool isol)
     : lpid_(lpid),
-      rpc_client_(get_runtime()->rpc_client_mgr()->get_by_ip(ctrl_server_ip)) {
+      ctrl_ips_(std::move(ctrl_ips)),
+      ctrl_idx_(0),
+      epoch_(0),
+      next_req_seq_(microtime()),
+      done_(false) {
   netaddr laddr{.ip = 0, .port = 0};
-  netaddr raddr{.ip = ctrl_server_ip, .port = ControllerServer::kPort};
+  netaddr raddr{.ip = ctrl_ips_[ctrl_idx_], .port = ControllerServer::kPort};
   tcp_conn_.reset(rt::TcpConn::Dial(laddr, raddr));
   BUG_ON(!tcp_conn_);
+  heartbeat_conn_.reset(rt::TcpConn::Dial(laddr, raddr));
+  BUG_ON(!heartbeat_conn_);
+
+  last_heartbeat_us_ = microtime();
+  heartbeat_thread_ = rt::Thread([&] { heartbeat(); });
+  watchdog_thread_ = rt::Thread([&] {
+    while (!rt::access_once(done_)) {
+      timer_sleep(kHeartbeatIntervalUs);
+      ScopedLock lock(&mutex_);
+      if (unlikely(microtime() - last_heartbeat_us_ > kFailoverTimeoutUs)) {
+        heartbeat_conn_->Abort();
+        last_heartbeat_us_ = microtime();
+      }
+    }
+  });
 
-  auto md5 = get_self_md5();
-  auto optional = register_node(get_cfg_ip(), md5, isol);
+  auto optional = register_node(get_cfg_ip(), get_build_md5(), isol);
   BUG_ON(!optional);
   BUG_ON(lpid_ && lpid_ != optional->first);
   std::tie(lpid_, stack_cluster_) = *optional;
   std::cout << "running with lpid = " << lpid_ << std::endl;
 }
 
+ControllerClient::~ControllerClient() {
+  {
+    ScopedLock lock(&mutex_);
+    done_ = true;
+    heartbeat_conn_->Abort();
+  }
+  watchdog_thread_.Join();
+  heartbeat_thread_.Join();
+}
+
+void ControllerClient::heartbeat() {
+  while (true) {
+    RPCReqHeartbeat req;
+    uint64_t len;
+    if (likely(heartbeat_conn_->WriteFull(&req, sizeof(req)) == sizeof(req) &&
+               heartbeat_conn_->ReadFull(&len, sizeof(len)) == sizeof(len))) {
+      {
+        ScopedLock lock(&mutex_);
+        last_heartbeat_us_ = microtime();
+      }
+      timer_sleep(kHeartbeatIntervalUs);
+    } else {
+      if (rt::access_once(done_)) {
+        break;
+      }
+      failover();
+    }
+  }
+}
+
+void ControllerClient::failover() {
+  auto start_us = microtime();
+  uint32_t failed_idx;
+
+  {
+    ScopedLock lock(&mutex_);
+
+    // Fails the outstanding requests so they can be retried.
+    for (auto &conn : conns_) {
+      conn->Abort();
+      retired_conns_.emplace_back(std::move(conn));
+    }
+    conns_.clear();
+    free_conns_.clear();
+    tcp_conn_->Abort();
+    heartbeat_conn_->Abort();
+    failed_idx = ctrl_idx_;
+  }
+
+  // Dials without the lock, as it takes seconds to time out. The standbys
+  // take a moment to notice the failure and take over, so the failed
+  // controller is only retried after they all had the chance.
+  auto retry_failed_us =
+      start_us + ControllerServer::kTakeoverTimeoutUs * (ctrl_ips_.size() - 1);
+  auto idx = failed_idx;
+  netaddr laddr{.ip = 0, .port = 0};
+  std::unique_ptr<rt::TcpConn> heartbeat_conn;
+  std::unique_ptr<rt::TcpConn> tcp_conn;
+  while (true) {
+    if (unlikely(rt::access_once(done_))) {
+      return;
+    }
+    idx = (idx + 1) % ctrl_ips_.size();
+    if (idx == failed_idx) {
+      timer_sleep(kHeartbeatIntervalUs);
+      if (ctrl_ips_.size() > 1 && microtime() < retry_failed_us) {
+        continue;
+      }
+    }
+
+    netaddr raddr{.ip = ctrl_ips_[idx], .port = ControllerServer::kPort};
+    heartbeat_conn.reset(rt::TcpConn::Dial(laddr, raddr));
+    if (heartbeat_conn) {
+      tcp_conn.reset(rt::TcpConn::Dial(laddr, raddr));
+      if (tcp_conn) {
+        break;
+      }
+    }
+  }
+
+  {
+    ScopedLock lock(&mutex_);
+    ctrl_idx_ = idx;
+    retired_conns_.emplace_back(std::move(heartbeat_conn_));
+    heartbeat_conn_ = std::move(heartbeat_conn);
+    {
+      rt::SpinGuard g(&spin_);
+      retired_conns_.emplace_back(std::move(tcp_conn_));
+      tcp_conn_ = std::move(tcp_conn);
+      epoch_++;
+    }
+    last_heartbeat_us_ = microtime();
+  }
+  failover_cv_.signal_all();
+
+  std::cout << "failed over to controller " << ctrl_ips_[idx] << " in "
+            << microtime() - start_us << " us" << std::endl;
+
+  // Location updates sent around the failure may have been lost, so report
+  // the proclets here again.
+  if (auto *proclet_manager = get_runtime()->proclet_manager()) {
+    for (auto *proclet_base : proclet_manager->get_all_proclets()) {
+      update_location(to_proclet_id(proclet_base), get_cfg_ip());
+    }
+  }
+}
+
+CtrlReqID ControllerClient::get_req_id() {
+  return CtrlReqID{.client_ip = get_cfg_ip(),
+                   .seq = next_req_seq_.fetch_add(1, std::memory_order_relaxed)};
+}
+
+// Resends the request on failovers. The ones that change the state carry an
+// ID, which the new controller uses to return the result of a request that it
+// got through the op log instead of applying it again.
+std::vector<std::byte> ControllerClient::call(std::span<const std::byte> req) {
+  netaddr laddr{.ip = 0, .port = 0};
+
+  while (true) {
+    rt::TcpConn *conn = nullptr;
+    uint64_t epoch;
+    NodeIP ctrl_ip;
+    {
+      ScopedLock lock(&mutex_);
+      epoch = epoch_;
+      ctrl_ip = ctrl_ips_[ctrl_idx_];
+      if (!free_conns_.empty()) {
+        conn = free_conns_.back();
+        free_conns_.pop_back();
+      }
+    }
+    if (!conn) {
+      // Dials without the lock, as it takes seconds to time out.
+      netaddr raddr{.ip = ctrl_ip, .port = ControllerServer::kPort};
+      std::unique_ptr<rt::TcpConn> new_conn(rt::TcpConn::Dial(laddr, raddr));
+      ScopedLock lock(&mutex_);
+      if (likely(new_conn && epoch == epoch_)) {
+        conn = conns_.emplace_back(std::move(new_conn)).get();
+      }
+    }
+
+    std::vector<std::byte> resp;
+    uint64_t len;
+    ssize_t req_size = req.size();
+    bool succeed = conn && conn->WriteFull(req.data(), req_size) == req_size &&
+                   conn->ReadFull(&len, sizeof(len)) == sizeof(len);
+    if (likely(succeed)) {
+      resp.resize(len);
+      succeed = !len || conn->ReadFull(resp.data(), len) ==
+                            static_cast<ssize_t>(len);
+    }
+
+    ScopedLock lock(&mutex_);
+    if (likely(succeed)) {
+      if (likely(epoch == epoch_)) {
+        free_conns_.push_back(conn);
+      }
+      return resp;
+    }
+    // Retries on the next controller once the heartbeat thread has found it.
+    while (epoch == epoch_) {
+      failover_cv_.wait(&mutex_);
+    }
+  }
+}
+
 std::optional<std::pair<lpid_t, VAddrRange>> ControllerClient::register_node(
     NodeIP ip, MD5Val md5, bool isol) {
   RPCReqRegisterNode req;
@@ -36,10 +245,9 @@ std::optional<std::pair<lpid_t, VAddrRange>> ControllerClient::register_node(
   req.lpid = lpid_;
   req.md5 = md5;
   req.isol = isol;
-  RPCReturnBuffer return_buf;
-  auto rc = rpc_client_->Call(to_span(req), &return_buf);
-  BUG_ON(rc != kOk);
-  auto &resp = from_span<RPCRespRegisterNode>(return_buf.get_buf());
+  req.req_id = get_req_id();
+  auto resp_buf = call(to_span(req));
+  const auto &resp = from_span<RPCRespRegisterNode>(std::span(resp_buf));
   if (resp.empty) {
     return std::nullopt;
   } else {
@@ -55,9 +263,9 @@ std::optional<std::pair<ProcletID, NodeIP>> ControllerClient::allocate_proclet(
   req.capacity = capacity;
   req.lpid = lpid_;
   req.ip_hint = ip_hint;
-  RPCReturnBuffer return_buf;
-  BUG_ON(rpc_client_->Call(to_span(req), &return_buf) != kOk);
-  auto &resp = from_span<RPCRespAllocateProclet>(return_buf.get_buf());
+  req.req_id = get_req_id();
+  auto resp_buf = call(to_span(req));
+  const auto &resp = from_span<RPCRespAllocateProclet>(std::span(resp_buf));
   if (resp.empty) {
     return std::nullopt;
   } else {
@@ -67,24 +275,84 @@ std::optional<std::pair<ProcletID, NodeIP>> ControllerClient::allocate_proclet(
   }
 }
 
+std::vector<std::pair<ProcletID, NodeIP>> ControllerClient::allocate_proclets(
+    uint32_t num, uint64_t capacity, NodeIP ip_hint) {
+  RPCReqAllocateProclets req;
+  req.num = num;
+  req.capacity = capacity;
+  req.lpid = lpid_;
+  req.ip_hint = ip_hint;
+  req.req_id = get_req_id();
+  auto buf = call(to_span(req));
+  auto *begin =
+      reinterpret_cast<const std::pair<ProcletID, NodeIP> *>(buf.data());
+  return std::vector(begin,
+                     begin + buf.size() / sizeof(std::pair<ProcletID, NodeIP>));
+}
+
 void ControllerClient::destroy_proclet(VAddrRange heap_segment) {
   RPCReqDestroyProclet req;
   req.heap_segment = heap_segment;
-  RPCReturnBuffer return_buf;
-  BUG_ON(rpc_client_->Call(to_span(req), &return_buf) != kOk);
+  req.req_id = get_req_id();
+  call(to_span(req));
+}
+
+std::optional<VAddrRange> ControllerClient::allocate_heap_segment(
+    uint64_t capacity) {
+  RPCReqAllocateHeapSegment req;
+  req.capacity = capacity;
+  req.req_id = get_req_id();
+  auto resp_buf = call(to_span(req));
+  const auto &resp =
+      from_span<RPCRespAllocateHeapSegment>(std::span(resp_buf));
+  if (resp.empty) {
+    return std::nullopt;
+  } else {
+    return resp.segment;
+  }
+}
+
+void ControllerClient::free_heap_segment(VAddrRange segment) {
+  RPCReqFreeHeapSegment req;
+  req.segment = segment;
+  req.req_id = get_req_id();
+  call(to_span(req));
 }
 
 NodeIP ControllerClient::resolve_proclet(ProcletID id) {
   RPCReqResolveProclet req;
   req.id = id;
-  RPCReturnBuffer return_buf;
-  BUG_ON(rpc_client_->Call(to_span(req), &return_buf) != kOk);
-  auto &resp = from_span<RPCRespResolveProclet>(return_buf.get_buf());
+  auto resp_buf = call(to_span(req));
+  const auto &resp = from_span<RPCRespResolveProclet>(std::span(resp_buf));
   return resp.ip;
 }
 
+std::vector<NodeIP> ControllerClient::resolve_proclets(
+    std::span<const ProcletID> ids) {
+  RPCReqResolveProclets req;
+  req.num_ids = ids.size();
+  auto ids_bytes = std::as_bytes(ids);
+  std::vector<std::byte> req_buf(sizeof(req) + ids_bytes.size());
+  memcpy(req_buf.data(), &req, sizeof(req));
+  memcpy(req_buf.data() + sizeof(req), ids_bytes.data(), ids_bytes.size());
+  auto buf = call(req_buf);
+  auto *begin = reinterpret_cast<const NodeIP *>(buf.data());
+  return std::vector(begin, begin + buf.size() / sizeof(NodeIP));
+}
+
+std::vector<std::pair<ProcletID, NodeIP>>
+ControllerClient::get_proclet_locations() {
+  RPCReqGetProcletLocations req;
+  req.lpid = lpid_;
+  auto buf = call(to_span(req));
+  auto *begin =
+      reinterpret_cast<const std::pair<ProcletID, NodeIP> *>(buf.data());
+  return std::vector(begin,
+                     begin + buf.size() / sizeof(std::pair<ProcletID, NodeIP>));
+}
+
 std::pair<NodeGuard, Resource> ControllerClient::acquire_migration_dest(
-    bool has_mem_pressure, Resource resource) {
+    bool has_mem_pressure, Resource resource, NodeIP preferred_ip) {
   rt::SpinGuard g(&spin_);
 
   RPCReqAcquireMigrationDest req;
@@ -92,32 +360,67 @@ std::pair<NodeGuard, Resource> ControllerClient::acquire_migration_dest(
   req.src_ip = get_cfg_ip();
   req.has_mem_pressure = has_mem_pressure;
   req.resource = resource;
-  BUG_ON(tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false,
-                              /* poll = */ true) != sizeof(req));
-
-  RPCRespAcquireMigrationDest resp;
-  BUG_ON(tcp_conn_->ReadFull(&resp, sizeof(resp), /* nt = */ false,
-                             /* poll = */ true) != sizeof(resp));
+  req.preferred_ip = preferred_ip;
+  // During a failover there is simply no destination.
+  RPCRespAcquireMigrationDest resp{.ip = 0, .resource = Resource{}};
+  if (unlikely(tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false,
+                                    /* poll = */ true) != sizeof(req) ||
+               tcp_conn_->ReadFull(&resp, sizeof(resp), /* nt = */ false,
+                                   /* poll = */ true) != sizeof(resp))) {
+    resp.ip = 0;
+  }
   auto ip = resp.ip;
   resource = resp.resource;
   return std::pair<NodeGuard, Resource>(std::piecewise_construct,
-                                        std::make_tuple(this, ip),
+                                        std::make_tuple(this, ip, epoch_),
                                         std::make_tuple(resource));
 }
 
+MigrationPlan ControllerClient::plan_migration(
+    bool has_mem_pressure, const std::vector<MigrationDemand> &demands) {
+  rt::SpinGuard g(&spin_);
+
+  RPCReqPlanMigration req;
+  req.lpid = lpid_;
+  req.src_ip = get_cfg_ip();
+  req.has_mem_pressure = has_mem_pressure;
+  req.num_demands = demands.size();
+  const iovec iovecs[] = {
+      {&req, sizeof(req)},
+      {const_cast<MigrationDemand *>(demands.data()),
+       std::span(demands).size_bytes()}};
+  MigrationPlan plan;
+  plan.dest_ips.resize(demands.size());
+  ssize_t size = std::span(plan.dest_ips).size_bytes();
+  if (unlikely(tcp_conn_->WritevFull(std::span(iovecs), /* nt = */ false,
+                                     /* poll = */ true) < 0 ||
+               tcp_conn_->ReadFull(plan.dest_ips.data(), size,
+                                   /* nt = */ false,
+                                   /* poll = */ true) != size)) {
+    std::ranges::fill(plan.dest_ips, 0);
+  }
+  std::set<NodeIP> acquired_ips(plan.dest_ips.begin(), plan.dest_ips.end());
+  acquired_ips.erase(0);
+  for (auto ip : acquired_ips) {
+    plan.dest_guards.emplace_back(this, ip, epoch_);
+  }
+  return plan;
+}
+
 NodeGuard ControllerClient::acquire_node() {
   rt::SpinGuard g(&spin_);
 
   RPCReqAcquireNode req;
   req.lpid = lpid_;
   req.ip = get_cfg_ip();
-  BUG_ON(tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false,
-                              /* poll = */ true) != sizeof(req));
-
   RPCRespAcquireNode resp;
-  BUG_ON(tcp_conn_->ReadFull(&resp, sizeof(resp), /* nt = */ false,
-                             /* poll = */ true) != sizeof(resp));
-  return NodeGuard(this, resp.succeed ? req.ip : 0);
+  if (unlikely(tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false,
+                                    /* poll = */ true) != sizeof(req) ||
+               tcp_conn_->ReadFull(&resp, sizeof(resp), /* nt = */ false,
+                                   /* poll = */ true) != sizeof(resp))) {
+    resp.succeed = false;
+  }
+  return NodeGuard(this, resp.succeed ? req.ip : 0, epoch_);
 }
 
 void ControllerClient::update_location(ProcletID id, NodeIP proclet_srv_ip) {
@@ -126,61 +429,73 @@ void ControllerClient::update_location(ProcletID id, NodeIP proclet_srv_ip) {
   RPCReqUpdateLocation req;
   req.id = id;
   req.proclet_srv_ip = proclet_srv_ip;
-  BUG_ON(tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false,
-                              /* poll = */ true) != sizeof(req));
+  // Lost updates get sent again after the failover.
+  tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false, /* poll = */ true);
 }
 
 VAddrRange ControllerClient::get_stack_cluster() const {
   return stack_cluster_;
 }
 
-std::vector<std::pair<NodeIP, Resource>> ControllerClient::report_free_resource(
-    Resource resource) {
+std::pair<uint64_t, std::vector<std::pair<NodeIP, Resource>>>
+ControllerClient::report_free_resource(std::optional<Resource> resource,
+                                       uint64_t known_view_version) {
   rt::SpinGuard g(&spin_);
 
   RPCReqReportFreeResource req;
   req.lpid = lpid_;
   req.ip = get_cfg_ip();
-  req.resource = resource;
-  BUG_ON(tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false,
-                              /* poll = */ true) != sizeof(req));
-  std::size_t num_nodes;
-  BUG_ON(tcp_conn_->ReadFull(&num_nodes, sizeof(num_nodes), /* nt = */ false,
-                             /* poll = */ true) != sizeof(num_nodes));
+  req.has_resource = resource.has_value();
+  req.resource = resource.value_or(Resource{});
+  req.view_version = known_view_version;
+  // Keeps the current view if the controller is failing over.
   std::vector<std::pair<NodeIP, Resource>> global_free_resources;
-  global_free_resources.resize(num_nodes);
+  RPCRespReportFreeResource resp;
+  if (unlikely(tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false,
+                                    /* poll = */ true) != sizeof(req) ||
+               tcp_conn_->ReadFull(&resp, sizeof(resp), /* nt = */ false,
+                                   /* poll = */ true) != sizeof(resp))) {
+    return std::make_pair(known_view_version, global_free_resources);
+  }
+  global_free_resources.resize(resp.num_nodes);
   ssize_t size_bytes = std::span(global_free_resources).size_bytes();
-  BUG_ON(tcp_conn_->ReadFull(global_free_resources.data(), size_bytes,
-                             /* nt = */ false,
-                             /* poll = */ true) != size_bytes);
-  return global_free_resources;
+  if (unlikely(tcp_conn_->ReadFull(global_free_resources.data(), size_bytes,
+                                   /* nt = */ false,
+                                   /* poll = */ true) != size_bytes)) {
+    return std::make_pair(known_view_version,
+                          std::vector<std::pair<NodeIP, Resource>>());
+  }
+  uint64_t view_version = resp.view_version;
+  return std::make_pair(view_version, std::move(global_free_resources));
 }
 
-void ControllerClient::release_node(NodeIP ip) {
+void ControllerClient::release_node(NodeIP ip, uint64_t epoch) {
   rt::SpinGuard g(&spin_);
 
+  // The new controller never had the node acquired.
+  if (unlikely(epoch != epoch_)) {
+    return;
+  }
   RPCReqReleaseNode req;
   req.lpid = lpid_;
   req.ip = ip;
-  BUG_ON(tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false,
-                              /* poll = */ true) != sizeof(req));
+  tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false, /* poll = */ true);
 }
 
 void ControllerClient::destroy_lp() {
   RPCReqDestroyLP req;
   req.lpid = lpid_;
   req.ip = get_runtime()->caladan()->get_ip();
-  RPCReturnBuffer return_buf;
-  auto rc = rpc_client_->Call(to_span(req), &return_buf);
-  BUG_ON(rc != kOk);
+  req.req_id = get_req_id();
+  call(to_span(req));
 }
 
-NodeGuard::NodeGuard(ControllerClient *client, NodeIP ip)
-    : client_(client), ip_(ip) {}
+NodeGuard::NodeGuard(ControllerClient *client, NodeIP ip, uint64_t epoch)
+    : client_(client), ip_(ip), epoch_(epoch) {}
 
 NodeGuard::~NodeGuard() {
   if (ip_) {
-    client_->release_node(ip_);
+    client_->release_node(ip_, epoch_);
   }
 }
 
@@ -2,7 +2,9 @@
 
 #include <cstdio>
 #include <fstream>
+#include <string>
 #include <utility>
+#include <vector>
 
 extern "C" {
 #include <runtime/net.h>
@@ -23,6 +25,10 @@ namespace nu {
 int ctrl_main(int argc, char **argv) {
   nu::CaladanOptionsDesc desc(kDefaultNumGuaranteedCores,
                               kDefaultNumSpinningCores, kIP);
+  std::string ctrl_ips_str;
+  desc.desc.add_options()(
+      "replicas,r", boost::program_options::value(&ctrl_ips_str),
+      "all controller ips, the primary first (comma-separated)");
   desc.parse(argc, argv);
 
   auto conf_path = desc.conf_path;
@@ -35,8 +41,10 @@ int ctrl_main(int argc, char **argv) {
     if (conf_path.starts_with(".conf_")) {
       BUG_ON(remove(conf_path.c_str()));
     }
+    auto ctrl_ips = ctrl_ips_str.empty() ? std::vector{get_cfg_ip()}
+                                         : str_to_ips(ctrl_ips_str);
     new (get_runtime())
-        Runtime(get_cfg_ip(), nu::Runtime::Mode::kController, 0, false);
+        Runtime(ctrl_ips, nu::Runtime::Mode::kController, 0, false);
     std::unreachable();
   });
 
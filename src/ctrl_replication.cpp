@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <span>
+
+extern "C" {
+#include <base/assert.h>
+#include <runtime/timer.h>
+}
+#include <runtime.h>
+
+#include "nu/ctrl_replication.hpp"
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+void DoneCtrlReqs::record(const CtrlOp &op) {
+  if (!op.req_id.seq) {
+    return;
+  }
+  auto [iter, new_req] = reqs.try_emplace(op.req_id);
+  iter->second.push_back(op);
+  if (new_req) {
+    order.push_back(op.req_id);
+    if (order.size() > kMaxNumReqs) {
+      reqs.erase(order.front());
+      order.pop_front();
+    }
+  }
+}
+
+std::optional<std::vector<CtrlOp>> DoneCtrlReqs::find(CtrlReqID req_id) const {
+  if (!req_id.seq) {
+    return std::nullopt;
+  }
+  auto iter = reqs.find(req_id);
+  if (iter == reqs.end()) {
+    return std::nullopt;
+  }
+  return iter->second;
+}
+
+void ControllerState::apply(const CtrlOp &op) {
+  done_reqs.record(op);
+  if (op.record_only) {
+    return;
+  }
+
+  switch (op.type) {
+    case CtrlOp::kRegisterNode: {
+      auto &lp = lps[op.lpid];
+      lp.md5 = op.md5;
+      lp.nodes[op.ip] = ReplicatedNode{.isol = op.isol,
+                                       .stack_cluster = op.range};
+      break;
+    }
+    case CtrlOp::kDestroyLP:
+      lps.erase(op.lpid);
+      break;
+    case CtrlOp::kAllocateProclet:
+      segments[op.range.start] = ReplicatedSegment{
+          .end = op.range.end, .location = op.ip, .lpid = op.lpid};
+      break;
+    case CtrlOp::kAllocateSegment:
+      segments[op.range.start] =
+          ReplicatedSegment{.end = op.range.end, .location = 0, .lpid = 0};
+      break;
+    case CtrlOp::kFreeSegment:
+      segments.erase(op.range.start);
+      break;
+    case CtrlOp::kUpdateLocation: {
+      auto iter = segments.find(op.range.start);
+      if (likely(iter != segments.end())) {
+        iter->second.location = op.ip;
+      }
+      break;
+    }
+    default:
+      BUG();
+  }
+}
+
+std::vector<CtrlOp> ControllerState::to_ops() const {
+  std::vector<CtrlOp> ops;
+
+  for (auto &[lpid, lp] : lps) {
+    for (auto &[ip, node] : lp.nodes) {
+      ops.push_back(CtrlOp{.type = CtrlOp::kRegisterNode,
+                           .lpid = lpid,
+                           .ip = ip,
+                           .isol = node.isol,
+                           .md5 = lp.md5,
+                           .range = node.stack_cluster});
+    }
+  }
+  for (auto &[start, segment] : segments) {
+    ops.push_back(CtrlOp{.type = segment.location ? CtrlOp::kAllocateProclet
+                                                  : CtrlOp::kAllocateSegment,
+                         .lpid = segment.lpid,
+                         .ip = segment.location,
+                         .range = {.start = start, .end = segment.end}});
+  }
+  for (auto &req_id : done_reqs.order) {
+    for (auto op : done_reqs.reqs.at(req_id)) {
+      op.record_only = true;
+      ops.push_back(op);
+    }
+  }
+  return ops;
+}
+
+ControllerReplicator::ControllerReplicator(ControllerState state)
+    : state_(std::move(state)), log_start_seq_(0), done_(false) {
+  netaddr laddr{.ip = 0, .port = kPort};
+  tcp_queue_.reset(rt::TcpQueue::Listen(laddr, kTCPListenBackLog));
+  BUG_ON(!tcp_queue_);
+
+  tcp_queue_thread_ = rt::Thread([&] {
+    rt::TcpConn *conn;
+    while ((conn = tcp_queue_->Accept())) {
+      ScopedLock lock(&mutex_);
+
+      // A new standby starts from a snapshot taken at the end of the log.
+      auto &standby = standbys_.emplace_back();
+      standby.conn.reset(conn);
+      standby.acked_seq = get_end_seq();
+      standby.last_ack_us = microtime();
+      standby.failed = false;
+      standby.exited = false;
+      standby.th = rt::Thread(
+          [&, standby = &standby, snapshot = state_.to_ops()]() mutable {
+            uint64_t num_ops = snapshot.size();
+            const iovec iovecs[] = {
+                {&num_ops, sizeof(num_ops)},
+                {snapshot.data(), std::span(snapshot).size_bytes()}};
+            uint8_t ack;
+            if (likely(standby->conn->WritevFull(std::span(iovecs)) >= 0 &&
+                       standby->conn->ReadFull(&ack, sizeof(ack)) ==
+                           sizeof(ack))) {
+              ship(standby);
+            }
+            {
+              ScopedLock lock(&mutex_);
+              standby->failed = true;
+              standby->exited = true;
+            }
+            ack_cv_.signal_all();
+          });
+    }
+  });
+
+  // Wakes up the shippers for heartbeats, drops the unresponsive standbys,
+  // and reaps the ones whose shippers have exited.
+  ticker_thread_ = rt::Thread([&] {
+    while (!rt::access_once(done_)) {
+      timer_sleep(kHeartbeatIntervalUs);
+      std::list<Standby> exited;
+      {
+        ScopedLock lock(&mutex_);
+
+        auto now_us = microtime();
+        for (auto &standby : standbys_) {
+          if (!standby.failed &&
+              now_us - standby.last_ack_us > kStandbyTimeoutUs) {
+            standby.failed = true;
+            standby.conn->Abort();
+          }
+        }
+        for (auto iter = standbys_.begin(); iter != standbys_.end();) {
+          auto cur = iter++;
+          if (cur->exited) {
+            exited.splice(exited.end(), standbys_, cur);
+          }
+        }
+        trim_log();
+      }
+      log_cv_.signal_all();
+      ack_cv_.signal_all();
+      for (auto &standby : exited) {
+        standby.th.Join();
+      }
+    }
+  });
+}
+
+ControllerReplicator::~ControllerReplicator() {
+  tcp_queue_->Shutdown();
+  tcp_queue_thread_.Join();
+  {
+    ScopedLock lock(&mutex_);
+    done_ = true;
+    for (auto &standby : standbys_) {
+      standby.conn->Abort();
+    }
+  }
+  log_cv_.signal_all();
+  ticker_thread_.Join();
+  for (auto &standby : standbys_) {
+    standby.th.Join();
+  }
+}
+
+uint64_t ControllerReplicator::get_end_seq() const {
+  return log_start_seq_ + log_.size();
+}
+
+void ControllerReplicator::append(const CtrlOp &op) {
+  {
+    ScopedLock lock(&mutex_);
+    state_.apply(op);
+    log_.push_back(op);
+  }
+  log_cv_.signal_all();
+}
+
+void ControllerReplicator::sync() {
+  ScopedLock lock(&mutex_);
+
+  auto seq = get_end_seq();
+  while (std::ranges::any_of(standbys_, [&](const Standby &standby) {
+    return !standby.failed && standby.acked_seq < seq;
+  })) {
+    ack_cv_.wait(&mutex_);
+  }
+}
+
+void ControllerReplicator::trim_log() {
+  auto seq = get_end_seq();
+  for (auto &standby : standbys_) {
+    if (!standby.failed) {
+      seq = std::min(seq, standby.acked_seq);
+    }
+  }
+  log_.erase(log_.begin(), log_.begin() + (seq - log_start_seq_));
+  log_start_seq_ = seq;
+}
+
+void ControllerReplicator::ship(Standby *standby) {
+  std::vector<CtrlOp> ops;
+
+  while (true) {
+    {
+      ScopedLock lock(&mutex_);
+
+      // Ship whatever is new once woken up; nothing new makes a heartbeat.
+      if (standby->acked_seq == get_end_seq() && !done_ && !standby->failed) {
+        log_cv_.wait(&mutex_);
+      }
+      if (unlikely(done_ || standby->failed)) {
+        return;
+      }
+      ops.assign(log_.begin() + (standby->acked_seq - log_start_seq_),
+                 log_.end());
+    }
+
+    uint64_t num_ops = ops.size();
+    const iovec iovecs[] = {{&num_ops, sizeof(num_ops)},
+                            {ops.data(), std::span(ops).size_bytes()}};
+    uint8_t ack;
+    if (unlikely(standby->conn->WritevFull(std::span(iovecs)) < 0 ||
+                 standby->conn->ReadFull(&ack, sizeof(ack)) != sizeof(ack))) {
+      return;
+    }
+
+    {
+      ScopedLock lock(&mutex_);
+      standby->acked_seq += num_ops;
+      standby->last_ack_us = microtime();
+    }
+    ack_cv_.signal_all();
+  }
+}
+
+bool follow_controller(NodeIP leader_ip, ControllerState *state) {
+  netaddr laddr{.ip = 0, .port = 0};
+  netaddr raddr{.ip = leader_ip, .port = ControllerReplicator::kPort};
+  std::unique_ptr<rt::TcpConn> conn(rt::TcpConn::Dial(laddr, raddr));
+  if (unlikely(!conn)) {
+    return false;
+  }
+
+  // The primary sends heartbeats, so silence means it's gone.
+  uint64_t last_msg_us = microtime();
+  bool done = false;
+  rt::Thread watchdog([&] {
+    while (!rt::access_once(done)) {
+      timer_sleep(ControllerReplicator::kHeartbeatIntervalUs);
+      if (microtime() - rt::access_once(last_msg_us) >
+          ControllerReplicator::kStandbyTimeoutUs) {
+        conn->Abort();
+        break;
+      }
+    }
+  });
+
+  // The first message is a snapshot of the primary's state.
+  *state = ControllerState();
+  std::vector<CtrlOp> ops;
+  while (true) {
+    uint64_t num_ops;
+    if (conn->ReadFull(&num_ops, sizeof(num_ops)) != sizeof(num_ops)) {
+      break;
+    }
+    rt::access_once(last_msg_us) = microtime();
+    ops.resize(num_ops);
+    ssize_t size = std::span(ops).size_bytes();
+    if (size && conn->ReadFull(ops.data(), size) != size) {
+      break;
+    }
+    for (auto &op : ops) {
+      state->apply(op);
+    }
+    rt::access_once(last_msg_us) = microtime();
+
+    uint8_t ack = 0;
+    if (conn->WriteFull(&ack, sizeof(ack)) != sizeof(ack)) {
+      break;
+    }
+  }
+
+  rt::access_once(done) = true;
+  watchdog.Join();
+  return true;
+}
+
+}  // namespace nu
@@ -13,12 +13,14 @@ extern "C" {
 
 namespace nu {
 
-ControllerServer::ControllerServer()
-    : num_register_node_(0),
+ControllerServer::ControllerServer(std::vector<NodeIP> ctrl_ips)
+    : ctrl_ips_(std::move(ctrl_ips)),
+      num_register_node_(0),
       num_allocate_proclet_(0),
       num_destroy_proclet_(0),
       num_resolve_proclet_(0),
       num_acquire_migration_dest_(0),
+      num_plan_migration_(0),
       num_acquire_node_(0),
       num_release_node_(0),
       num_update_location_(0),
@@ -29,21 +31,56 @@ ControllerServer::ControllerServer()
     logging_thread_ = rt::Thread([&] {
       std::cout
           << "time_us register_node allocate_proclet destroy_proclet"
-             "resolve_proclet acquire_migration_dest acquire_node release_node"
-             "update_location report_free_resource destroy_ip"
+             "resolve_proclet acquire_migration_dest plan_migration "
+             "acquire_node release_node update_location report_free_resource "
+             "destroy_ip"
           << std::endl;
       while (!rt::access_once(done_)) {
         timer_sleep(kPrintIntervalUs);
         std::cout << microtime() << " " << num_register_node_ << " "
                   << num_allocate_proclet_ << " " << num_destroy_proclet_ << " "
                   << num_resolve_proclet_ << " " << num_acquire_migration_dest_
-                  << " " << num_acquire_node_ << " " << num_release_node_ << " "
-                  << num_update_location_ << " " << num_report_free_resource_
-                  << " " << num_destroy_ip_ << std::endl;
+                  << " " << num_plan_migration_ << " " << num_acquire_node_
+                  << " " << num_release_node_ << " " << num_update_location_
+                  << " " << num_report_free_resource_ << " " << num_destroy_ip_
+                  << std::endl;
       }
     });
   }
 
+  auto iter = std::ranges::find(ctrl_ips_, get_cfg_ip());
+  BUG_ON(iter == ctrl_ips_.end());
+  uint32_t rank = iter - ctrl_ips_.begin();
+  if (rank) {
+    standby_thread_ = rt::Thread([&, rank] { run_standby(rank); });
+  } else {
+    become_primary(ControllerState());
+  }
+}
+
+void ControllerServer::run_standby(uint32_t rank) {
+  ControllerState state;
+
+  for (uint32_t leader = 0; leader < rank; leader++) {
+    auto deadline_us = microtime() + kTakeoverTimeoutUs;
+    while (!follow_controller(ctrl_ips_[leader], &state) &&
+           microtime() < deadline_us) {
+      timer_sleep(ControllerReplicator::kHeartbeatIntervalUs);
+    }
+  }
+
+  std::cout << microtime() << " taking over as the primary controller"
+            << std::endl;
+  ctrl_.restore(state);
+  become_primary(std::move(state));
+}
+
+void ControllerServer::become_primary(ControllerState state) {
+  if (ctrl_ips_.size() > 1) {
+    replicator_ = std::make_unique<ControllerReplicator>(std::move(state));
+    ctrl_.set_replicator(replicator_.get());
+  }
+
   netaddr laddr{.ip = 0, .port = kPort};
   tcp_queue_.reset(rt::TcpQueue::Listen(laddr, kTCPListenBackLog));
   BUG_ON(!tcp_queue_);
@@ -56,10 +93,17 @@ ControllerServer::ControllerServer()
   });
 }
 
+void ControllerServer::sync_standbys() {
+  if (replicator_) {
+    replicator_->sync();
+  }
+}
+
 ControllerServer::~ControllerServer() {
   done_ = true;
   barrier();
   logging_thread_.Join();
+  standby_thread_.Join();
 
   tcp_queue_.reset();
   barrier();
@@ -73,50 +117,217 @@ ControllerServer::~ControllerServer() {
 }
 
 void ControllerServer::tcp_loop(rt::TcpConn *c) {
+  // Clients drop their connections on a failover, so I/O errors just end the
+  // loop.
+  auto read_req = [&](auto *req) {
+    ssize_t data_size = sizeof(*req) - sizeof(RPCReqType);
+    return c->ReadFull(&req->rpc_type + 1, data_size) == data_size;
+  };
+  auto write_resp = [&](std::span<const std::byte> span) {
+    uint64_t len = span.size();
+    const iovec iovecs[] = {
+        {&len, sizeof(len)},
+        {const_cast<std::byte *>(span.data()), span.size()}};
+    return c->WritevFull(std::span(iovecs)) >= 0;
+  };
+
   RPCReqType rpc_type;
   while (c->ReadFull(&rpc_type, sizeof(rpc_type)) == sizeof(rpc_type)) {
     switch (rpc_type) {
+      case kRegisterNode: {
+        RPCReqRegisterNode req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        auto resp = handle_register_node(req);
+        if (unlikely(!write_resp(to_span(*resp)))) {
+          return;
+        }
+        break;
+      }
+      case kAllocateProclet: {
+        RPCReqAllocateProclet req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        auto resp = handle_allocate_proclet(req);
+        if (unlikely(!write_resp(to_span(*resp)))) {
+          return;
+        }
+        break;
+      }
+      case kAllocateProclets: {
+        RPCReqAllocateProclets req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        auto resp = handle_allocate_proclets(req);
+        if (unlikely(!write_resp(std::as_bytes(std::span(resp))))) {
+          return;
+        }
+        break;
+      }
+      case kDestroyProclet: {
+        RPCReqDestroyProclet req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        handle_destroy_proclet(req);
+        if (unlikely(!write_resp({}))) {
+          return;
+        }
+        break;
+      }
+      case kAllocateHeapSegment: {
+        RPCReqAllocateHeapSegment req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        auto resp = handle_allocate_heap_segment(req);
+        if (unlikely(!write_resp(to_span(*resp)))) {
+          return;
+        }
+        break;
+      }
+      case kFreeHeapSegment: {
+        RPCReqFreeHeapSegment req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        handle_free_heap_segment(req);
+        if (unlikely(!write_resp({}))) {
+          return;
+        }
+        break;
+      }
+      case kResolveProclet: {
+        RPCReqResolveProclet req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        auto resp = handle_resolve_proclet(req);
+        if (unlikely(!write_resp(to_span(*resp)))) {
+          return;
+        }
+        break;
+      }
+      case kResolveProclets: {
+        RPCReqResolveProclets req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        std::vector<ProcletID> ids(req.num_ids);
+        ssize_t data_size = std::span(ids).size_bytes();
+        if (unlikely(c->ReadFull(ids.data(), data_size) != data_size)) {
+          return;
+        }
+        auto ips = handle_resolve_proclets(ids);
+        if (unlikely(!write_resp(std::as_bytes(std::span(ips))))) {
+          return;
+        }
+        break;
+      }
+      case kGetProcletLocations: {
+        RPCReqGetProcletLocations req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        auto locations = handle_get_proclet_locations(req);
+        if (unlikely(!write_resp(std::as_bytes(std::span(locations))))) {
+          return;
+        }
+        break;
+      }
+      case kDestroyLP: {
+        RPCReqDestroyLP req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        handle_destroy_lp(req);
+        if (unlikely(!write_resp({}))) {
+          return;
+        }
+        break;
+      }
+      case kHeartbeat: {
+        if (unlikely(!write_resp({}))) {
+          return;
+        }
+        break;
+      }
       case kAcquireMigrationDest: {
         RPCReqAcquireMigrationDest req;
-        ssize_t data_size = sizeof(req) - sizeof(rpc_type);
-        BUG_ON(c->ReadFull(&req.rpc_type + 1, data_size) != data_size);
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
         auto resp = handle_acquire_migration_dest(req);
-        BUG_ON(c->WriteFull(&resp, sizeof(resp)) != sizeof(resp));
+        if (unlikely(c->WriteFull(&resp, sizeof(resp)) != sizeof(resp))) {
+          return;
+        }
+        break;
+      }
+      case kPlanMigration: {
+        RPCReqPlanMigration req;
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        std::vector<MigrationDemand> demands(req.num_demands);
+        auto demands_span = std::span(demands);
+        ssize_t data_size = demands_span.size_bytes();
+        if (unlikely(c->ReadFull(demands.data(), data_size) != data_size)) {
+          return;
+        }
+        auto dest_ips = handle_plan_migration(req, demands_span);
+        data_size = std::span(dest_ips).size_bytes();
+        if (unlikely(c->WriteFull(dest_ips.data(), data_size) != data_size)) {
+          return;
+        }
         break;
       }
       case kAcquireNode: {
         RPCReqAcquireNode req;
-        ssize_t data_size = sizeof(req) - sizeof(rpc_type);
-        BUG_ON(c->ReadFull(&req.rpc_type + 1, data_size) != data_size);
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
         auto resp = handle_acquire_node(req);
-        BUG_ON(c->WriteFull(&resp, sizeof(resp)) != sizeof(resp));
+        if (unlikely(c->WriteFull(&resp, sizeof(resp)) != sizeof(resp))) {
+          return;
+        }
         break;
       }
       case kReleaseNode: {
         RPCReqReleaseNode req;
-        ssize_t data_size = sizeof(req) - sizeof(rpc_type);
-        BUG_ON(c->ReadFull(&req.rpc_type + 1, data_size) != data_size);
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
         handle_release_node(req);
         break;
       }
       case kUpdateLocation: {
         RPCReqUpdateLocation req;
-        ssize_t data_size = sizeof(req) - sizeof(rpc_type);
-        BUG_ON(c->ReadFull(&req.rpc_type + 1, data_size) != data_size);
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
         handle_update_location(req);
         break;
       }
       case kReportFreeResource: {
         RPCReqReportFreeResource req;
-        ssize_t data_size = sizeof(req) - sizeof(rpc_type);
-        BUG_ON(c->ReadFull(&req.rpc_type + 1, data_size) != data_size);
-        auto global_free_resources = handle_report_free_resource(req);
-        std::size_t num_nodes = global_free_resources.size();
+        if (unlikely(!read_req(&req))) {
+          return;
+        }
+        auto [view_version, global_free_resources] =
+            handle_report_free_resource(req);
+        RPCRespReportFreeResource resp;
+        resp.view_version = view_version;
+        resp.num_nodes = global_free_resources.size();
         const iovec iovecs[] = {
-            {&num_nodes, sizeof(num_nodes)},
+            {&resp, sizeof(resp)},
             {global_free_resources.data(),
              std::span(global_free_resources).size_bytes()}};
-        BUG_ON(c->WritevFull(std::span(iovecs)) < 0);
+        if (unlikely(c->WritevFull(std::span(iovecs)) < 0)) {
+          return;
+        }
         break;
       }
       default:
@@ -136,7 +347,7 @@ std::unique_ptr<RPCRespRegisterNode> ControllerServer::handle_register_node(
   auto lpid = req.lpid;
   auto md5 = req.md5;
   auto isol = req.isol;
-  auto optional = ctrl_.register_node(ip, lpid, md5, isol);
+  auto optional = ctrl_.register_node(ip, lpid, md5, isol, req.req_id);
   if (optional) {
     resp->empty = false;
     resp->lpid = optional->first;
@@ -144,6 +355,7 @@ std::unique_ptr<RPCRespRegisterNode> ControllerServer::handle_register_node(
   } else {
     resp->empty = true;
   }
+  sync_standbys();
   return resp;
 }
 
@@ -154,7 +366,8 @@ ControllerServer::handle_allocate_proclet(const RPCReqAllocateProclet &req) {
   }
 
   auto resp = std::make_unique_for_overwrite<RPCRespAllocateProclet>();
-  auto optional = ctrl_.allocate_proclet(req.capacity, req.lpid, req.ip_hint);
+  auto optional = ctrl_.allocate_proclet(req.capacity, req.lpid, req.ip_hint,
+                                         req.req_id);
   if (optional) {
     resp->empty = false;
     resp->id = optional->first;
@@ -162,16 +375,52 @@ ControllerServer::handle_allocate_proclet(const RPCReqAllocateProclet &req) {
   } else {
     resp->empty = true;
   }
+  sync_standbys();
   return resp;
 }
 
+std::vector<std::pair<ProcletID, NodeIP>>
+ControllerServer::handle_allocate_proclets(const RPCReqAllocateProclets &req) {
+  if constexpr (kEnableLogging) {
+    num_allocate_proclet_ += req.num;
+  }
+
+  auto allocated =
+      ctrl_.allocate_proclets(req.num, req.capacity, req.lpid, req.ip_hint,
+                              req.req_id);
+  sync_standbys();
+  return allocated;
+}
+
 void ControllerServer::handle_destroy_proclet(
     const RPCReqDestroyProclet &req) {
   if constexpr (kEnableLogging) {
     num_destroy_proclet_++;
   }
 
-  ctrl_.destroy_proclet(req.heap_segment);
+  ctrl_.destroy_proclet(req.heap_segment, req.req_id);
+  sync_standbys();
+}
+
+std::unique_ptr<RPCRespAllocateHeapSegment>
+ControllerServer::handle_allocate_heap_segment(
+    const RPCReqAllocateHeapSegment &req) {
+  auto resp = std::make_unique_for_overwrite<RPCRespAllocateHeapSegment>();
+  auto optional = ctrl_.allocate_heap_segment(req.capacity, req.req_id);
+  if (optional) {
+    resp->empty = false;
+    resp->segment = *optional;
+  } else {
+    resp->empty = true;
+  }
+  sync_standbys();
+  return resp;
+}
+
+void ControllerServer::handle_free_heap_segment(
+    const RPCReqFreeHeapSegment &req) {
+  ctrl_.free_heap_segment(req.segment, req.req_id);
+  sync_standbys();
 }
 
 std::unique_ptr<RPCRespResolveProclet> ControllerServer::handle_resolve_proclet(
@@ -185,6 +434,21 @@ std::unique_ptr<RPCRespResolveProclet> ControllerServer::handle_resolve_proclet(
   return resp;
 }
 
+std::vector<NodeIP> ControllerServer::handle_resolve_proclets(
+    std::span<const ProcletID> ids) {
+  if constexpr (kEnableLogging) {
+    num_resolve_proclet_ += ids.size();
+  }
+
+  return ctrl_.resolve_proclets(ids);
+}
+
+std::vector<std::pair<ProcletID, NodeIP>>
+ControllerServer::handle_get_proclet_locations(
+    const RPCReqGetProcletLocations &req) {
+  return ctrl_.get_proclet_locations(req.lpid);
+}
+
 void ControllerServer::handle_update_location(const RPCReqUpdateLocation &req) {
   if constexpr (kEnableLogging) {
     num_update_location_++;
@@ -200,13 +464,24 @@ RPCRespAcquireMigrationDest ControllerServer::handle_acquire_migration_dest(
   }
 
   RPCRespAcquireMigrationDest resp;
-  auto pair = ctrl_.acquire_migration_dest(req.lpid, req.src_ip,
-                                           req.has_mem_pressure, req.resource);
+  auto pair =
+      ctrl_.acquire_migration_dest(req.lpid, req.src_ip, req.has_mem_pressure,
+                                   req.resource, req.preferred_ip);
   resp.ip = pair.first;
   resp.resource = pair.second;
   return resp;
 }
 
+std::vector<NodeIP> ControllerServer::handle_plan_migration(
+    const RPCReqPlanMigration &req, std::span<const MigrationDemand> demands) {
+  if constexpr (kEnableLogging) {
+    num_plan_migration_++;
+  }
+
+  return ctrl_.plan_migration(req.lpid, req.src_ip, req.has_mem_pressure,
+                              demands);
+}
+
 RPCRespAcquireNode ControllerServer::handle_acquire_node(
     const RPCReqAcquireNode &req) {
   if constexpr (kEnableLogging) {
@@ -226,14 +501,19 @@ void ControllerServer::handle_release_node(const RPCReqReleaseNode &req) {
   ctrl_.release_node(req.lpid, req.ip);
 }
 
-std::vector<std::pair<NodeIP, Resource>>
+std::pair<uint64_t, std::vector<std::pair<NodeIP, Resource>>>
 ControllerServer::handle_report_free_resource(
     const RPCReqReportFreeResource &req) {
   if constexpr (kEnableLogging) {
     num_report_free_resource_++;
   }
 
-  return ctrl_.report_free_resource(req.lpid, req.ip, req.resource);
+  std::optional<Resource> resource;
+  if (req.has_resource) {
+    resource = req.resource;
+  }
+  return ctrl_.report_free_resource(req.lpid, req.ip, resource,
+                                    req.view_version);
 }
 
 void ControllerServer::handle_destroy_lp(const RPCReqDestroyLP &req) {
@@ -241,7 +521,8 @@ void ControllerServer::handle_destroy_lp(const RPCReqDestroyLP &req) {
     num_destroy_ip_++;
   }
 
-  return ctrl_.destroy_lp(req.lpid, req.ip);
+  ctrl_.destroy_lp(req.lpid, req.ip, req.req_id);
+  sync_standbys();
 }
 
 }  // namespace nu
@@ -36,17 +36,19 @@ static inline ReallocFn get_real_realloc() {
   return real_realloc;
 }
 
+static inline nu::SlabAllocator *get_slab() {
+  auto *slab = nu::Caladan::thread_self()
+                   ? nu::get_runtime()->caladan()->thread_get_proclet_slab()
+                   : nullptr;
+  return slab ? slab : nu::get_runtime()->runtime_slab();
+}
+
 static inline void *__new(std::size_t size) {
   nu::Caladan::PreemptGuard g;
 
   void *ptr;
-  auto *slab = nu::Caladan::thread_self()
-                   ? nu::get_runtime()->caladan()->thread_get_proclet_slab()
-                   : nullptr;
-  if (slab) {
+  if (auto *slab = get_slab()) {
     ptr = slab->allocate(size);
-  } else if (auto *runtime_slab = nu::get_runtime()->runtime_slab()) {
-    ptr = runtime_slab->allocate(size);
   } else {
     ptr = get_real_malloc()(size);
   }
@@ -65,16 +67,16 @@ void *operator new(std::size_t size,
 }
 
 static inline void *__new_aligned(std::size_t size, std::align_val_t al) {
-  size += sizeof(size_t);
+  nu::Caladan::PreemptGuard g;
+
+  void *ptr;
   auto align = static_cast<std::size_t>(al);
-  auto *ptr = __new(size + align - 1);
-  auto ptr_addr = reinterpret_cast<uintptr_t>(ptr);
-  auto aligned_ptr_addr =
-      (ptr_addr + sizeof(size_t) + align - 1) & (~(align - 1));
-  assert(reinterpret_cast<uintptr_t>(aligned_ptr_addr) % align == 0);
-  auto *header = reinterpret_cast<void **>(aligned_ptr_addr) - 1;
-  *header = ptr;
-  return reinterpret_cast<void *>(aligned_ptr_addr);
+  if (auto *slab = get_slab()) {
+    ptr = slab->allocate_aligned(size, align);
+  } else if (posix_memalign(&ptr, align, size)) {
+    ptr = nullptr;
+  }
+  return ptr;
 }
 
 void *operator new(std::size_t size, std::align_val_t al) {
@@ -103,8 +105,7 @@ static inline void __delete(void *ptr) {
 void operator delete(void *ptr) noexcept { __delete(ptr); }
 
 void operator delete(void *ptr, std::align_val_t al) noexcept {
-  auto *header = reinterpret_cast<void **>(ptr) - 1;
-  __delete(*header);
+  __delete(ptr);
 }
 
 void *malloc(std::size_t size) { return __new(size); }
@@ -0,0 +1,91 @@
+#include <algorithm>
+
+#include "nu/migration_estimator.hpp"
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+MigrationEstimator::MigrationEstimator() {}
+
+float MigrationEstimator::Model::predict_us(uint64_t size) const {
+  return fixed_cost_us.load(std::memory_order_relaxed) +
+         size * us_per_byte.load(std::memory_order_relaxed);
+}
+
+void MigrationEstimator::Model::add(uint64_t size, float actual_us) {
+  num_samples++;
+  ewma(kEWMAWeight, &mean_size, static_cast<double>(size));
+  ewma(kEWMAWeight, &mean_us, static_cast<double>(actual_us));
+  ewma(kEWMAWeight, &mean_size_sq, static_cast<double>(size) * size);
+  ewma(kEWMAWeight, &mean_size_us, static_cast<double>(size) * actual_us);
+  if (unlikely(mean_size <= 0)) {
+    return;
+  }
+
+  // A least-squares fit over the moving averages. It degenerates into keeping
+  // the fixed overhead when the sizes barely vary, yet leaves part of the time
+  // to the transfer.
+  double fixed_us = std::min<double>(
+      fixed_cost_us.load(std::memory_order_relaxed), mean_us / 2);
+  double slope = (mean_us - fixed_us) / mean_size;
+  auto var = mean_size_sq - mean_size * mean_size;
+  auto min_stddev = kMinRelSizeStddev * mean_size;
+  if (num_samples >= kMinNumSamplesForFixedCost &&
+      var > min_stddev * min_stddev) {
+    auto fitted_slope = (mean_size_us - mean_size * mean_us) / var;
+    auto fitted_fixed_us = mean_us - fitted_slope * mean_size;
+    if (fitted_slope > 0 && fitted_fixed_us >= 0) {
+      slope = fitted_slope;
+      fixed_us = fitted_fixed_us;
+    }
+  }
+  if (slope > 0) {
+    fixed_cost_us.store(fixed_us, std::memory_order_relaxed);
+    us_per_byte.store(slope, std::memory_order_relaxed);
+  }
+}
+
+MigrationEstimator::Model *MigrationEstimator::get_model(NodeIP dest_ip) {
+  if (!dest_ip) {
+    return &global_model_;
+  }
+  auto iter = dest_models_.find(dest_ip);
+  return iter != dest_models_.end() ? &iter->second : &global_model_;
+}
+
+float MigrationEstimator::predict_us(NodeIP dest_ip, uint64_t size) {
+  if (!dest_ip) {
+    return global_model_.predict_us(size);
+  }
+  ScopedLock lock(&spin_);
+  return get_model(dest_ip)->predict_us(size);
+}
+
+void MigrationEstimator::add(const MigrationTimeRecord &record) {
+  ScopedLock lock(&spin_);
+  global_model_.add(record.size, record.actual_us);
+  dest_models_[record.dest_ip].add(record.size, record.actual_us);
+  if (records_.size() == kMaxNumRecords) {
+    records_.pop_front();
+  }
+  records_.push_back(record);
+}
+
+float MigrationEstimator::get_fixed_cost_us(NodeIP dest_ip) {
+  ScopedLock lock(&spin_);
+  return get_model(dest_ip)->fixed_cost_us.load(std::memory_order_relaxed);
+}
+
+float MigrationEstimator::get_net_bw_gbps(NodeIP dest_ip) {
+  ScopedLock lock(&spin_);
+  auto us_per_byte =
+      get_model(dest_ip)->us_per_byte.load(std::memory_order_relaxed);
+  return 8 / us_per_byte / 1000;
+}
+
+std::vector<MigrationTimeRecord> MigrationEstimator::get_records() {
+  ScopedLock lock(&spin_);
+  return std::vector<MigrationTimeRecord>(records_.begin(), records_.end());
+}
+
+}  // namespace nu
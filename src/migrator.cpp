@@ -4,12 +4,16 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstring>
+#include <map>
 #include <memory>
+#include <numeric>
+#include <optional>
 #include <span>
 #include <syncstream>
 
 extern "C" {
 #include <base/assert.h>
+#include <base/log.h>
 #include <net/ip.h>
 #include <runtime/membarrier.h>
 #include <runtime/timer.h>
@@ -17,6 +21,7 @@ extern "C" {
 #include <thread.h>
 #include <runtime.h>
 
+#include "nu/call_graph_profiler.hpp"
 #include "nu/commons.hpp"
 #include "nu/ctrl_client.hpp"
 #include "nu/migrator.hpp"
@@ -24,6 +29,7 @@ extern "C" {
 #include "nu/pressure_handler.hpp"
 #include "nu/proclet_mgr.hpp"
 #include "nu/proclet_server.hpp"
+#include "nu/rpc_client_mgr.hpp"
 #include "nu/utils/cond_var.hpp"
 #include "nu/utils/mutex.hpp"
 #include "nu/utils/scoped_lock.hpp"
@@ -109,10 +115,9 @@ Migrator::~Migrator() {
 
 void Migrator::handle_copy_proclet(rt::TcpConn *c) {
   ProcletHeader *proclet_header;
-  uint64_t start_addr, len;
+  uint64_t num_pieces;
   const iovec iovecs[] = {{&proclet_header, sizeof(proclet_header)},
-                          {&start_addr, sizeof(start_addr)},
-                          {&len, sizeof(len)}};
+                          {&num_pieces, sizeof(num_pieces)}};
   BUG_ON(c->ReadvFull(std::span(iovecs), /* nt = */ false, /* poll = */ true) <=
          0);
 
@@ -126,8 +131,14 @@ void Migrator::handle_copy_proclet(rt::TcpConn *c) {
     proclet_header->status() = kAbsent;
   }
 
-  BUG_ON(c->ReadFull(reinterpret_cast<uint8_t *>(start_addr), len,
-                     /* nt = */ true, /* poll = */ true) <= 0);
+  for (uint64_t i = 0; i < num_pieces; i++) {
+    VAddrRange piece;
+    BUG_ON(c->ReadFull(&piece, sizeof(piece), /* nt = */ false,
+                       /* poll = */ true) <= 0);
+    BUG_ON(c->ReadFull(reinterpret_cast<uint8_t *>(piece.start),
+                       piece.end - piece.start,
+                       /* nt = */ true, /* poll = */ true) <= 0);
+  }
   proclet_header->pending_load_cnt--;
 }
 
@@ -221,25 +232,51 @@ void Migrator::transmit_proclet(rt::TcpConn *c, ProcletHeader *proclet_header) {
   }
 
   uint8_t type = kCopyProclet;
-  auto start_addr = reinterpret_cast<uint64_t>(proclet_header->copy_start);
-  auto len = (reinterpret_cast<uint64_t>(proclet_header->slab.get_base()) -
-              start_addr) +
-             proclet_header->slab.get_usage();
+  // The heap might span several regions. Their carved parts are concatenated
+  // and split evenly, so every thread sends one or more pieces.
+  auto &slab = proclet_header->slab;
+  VAddrRange ranges[SlabAllocator::kMaxNumRegions];
+  uint32_t num_ranges = 0;
+  uint64_t len = 0;
+  for (uint32_t i = 0; i < slab.get_num_regions(); i++) {
+    auto range = slab.get_used_region(i);
+    if (!i) {
+      range.start = reinterpret_cast<uint64_t>(proclet_header->copy_start);
+    }
+    if (range.end > range.start) {
+      ranges[num_ranges++] = range;
+      len += range.end - range.start;
+    }
+  }
   auto per_thread_len = (len - 1) / kTransmitProcletNumThreads + 1;
-  uint64_t req_start_addrs[kTransmitProcletNumThreads];
-  uint64_t req_lens[kTransmitProcletNumThreads];
+  uint64_t num_pieces[kTransmitProcletNumThreads];
+  VAddrRange pieces[kTransmitProcletNumThreads][SlabAllocator::kMaxNumRegions];
+  uint32_t range_idx = 0;
+  uint64_t range_offset = 0;
 
   for (uint32_t i = 0; i < kTransmitProcletNumThreads; i++) {
-    req_start_addrs[i] = start_addr + i * per_thread_len;
-    req_lens[i] = (i != kTransmitProcletNumThreads - 1)
-                      ? per_thread_len
-                      : start_addr + len - req_start_addrs[i];
-    std::vector<iovec> task{
-        {&type, sizeof(type)},
-        {&proclet_header, sizeof(proclet_header)},
-        {&req_start_addrs[i], sizeof(req_start_addrs[i])},
-        {&req_lens[i], sizeof(req_lens[i])},
-        {reinterpret_cast<std::byte *>(req_start_addrs[i]), req_lens[i]}};
+    std::vector<iovec> task{{&type, sizeof(type)},
+                            {&proclet_header, sizeof(proclet_header)},
+                            {&num_pieces[i], sizeof(num_pieces[i])}};
+    num_pieces[i] = 0;
+    auto remaining =
+        std::min(per_thread_len, len - std::min(len, i * per_thread_len));
+    while (remaining) {
+      auto &range = ranges[range_idx];
+      auto &piece = pieces[i][num_pieces[i]++];
+      piece.start = range.start + range_offset;
+      piece.end =
+          piece.start + std::min(remaining, range.end - piece.start);
+      task.push_back({&piece, sizeof(piece)});
+      task.push_back({reinterpret_cast<std::byte *>(piece.start),
+                      piece.end - piece.start});
+      remaining -= piece.end - piece.start;
+      range_offset += piece.end - piece.start;
+      if (piece.end == range.end) {
+        range_idx++;
+        range_offset = 0;
+      }
+    }
     if (i < PressureHandler::kNumAuxHandlers) {
       // Dispatch to aux handler.
       get_runtime()->pressure_handler()->dispatch_aux_tcp_task(i,
@@ -512,44 +549,108 @@ uint32_t Migrator::migrate(
     callback();
   }
 
+  struct DestTasks {
+    std::vector<uint32_t> idxes;
+    std::vector<ProcletMigrationTask> tasks;
+    MigratorConn conn;
+  };
+
   std::set<NodeIP> congested_dests;
-  auto it = tasks.begin();
-  std::vector<ProcletMigrationTask> cur_round_tasks;
+  std::vector<uint32_t> pending_idxes(tasks.size());
+  std::iota(pending_idxes.begin(), pending_idxes.end(), 0);
+  uint32_t num_migrated = 0;
 
-  while (it != tasks.end() &&
+  while (!pending_idxes.empty() &&
          get_runtime()->pressure_handler()->has_pressure()) {
     auto has_mem_pressure =
         get_runtime()->pressure_handler()->has_mem_pressure();
-    auto [dest_guard, dest_resource] =
-        get_runtime()->controller_client()->acquire_migration_dest(
-            has_mem_pressure, it->second);
-    auto dest_ip = dest_guard.get_ip();
-    if (unlikely(!dest_guard || congested_dests.contains(dest_ip))) {
-      break;
+    std::vector<MigrationDemand> demands;
+    auto now_us = microtime();
+    for (auto idx : pending_idxes) {
+      auto &[task, resource] = tasks[idx];
+      auto affinity =
+          get_runtime()->call_graph_profiler()->get_affinity(task.header);
+      auto preferred_ip = affinity ? affinity->best_remote_ip : 0;
+      // Don't steer a proclet back to where it just came from.
+      if (preferred_ip == task.header->migrated_from_ip &&
+          now_us - task.header->migrated_in_us < Utility::kMigrationPenaltyUs) {
+        preferred_ip = 0;
+      }
+      demands.push_back({resource, preferred_ip});
     }
-
-    cur_round_tasks.clear();
-    Resource cur_round_resource{.cores = 0, .mem_mbs = 0};
-    for (auto tmp = it; tmp != tasks.end(); ++tmp) {
-      cur_round_resource += tmp->second;
-      bool too_much = cur_round_resource.mem_mbs > dest_resource.mem_mbs;
-      if (!has_mem_pressure) {
-        too_much |= cur_round_resource.cores > dest_resource.cores;
+    auto plan = get_runtime()->controller_client()->plan_migration(
+        has_mem_pressure, demands);
+
+    // Tasks without a usable destination are left where they are, and so are
+    // those that would co-locate replicas.
+    std::map<NodeIP, DestTasks> dest_to_tasks;
+    for (size_t i = 0; i < pending_idxes.size(); i++) {
+      auto dest_ip = plan.dest_ips[i];
+      if (!dest_ip || congested_dests.contains(dest_ip)) {
+        continue;
       }
-      if (too_much) {
-        break;
+      auto &task = tasks[pending_idxes[i]].first;
+      auto &dest_tasks = dest_to_tasks[dest_ip];
+      if (unlikely(has_replica_peer_at(task.header, dest_ip,
+                                       dest_tasks.tasks))) {
+        continue;
       }
-      cur_round_tasks.push_back(tmp->first);
+      dest_tasks.idxes.push_back(pending_idxes[i]);
+      dest_tasks.tasks.push_back(task);
+    }
+    std::erase_if(dest_to_tasks,
+                  [](auto &pair) { return pair.second.tasks.empty(); });
+    if (unlikely(dest_to_tasks.empty())) {
+      break;
     }
 
-    auto delta = __migrate(dest_guard, has_mem_pressure, cur_round_tasks);
-    if (unlikely(delta < cur_round_tasks.size())) {
-      congested_dests.insert(dest_ip);
+    // Hand out all task lists first so that every destination populates its
+    // heaps while the proclets are streamed to the others.
+    for (auto &[dest_ip, dest_tasks] : dest_to_tasks) {
+      dest_tasks.conn = migrator_conn_mgr_.get(dest_ip);
+      auto *conn = dest_tasks.conn.get_tcp_conn();
+      BUG_ON(conn->HasPendingDataToRead());
+      transmit_proclet_migration_tasks(conn, has_mem_pressure,
+                                       dest_tasks.tasks);
+    }
+
+    // Thread pausing and the aux handlers are process-wide, so destinations
+    // are streamed to one after another. The leftovers of a congested
+    // destination go to the others next round.
+    pending_idxes.clear();
+    for (auto &[dest_ip, dest_tasks] : dest_to_tasks) {
+      auto delta = __migrate(dest_tasks.conn.get_tcp_conn(), dest_ip,
+                             has_mem_pressure, dest_tasks.tasks);
+      if (unlikely(delta < dest_tasks.tasks.size())) {
+        congested_dests.insert(dest_ip);
+        pending_idxes.insert(pending_idxes.end(),
+                             dest_tasks.idxes.begin() + delta,
+                             dest_tasks.idxes.end());
+      }
+      num_migrated += delta;
     }
-    it += delta;
   }
 
-  return it - tasks.begin();
+  return num_migrated;
+}
+
+bool Migrator::has_replica_peer_at(
+    ProcletHeader *proclet_header, NodeIP ip,
+    const std::vector<ProcletMigrationTask> &cur_round_tasks) {
+  for (auto peer : proclet_header->replica_peers) {
+    if (!peer) {
+      break;
+    }
+    if (get_runtime()->rpc_client_mgr()->get_ip_by_proclet_id(peer) == ip) {
+      return true;
+    }
+    for (auto &task : cur_round_tasks) {
+      if (to_proclet_id(task.header) == peer) {
+        return true;
+      }
+    }
+  }
+  return false;
 }
 
 void Migrator::pause_migrating_threads(ProcletHeader *proclet_header) {
@@ -596,23 +697,29 @@ static inline bool receive_approval(rt::TcpConn *c) {
   return approval;
 }
 
-uint32_t Migrator::__migrate(const NodeGuard &dest_guard, bool mem_pressure,
+uint32_t Migrator::__migrate(rt::TcpConn *conn, NodeIP dest_ip,
+                             bool mem_pressure,
                              const std::vector<ProcletMigrationTask> &tasks) {
-  if (unlikely(tasks.empty())) {
-    return 0;
-  }
-
   auto *pressure_handler = get_runtime()->pressure_handler();
-  auto conn_guard = migrator_conn_mgr_.get(dest_guard.get_ip());
-  auto *conn = conn_guard.get_tcp_conn();
-  BUG_ON(conn->HasPendingDataToRead());
-  transmit_proclet_migration_tasks(conn, mem_pressure, tasks);
+
+  // A proclet's time runs until the destination's next approval comes in.
+  std::optional<MigrationTimeRecord> pending_record;
+  uint64_t start_us = 0;
+  auto wait_approval = [&] {
+    auto approval = receive_approval(conn);
+    if (pending_record) {
+      pending_record->actual_us = microtime() - start_us;
+      estimator_.add(*pending_record);
+      pending_record.reset();
+    }
+    return approval;
+  };
 
   bool aux_handlers_enabled = false;
   auto it = tasks.begin();
   for (; it != tasks.end(); ++it) {
     auto *proclet_header = it->header;
-    if (unlikely(it != tasks.begin() && !receive_approval(conn))) {
+    if (unlikely(it != tasks.begin() && !wait_approval())) {
       break;
     }
 
@@ -626,9 +733,16 @@ uint32_t Migrator::__migrate(const NodeGuard &dest_guard, bool mem_pressure,
 
     if (unlikely(!aux_handlers_enabled)) {
       aux_handlers_enabled = true;
-      aux_handlers_enable_polling(dest_guard.get_ip());
+      aux_handlers_enable_polling(dest_ip);
     }
 
+    auto size = proclet_header->total_mem_size();
+    pending_record = MigrationTimeRecord{
+        .id = to_proclet_id(proclet_header),
+        .dest_ip = dest_ip,
+        .size = size,
+        .predicted_us = estimator_.predict_us(dest_ip, size)};
+    start_us = microtime();
     pause_migrating_threads(proclet_header);
     {
       ScopedLock l(&proclet_header->migration_spin());
@@ -644,7 +758,7 @@ uint32_t Migrator::__migrate(const NodeGuard &dest_guard, bool mem_pressure,
     aux_handlers_disable_polling();
   }
 
-  receive_approval(conn);
+  wait_approval();
 
   return it - tasks.begin();
 }
@@ -679,6 +793,8 @@ bool Migrator::load_proclet(rt::TcpConn *c, ProcletHeader *proclet_header,
 
   auto *slab = &proclet_header->slab;
   nu::SlabAllocator::register_slab_by_id(slab, slab->get_id());
+  // The copy populated the pages the source had returned to the OS.
+  slab->release_spans();
 
   if constexpr (kMonitorTime) {
     t1 = microtime();
@@ -859,18 +975,20 @@ Migrator::load_proclet_migration_tasks(rt::TcpConn *c) {
 }
 
 void Migrator::populate_proclets(std::vector<ProcletMigrationTask> &tasks) {
-  for (auto &[header, _, size] : tasks) {
+  for (auto &[header, capacity, size] : tasks) {
     ScopedLock l(&header->migration_spin());
 
     if (unlikely(header->status() == kCleaning)) {
       std::destroy_at(&header->slab);
     }
     header->status() = kPopulating;
-    header->populate_size = size;
+    // Regions beyond the first one are populated by the copy itself.
+    header->populate_size = std::min(size, capacity);
   }
 
   rt::Spawn([tasks] {
-    for (auto &[header, _, size] : tasks) {
+    for (auto &task : tasks) {
+      auto *header = task.header;
       if (load_acquire(&header->status()) == kPopulating) {
         ScopedLock l(&header->migration_spin());
 
@@ -878,7 +996,8 @@ void Migrator::populate_proclets(std::vector<ProcletMigrationTask> &tasks) {
           if (unlikely(get_runtime()->pressure_handler()->has_mem_pressure())) {
             break;
           }
-          get_runtime()->proclet_manager()->madvise_populate(header, size);
+          get_runtime()->proclet_manager()->madvise_populate(
+              header, header->populate_size);
         }
       }
     }
@@ -928,6 +1047,9 @@ void Migrator::load(rt::TcpConn *c) {
       depopulate_proclet(proclet_header);
       continue;
     }
+    proclet_header->migrated_in_us = microtime();
+    proclet_header->migrated_from_ip = c->RemoteAddr().ip;
+    proclet_header->num_migrations++;
 
     load_mutexes(c, proclet_header);
     load_condvars(c, proclet_header);
@@ -941,6 +1063,8 @@ void Migrator::load(rt::TcpConn *c) {
   issue_approval(c, true);
 }
 
+MigrationEstimator *Migrator::estimator() { return &estimator_; }
+
 void Migrator::reserve_conns(uint32_t dest_server_ip) {
   std::vector<MigratorConn> migrator_conns;
   migrator_conns.reserve(kDefaultNumReservedConns);
@@ -1005,6 +1129,11 @@ retry:
     get_runtime()->rpc_client_mgr()->invalidate_cache(dest_id, rpc_client);
     goto retry;
   }
+  if (unlikely(rc == kErrUnknownHandler)) {
+    char ip_str[IP_ADDR_STR_LEN];
+    log_err("migrator: %s doesn't know the thread loader, thread dropped",
+            ip_addr_to_str(rpc_client->GetAddr().ip, ip_str));
+  }
 
   rt::Exit();
 }
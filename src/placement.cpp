@@ -0,0 +1,91 @@
+#include <vector>
+
+#include "nu/ctrl.hpp"
+#include "nu/placement.hpp"
+#include "nu/utils/splitmix64.hpp"
+
+namespace nu {
+
+inline bool is_candidate(const NodeStatus &status, Resource demand) {
+  return !status.isol && status.has_enough_resource(demand);
+}
+
+// Whether x has more free resource than y.
+inline bool is_less_loaded(const NodeStatus &x, const NodeStatus &y) {
+  if (x.free_resource.cores != y.free_resource.cores) {
+    return x.free_resource.cores > y.free_resource.cores;
+  }
+  return x.free_resource.mem_mbs > y.free_resource.mem_mbs;
+}
+
+NodeIP RoundRobinPolicy::select(const NodeStatuses &node_statuses,
+                                Resource demand) {
+  auto start = node_statuses.upper_bound(last_ip_.load());
+  auto iter = start;
+  do {
+    if (iter == node_statuses.end()) {
+      iter = node_statuses.begin();
+      if (iter == start) {
+        break;
+      }
+    }
+    if (is_candidate(iter->second, demand)) {
+      last_ip_.store(iter->first);
+      return iter->first;
+    }
+  } while (++iter != start);
+  return 0;
+}
+
+NodeIP LeastLoadedPolicy::select(const NodeStatuses &node_statuses,
+                                 Resource demand) {
+  const NodeStatuses::value_type *best = nullptr;
+  for (auto &pair : node_statuses) {
+    if (is_candidate(pair.second, demand) &&
+        (!best || is_less_loaded(pair.second, best->second))) {
+      best = &pair;
+    }
+  }
+  return best ? best->first : 0;
+}
+
+NodeIP PowerOfTwoChoicesPolicy::select(const NodeStatuses &node_statuses,
+                                       Resource demand) {
+  std::vector<const NodeStatuses::value_type *> candidates;
+  for (auto &pair : node_statuses) {
+    if (is_candidate(pair.second, demand)) {
+      candidates.push_back(&pair);
+    }
+  }
+  if (candidates.empty()) {
+    return 0;
+  }
+
+  SplitMix64 rng;
+  auto *x = candidates[rng.next() % candidates.size()];
+  auto *y = candidates[rng.next() % candidates.size()];
+  return is_less_loaded(y->second, x->second) ? y->first : x->first;
+}
+
+BinPackingPolicy::BinPackingPolicy(
+    float min_mem_mbs, std::unique_ptr<PlacementPolicy> light_policy)
+    : min_mem_mbs_(min_mem_mbs), light_policy_(std::move(light_policy)) {}
+
+NodeIP BinPackingPolicy::select(const NodeStatuses &node_statuses,
+                                Resource demand) {
+  if (demand.mem_mbs < min_mem_mbs_) {
+    return light_policy_->select(node_statuses, demand);
+  }
+
+  const NodeStatuses::value_type *best = nullptr;
+  for (auto &pair : node_statuses) {
+    if (is_candidate(pair.second, demand) &&
+        (!best || pair.second.free_resource.mem_mbs <
+                      best->second.free_resource.mem_mbs)) {
+      best = &pair;
+    }
+  }
+  return best ? best->first : 0;
+}
+
+}  // namespace nu
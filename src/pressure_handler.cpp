@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <limits>
 #include <type_traits>
@@ -5,12 +6,14 @@
 #include <sync.h>
 #include <thread.h>
 
+#include "nu/call_graph_profiler.hpp"
 #include "nu/commons.hpp"
 #include "nu/ctrl_client.hpp"
 #include "nu/runtime.hpp"
 #include "nu/migrator.hpp"
 #include "nu/pressure_handler.hpp"
 #include "nu/utils/caladan.hpp"
+#include "nu/utils/slab.hpp"
 
 constexpr static bool kEnableLogging = false;
 
@@ -22,8 +25,9 @@ PressureHandler::PressureHandler()
 
   update_th_ = rt::Thread([&] {
     while (!rt::access_once(done_)) {
-      timer_sleep_hp(kSortedProcletsUpdateIntervalMs * kOneMilliSecond);
-      update_sorted_proclets();
+      timer_sleep_hp(kAffinitiesUpdateIntervalMs * kOneMilliSecond);
+      get_runtime()->call_graph_profiler()->update_affinities(
+          Utility::kFixedCostUs, Utility::kNetBwGbps);
     }
   });
 }
@@ -39,60 +43,6 @@ PressureHandler::~PressureHandler() {
   }
 }
 
-Utility::Utility() {}
-
-Utility::Utility(ProcletHeader *proclet_header, uint64_t mem_size,
-                 float cpu_load) {
-  header = proclet_header;
-  auto time = kFixedCostUs + (mem_size / (kNetBwGbps / 8.0f) / 1000.0f);
-
-  cpu_pressure_util = cpu_load / time;
-  mem_pressure_util = mem_size / time;
-}
-
-void PressureHandler::update_sorted_proclets() {
-  CPULoad::flush_all();
-
-  auto new_mem_pressure_sorted_proclets =
-      std::make_shared<decltype(mem_pressure_sorted_proclets_)::element_type>();
-  auto new_cpu_pressure_sorted_proclets =
-      std::make_shared<decltype(cpu_pressure_sorted_proclets_)::element_type>();
-  auto all_proclets = get_runtime()->proclet_manager()->get_all_proclets();
-
-  auto used_budget = 0;
-  for (auto *proclet_base : all_proclets) {
-    auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
-    auto optional_info = get_runtime()->proclet_manager()->get_proclet_info(
-        proclet_header, std::function([](const ProcletHeader *header) {
-          return std::make_tuple(header->migratable, header->total_mem_size(),
-                                 header->cpu_load.get_load());
-        }));
-
-    if (likely(optional_info)) {
-      auto [migratable, mem_size, cpu_load] = *optional_info;
-      if (migratable) {
-        Utility u(proclet_header, mem_size, cpu_load);
-        new_cpu_pressure_sorted_proclets->insert(u);
-        new_mem_pressure_sorted_proclets->insert(u);
-      }
-    }
-
-    if (++used_budget == kUpdateBudget) {
-      used_budget = 0;
-      rt::Yield();
-    }
-  }
-
-  {
-    Caladan::PreemptGuard g;
-
-    std::atomic_exchange(&cpu_pressure_sorted_proclets_,
-                         new_cpu_pressure_sorted_proclets);
-    std::atomic_exchange(&mem_pressure_sorted_proclets_,
-                         new_mem_pressure_sorted_proclets);
-  }
-}
-
 void PressureHandler::register_handlers() {
   resource_pressure_closure closures[kNumAuxHandlers + 1];
   closures[0] = {main_handler, nullptr};
@@ -109,9 +59,29 @@ void PressureHandler::main_handler(void *unused) {
 void PressureHandler::__main_handler() {
   active_handlers_ += kNumAuxHandlers + 1;
 
+  if (has_mem_pressure()) {
+    // Cached free objects shouldn't count towards the memory to release.
+    SlabAllocator::shrink_caches();
+  }
+
+  // Moving heaps across NUMA nodes is far cheaper than moving proclets across
+  // the network, so give it a chance to relieve the CPU pressure first. It's
+  // bounded by ProcletManager::kMaxNumaRebalanceBytes.
+  if (!has_cpu_pressure() ||
+      !get_runtime()->proclet_manager()->rebalance_numa()) {
+    migrate_on_pressure();
+  }
+
+  pause_aux_handlers();
+  if (--active_handlers_ == 0) {
+    set_handled();
+  }
+}
+
+void PressureHandler::migrate_on_pressure() {
   auto node_guard = get_runtime()->controller_client()->acquire_node();
   if (unlikely(!node_guard)) {
-    goto done;
+    return;
   }
 
   while (has_pressure()) {
@@ -141,12 +111,6 @@ void PressureHandler::__main_handler() {
       break;
     }
   }
-
-done:
-  pause_aux_handlers();
-  if (--active_handlers_ == 0) {
-    set_handled();
-  }
 }
 
 void PressureHandler::pause_aux_handlers() {
@@ -237,23 +201,32 @@ PressureHandler::pick_tasks(uint32_t min_num_proclets, uint32_t min_mem_mbs) {
   uint32_t total_mem_mbs = 0;
   std::vector<std::pair<ProcletMigrationTask, Resource>> picked_tasks;
   std::set<ProcletHeader *> dedupper;
+  bool cpu_pressure = min_num_proclets;
+  auto now_us = microtime();
 
   auto pick_fn = [&](ProcletHeader *header) {
     auto optional = get_runtime()->proclet_manager()->get_proclet_info(
         header, std::function([&](const ProcletHeader *header) {
           return std::make_tuple(header->migratable, header->capacity,
                                  header->heap_size(), header->total_mem_size(),
-                                 header->cpu_load.get_load());
+                                 header->resident_mem_size(),
+                                 header->cpu_load.get_load(),
+                                 header->migrated_in_us);
         }));
     if (likely(optional)) {
-      auto &[migratable, capacity, heap_size, mem_size, cpu_load] = *optional;
-      if (likely(migratable && !dedupper.contains(header))) {
+      auto &[migratable, capacity, heap_size, mem_size, resident_mem_size,
+             cpu_load, migrated_in_us] = *optional;
+      // Proclets that just arrived sit out CPU pressure for a while, so that
+      // they don't bounce between nodes. Memory pressure can't wait for them.
+      auto cooling_down = cpu_pressure && migrated_in_us &&
+                          now_us - migrated_in_us < kMigrationCooldownUs;
+      if (likely(migratable && !cooling_down && !dedupper.contains(header))) {
         dedupper.insert(header);
         ProcletMigrationTask task(header, capacity, heap_size);
         auto mem_mbs = mem_size / static_cast<float>(kOneMB);
         Resource resource(cpu_load, mem_mbs);
         picked_tasks.emplace_back(std::move(task), std::move(resource));
-        total_mem_mbs += mem_mbs;
+        total_mem_mbs += resident_mem_size / static_cast<float>(kOneMB);
         done = ((total_mem_mbs >= min_mem_mbs) &&
                 (picked_tasks.size() >= min_num_proclets));
       }
@@ -262,25 +235,20 @@ PressureHandler::pick_tasks(uint32_t min_num_proclets, uint32_t min_mem_mbs) {
     return optional.has_value();
   };
 
-  auto traverse_fn = [&]<typename T>(T &&sorted_proclets) {
-    if (sorted_proclets) {
-      auto iter = sorted_proclets->begin();
-      while (iter != sorted_proclets->end() && !done) {
-        if (pick_fn(iter->header)) {
-          ++iter;
-        } else {
-          iter = sorted_proclets->erase(iter);
-        }
-      }
-    }
-  };
-
-  bool cpu_pressure = min_num_proclets;
+  // The proclets that went away since they were last indexed are dropped.
+  auto *utility_index = get_runtime()->proclet_manager()->utility_index();
+  std::vector<ProcletHeader *> stale_headers;
   assert_preempt_disabled();
-  if (cpu_pressure) {
-    traverse_fn(std::atomic_load(&cpu_pressure_sorted_proclets_));
-  } else {
-    traverse_fn(std::atomic_load(&mem_pressure_sorted_proclets_));
+  utility_index->for_each_top(
+      cpu_pressure ? UtilityIndex::kCpuPressure : UtilityIndex::kMemPressure,
+      [&](ProcletHeader *header) {
+        if (!pick_fn(header)) {
+          stale_headers.push_back(header);
+        }
+        return !done;
+      });
+  for (auto *header : stale_headers) {
+    utility_index->remove(header);
   }
 
   if (unlikely(!done)) {
@@ -293,7 +261,28 @@ PressureHandler::pick_tasks(uint32_t min_num_proclets, uint32_t min_mem_mbs) {
     }
   }
 
-  return picked_tasks;
+  // Group the proclets that share a preferred destination, so that the
+  // migrator can send them to the same node back to back.
+  std::vector<NodeIP> preferred_ips;
+  auto *profiler = get_runtime()->call_graph_profiler();
+  for (auto &[task, _] : picked_tasks) {
+    auto affinity = profiler->get_affinity(task.header);
+    preferred_ips.push_back(affinity ? affinity->best_remote_ip : 0);
+  }
+  std::vector<uint32_t> order(picked_tasks.size());
+  for (uint32_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+    return preferred_ips[x] > preferred_ips[y];
+  });
+  std::vector<std::pair<ProcletMigrationTask, Resource>> sorted_tasks;
+  sorted_tasks.reserve(picked_tasks.size());
+  for (auto idx : order) {
+    sorted_tasks.emplace_back(std::move(picked_tasks[idx]));
+  }
+
+  return sorted_tasks;
 }
 
 void PressureHandler::mock_set_pressure() {
@@ -1,8 +1,10 @@
 #include <asm/mman.h>
 #include <sys/mman.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <functional>
+#include <limits>
 #include <memory>
 
 extern "C" {
@@ -10,8 +12,12 @@ extern "C" {
 #include <runtime/thread.h>
 }
 
+#include "nu/call_graph_profiler.hpp"
+#include "nu/ctrl_client.hpp"
+#include "nu/migrator.hpp"
 #include "nu/runtime.hpp"
 #include "nu/proclet_mgr.hpp"
+#include "nu/utils/numa.hpp"
 
 namespace nu {
 
@@ -20,6 +26,7 @@ SpinLock proclet_migration_spin[kMaxNumProclets];
 
 ProcletManager::ProcletManager() {
   num_present_proclets_ = 0;
+  rescore_cursor_ = 0;
   for (uint64_t vaddr = kMinProcletHeapVAddr;
        vaddr + kMaxProcletHeapSize <= kMaxProcletHeapVAddr;
        vaddr += kMaxProcletHeapSize) {
@@ -31,6 +38,205 @@ ProcletManager::ProcletManager() {
     auto rc = madvise(proclet_base, kMaxProcletHeapSize, MADV_DONTDUMP);
     BUG_ON(rc == -1);
   }
+
+  done_ = false;
+  scavenge_th_ = rt::Thread([&] {
+    for (uint64_t i = 1; !rt::access_once(done_); i++) {
+      timer_sleep(kHeapGrowIntervalMs * kOneMilliSecond);
+      grow_heaps();
+      rescore_some();
+      if (i % (kScavengeIntervalMs / kHeapGrowIntervalMs) == 0) {
+        scavenge();
+        rebalance_numa();
+      }
+    }
+  });
+}
+
+ProcletManager::~ProcletManager() {
+  done_ = true;
+  barrier();
+  scavenge_th_.Join();
+}
+
+void ProcletManager::scavenge() {
+  for (auto *proclet_base : get_all_proclets()) {
+    auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
+    // Keeps the proclet from being migrated or destructed meanwhile.
+    auto optional_migration_guard =
+        get_runtime()->attach_and_disable_migration(proclet_header);
+    if (unlikely(!optional_migration_guard)) {
+      continue;
+    }
+    get_runtime()->detach();
+    auto resident_mem_size = proclet_header->resident_mem_size();
+    proclet_header->slab.scavenge();
+    if (proclet_header->resident_mem_size() != resident_mem_size) {
+      update_utility(proclet_header);
+    }
+  }
+}
+
+void ProcletManager::grow_heaps() {
+  // Only the slabs that ran low since the last round are looked at.
+  for (auto slab_id : SlabAllocator::take_low_space_slabs()) {
+    auto *proclet_header =
+        reinterpret_cast<ProcletHeader *>(slab_id_to_proclet_base(slab_id));
+    auto optional_migration_guard =
+        get_runtime()->attach_and_disable_migration(proclet_header);
+    if (unlikely(!optional_migration_guard)) {
+      continue;
+    }
+    get_runtime()->detach();
+
+    auto &slab = proclet_header->slab;
+    auto capacity = proclet_header->capacity;
+    if (unlikely(slab.get_remaining() >= capacity / kHeapGrowDivisor ||
+                 slab.get_num_regions() == SlabAllocator::kMaxNumRegions)) {
+      continue;
+    }
+    auto *ctrl_client = get_runtime()->controller_client();
+    auto optional_segment = ctrl_client->allocate_heap_segment(capacity);
+    if (unlikely(!optional_segment)) {
+      continue;
+    }
+    auto [start, end] = *optional_segment;
+    // The segment then just follows the default policy.
+    WARN_ON_ONCE(!bind_to_numa_node(reinterpret_cast<void *>(start),
+                                    end - start, proclet_header->numa_node,
+                                    /* move = */ false));
+    if (unlikely(!slab.add_region(reinterpret_cast<void *>(start),
+                                  end - start))) {
+      ctrl_client->free_heap_segment(*optional_segment);
+      continue;
+    }
+    update_utility(proclet_header);
+  }
+}
+
+void ProcletManager::rescore_some() {
+  constexpr static uint32_t kNumSlices =
+      kRescoreIntervalMs / kHeapGrowIntervalMs;
+
+  std::vector<void *> proclets;
+  {
+    ScopedLock lock(&spin_);
+    uint32_t num = present_proclets_.size();
+    if (rescore_cursor_ >= num) {
+      rescore_cursor_ = 0;
+    }
+    auto end =
+        std::min(num, rescore_cursor_ + (num + kNumSlices - 1) / kNumSlices);
+    proclets.assign(present_proclets_.begin() + rescore_cursor_,
+                    present_proclets_.begin() + end);
+    rescore_cursor_ = end;
+  }
+  if (proclets.empty()) {
+    return;
+  }
+
+  CPULoad::flush_all();
+  for (auto *proclet_base : proclets) {
+    auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
+    auto optional_migration_guard =
+        get_runtime()->attach_and_disable_migration(proclet_header);
+    if (unlikely(!optional_migration_guard)) {
+      continue;
+    }
+    get_runtime()->detach();
+    update_utility(proclet_header);
+  }
+}
+
+void ProcletManager::update_utility(ProcletHeader *proclet_header) {
+  if (unlikely(!proclet_header->migratable)) {
+    return;
+  }
+  auto affinity =
+      get_runtime()->call_graph_profiler()->get_affinity(proclet_header);
+  // The destination isn't known yet, so take the estimate over all of them.
+  auto migration_us = get_runtime()->migrator()->estimator()->predict_us(
+      0, proclet_header->total_mem_size());
+  auto migrated_in_us = proclet_header->migrated_in_us;
+  auto us_since_migration = migrated_in_us
+                                ? microtime() - migrated_in_us
+                                : std::numeric_limits<uint64_t>::max();
+  utility_index_.update(Utility(
+      proclet_header, migration_us, proclet_header->resident_mem_size(),
+      proclet_header->cpu_load.get_load(),
+      affinity ? affinity->locality() : 0, us_since_migration));
+}
+
+uint32_t ProcletManager::rebalance_numa() {
+  auto num_nodes = get_num_numa_nodes();
+  if (likely(num_nodes == 1)) {
+    return 0;
+  }
+  if (!numa_mutex_.try_lock()) {
+    return 0;
+  }
+
+  uint32_t num_moved = 0;
+  uint64_t moved_bytes = 0;
+  for (auto *proclet_base : get_all_proclets()) {
+    if (moved_bytes >= kMaxNumaRebalanceBytes) {
+      break;
+    }
+    auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
+    auto optional_migration_guard =
+        get_runtime()->attach_and_disable_migration(proclet_header);
+    if (unlikely(!optional_migration_guard)) {
+      continue;
+    }
+    get_runtime()->detach();
+
+    auto &cpu_load = proclet_header->cpu_load;
+    uint64_t sum_samples = 0;
+    uint64_t max_samples = 0;
+    uint32_t max_node = 0;
+    for (uint32_t node = 0; node < num_nodes; node++) {
+      auto samples = cpu_load.get_numa_samples(node);
+      sum_samples += samples;
+      if (samples > max_samples) {
+        max_samples = samples;
+        max_node = node;
+      }
+    }
+    if (sum_samples < kMinNumaSamples) {
+      continue;
+    }
+    cpu_load.zero_numa_samples();
+
+    if (max_node != proclet_header->numa_node &&
+        max_samples >= sum_samples * kNumaRebalanceRatio) {
+      moved_bytes += proclet_header->resident_mem_size();
+      // Stay on the old node if the pages couldn't be moved, so that the
+      // heap's new segments keep joining the bulk of it.
+      if (likely(bind_heap(proclet_header, max_node, /* move = */ true))) {
+        proclet_header->numa_node = max_node;
+        num_moved++;
+      } else {
+        bind_heap(proclet_header, proclet_header->numa_node,
+                  /* move = */ false);
+      }
+    }
+  }
+
+  numa_mutex_.unlock();
+  return num_moved;
+}
+
+bool ProcletManager::bind_heap(ProcletHeader *proclet_header, uint32_t node,
+                               bool move) {
+  auto &slab = proclet_header->slab;
+  bool bound = true;
+  for (uint32_t i = 0; i < slab.get_num_regions(); i++) {
+    // The first region starts right after the header, which shares its pages.
+    auto [start, end] = i ? slab.get_region(i) : proclet_header->range();
+    bound &= bind_to_numa_node(reinterpret_cast<void *>(start), end - start,
+                               node, move);
+  }
+  return bound;
 }
 
 void ProcletManager::madvise_populate(void *proclet_base,
@@ -49,11 +255,33 @@ void ProcletManager::cleanup(void *proclet_base, bool for_migration) {
     }
   }
 
+  // The regions the heap grew into are tracked within its first region, so
+  // save them before it's depopulated.
+  auto &slab = proclet_header->slab;
+  auto num_regions = slab.get_num_regions();
+  auto primary_size = slab.get_used_region(0).end -
+                      reinterpret_cast<uint64_t>(proclet_header);
+  VAddrRange segments[SlabAllocator::kMaxNumRegions];
+  VAddrRange used_regions[SlabAllocator::kMaxNumRegions];
+  for (uint32_t i = 1; i < num_regions; i++) {
+    segments[i] = slab.get_region(i);
+    used_regions[i] = slab.get_used_region(i);
+  }
+
   // Deregister its slab ID.
   std::destroy_at(&proclet_header->slab);
 
   bool defer = !for_migration;
-  depopulate(proclet_base, proclet_header->heap_size(), defer);
+  depopulate(proclet_base, primary_size, defer);
+  for (uint32_t i = 1; i < num_regions; i++) {
+    auto [start, end] = used_regions[i];
+    if (end > start) {
+      depopulate(reinterpret_cast<void *>(start), end - start, defer);
+    }
+    if (!for_migration) {
+      get_runtime()->controller_client()->free_heap_segment(segments[i]);
+    }
+  }
 }
 
 void ProcletManager::depopulate(void *proclet_base, uint64_t size, bool defer) {
@@ -83,15 +311,26 @@ void ProcletManager::setup(void *proclet_base, uint64_t capacity,
   std::construct_at(&proclet_header->blocked_syncer);
   std::construct_at(&proclet_header->time);
   proclet_header->migratable = migratable;
+  proclet_header->numa_node = get_cur_numa_node();
+  proclet_header->migrated_in_us = 0;
+  proclet_header->migrated_from_ip = 0;
 
   if (!from_migration) {
     proclet_header->ref_cnt = 1;
+    proclet_header->num_migrations = 0;
+    std::fill(std::begin(proclet_header->replica_peers),
+              std::end(proclet_header->replica_peers), kNullProcletID);
     std::construct_at(&proclet_header->rcu_lock);
     std::construct_at(&proclet_header->slab_ref_cnt);
     auto slab_region_size = capacity - sizeof(ProcletHeader);
     std::construct_at(&proclet_header->slab, to_slab_id(proclet_header),
                       proclet_header + 1, slab_region_size);
+    proclet_header->slab.set_low_space_threshold(capacity / kHeapGrowDivisor);
   }
+  // Migrated heaps stay where they were copied to until the proclet's threads
+  // show where it runs. The heap then just follows the default policy.
+  WARN_ON_ONCE(!bind_heap(proclet_header, proclet_header->numa_node,
+                          /* move = */ false));
 }
 
 std::vector<void *> ProcletManager::get_all_proclets() {
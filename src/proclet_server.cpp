@@ -42,8 +42,15 @@ void ProcletServer::parse_and_run_handler(std::span<std::byte> args,
   auto &[args_ss, ia] = *ia_sstream;
   args_ss.span({reinterpret_cast<char *>(args.data()), args.size()});
 
-  GenericHandler handler;
-  ia_sstream->ia >> handler;
+  HandlerID handler_id;
+  ia_sstream->ia >> handler_id;
+  auto handler = Handlers::get_handler(handler_id);
+  if (unlikely(!handler)) {
+    get_runtime()->archive_pool()->put_ia_sstream(ia_sstream);
+    returner->Return(kErrUnknownHandler);
+    ref_cnt_.dec();
+    return;
+  }
 
   if constexpr (kEnableLogging) {
     trace_logger_.add_trace([&] { handler(ia_sstream, returner); });
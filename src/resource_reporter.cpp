@@ -5,14 +5,29 @@ extern "C" {
 #include <runtime.h>
 #include <sync.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
 #include "nu/runtime.hpp"
 #include "nu/commons.hpp"
+#include "nu/ctrl.hpp"
 #include "nu/ctrl_client.hpp"
 #include "nu/resource_reporter.hpp"
+#include "nu/rpc_client_mgr.hpp"
+#include "nu/utils/splitmix64.hpp"
 
 namespace nu {
 
-ResourceReporter::ResourceReporter() : done_(false) {
+ResourceReporter::ResourceReporter()
+    : done_(false),
+      gossip_enabled_(false),
+      view_version_(0),
+      last_reported_{.cores = 0, .mem_mbs = 0},
+      num_skipped_reports_(kMaxNumSkippedReports),
+      num_reports_(0),
+      seq_(0) {
   th_ = rt::Thread([&] {
     set_resource_reporting_handler(thread_self());
 
@@ -28,15 +43,58 @@ ResourceReporter::ResourceReporter() : done_(false) {
 
 std::vector<std::pair<NodeIP, Resource>>
 ResourceReporter::get_global_free_resources() {
+  std::vector<std::pair<NodeIP, Resource>> global_free_resources;
   rt::ScopedLock lock(&spin_);
 
-  return global_free_resources_;
+  global_free_resources.reserve(view_.size());
+  for (auto &entry : view_) {
+    global_free_resources.emplace_back(entry.ip, entry.resource);
+  }
+  return global_free_resources;
 }
 
 ResourceReporter::~ResourceReporter() {
   done_ = true;
   barrier();
   th_.Join();
+  set_gossip(false);
+}
+
+void ResourceReporter::set_gossip(bool enabled) {
+  rt::ScopedLock gossip_lock(&gossip_mutex_);
+
+  if (enabled == gossip_enabled_) {
+    return;
+  }
+  gossip_enabled_ = enabled;
+  if (enabled) {
+    gossip_th_ = rt::Thread([&] { gossip(); });
+  } else {
+    gossip_th_.Join();
+    // Fall back to the controller's averages.
+    rt::ScopedLock lock(&spin_);
+    for (auto &entry : view_) {
+      entry.seq = 0;
+    }
+  }
+}
+
+bool ResourceReporter::is_gossip_enabled() const {
+  return rt::access_once(gossip_enabled_);
+}
+
+bool ResourceReporter::should_report(Resource resource) {
+  if (num_skipped_reports_ >= kMaxNumSkippedReports ||
+      std::abs(resource.cores - last_reported_.cores) >=
+          kMinReportCoresDelta ||
+      std::abs(resource.mem_mbs - last_reported_.mem_mbs) >=
+          kMinReportMemMbsDelta) {
+    last_reported_ = resource;
+    num_skipped_reports_ = 0;
+    return true;
+  }
+  num_skipped_reports_++;
+  return false;
 }
 
 void ResourceReporter::report_resource() {
@@ -44,14 +102,114 @@ void ResourceReporter::report_resource() {
   resource.cores = std::min(rt::RuntimeGlobalIdleCores(),
                             rt::RuntimeMaxCores() - rt::RuntimeActiveCores());
   resource.mem_mbs = rt::RuntimeFreeMemMbs();
-  auto global_free_resources =
-      get_runtime()->controller_client()->report_free_resource(resource);
-  {
-    rt::ScopedLock lock(&spin_);
 
-    global_free_resources_ = std::move(global_free_resources);
+  auto gossip_enabled = is_gossip_enabled();
+  std::optional<Resource> changed_resource;
+  if (should_report(resource)) {
+    changed_resource = resource;
+    if (gossip_enabled) {
+      update_self(resource);
+    }
+  }
+
+  // Without gossip the view is pulled every time, which is cheap as it's only
+  // sent back when it changed.
+  bool pull_view =
+      !gossip_enabled || num_reports_++ % kGossipViewRefreshInterval == 0;
+  if (changed_resource || pull_view) {
+    auto [view_version, view] =
+        get_runtime()->controller_client()->report_free_resource(
+            changed_resource,
+            pull_view ? view_version_ : Controller::kViewNotNeeded);
+    if (pull_view && view_version != view_version_) {
+      view_version_ = view_version;
+      update_view(std::move(view), gossip_enabled);
+    }
   }
   finish_resource_reporting();
 }
 
+void ResourceReporter::update_view(
+    std::vector<std::pair<NodeIP, Resource>> &&view, bool keep_gossiped) {
+  std::vector<GossipEntry> new_view;
+  new_view.reserve(view.size());
+  rt::ScopedLock lock(&spin_);
+
+  // The controller decides which nodes are in, but gossiped entries are
+  // fresher than its averages while gossip is on.
+  auto iter = view_.begin();
+  for (auto &[ip, resource] : view) {
+    while (iter != view_.end() && iter->ip < ip) {
+      ++iter;
+    }
+    if (keep_gossiped && iter != view_.end() && iter->ip == ip && iter->seq) {
+      new_view.push_back(*iter);
+    } else {
+      new_view.push_back({ip, resource, 0});
+    }
+  }
+  view_ = std::move(new_view);
+}
+
+void ResourceReporter::update_self(Resource resource) {
+  rt::ScopedLock lock(&spin_);
+
+  auto iter = std::ranges::lower_bound(view_, get_cfg_ip(), {},
+                                       &GossipEntry::ip);
+  // Isolated nodes aren't in the view.
+  if (iter != view_.end() && iter->ip == get_cfg_ip()) {
+    iter->resource = resource;
+    iter->seq = ++seq_;
+  }
+}
+
+void ResourceReporter::merge_gossip(std::span<const GossipEntry> entries) {
+  rt::ScopedLock lock(&spin_);
+
+  for (auto &entry : entries) {
+    auto iter =
+        std::ranges::lower_bound(view_, entry.ip, {}, &GossipEntry::ip);
+    if (iter != view_.end() && iter->ip == entry.ip && iter->seq < entry.seq) {
+      *iter = entry;
+    }
+  }
+}
+
+void ResourceReporter::gossip() {
+  SplitMix64 rng;
+
+  while (!rt::access_once(done_) && is_gossip_enabled()) {
+    timer_sleep(kGossipIntervalUs);
+
+    std::vector<GossipEntry> view;
+    {
+      rt::ScopedLock lock(&spin_);
+      view = view_;
+    }
+    std::vector<NodeIP> peers;
+    for (auto &entry : view) {
+      if (entry.ip != get_cfg_ip()) {
+        peers.push_back(entry.ip);
+      }
+    }
+    if (peers.empty()) {
+      continue;
+    }
+
+    auto view_span = std::span(view);
+    auto req_buf_len = sizeof(RPCReqGossipResources) + view_span.size_bytes();
+    auto req_buf = std::make_unique_for_overwrite<std::byte[]>(req_buf_len);
+    auto *req = reinterpret_cast<RPCReqGossipResources *>(req_buf.get());
+    std::construct_at(req);
+    req->num_entries = view.size();
+    memcpy(req->entries, view.data(), view_span.size_bytes());
+
+    // Best effort: the peer may be going away.
+    auto peer = peers[rng.next() % peers.size()];
+    RPCReturnBuffer return_buf;
+    get_runtime()->rpc_client_mgr()->get_by_ip(peer)->Call(
+        std::span(req_buf.get(), req_buf_len), &return_buf);
+  }
+}
+
 }  // namespace nu
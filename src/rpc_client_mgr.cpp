@@ -94,6 +94,48 @@ void RPCClientMgr::invalidate_cache(ProcletID proclet_id, RPCClient *old_client)
   }
 }
 
+void RPCClientMgr::fill_cache(ProcletID proclet_id, NodeIP ip) {
+  if (unlikely(!ip)) {
+    return;
+  }
+
+  auto slab_id = to_slab_id(proclet_id);
+  rt::MutexGuard g(&node_info_mutexes_[slab_id]);
+  // Anything cached meanwhile is at least as fresh.
+  auto &info_ref = rem_id_to_node_info_[slab_id];
+  if (!info_ref.raw) {
+    NodeInfo info;
+    info.ip = ip;
+    info.id = get_node_id_by_node_ip(ip);
+    info_ref = info;
+  }
+}
+
+void RPCClientMgr::prefetch_locations(std::span<const ProcletID> proclet_ids) {
+  std::vector<ProcletID> uncached_ids;
+  for (auto proclet_id : proclet_ids) {
+    if (!rem_id_to_node_info_[to_slab_id(proclet_id)].raw) {
+      uncached_ids.push_back(proclet_id);
+    }
+  }
+  if (uncached_ids.empty()) {
+    return;
+  }
+
+  auto ips =
+      get_runtime()->controller_client()->resolve_proclets(uncached_ids);
+  for (size_t i = 0; i < ips.size(); i++) {
+    fill_cache(uncached_ids[i], ips[i]);
+  }
+}
+
+void RPCClientMgr::warm_up_cache() {
+  for (auto [proclet_id, ip] :
+       get_runtime()->controller_client()->get_proclet_locations()) {
+    fill_cache(proclet_id, ip);
+  }
+}
+
 void RPCClientMgr::update_cache(ProcletID proclet_id, NodeIP ip) {
   auto slab_id = to_slab_id(proclet_id);
   rt::MutexGuard g(&node_info_mutexes_[slab_id]);
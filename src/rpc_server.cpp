@@ -2,9 +2,9 @@
 
 #include "nu/commons.hpp"
 #include "nu/runtime.hpp"
-#include "nu/ctrl_server.hpp"
 #include "nu/migrator.hpp"
 #include "nu/proclet_server.hpp"
+#include "nu/resource_reporter.hpp"
 #include "nu/utils/rpc.hpp"
 
 namespace nu {
@@ -33,47 +33,16 @@ void RPCServer::handler_fn(std::span<std::byte> args, RPCReturner *returner) {
     }
     case kMigrateThreadAndRetVal: {
       auto &req = from_span<RPCReqMigrateThreadAndRetVal>(args);
-      auto rc = req.handler(req.dest_proclet_header, req.dest_ret_val_ptr,
-                            req.payload_len, req.payload);
+      auto handler = Migrator::ThreadLoaders::get_handler(req.handler_id);
+      if (unlikely(!handler)) {
+        returner->Return(kErrUnknownHandler);
+        break;
+      }
+      auto rc = handler(req.dest_proclet_header, req.dest_ret_val_ptr,
+                        req.payload_len, req.payload);
       returner->Return(rc);
       break;
     }
-    // Controller
-    case kRegisterNode: {
-      auto &req = from_span<RPCReqRegisterNode>(args);
-      auto resp = get_runtime()->controller_server()->handle_register_node(req);
-      auto span = to_span(*resp);
-      returner->Return(kOk, span, [resp = std::move(resp)] {});
-      break;
-    }
-    case kAllocateProclet: {
-      auto &req = from_span<RPCReqAllocateProclet>(args);
-      auto resp =
-          get_runtime()->controller_server()->handle_allocate_proclet(req);
-      auto span = to_span(*resp);
-      returner->Return(kOk, span, [resp = std::move(resp)] {});
-      break;
-    }
-    case kDestroyProclet: {
-      auto &req = from_span<RPCReqDestroyProclet>(args);
-      get_runtime()->controller_server()->handle_destroy_proclet(req);
-      returner->Return(kOk);
-      break;
-    }
-    case kResolveProclet: {
-      auto &req = from_span<RPCReqResolveProclet>(args);
-      auto resp =
-          get_runtime()->controller_server()->handle_resolve_proclet(req);
-      auto span = to_span(*resp);
-      returner->Return(kOk, span, [resp = std::move(resp)] {});
-      break;
-    }
-    case kDestroyLP: {
-      auto &req = from_span<RPCReqDestroyLP>(args);
-      get_runtime()->controller_server()->handle_destroy_lp(req);
-      returner->Return(kOk);
-      break;
-    }
     // Proclet server
     case kProcletCall: {
       args = args.subspan(sizeof(RPCReqType));
@@ -86,6 +55,13 @@ void RPCServer::handler_fn(std::span<std::byte> args, RPCReturner *returner) {
       returner->Return(kOk);
       break;
     }
+    case kGossipResources: {
+      auto &req = from_span<RPCReqGossipResources>(args);
+      get_runtime()->resource_reporter()->merge_gossip(
+          std::span(req.entries, req.num_entries));
+      returner->Return(kOk);
+      break;
+    }
     case kShutdown: {
       get_runtime()->shutdown(returner);
       break;
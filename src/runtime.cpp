@@ -18,6 +18,7 @@ extern "C" {
 #include <runtime.h>
 #include <thread.h>
 
+#include "nu/call_graph_profiler.hpp"
 #include "nu/command_line.hpp"
 #include "nu/ctrl_client.hpp"
 #include "nu/ctrl_server.hpp"
@@ -35,16 +36,17 @@ namespace nu {
 
 Runtime::Runtime() {}
 
-Runtime::Runtime(uint32_t remote_ctrl_ip, Mode mode, lpid_t lpid, bool isol) {
+Runtime::Runtime(std::vector<uint32_t> ctrl_ips, Mode mode, lpid_t lpid,
+                 bool isol) {
   init_base();
 
   if (mode == kMainServer) {
-    init_as_server(remote_ctrl_ip, lpid, isol);
+    init_as_server(std::move(ctrl_ips), lpid, isol);
   } else {
     if (mode == kController) {
-      init_as_controller();
+      init_as_controller(std::move(ctrl_ips));
     } else if (mode == kServer) {
-      init_as_server(remote_ctrl_ip, lpid, isol);
+      init_as_server(std::move(ctrl_ips), lpid, isol);
     } else {
       BUG();
     }
@@ -74,15 +76,19 @@ void Runtime::init_runtime_heap() {
                                     /* aggressive_caching = */ true);
 }
 
-void Runtime::init_as_controller() {
-  controller_server_ = new ControllerServer();
+void Runtime::init_as_controller(std::vector<uint32_t> ctrl_ips) {
+  controller_server_ = new ControllerServer(std::move(ctrl_ips));
 }
 
-void Runtime::init_as_server(uint32_t remote_ctrl_ip, lpid_t lpid, bool isol) {
+void Runtime::init_as_server(std::vector<uint32_t> ctrl_ips, lpid_t lpid,
+                             bool isol) {
   proclet_server_ = new ProcletServer();
   migrator_ = new Migrator();
   controller_client_ =
-      new ControllerClient(remote_ctrl_ip, kServer, lpid, isol);
+      new ControllerClient(std::move(ctrl_ips), kServer, lpid, isol);
+  rpc_client_mgr_->warm_up_cache();
+  // The proclet manager feeds the call affinities into its utility index.
+  call_graph_profiler_ = new CallGraphProfiler();
   proclet_manager_ = new ProcletManager();
   pressure_handler_ = new PressureHandler();
   resource_reporter_ = new ResourceReporter();
@@ -142,6 +148,7 @@ void Runtime::destroy() {
   delete resource_reporter_;
   delete pressure_handler_;
   delete proclet_manager_;
+  delete call_graph_profiler_;
   delete migrator_;
   delete proclet_server_;
   delete controller_client_;
@@ -165,7 +172,7 @@ int runtime_main_init(int argc, char **argv,
 
   auto mode = all_options_desc.vm.count("main") ? nu::Runtime::Mode::kMainServer
                                                 : nu::Runtime::Mode::kServer;
-  auto ctrl_ip = str_to_ip(all_options_desc.nu.ctrl_ip_str);
+  auto ctrl_ips = str_to_ips(all_options_desc.nu.ctrl_ip_str);
   auto lpid = all_options_desc.nu.lpid;
   auto conf_path = all_options_desc.caladan.conf_path;
   auto isol = all_options_desc.vm.count("isol");
@@ -186,7 +193,7 @@ int runtime_main_init(int argc, char **argv,
         break;
       }
     }
-    new (get_runtime_nocheck()) Runtime(ctrl_ip, mode, lpid, isol);
+    new (get_runtime_nocheck()) Runtime(ctrl_ips, mode, lpid, isol);
     {
       auto main_proclet = make_proclet<ErasedType>(
           true, kMainProcletHeapSize, get_runtime()->caladan()->get_ip());
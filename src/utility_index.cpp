@@ -0,0 +1,105 @@
+#include <algorithm>
+
+#include <thread.h>
+
+#include "nu/utility_index.hpp"
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+Utility::Utility() {}
+
+Utility::Utility(ProcletHeader *proclet_header, float migration_us,
+                 uint64_t resident_mem_size, float cpu_load, float locality,
+                 uint64_t us_since_migration) {
+  header = proclet_header;
+  auto time = migration_us;
+  // Prefer proclets whose heavy peers are remote over those that would turn
+  // their local calls into RPCs once migrated.
+  auto affinity_factor = 1 - kAffinityWeight * locality;
+  auto recency_factor =
+      std::min(1.0f, static_cast<float>(us_since_migration) /
+                         static_cast<float>(kMigrationPenaltyUs));
+  auto factor = affinity_factor * recency_factor;
+
+  cpu_pressure_util = cpu_load / time * factor;
+  // Migration copies the whole heap but only frees its resident part.
+  mem_pressure_util = resident_mem_size / time * factor;
+}
+
+UtilityIndex::UtilityIndex()
+    : entries_(std::make_unique<Entry[]>(kMaxNumProclets)) {
+  for (auto &heads : heads_) {
+    std::fill(std::begin(heads), std::end(heads), kNil);
+  }
+}
+
+void UtilityIndex::update(const Utility &utility) {
+  auto idx = to_idx(utility.header);
+  auto &entry = entries_[idx];
+  uint16_t buckets[kNumKinds];
+  buckets[kCpuPressure] = to_bucket(utility.cpu_pressure_util);
+  buckets[kMemPressure] = to_bucket(utility.mem_pressure_util);
+
+  // Most updates don't cross a bucket boundary, so skip the lock for them.
+  if (likely(rt::access_once(entry.indexed) &&
+             rt::access_once(entry.buckets[kCpuPressure]) ==
+                 buckets[kCpuPressure] &&
+             rt::access_once(entry.buckets[kMemPressure]) ==
+                 buckets[kMemPressure])) {
+    return;
+  }
+
+  ScopedLock lock(&spin_);
+  for (uint32_t i = 0; i < kNumKinds; i++) {
+    auto kind = static_cast<Kind>(i);
+    if (!entry.indexed) {
+      link(idx, kind, buckets[kind]);
+    } else if (entry.buckets[kind] != buckets[kind]) {
+      unlink(idx, kind);
+      link(idx, kind, buckets[kind]);
+    }
+  }
+  entry.indexed = true;
+}
+
+void UtilityIndex::remove(ProcletHeader *header) {
+  auto idx = to_idx(header);
+  auto &entry = entries_[idx];
+
+  ScopedLock lock(&spin_);
+  if (entry.indexed) {
+    for (uint32_t i = 0; i < kNumKinds; i++) {
+      unlink(idx, static_cast<Kind>(i));
+    }
+    entry.indexed = false;
+  }
+}
+
+void UtilityIndex::link(uint32_t idx, Kind kind, uint16_t bucket) {
+  auto &entry = entries_[idx];
+  auto &head = heads_[kind][bucket];
+  entry.buckets[kind] = bucket;
+  entry.prevs[kind] = kNil;
+  entry.nexts[kind] = head;
+  if (head != kNil) {
+    entries_[head].prevs[kind] = idx;
+  }
+  head = idx;
+}
+
+void UtilityIndex::unlink(uint32_t idx, Kind kind) {
+  auto &entry = entries_[idx];
+  auto prev = entry.prevs[kind];
+  auto next = entry.nexts[kind];
+  if (prev != kNil) {
+    entries_[prev].nexts[kind] = next;
+  } else {
+    heads_[kind][entry.buckets[kind]] = next;
+  }
+  if (next != kNil) {
+    entries_[next].prevs[kind] = prev;
+  }
+}
+
+}  // namespace nu
@@ -0,0 +1,50 @@
+#include <algorithm>
+
+#include "nu/utils/compaction.hpp"
+#include "nu/runtime.hpp"
+
+namespace nu {
+
+SlabAllocator *get_compaction_slab() {
+  auto *slab = get_runtime()->get_current_proclet_slab();
+  return slab ? slab : get_runtime()->runtime_slab();
+}
+
+bool should_compact(SlabAllocator *slab) {
+  return slab->get_fragmentation() >= slab->get_compaction_ratio();
+}
+
+CompactionRatioGuard::CompactionRatioGuard(double ratio)
+    : slab_(get_compaction_slab()), old_ratio_(slab_->get_compaction_ratio()) {
+  slab_->set_compaction_ratio(ratio);
+}
+
+CompactionRatioGuard::~CompactionRatioGuard() {
+  slab_->set_compaction_ratio(old_ratio_);
+}
+
+RelocationRun::RelocationRun(SlabAllocator *slab, size_t size)
+    : slab_(slab), size_(size), drained_(false) {}
+
+RelocationRun::~RelocationRun() {
+  for (auto *chunk : chunks_) {
+    slab_->free(chunk);
+  }
+}
+
+void *RelocationRun::take_below(const void *addr) {
+  if (chunks_.empty() && !drained_) {
+    chunks_ = slab_->allocate_lowest(size_, kRefillSize);
+    drained_ = (chunks_.size() < kRefillSize);
+    std::reverse(chunks_.begin(), chunks_.end());
+  }
+  if (chunks_.empty() || reinterpret_cast<uintptr_t>(chunks_.back()) >=
+                              reinterpret_cast<uintptr_t>(addr)) {
+    return nullptr;
+  }
+  auto *chunk = chunks_.back();
+  chunks_.pop_back();
+  return chunk;
+}
+
+}  // namespace nu
@@ -32,16 +32,21 @@ MD5Val get_md5(std::string file_name) {
   auto file_buf = mmap(0, file_size, PROT_READ, MAP_SHARED, fd, 0);
   BUG_ON(file_buf == MAP_FAILED);
 
+  auto md5_val = get_md5(
+      std::span(reinterpret_cast<const std::byte *>(file_buf), file_size));
+  BUG_ON(munmap(file_buf, file_size) == -1);
+  return md5_val;
+}
+
+MD5Val get_md5(std::span<const std::byte> data) {
   MD5Val md5_val;
   const EVP_MD *algo = EVP_md5();
   auto context = std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)>(
       EVP_MD_CTX_new(), EVP_MD_CTX_free);
 
   EVP_DigestInit_ex(context.get(), algo, nullptr);
-  EVP_DigestUpdate(context.get(), file_buf, file_size);
+  EVP_DigestUpdate(context.get(), data.data(), data.size());
   EVP_DigestFinal_ex(context.get(), md5_val.data, nullptr);
-
-  BUG_ON(munmap(file_buf, file_size) == -1);
   return md5_val;
 }
 
@@ -0,0 +1,42 @@
+#include <numaif.h>
+#include <sched.h>
+
+#include <algorithm>
+
+extern "C" {
+#include <base/compiler.h>
+#include <base/cpu.h>
+}
+
+#include "nu/utils/numa.hpp"
+
+namespace nu {
+
+uint32_t get_num_numa_nodes() {
+  return std::clamp(numa_count, 1, static_cast<int>(kMaxNumNumaNodes));
+}
+
+uint32_t get_cur_numa_node() {
+  // The kernel's node of the CPU, which differs from its package (socket)
+  // when sub-NUMA clustering splits a socket into several nodes.
+  unsigned int cpu, node;
+  if (unlikely(getcpu(&cpu, &node) < 0)) {
+    return 0;
+  }
+  return std::min(static_cast<uint32_t>(node), get_num_numa_nodes() - 1);
+}
+
+bool bind_to_numa_node(void *addr, uint64_t len, uint32_t node, bool move) {
+  if (unlikely(node >= get_num_numa_nodes())) {
+    return false;
+  }
+  if (get_num_numa_nodes() == 1) {
+    return true;
+  }
+  unsigned long node_mask = 1UL << node;
+  auto flags = move ? MPOL_MF_MOVE : 0;
+  return mbind(addr, len, MPOL_PREFERRED, &node_mask, sizeof(node_mask) * 8,
+               flags) == 0;
+}
+
+}  // namespace nu
@@ -1,4 +1,14 @@
+#include <execinfo.h>
+#include <sys/mman.h>
+
 #include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include <runtime/membarrier.h>
+}
 
 #include "nu/utils/slab.hpp"
 #include "nu/utils/scoped_lock.hpp"
@@ -6,6 +16,56 @@
 namespace nu {
 
 SlabAllocator *SlabAllocator::slabs_[get_max_slab_id() + 1];
+std::atomic<uint32_t> SlabAllocator::cache_shrink_epoch_;
+std::atomic<uint64_t>
+    SlabAllocator::low_space_slabs_[get_max_slab_id() / 64 + 1];
+std::atomic<bool> SlabAllocator::has_low_space_slabs_;
+SlabId_t SlabAllocator::proclet_heap_slab_ids_[(kMaxProcletHeapVAddr -
+                                                kMinProcletHeapVAddr) /
+                                               kMinProcletHeapSize];
+
+constexpr auto kClassSizes = [] {
+  std::array<uint64_t, SlabAllocator::kNumSizeClasses> sizes{};
+  uint32_t size_class = 0;
+  for (uint64_t size = 1ULL << SlabAllocator::kMinSlabClassShift;
+       size <= 1ULL << SlabAllocator::kMinSpacedClassShift;
+       size += kAlignment) {
+    sizes[size_class++] = size;
+  }
+  for (auto shift = SlabAllocator::kMinSpacedClassShift;
+       shift < SlabAllocator::kMaxSlabClassShift; shift++) {
+    auto spacing = 1ULL << (shift - SlabAllocator::kLgNumClassesPerDoubling);
+    for (auto size = (1ULL << shift) + spacing; size <= (2ULL << shift);
+         size += spacing) {
+      sizes[size_class++] = size;
+    }
+  }
+  return sizes;
+}();
+
+static_assert(SlabAllocator::kNumSizeClasses <= 256);
+static_assert(kClassSizes[SlabAllocator::kNumLinearClasses - 1] ==
+              1ULL << SlabAllocator::kMinSpacedClassShift);
+static_assert(kClassSizes.back() == 1ULL << SlabAllocator::kMaxSlabClassShift);
+static_assert(kClassSizes[SlabAllocator::kNumSmallClasses - 1] ==
+              1ULL << SlabAllocator::kMaxSmallClassShift);
+
+const std::array<uint64_t, SlabAllocator::kNumSizeClasses>
+    SlabAllocator::class_sizes_ = kClassSizes;
+
+const std::array<uint8_t, SlabAllocator::kMaxLookupSize / kAlignment + 1>
+    SlabAllocator::size_to_class_ = [] {
+      std::array<uint8_t, SlabAllocator::kMaxLookupSize / kAlignment + 1>
+          classes{};
+      uint32_t size_class = 0;
+      for (uint32_t i = 0; i < classes.size(); i++) {
+        while (kClassSizes[size_class] < i * kAlignment) {
+          size_class++;
+        }
+        classes[i] = size_class;
+      }
+      return classes;
+    }();
 
 void *SlabAllocator::FreePtrsLinkedList::pop() {
   size_--;
@@ -42,44 +102,192 @@ void SlabAllocator::FreePtrsLinkedList::push(void *ptr) {
   std::fill(std::begin(head_->p) + 1, std::end(head_->p), nullptr);
 }
 
-// TODO: should be dynamic.
-inline uint32_t get_max_num_cache_entries(bool aggressive_caching,
-                                          uint32_t slab_shift) {
-  switch (slab_shift) {
-    case 4:  // 32 B
-      return 128;
-    case 5:  // 64 B
-      return 128;
-    case 6:  // 128 B
-      return 64;
-    case 7:  // 256 B
-      return 32;
-    case 8:  // 512 B
-      return 16;
-    case 9:  // 1024 B
-      return 8;
-    case 10:  // 2048 B
-      return 4;
-    case 11:  // 4096 B
-      return 2;
-    case 12:  // 8192 B
-      return 1;
-    default:
-      return aggressive_caching && slab_shift <= 20;  // 2 MiB
+inline uint32_t get_init_num_cache_entries(bool aggressive_caching,
+                                           uint64_t class_size) {
+  if (class_size <= 64) {
+    return 128;
+  }
+  if (class_size <= 8192) {
+    return 8192 / class_size;
+  }
+  return aggressive_caching && class_size <= (2 << 20);  // 2 MiB
+}
+
+uint32_t SlabAllocator::get_max_num_cache_entries(CoreCache &cache,
+                                                  uint32_t size_class) {
+  auto &max_entries = cache.max_entries[size_class];
+  if (unlikely(!max_entries)) {
+    max_entries = get_init_num_cache_entries(aggressive_caching_,
+                                             class_sizes_[size_class]);
+    cache.capacity_bytes += max_entries * class_sizes_[size_class];
+  }
+  return max_entries;
+}
+
+void SlabAllocator::grow_cache(CoreCache &cache, uint32_t size_class,
+                               bool contended) {
+  auto class_size = class_sizes_[size_class];
+  if (class_size > kCacheSizeCutoff) {
+    return;
+  }
+
+  auto &max_entries = cache.max_entries[size_class];
+  uint64_t new_max_entries =
+      contended ? max_entries * 2 : max_entries + max_entries / 4 + 1;
+  new_max_entries =
+      std::min(new_max_entries, kMaxCacheBytesPerClass / class_size);
+  if (new_max_entries <= max_entries) {
+    return;
+  }
+  auto delta = (new_max_entries - max_entries) * class_size;
+  if (cache.capacity_bytes + delta > kMaxCacheBytesPerCore) {
+    return;
+  }
+  cache.capacity_bytes += delta;
+  max_entries = new_max_entries;
+}
+
+// Returns whether spin_ was contended.
+inline bool SlabAllocator::lock_spin() {
+  if (likely(spin_.try_lock())) {
+    return false;
+  }
+  spin_.lock();
+  return true;
+}
+
+void SlabAllocator::shrink_caches() {
+  cache_shrink_epoch_.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Called with spin_ held, after carving from cur_.
+inline void SlabAllocator::check_low_space() {
+  if (likely(!low_space_threshold_ || num_regions_ == kMaxNumRegions ||
+             static_cast<uint64_t>(cur_region().end - cur_) >=
+                 low_space_threshold_)) {
+    return;
+  }
+  auto &word = low_space_slabs_[slab_id_ / 64];
+  auto mask = 1ULL << (slab_id_ % 64);
+  if (!(word.load(std::memory_order_relaxed) & mask)) {
+    word.fetch_or(mask, std::memory_order_relaxed);
+    has_low_space_slabs_.store(true, std::memory_order_release);
+  }
+}
+
+std::vector<SlabId_t> SlabAllocator::take_low_space_slabs() {
+  std::vector<SlabId_t> slab_ids;
+  if (!has_low_space_slabs_.exchange(false, std::memory_order_acquire)) {
+    return slab_ids;
+  }
+  for (uint32_t i = 0; i < std::size(low_space_slabs_); i++) {
+    auto word = low_space_slabs_[i].exchange(0, std::memory_order_relaxed);
+    while (word) {
+      slab_ids.push_back(i * 64 + __builtin_ctzll(word));
+      word &= word - 1;
+    }
+  }
+  return slab_ids;
+}
+
+// The caller exits the returned cache once done with it.
+inline SlabAllocator::CoreCache &SlabAllocator::enter_cache(
+    const Caladan::PreemptGuard &g) {
+  auto &cache = cache_lists_[g.read_cpu()];
+  rt::access_once(cache.busy) = true;
+  barrier();
+  // drain_idle_caches() issues a membarrier() between setting draining and
+  // checking busy, so it's either seen here or it sees our busy.
+  while (unlikely(rt::access_once(cache.draining))) {
+    rt::access_once(cache.busy) = false;
+    while (rt::access_once(cache.draining)) {
+      cpu_relax();
+    }
+    rt::access_once(cache.busy) = true;
+    barrier();
+  }
+  cache.active = true;
+  return cache;
+}
+
+inline void SlabAllocator::exit_cache(CoreCache &cache) {
+  barrier();
+  rt::access_once(cache.busy) = false;
+}
+
+// The caller has entered the current core's cache.
+inline void SlabAllocator::check_cache_shrink(const Caladan::PreemptGuard &g) {
+  auto &cache = cache_lists_[g.read_cpu()];
+  auto epoch = cache_shrink_epoch_.load(std::memory_order_relaxed);
+  if (unlikely(cache.shrink_epoch != epoch)) {
+    cache.shrink_epoch = epoch;
+    flush_cache(g.read_cpu());
+  }
+}
+
+// The caller has entered the core's cache, or is draining it.
+void SlabAllocator::flush_cache(uint32_t core) {
+  auto &cache = cache_lists_[core];
+  auto &transferred_cache = transferred_caches_[core];
+  ScopedLock l(&transferred_cache.spin);
+  ScopedLock lock(&spin_);
+
+  for (uint32_t size_class = 0; size_class < kNumSizeClasses; size_class++) {
+    for (auto *list : {&cache.lists[size_class],
+                       &transferred_cache.lists[size_class]}) {
+      while (list->size()) {
+        slab_lists_[size_class].push(list->pop());
+        global_free_bytes_ += get_chunk_size(size_class);
+      }
+    }
+  }
+  std::fill(std::begin(cache.max_entries), std::end(cache.max_entries), 0);
+  cache.capacity_bytes = 0;
+}
+
+void SlabAllocator::drain_idle_caches() {
+  std::vector<uint32_t> idle_cores;
+  for (uint32_t core = 0; core < kNumCores; core++) {
+    auto &cache = cache_lists_[core];
+    if (rt::access_once(cache.active)) {
+      rt::access_once(cache.active) = false;
+    } else if (rt::access_once(cache.capacity_bytes)) {
+      idle_cores.push_back(core);
+    }
+  }
+  if (idle_cores.empty()) {
+    return;
+  }
+
+  // The owners spin while we're draining, so don't get preempted meanwhile.
+  Caladan::PreemptGuard g;
+  for (auto core : idle_cores) {
+    rt::access_once(cache_lists_[core].draining) = true;
+  }
+  // Only paid here, it makes the owners' busy flags visible to us.
+  membarrier();
+  for (auto core : idle_cores) {
+    auto &cache = cache_lists_[core];
+    // Skip the ones in use, they are not idle anyway.
+    if (!rt::access_once(cache.busy) && !rt::access_once(cache.active)) {
+      flush_cache(core);
+    }
+    barrier();
+    rt::access_once(cache.draining) = false;
   }
 }
 
 inline void SlabAllocator::drain_transferred_cache(
-    const Caladan::PreemptGuard &g, uint32_t slab_shift) {
+    const Caladan::PreemptGuard &g, uint32_t size_class) {
   auto &transferred_cache = transferred_caches_[g.read_cpu()];
-  auto &list = transferred_cache.lists[slab_shift];
+  auto &list = transferred_cache.lists[size_class];
 
   if (list.size()) {
     ScopedLock l(&transferred_cache.spin);
 
     while (list.size()) {
       auto *hdr = reinterpret_cast<PtrHeader *>(list.pop());
-      free_to_cache_list(g, hdr, slab_shift);
+      free_to_cache_list(g, hdr, size_class);
     }
   }
 }
@@ -87,48 +295,96 @@ inline void SlabAllocator::drain_transferred_cache(
 void *SlabAllocator::__allocate(size_t size) {
   void *ret = nullptr;
   int cpu;
-  auto slab_shift = get_slab_shift(size);
+  auto size_class = get_size_class(size);
+
+  if (unlikely(size_class >= kNumSizeClasses)) {
+    ret = allocate_large(size);
+    if (unlikely(rt::access_once(profiling_rate_)) && ret) {
+      Caladan::PreemptGuard g;
+      maybe_sample(g, size);
+    }
+    return ret;
+  }
 
-  if (likely(slab_shift < kMaxSlabClassShift)) {
+  if (likely(size_class < kNumSizeClasses)) {
     Caladan::PreemptGuard g;
 
-    drain_transferred_cache(g, slab_shift);
+    auto &cache = enter_cache(g);
+    check_cache_shrink(g);
+    drain_transferred_cache(g, size_class);
     cpu = g.read_cpu();
-    auto &cache_list = cache_lists_[cpu].lists[slab_shift];
+    auto &cache_list = cache.lists[size_class];
     if (likely(cache_list.size())) {
       ret = cache_list.pop();
     }
 
     if (unlikely(!ret)) {
-      ScopedLock lock(&spin_);
-      auto &slab_list = slab_lists_[slab_shift];
+      get_max_num_cache_entries(cache, size_class);
+      grow_cache(cache, size_class, lock_spin());
+      auto &slab_list = slab_lists_[size_class];
       auto max_num_cache_entries =
-          std::max(static_cast<uint32_t>(1),
-                   get_max_num_cache_entries(aggressive_caching_, slab_shift));
+          std::max(static_cast<uint32_t>(1), cache.max_entries[size_class]);
       while (slab_list.size() && cache_list.size() < max_num_cache_entries) {
         cache_list.push(slab_list.pop());
-        global_free_bytes_ -= get_slab_size(slab_shift);
+        global_free_bytes_ -= get_chunk_size(size_class);
+      }
+      while (cache_list.size() < max_num_cache_entries &&
+             released_spans_[size_class]) {
+        refill_from_released_span(size_class, cache_list,
+                                  max_num_cache_entries - cache_list.size());
       }
 
       auto remaining = max_num_cache_entries - cache_list.size();
-      if (remaining) {
-        auto slab_size = get_slab_size(slab_shift);
-        remaining = std::min(remaining, (end_ - cur_) / slab_size);
-        cur_ += slab_size * remaining;
+      auto chunk_size = get_chunk_size(size_class);
+      if (is_headerless_class(size_class)) {
+        auto &run_cur = run_curs_[size_class];
+        while (remaining) {
+          if (static_cast<uint64_t>(run_ends_[size_class] - run_cur) <
+                  chunk_size &&
+              !new_run(size_class)) {
+            break;
+          }
+          auto num = std::min(
+              remaining,
+              static_cast<uint64_t>(run_ends_[size_class] - run_cur) /
+                  chunk_size);
+          run_cur += chunk_size * num;
+          auto tmp = run_cur;
+          for (uint32_t i = 0; i < num; i++) {
+            tmp -= chunk_size;
+            cache_list.push(tmp);
+          }
+          remaining -= num;
+        }
+      } else if (remaining) {
+        remaining =
+            std::min(remaining, (cur_region().end - cur_) / chunk_size);
+        cur_ += chunk_size * remaining;
         auto tmp = cur_;
         for (uint32_t i = 0; i < remaining; i++) {
-          tmp -= slab_size;
+          tmp -= chunk_size;
           cache_list.push(tmp);
         }
       }
+      check_low_space();
+
+      spin_.unlock();
 
       if (likely(cache_list.size())) {
         ret = cache_list.pop();
       }
     }
+
+    if (likely(ret)) {
+      cache.num_live[size_class]++;
+    }
+    exit_cache(cache);
+    if (likely(ret) && unlikely(rt::access_once(profiling_rate_))) {
+      maybe_sample(g, size);
+    }
   }
 
-  if (ret) {
+  if (ret && !is_headerless_class(size_class)) {
     auto *hdr = reinterpret_cast<PtrHeader *>(ret);
     hdr->size = size;
     hdr->core_id = cpu;
@@ -142,113 +398,827 @@ void *SlabAllocator::__allocate(size_t size) {
   return ret;
 }
 
+std::vector<void *> SlabAllocator::allocate_lowest(size_t size,
+                                                   uint32_t max_num) {
+  std::vector<void *> ret;
+  auto size_class = get_size_class(size);
+  if (unlikely(!size || size_class >= kNumSizeClasses)) {
+    return ret;
+  }
+
+  auto chunk_size = get_chunk_size(size_class);
+  auto &slab_list = slab_lists_[size_class];
+  std::vector<uint8_t *> chunks;
+  {
+    ScopedLock lock(&spin_);
+    chunks.reserve(std::min(slab_list.size(), kMaxNumScavengedChunks));
+    while (slab_list.size() && chunks.size() < chunks.capacity()) {
+      chunks.push_back(reinterpret_cast<uint8_t *>(slab_list.pop()));
+    }
+  }
+  auto num = std::min(static_cast<uint64_t>(max_num), chunks.size());
+  std::nth_element(chunks.begin(), chunks.begin() + num, chunks.end());
+  std::sort(chunks.begin(), chunks.begin() + num);
+  {
+    ScopedLock lock(&spin_);
+    for (auto i = chunks.size(); i > num; i--) {
+      slab_list.push(chunks[i - 1]);
+    }
+    global_free_bytes_ -= chunk_size * num;
+  }
+  chunks.resize(num);
+
+  Caladan::PreemptGuard g;
+  auto &cache = enter_cache(g);
+  cache.num_live[size_class] += num;
+  exit_cache(cache);
+  for (auto *chunk : chunks) {
+    if (is_headerless_class(size_class)) {
+      ret.push_back(chunk);
+      continue;
+    }
+    auto *hdr = reinterpret_cast<PtrHeader *>(chunk);
+    hdr->size = size;
+    hdr->core_id = g.read_cpu();
+    hdr->slab_id = slab_id_;
+    ret.push_back(hdr + 1);
+  }
+  return ret;
+}
+
+void *SlabAllocator::allocate_aligned(size_t size, size_t align) {
+  if (align <= kAlignment) {
+    return allocate(size);
+  }
+  if (unlikely(!size)) {
+    return nullptr;
+  }
+
+  // Runs are kSmallRunSize-aligned, so the chunks of a headerless class whose
+  // size is a multiple of align are naturally aligned.
+  if (headerless_) {
+    for (auto size_class = get_size_class(size); size_class < kNumSmallClasses;
+         size_class++) {
+      if (class_sizes_[size_class] % align == 0) {
+        return __allocate(class_sizes_[size_class]);
+      }
+    }
+  }
+
+  // Otherwise, cut the object out of a larger chunk. That chunk carries a
+  // PtrHeader, i.e., is never headerless, since a small class would have
+  // served the request above.
+  auto *chunk = reinterpret_cast<uint8_t *>(__allocate(size + align));
+  if (unlikely(!chunk)) {
+    return nullptr;
+  }
+  assert(!get_run_class(reinterpret_cast<uintptr_t>(chunk)));
+  auto addr = (reinterpret_cast<uintptr_t>(chunk) + sizeof(PtrHeader) +
+               align - 1) &
+              ~(align - 1);
+  auto *hdr = reinterpret_cast<PtrHeader *>(addr - sizeof(PtrHeader));
+  hdr->size = addr - reinterpret_cast<uintptr_t>(chunk);
+  hdr->core_id = 0;
+  hdr->slab_id = kForwardingSlabId;
+  return reinterpret_cast<void *>(addr);
+}
+
 void SlabAllocator::__free(const void *_ptr) {
   auto ptr = const_cast<void *>(_ptr);
+  auto addr = reinterpret_cast<uintptr_t>(ptr);
+  auto *mapped_slab = get_mapped_slab(addr);
+  if (mapped_slab) {
+    if (auto run_class = mapped_slab->get_run_class(addr)) {
+      // Without a header we don't know the allocating core, so the object
+      // simply goes to the freeing core's cache.
+      Caladan::PreemptGuard g;
+      auto &cache = mapped_slab->enter_cache(g);
+      mapped_slab->check_cache_shrink(g);
+      cache.num_live[run_class - 1]--;
+      mapped_slab->free_to_cache_list(g, ptr, run_class - 1);
+      mapped_slab->exit_cache(cache);
+      return;
+    }
+  }
+
   auto *hdr = reinterpret_cast<PtrHeader *>(reinterpret_cast<uintptr_t>(ptr) -
                                             sizeof(PtrHeader));
+  if (unlikely(hdr->slab_id == kForwardingSlabId)) {
+    __free(reinterpret_cast<uint8_t *>(ptr) - hdr->size);
+    return;
+  }
   auto *slab = slabs_[hdr->slab_id];
-  assert(reinterpret_cast<const uint8_t *>(_ptr) >= slab->start_);
-  assert(reinterpret_cast<const uint8_t *>(_ptr) < slab->cur_);
+  assert(slab->owns(_ptr));
 
   auto size = hdr->size;
-  auto slab_shift = slab->get_slab_shift(size);
+  auto size_class = get_size_class(size);
 
-  if (likely(slab_shift < slab->kMaxSlabClassShift)) {
+  if (likely(size_class < kNumSizeClasses)) {
     Caladan::PreemptGuard g;
 
-    slab->__do_free(g, hdr, slab_shift);
+    slab->__do_free(g, hdr, size_class);
+  } else {
+    slab->free_large(hdr);
   }
 }
 
 void *SlabAllocator::reallocate(const void *_ptr, size_t new_size) {
   auto *ptr = const_cast<void *>(_ptr);
-  auto *hdr = reinterpret_cast<PtrHeader *>(reinterpret_cast<uintptr_t>(ptr) -
-                                            sizeof(PtrHeader));
-  auto *slab = slabs_[hdr->slab_id];
-  assert(reinterpret_cast<const uint8_t *>(_ptr) >= slab->start_);
-  assert(reinterpret_cast<const uint8_t *>(_ptr) < slab->cur_);
-
-  auto size = hdr->size;
-  auto slab_shift = slab->get_slab_shift(size);
+  auto addr = reinterpret_cast<uintptr_t>(ptr);
+  auto *slab = get_mapped_slab(addr);
+  auto run_class = slab ? slab->get_run_class(addr) : 0;
+  uint64_t size;
 
-  BUG_ON(slab_shift >= slab->kMaxSlabClassShift);
+  if (run_class) {
+    size = class_sizes_[run_class - 1];
+  } else {
+    auto *hdr = reinterpret_cast<PtrHeader *>(addr - sizeof(PtrHeader));
+    uint64_t offset = 0;
+    if (unlikely(hdr->slab_id == kForwardingSlabId)) {
+      // The object is the tail of a larger chunk.
+      offset = hdr->size;
+      hdr = reinterpret_cast<PtrHeader *>(addr - offset - sizeof(PtrHeader));
+    }
+    slab = slabs_[hdr->slab_id];
+    assert(slab->owns(_ptr));
+    size = hdr->size - offset;
+    if (!offset && get_size_class(size) >= kNumSizeClasses &&
+        get_size_class(new_size) >= kNumSizeClasses &&
+        slab->resize_large(hdr, new_size)) {
+      return ptr;
+    }
+  }
 
   auto *new_ptr = slab->allocate(new_size);
   if (unlikely(!new_ptr)) {
     return nullptr;
   }
   memcpy(new_ptr, ptr, std::min(size, new_size));
-
-  {
-    Caladan::PreemptGuard g;
-    slab->__do_free(g, hdr, slab_shift);
-  }
+  __free(ptr);
 
   return new_ptr;
 }
 
 inline void SlabAllocator::__do_free(const Caladan::PreemptGuard &g,
-                                     PtrHeader *hdr, uint32_t slab_shift) {
-  drain_transferred_cache(g, slab_shift);
+                                     PtrHeader *hdr, uint32_t size_class) {
+  auto &cache = enter_cache(g);
+  check_cache_shrink(g);
+  drain_transferred_cache(g, size_class);
+  cache.num_live[size_class]--;
 
   if (likely(g.read_cpu() == hdr->core_id)) {
-    free_to_cache_list(g, hdr, slab_shift);
+    free_to_cache_list(g, hdr, size_class);
+    exit_cache(cache);
   } else {
-    free_to_transferred_cache_list(hdr, slab_shift);
+    exit_cache(cache);
+    free_to_transferred_cache_list(hdr, size_class);
   }
 }
 
 void SlabAllocator::free_to_cache_list(const Caladan::PreemptGuard &g,
-                                       PtrHeader *hdr, uint32_t slab_shift) {
-  auto max_num_cache_entries =
-      get_max_num_cache_entries(aggressive_caching_, slab_shift);
-  auto &cache_list = cache_lists_[g.read_cpu()].lists[slab_shift];
-  cache_list.push(hdr);
+                                       void *chunk, uint32_t size_class) {
+  auto &cache = cache_lists_[g.read_cpu()];
+  auto &cache_list = cache.lists[size_class];
+  auto max_num_cache_entries = get_max_num_cache_entries(cache, size_class);
+  cache_list.push(chunk);
 
   if (unlikely(cache_list.size() > max_num_cache_entries)) {
-    auto &slab_list = slab_lists_[slab_shift];
-    ScopedLock lock(&spin_);
+    auto &slab_list = slab_lists_[size_class];
+    grow_cache(cache, size_class, lock_spin());
+    max_num_cache_entries = cache.max_entries[size_class];
 
-    while (cache_list.size() > max_num_cache_entries / 2) {
-      slab_list.push(cache_list.pop());
-      global_free_bytes_ += get_slab_size(slab_shift);
+    if (cache_list.size() > max_num_cache_entries) {
+      while (cache_list.size() > max_num_cache_entries / 2) {
+        slab_list.push(cache_list.pop());
+        global_free_bytes_ += get_chunk_size(size_class);
+      }
     }
+    spin_.unlock();
   }
 }
 
 void SlabAllocator::free_to_transferred_cache_list(PtrHeader *hdr,
-                                                   uint32_t slab_shift) {
-  auto max_num_cache_entries =
-      get_max_num_cache_entries(aggressive_caching_, slab_shift);
+                                                   uint32_t size_class) {
+  // The owner core sizes its own cache; don't race with it.
+  uint32_t owner_max_num_cache_entries =
+      rt::access_once(cache_lists_[hdr->core_id].max_entries[size_class]);
+  auto max_num_cache_entries = std::max(
+      owner_max_num_cache_entries,
+      get_init_num_cache_entries(aggressive_caching_,
+                                 class_sizes_[size_class]));
   auto &transferred_cache = transferred_caches_[hdr->core_id];
-  auto &transferred_cache_list = transferred_cache.lists[slab_shift];
-  auto &cache_list = cache_lists_[hdr->core_id].lists[slab_shift];
+  auto &transferred_cache_list = transferred_cache.lists[size_class];
+  auto &cache_list = cache_lists_[hdr->core_id].lists[size_class];
 
   ScopedLock lock(&transferred_cache.spin);
-  transferred_cache.lists[slab_shift].push(hdr);
+  transferred_cache.lists[size_class].push(hdr);
 
   auto total_num = transferred_cache_list.size() + cache_list.size();
   if (unlikely(total_num > max_num_cache_entries)) {
     auto num_to_turn_in = std::min(transferred_cache_list.size(),
                                    total_num - max_num_cache_entries / 2);
-    auto &slab_list = slab_lists_[slab_shift];
+    auto &slab_list = slab_lists_[size_class];
     ScopedLock lock(&spin_);
 
     while (num_to_turn_in--) {
       slab_list.push(transferred_cache_list.pop());
-      global_free_bytes_ += get_slab_size(slab_shift);
+      global_free_bytes_ += get_chunk_size(size_class);
+    }
+  }
+}
+
+// Carves the region's run map from cur_.
+void SlabAllocator::init_run_map(Region &region) {
+  region.run_map_base =
+      reinterpret_cast<uintptr_t>(region.start) & ~(kSmallRunSize - 1);
+  auto num_runs = (reinterpret_cast<uintptr_t>(region.end) -
+                   region.run_map_base - 1) /
+                      kSmallRunSize +
+                  1;
+  region.run_map = cur_;
+  memset(region.run_map, 0, num_runs);
+  cur_ += (num_runs + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+// Called with spin_ held. Moves cur_ up to aligned_cur, handing the skipped
+// bytes over to the headered classes.
+void SlabAllocator::hand_out_gap(uint8_t *aligned_cur) {
+  while (static_cast<uint64_t>(aligned_cur - cur_) > sizeof(PtrHeader)) {
+    uint64_t gap = aligned_cur - cur_;
+    auto gap_class = get_size_class(gap - sizeof(PtrHeader));
+    if (get_chunk_size(gap_class) > gap) {
+      if (!gap_class) {
+        break;
+      }
+      gap_class--;
+    }
+    if (is_headerless_class(gap_class)) {
+      break;
+    }
+    slab_lists_[gap_class].push(cur_);
+    global_free_bytes_ += get_chunk_size(gap_class);
+    cur_ += get_chunk_size(gap_class);
+  }
+  cur_ = aligned_cur;
+}
+
+// Called with spin_ held.
+bool SlabAllocator::new_run(uint32_t size_class) {
+  auto *run = reinterpret_cast<uint8_t *>(
+      (reinterpret_cast<uintptr_t>(cur_) + kSmallRunSize - 1) &
+      ~(kSmallRunSize - 1));
+  auto &region = cur_region();
+  if (unlikely(run + kSmallRunSize > region.end)) {
+    return false;
+  }
+
+  hand_out_gap(run);
+  region.run_map[(reinterpret_cast<uintptr_t>(run) - region.run_map_base) >>
+                 kSmallRunShift] = size_class + 1;
+  run_curs_[size_class] = run;
+  run_ends_[size_class] = run + kSmallRunSize;
+  cur_ = run + kSmallRunSize;
+  return true;
+}
+
+// The first page of a span keeps its ReleasedSpan header.
+inline uint64_t get_released_len(const uint8_t *span_start,
+                                 const uint8_t *span_end) {
+  auto start = reinterpret_cast<uintptr_t>(span_start) +
+               sizeof(uint8_t *) * 2 + kPageSize - 1;
+  start -= start % kPageSize;
+  auto end = reinterpret_cast<uintptr_t>(span_end);
+  end -= end % kPageSize;
+  return end > start ? end - start : 0;
+}
+
+inline void release_pages(uint8_t *span_start, uint8_t *span_end) {
+  auto len = get_released_len(span_start, span_end);
+  if (len) {
+    auto *end = span_end - reinterpret_cast<uintptr_t>(span_end) % kPageSize;
+    BUG_ON(madvise(end - len, len, MADV_DONTNEED) != 0);
+  }
+}
+
+void SlabAllocator::scavenge() {
+  drain_idle_caches();
+
+  for (uint32_t size_class = 0; size_class < kNumSizeClasses; size_class++) {
+    if (slab_lists_[size_class].size()) {
+      scavenge_class(size_class);
+    }
+  }
+
+  // Take the resident large spans out so that their pages are dropped without
+  // holding spin_, then put them back as released. They are chained through
+  // their own headers, which release_pages() keeps.
+  LargeSpan *resident_spans = nullptr;
+  {
+    ScopedLock lock(&spin_);
+    for (auto *span = large_spans_; span;) {
+      auto *next = span->next;
+      if (!span->released) {
+        take_from_large_span(span, span->len);
+        span->next = resident_spans;
+        resident_spans = span;
+      }
+      span = next;
+    }
+  }
+
+  while (resident_spans) {
+    auto *span = resident_spans;
+    resident_spans = span->next;
+    auto *start = reinterpret_cast<uint8_t *>(span);
+    auto len = span->len;
+    release_pages(start, start + len);
+
+    std::optional<VAddrRange> top;
+    {
+      ScopedLock lock(&spin_);
+      top = insert_large_span(start, len, true);
+    }
+    if (top) {
+      trim_top(*top);
+    }
+  }
+}
+
+void SlabAllocator::scavenge_class(uint32_t size_class) {
+  static_assert(sizeof(ReleasedSpan) == sizeof(uint8_t *) * 2);
+  static_assert(sizeof(ReleasedSpan) <= (1 << kMinSlabClassShift));
+
+  auto chunk_size = get_chunk_size(size_class);
+  auto &slab_list = slab_lists_[size_class];
+  std::vector<uint8_t *> chunks;
+  chunks.reserve(std::min(slab_list.size(), kMaxNumScavengedChunks));
+  {
+    ScopedLock lock(&spin_);
+    while (slab_list.size() && chunks.size() < chunks.capacity()) {
+      chunks.push_back(reinterpret_cast<uint8_t *>(slab_list.pop()));
+    }
+  }
+  std::sort(chunks.begin(), chunks.end());
+
+  // Coalesce adjacent chunks into spans and release the pages they cover.
+  ReleasedSpan *spans = nullptr;
+  uint64_t released_bytes = 0;
+  uint64_t num_kept = 0;
+  for (uint64_t i = 0, j; i < chunks.size(); i = j) {
+    for (j = i + 1;
+         j < chunks.size() && chunks[j] == chunks[j - 1] + chunk_size; j++)
+      ;
+    auto *span_start = chunks[i];
+    auto *span_end = chunks[j - 1] + chunk_size;
+    auto len = get_released_len(span_start, span_end);
+    if (len) {
+      release_pages(span_start, span_end);
+      auto *span = reinterpret_cast<ReleasedSpan *>(span_start);
+      span->next = spans;
+      span->end = span_end;
+      spans = span;
+      released_bytes += len;
+    } else {
+      while (i < j) {
+        chunks[num_kept++] = chunks[i++];
+      }
+    }
+  }
+
+  // Pushed in descending order so that the lowest addresses are handed out
+  // first, which is what compaction relies on to pack objects.
+  ScopedLock lock(&spin_);
+  for (uint64_t i = num_kept; i > 0; i--) {
+    slab_list.push(chunks[i - 1]);
+  }
+  while (spans) {
+    auto *next = spans->next;
+    spans->next = released_spans_[size_class];
+    released_spans_[size_class] = spans;
+    spans = next;
+  }
+  released_bytes_ += released_bytes;
+}
+
+// Called with spin_ held.
+void SlabAllocator::refill_from_released_span(uint32_t size_class,
+                                              FreePtrsLinkedList &list,
+                                              uint64_t num) {
+  auto chunk_size = get_chunk_size(size_class);
+  auto *span = released_spans_[size_class];
+  auto *start = reinterpret_cast<uint8_t *>(span);
+  auto *end = span->end;
+  auto *next = span->next;
+
+  num = std::min(num, static_cast<uint64_t>(end - start) / chunk_size);
+  auto *new_start = start + num * chunk_size;
+  released_bytes_ -= get_released_len(start, end);
+  if (new_start < end) {
+    auto *new_span = reinterpret_cast<ReleasedSpan *>(new_start);
+    new_span->next = next;
+    new_span->end = end;
+    released_spans_[size_class] = new_span;
+    released_bytes_ += get_released_len(new_start, end);
+  } else {
+    released_spans_[size_class] = next;
+  }
+
+  global_free_bytes_ -= num * chunk_size;
+  for (auto *tmp = new_start; tmp > start;) {
+    tmp -= chunk_size;
+    list.push(tmp);
+  }
+}
+
+void SlabAllocator::release_spans() {
+  ScopedLock lock(&spin_);
+  for (auto *span : released_spans_) {
+    for (; span; span = span->next) {
+      release_pages(reinterpret_cast<uint8_t *>(span), span->end);
+    }
+  }
+  for (auto *span = large_spans_; span; span = span->next) {
+    if (span->released) {
+      auto *start = reinterpret_cast<uint8_t *>(span);
+      release_pages(start, start + span->len);
+    }
+  }
+}
+
+inline uint64_t get_large_len(uint64_t size) {
+  return (size + sizeof(PtrHeader) + kPageSize - 1) / kPageSize * kPageSize;
+}
+
+void *SlabAllocator::allocate_large(size_t size) {
+  auto len = get_large_len(size);
+  uint8_t *start;
+
+  {
+    ScopedLock lock(&spin_);
+
+    // Address-ordered best fit.
+    LargeSpan *best = nullptr;
+    for (auto *span = large_spans_; span; span = span->next) {
+      if (span->len >= len && (!best || span->len < best->len)) {
+        best = span;
+      }
+    }
+
+    if (best) {
+      start = reinterpret_cast<uint8_t *>(best);
+      take_from_large_span(best, len);
+    } else {
+      auto *aligned_cur = reinterpret_cast<uint8_t *>(
+          (reinterpret_cast<uintptr_t>(cur_) + kPageSize - 1) &
+          ~(kPageSize - 1));
+      auto *end = cur_region().end;
+      if (unlikely(aligned_cur > end ||
+                   static_cast<uint64_t>(end - aligned_cur) < len)) {
+        return nullptr;
+      }
+      hand_out_gap(aligned_cur);
+      start = cur_;
+      cur_ += len;
+      check_low_space();
+    }
+    large_live_bytes_ += len;
+  }
+
+  auto *hdr = reinterpret_cast<PtrHeader *>(start);
+  hdr->size = size;
+  hdr->core_id = 0;
+  hdr->slab_id = slab_id_;
+  return start + sizeof(PtrHeader);
+}
+
+void SlabAllocator::free_large(PtrHeader *hdr) {
+  auto len = get_large_len(hdr->size);
+  std::optional<VAddrRange> top;
+  {
+    ScopedLock lock(&spin_);
+    large_live_bytes_ -= len;
+    top = insert_large_span(reinterpret_cast<uint8_t *>(hdr), len);
+  }
+  if (top) {
+    trim_top(*top);
+  }
+}
+
+bool SlabAllocator::resize_large(PtrHeader *hdr, size_t new_size) {
+  auto *start = reinterpret_cast<uint8_t *>(hdr);
+  auto len = get_large_len(hdr->size);
+  auto new_len = get_large_len(new_size);
+  auto *end = start + len;
+
+  if (new_len <= len) {
+    std::optional<VAddrRange> top;
+    {
+      ScopedLock lock(&spin_);
+      if (new_len < len) {
+        large_live_bytes_ -= len - new_len;
+        top = insert_large_span(start + new_len, len - new_len);
+      }
+      hdr->size = new_size;
+    }
+    if (top) {
+      trim_top(*top);
+    }
+    return true;
+  }
+
+  ScopedLock lock(&spin_);
+  // Grow into the adjacent free span or the untouched heap.
+  auto extra = new_len - len;
+  if (end == cur_) {
+    if (static_cast<uint64_t>(cur_region().end - cur_) < extra) {
+      return false;
+    }
+    cur_ += extra;
+    check_low_space();
+    large_live_bytes_ += extra;
+    hdr->size = new_size;
+    return true;
+  }
+  auto *span = large_spans_;
+  while (span && reinterpret_cast<uint8_t *>(span) < end) {
+    span = span->next;
+  }
+  if (reinterpret_cast<uint8_t *>(span) == end && span->len >= extra) {
+    take_from_large_span(span, extra);
+    large_live_bytes_ += extra;
+    hdr->size = new_size;
+    return true;
+  }
+  return false;
+}
+
+// Called with spin_ held.
+void SlabAllocator::take_from_large_span(LargeSpan *span, uint64_t len) {
+  auto *start = reinterpret_cast<uint8_t *>(span);
+  auto span_len = span->len;
+  auto *prev = span->prev;
+  auto *next = span->next;
+  auto released = span->released;
+
+  if (released) {
+    released_bytes_ -= get_released_len(start, start + span_len);
+  }
+  global_free_bytes_ -= len;
+
+  auto *rest = next;
+  if (span_len > len) {
+    rest = reinterpret_cast<LargeSpan *>(start + len);
+    rest->prev = prev;
+    rest->next = next;
+    rest->len = span_len - len;
+    rest->released = released;
+    if (released) {
+      released_bytes_ +=
+          get_released_len(start + len, start + len + rest->len);
+    }
+    if (next) {
+      next->prev = rest;
+    }
+  } else if (next) {
+    next->prev = prev;
+  }
+  (prev ? prev->next : large_spans_) = rest;
+}
+
+// Called with spin_ held. released tells whether the pages of the span,
+// except for the first one, were already returned to the OS. If the span ends
+// up at the top of the heap, it's taken out and returned, and the caller has
+// to pass it to trim_top() after releasing spin_.
+std::optional<VAddrRange> SlabAllocator::insert_large_span(uint8_t *start,
+                                                           uint64_t len,
+                                                           bool released) {
+  global_free_bytes_ += len;
+  if (released) {
+    released_bytes_ += get_released_len(start, start + len);
+  }
+
+  LargeSpan *prev = nullptr;
+  auto *next = large_spans_;
+  while (next && reinterpret_cast<uint8_t *>(next) < start) {
+    prev = next;
+    next = next->next;
+  }
+
+  // Coalesce with the neighbors. A merged span counts as resident until it's
+  // scavenged again.
+  auto unrelease = [&](LargeSpan *span) {
+    if (span->released) {
+      auto *span_start = reinterpret_cast<uint8_t *>(span);
+      released_bytes_ -= get_released_len(span_start, span_start + span->len);
+      span->released = false;
+    }
+  };
+  LargeSpan *span;
+  span = reinterpret_cast<LargeSpan *>(start);
+  span->prev = prev;
+  span->next = next;
+  span->len = len;
+  span->released = released;
+  (prev ? prev->next : large_spans_) = span;
+  if (next) {
+    next->prev = span;
+  }
+  if (prev && reinterpret_cast<uint8_t *>(prev) + prev->len == start) {
+    unrelease(prev);
+    unrelease(span);
+    prev->len += span->len;
+    prev->next = next;
+    if (next) {
+      next->prev = prev;
+    }
+    span = prev;
+  }
+  if (next && reinterpret_cast<uint8_t *>(span) + span->len ==
+                  reinterpret_cast<uint8_t *>(next)) {
+    unrelease(span);
+    unrelease(next);
+    span->len += next->len;
+    span->next = next->next;
+    if (span->next) {
+      span->next->prev = span;
+    }
+  }
+
+  // Take out the span at the top of the heap so that it can be given back.
+  auto *span_start = reinterpret_cast<uint8_t *>(span);
+  if (span_start + span->len == cur_) {
+    peak_usage_ = std::max(peak_usage_, get_usage());
+    auto top = reinterpret_cast<uint64_t>(span_start);
+    auto top_len = span->len;
+    take_from_large_span(span, top_len);
+    return VAddrRange{top, top + top_len};
+  }
+  return std::nullopt;
+}
+
+// Drops the pages of a free span that was at the top of the heap, and then
+// lowers the top to it, unless something was carved above it meanwhile.
+void SlabAllocator::trim_top(VAddrRange range) {
+  while (true) {
+    auto *start = reinterpret_cast<uint8_t *>(range.start);
+    auto len = range.end - range.start;
+    BUG_ON(madvise(start, len, MADV_DONTNEED) != 0);
+
+    ScopedLock lock(&spin_);
+    if (start + len == cur_) {
+      cur_ = start;
+      return;
+    }
+    auto top = insert_large_span(start, len, true);
+    if (!top) {
+      return;
+    }
+    range = *top;
+  }
+}
+
+bool SlabAllocator::add_region(void *buf, size_t len) {
+  ScopedLock lock(&spin_);
+  if (unlikely(num_regions_ == kMaxNumRegions)) {
+    return false;
+  }
+
+  // The rest of the current region is left untouched.
+  auto &prev = cur_region();
+  auto *start = reinterpret_cast<uint8_t *>(buf);
+  rt::access_once(region_seq_) = region_seq_ + 1;
+  barrier();
+  prev.top = cur_;
+  retired_usage_ += cur_ - prev.start;
+  regions_[num_regions_] = Region{.start = start,
+                                  .end = start + len,
+                                  .top = nullptr,
+                                  .run_map = nullptr,
+                                  .run_map_base = 0};
+  cur_ = start;
+  num_regions_++;
+  barrier();
+  rt::access_once(region_seq_) = region_seq_ + 1;
+
+  if (headerless_) {
+    init_run_map(cur_region());
+    if (slab_id_ != kRuntimeSlabId) {
+      map_proclet_heap(this, slab_id_);
+    }
+  }
+  return true;
+}
+
+SlabAllocator::Stats SlabAllocator::stats() const {
+  Stats stats;
+
+  for (uint32_t size_class = 0; size_class < kNumSizeClasses; size_class++) {
+    int64_t num_live = 0;
+    for (auto &cache : cache_lists_) {
+      num_live += rt::access_once(cache.num_live[size_class]);
+    }
+    auto &c = stats.classes[size_class];
+    c.size = class_sizes_[size_class];
+    c.num_live = std::max(num_live, static_cast<int64_t>(0));
+    c.num_free = slab_lists_[size_class].size();
+  }
+  for (uint32_t i = 0; i < kNumCores; i++) {
+    stats.cached_bytes[i] = 0;
+    stats.num_transferred[i] = 0;
+    for (uint32_t size_class = 0; size_class < kNumSizeClasses;
+         size_class++) {
+      stats.cached_bytes[i] += cache_lists_[i].lists[size_class].size() *
+                               get_chunk_size(size_class);
+      stats.num_transferred[i] +=
+          transferred_caches_[i].lists[size_class].size();
+    }
+  }
+  stats.large_live_bytes = rt::access_once(large_live_bytes_);
+  stats.global_free_bytes = rt::access_once(global_free_bytes_);
+  stats.released_bytes = rt::access_once(released_bytes_);
+  stats.usage = get_usage();
+  uint64_t peak_usage = rt::access_once(peak_usage_);
+  stats.peak_usage = std::max(stats.usage, peak_usage);
+  return stats;
+}
+
+void SlabAllocator::set_profiling_rate(uint32_t rate) {
+  if (rate) {
+    // The first call loads the unwinder, which allocates.
+    void *frame;
+    backtrace(&frame, 1);
+  }
+  rt::access_once(profiling_rate_) = rate;
+}
+
+void SlabAllocator::record_sample(size_t size) {
+  // Skip this frame.
+  void *frames[kNumProfiledFrames + 1];
+  auto num_frames = std::max(backtrace(frames, kNumProfiledFrames + 1) - 1, 0);
+  uint32_t rate = rt::access_once(profiling_rate_);
+  rate = std::max(rate, 1U);
+
+  ScopedLock lock(&profile_spin_);
+  for (auto &site : alloc_sites_) {
+    if (!site.num_samples) {
+      site.num_frames = num_frames;
+      std::copy(frames + 1, frames + 1 + num_frames, site.frames);
+    } else if (site.num_frames != static_cast<uint32_t>(num_frames) ||
+               !std::equal(frames + 1, frames + 1 + num_frames,
+                           site.frames)) {
+      continue;
+    }
+    site.num_samples++;
+    site.num_bytes += size * rate;
+    return;
+  }
+  num_dropped_samples_++;
+}
+
+std::vector<SlabAllocator::AllocSite> SlabAllocator::get_profile() {
+  std::vector<AllocSite> sites;
+  sites.reserve(kMaxNumAllocSites);
+
+  {
+    ScopedLock lock(&profile_spin_);
+    for (auto &site : alloc_sites_) {
+      if (!site.num_samples) {
+        break;
+      }
+      sites.push_back(site);
+    }
+  }
+  std::sort(sites.begin(), sites.end(), [](auto &x, auto &y) {
+    return x.num_bytes > y.num_bytes;
+  });
+  return sites;
+}
+
+void SlabAllocator::dump_profile(std::ostream &os) {
+  auto sites = get_profile();
+  os << "slab " << slab_id_ << ": " << sites.size() << " sites, "
+     << rt::access_once(num_dropped_samples_) << " dropped samples"
+     << std::endl;
+  for (auto &site : sites) {
+    os << site.num_samples << " samples, ~" << site.num_bytes << " B"
+       << std::endl;
+    auto symbols = backtrace_symbols(site.frames, site.num_frames);
+    for (uint32_t i = 0; i < site.num_frames; i++) {
+      os << "  " << (symbols ? symbols[i] : "?") << std::endl;
     }
+    ::free(symbols);
   }
 }
 
 void *SlabAllocator::yield(size_t size) {
   ScopedLock lock(&spin_);
   size = (((size - 1) / kAlignment) + 1) * kAlignment;
-  if (unlikely(cur_ + size > end_)) {
+  if (unlikely(cur_ + size > cur_region().end)) {
     return nullptr;
   }
   auto ret = cur_;
   cur_ += size;
+  check_low_space();
   return ret;
 }
 
@@ -7,7 +7,8 @@ USAGE="Usage: $0 [tests_prefix]
 SERVER_IP="18.18.1.2"
 MAIN_SERVER_IP="18.18.1.3"
 LPID=1
-SKIPPED_TESTS=("test_continuous_migrate")
+# The last two need the setups of their own scripts.
+SKIPPED_TESTS=("test_continuous_migrate" "test_ctrl_failover" "test_migration_oscillation")
 
 all_passed=1
 tests_prefix="test_dis_vector"
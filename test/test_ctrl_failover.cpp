@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+extern "C" {
+#include <runtime/timer.h>
+}
+#include <runtime.h>
+
+#include "nu/proclet.hpp"
+#include "nu/runtime.hpp"
+
+using namespace nu;
+
+// Long enough for test_ctrl_failover.sh to kill the primary controller midway.
+constexpr uint64_t kRunTimeUs = 20 * kOneSecond;
+
+class Adder {
+ public:
+  Adder(int base) : base_(base) {}
+  int add(int x) { return base_ + x; }
+
+ private:
+  int base_;
+};
+
+void do_work() {
+  bool passed = true;
+  uint64_t num_rounds = 0;
+  uint64_t max_round_us = 0;
+
+  // Every round goes through the controller for allocating, resolving and
+  // destroying a proclet, so the slowest round bounds the failover time.
+  auto start_us = microtime();
+  auto last_us = start_us;
+  while (last_us - start_us < kRunTimeUs) {
+    {
+      auto adder = make_proclet<Adder>(std::tuple(10));
+      passed &= (adder.run(&Adder::add, 1) == 11);
+    }
+    auto now_us = microtime();
+    max_round_us = std::max(max_round_us, now_us - last_us);
+    last_us = now_us;
+    num_rounds++;
+  }
+
+  std::cout << "rounds = " << num_rounds
+            << ", max round time (us) = " << max_round_us << std::endl;
+  if (passed) {
+    std::cout << "Passed" << std::endl;
+  } else {
+    std::cout << "Failed" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
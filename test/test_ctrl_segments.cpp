@@ -0,0 +1,78 @@
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "nu/commons.hpp"
+#include "nu/ctrl.hpp"
+#include "nu/runtime.hpp"
+
+using namespace nu;
+
+constexpr uint64_t kNumMaxSegments =
+    (kMaxProcletHeapVAddr - kMinProcletHeapVAddr) / kMaxProcletHeapSize;
+
+// Allocates segments of the capacity until the VA space runs out.
+std::vector<VAddrRange> allocate_all(Controller *ctrl, uint64_t capacity) {
+  std::vector<VAddrRange> segments;
+  while (auto optional = ctrl->allocate_heap_segment(capacity)) {
+    segments.push_back(*optional);
+  }
+  return segments;
+}
+
+void free_all(Controller *ctrl, const std::vector<VAddrRange> &segments) {
+  // Frees them in an interleaved order, so that buddies rarely go in a row.
+  for (uint32_t parity = 0; parity < 2; parity++) {
+    for (size_t i = parity; i < segments.size(); i += 2) {
+      ctrl->free_heap_segment(segments[i]);
+    }
+  }
+}
+
+void do_work() {
+  bool passed = true;
+  auto ctrl = std::make_unique<Controller>();
+
+  // Churns through the capacities from the smallest one; every round must get
+  // the whole VA space back.
+  for (auto capacity = kMinProcletHeapSize; capacity <= kMaxProcletHeapSize;
+       capacity *= 2) {
+    auto segments = allocate_all(ctrl.get(), capacity);
+    passed &= (segments.size() * capacity ==
+               kNumMaxSegments * kMaxProcletHeapSize);
+    free_all(ctrl.get(), segments);
+  }
+
+  // Leaves one small segment in use per max segment; nothing else fits.
+  auto max_segments = allocate_all(ctrl.get(), kMaxProcletHeapSize);
+  passed &= (max_segments.size() == kNumMaxSegments);
+  free_all(ctrl.get(), max_segments);
+  auto small_segments = allocate_all(ctrl.get(), kMinProcletHeapSize);
+  std::vector<VAddrRange> pinned_segments, other_segments;
+  for (auto &segment : small_segments) {
+    if (segment.start % kMaxProcletHeapSize == 0) {
+      pinned_segments.push_back(segment);
+    } else {
+      other_segments.push_back(segment);
+    }
+  }
+  free_all(ctrl.get(), other_segments);
+  passed &= !ctrl->allocate_heap_segment(kMaxProcletHeapSize);
+  auto half_segments = allocate_all(ctrl.get(), kMaxProcletHeapSize / 2);
+  passed &= (half_segments.size() == kNumMaxSegments);
+  free_all(ctrl.get(), half_segments);
+  free_all(ctrl.get(), pinned_segments);
+  passed &= (allocate_all(ctrl.get(), kMaxProcletHeapSize).size() ==
+             kNumMaxSegments);
+
+  if (passed) {
+    std::cout << "Passed" << std::endl;
+  } else {
+    std::cout << "Failed" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
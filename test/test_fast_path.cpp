@@ -1,5 +1,7 @@
 #include <atomic>
 #include <iostream>
+#include <numeric>
+#include <vector>
 
 #include "nu/pressure_handler.hpp"
 #include "nu/proclet.hpp"
@@ -10,15 +12,39 @@
 
 constexpr uint32_t kMagic = 0x12345678;
 constexpr uint32_t ip = MAKE_IP_ADDR(18, 18, 1, 2);
+constexpr uint32_t kVecLen = 1 << 20;
+constexpr uint32_t kBenchRounds = 100;
 
 namespace nu {
 
+using Vec = std::vector<uint64_t>;
+
 class CalleeObj {
  public:
   uint32_t foo() {
     Time::delay_us(1000 * 1000);
     return kMagic;
   }
+
+  uint64_t sum_copied(Vec vec) {
+    return std::accumulate(vec.begin(), vec.end(), 0ULL);
+  }
+
+  uint64_t sum_borrowed(Borrowed<Vec> vec) {
+    return std::accumulate(vec->begin(), vec->end(), 0ULL);
+  }
+
+  uint64_t sum_moved(Moved<Vec> vec) {
+    return std::accumulate(vec->begin(), vec->end(), 0ULL);
+  }
+
+  uint64_t keep_moved(Moved<Vec> vec) {
+    kept_ = vec.take();
+    return std::accumulate(kept_.begin(), kept_.end(), 0ULL);
+  }
+
+ private:
+  Vec kept_;
 };
 
 class CallerObj {
@@ -28,6 +54,48 @@ class CallerObj {
   uint32_t foo(Proclet<CalleeObj> callee_obj) {
     return callee_obj.run(&CalleeObj::foo);
   }
+
+  bool check_pass_modes(Proclet<CalleeObj> callee_obj) {
+    Vec vec(kVecLen, 1);
+    auto vec_copy = vec;
+    return callee_obj.run<false>(&CalleeObj::sum_borrowed, borrow(vec)) ==
+               kVecLen &&
+           callee_obj.run<false>(&CalleeObj::sum_moved,
+                                 move_across(std::move(vec_copy))) ==
+               kVecLen &&
+           callee_obj.run<false>(&CalleeObj::keep_moved,
+                                 move_across(std::move(vec))) == kVecLen;
+  }
+
+  // Returns the per-call latency (us) of copy, borrow, rvalue copy and move.
+  std::vector<float> bench_pass_modes(Proclet<CalleeObj> callee_obj) {
+    Vec vec(kVecLen, 1);
+    std::vector<float> lats;
+    auto bench = [&](auto &&fn) {
+      auto start_us = Time::microtime();
+      for (uint32_t i = 0; i < kBenchRounds; i++) {
+        fn();
+      }
+      lats.push_back(static_cast<float>(Time::microtime() - start_us) /
+                     kBenchRounds);
+    };
+
+    bench([&] { callee_obj.run<false>(&CalleeObj::sum_copied, vec); });
+    bench([&] {
+      callee_obj.run<false>(&CalleeObj::sum_borrowed, borrow(vec));
+    });
+    // The two below pay the same caller-side copy to make a disposable vec.
+    bench([&] {
+      auto tmp = vec;
+      callee_obj.run<false>(&CalleeObj::sum_copied, std::move(tmp));
+    });
+    bench([&] {
+      auto tmp = vec;
+      callee_obj.run<false>(&CalleeObj::sum_moved,
+                            move_across(std::move(tmp)));
+    });
+    return lats;
+  }
 };
 
 class Test {
@@ -60,9 +128,27 @@ class Test {
     return future.get() == kMagic;
   }
 
+  bool run_pass_modes_test() {
+    auto caller_obj = make_proclet<CallerObj>(true, std::nullopt, ip);
+    auto callee_obj = make_proclet<CalleeObj>(true, std::nullopt, ip);
+    return caller_obj.run(&CallerObj::check_pass_modes, callee_obj);
+  }
+
+  void run_pass_modes_bench() {
+    auto caller_obj = make_proclet<CallerObj>(true, std::nullopt, ip);
+    auto callee_obj = make_proclet<CalleeObj>(true, std::nullopt, ip);
+    auto lats = caller_obj.run(&CallerObj::bench_pass_modes, callee_obj);
+    std::cout << "copy borrow rvalue_copy move_across (us/call, "
+              << kVecLen * sizeof(uint64_t) << " bytes)" << std::endl;
+    for (auto lat : lats) {
+      std::cout << lat << " ";
+    }
+    std::cout << std::endl;
+  }
+
   bool run_all_tests() {
     return run_callee_migrated_test() && run_caller_migrated_test() &&
-           run_both_migrated_test();
+           run_both_migrated_test() && run_pass_modes_test();
   }
 
   static void migrate() {
@@ -82,5 +168,6 @@ int main(int argc, char **argv) {
     } else {
       std::cout << "Failed" << std::endl;
     }
+    test.run_pass_modes_bench();
   });
 }
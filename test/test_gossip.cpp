@@ -0,0 +1,129 @@
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "nu/proclet.hpp"
+#include "nu/resource_reporter.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/time.hpp"
+
+using namespace nu;
+
+constexpr uint32_t kNumGossipRounds = 32;
+constexpr float kFakeCores = 12345;
+
+std::vector<NodeIP> get_node_ips() {
+  MigrationGuard migration_guard;
+  RuntimeSlabGuard slab_guard;
+
+  std::vector<NodeIP> ips;
+  for (auto &[ip, _] :
+       get_runtime()->resource_reporter()->get_global_free_resources()) {
+    ips.push_back(ip);
+  }
+  return ips;
+}
+
+bool set_gossip(bool enabled) {
+  get_runtime()->resource_reporter()->set_gossip(enabled);
+  return get_runtime()->resource_reporter()->is_gossip_enabled() == enabled;
+}
+
+std::optional<float> get_free_cores(NodeIP ip) {
+  MigrationGuard migration_guard;
+  RuntimeSlabGuard slab_guard;
+
+  for (auto &[node_ip, resource] :
+       get_runtime()->resource_reporter()->get_global_free_resources()) {
+    if (node_ip == ip) {
+      return resource.cores;
+    }
+  }
+  return std::nullopt;
+}
+
+void merge_cores(NodeIP ip, float cores, uint64_t seq) {
+  MigrationGuard migration_guard;
+  RuntimeSlabGuard slab_guard;
+
+  GossipEntry entry{
+      .ip = ip, .resource = {.cores = cores, .mem_mbs = 0}, .seq = seq};
+  get_runtime()->resource_reporter()->merge_gossip(std::span(&entry, 1));
+}
+
+class Peer {
+ public:
+  bool set_gossip(bool enabled) { return ::set_gossip(enabled); }
+  uint32_t get_view_size() { return get_node_ips().size(); }
+};
+
+bool test_default_off() {
+  return !get_runtime()->resource_reporter()->is_gossip_enabled();
+}
+
+bool test_merge(const std::vector<NodeIP> &ips) {
+  NodeIP peer_ip = 0;
+  for (auto ip : ips) {
+    if (ip != get_cfg_ip()) {
+      peer_ip = ip;
+    }
+  }
+  if (!peer_ip) {
+    return false;
+  }
+
+  // The newer entry wins and the older one is dropped.
+  constexpr auto kMaxSeq = std::numeric_limits<uint64_t>::max();
+  merge_cores(peer_ip, kFakeCores, kMaxSeq);
+  bool passed = (get_free_cores(peer_ip) == kFakeCores);
+  merge_cores(peer_ip, 0, kMaxSeq - 1);
+  passed &= (get_free_cores(peer_ip) == kFakeCores);
+  return passed;
+}
+
+bool test_gossip() {
+  auto ips = get_node_ips();
+  if (ips.empty()) {
+    return false;
+  }
+
+  bool passed = set_gossip(true);
+  std::vector<Proclet<Peer>> peers;
+  for (auto ip : ips) {
+    if (ip != get_cfg_ip()) {
+      peers.emplace_back(make_proclet<Peer>(true, std::nullopt, ip));
+      passed &= peers.back().run(&Peer::set_gossip, true);
+    }
+  }
+
+  // Every node still sees the whole cluster once the controller's view is
+  // only pulled every now and then.
+  Time::sleep(kNumGossipRounds * ResourceReporter::kGossipIntervalUs);
+  passed &= (get_node_ips().size() == ips.size());
+  for (auto &peer : peers) {
+    passed &= (peer.run(&Peer::get_view_size) == ips.size());
+  }
+  // Gossiped entries only stick while gossip is on.
+  passed &= test_merge(ips);
+
+  for (auto &peer : peers) {
+    passed &= peer.run(&Peer::set_gossip, false);
+  }
+  passed &= set_gossip(false);
+  return passed;
+}
+
+void do_work() {
+  if (test_default_off() && test_gossip()) {
+    std::cout << "Passed" << std::endl;
+  } else {
+    std::cout << "Failed" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
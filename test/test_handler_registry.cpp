@@ -0,0 +1,88 @@
+#include <cstdint>
+#include <iostream>
+
+#include "nu/closure_registry.hpp"
+#include "nu/handler_registry.hpp"
+#include "nu/proclet.hpp"
+#include "nu/runtime.hpp"
+
+using namespace nu;
+
+constexpr uint32_t kRemoteIP = MAKE_IP_ADDR(18, 18, 1, 2);
+
+using TestHandler = int (*)(int);
+
+int handler_a(int x) { return x + 1; }
+int handler_b(int x) { return x + 2; }
+
+int add_one(int &x) { return x + 1; }
+
+class Obj {
+ public:
+  int add(int x) { return x + val_; }
+
+ private:
+  int val_ = 42;
+};
+
+bool test_handler_registry() {
+  using Registry = HandlerRegistry<TestHandler>;
+
+  bool passed = true;
+  auto id_a = Registry::get_id<handler_a>();
+  auto id_b = Registry::get_id<handler_b>();
+  passed &= (id_a != id_b);
+  passed &= (Registry::get_id<handler_a>() == id_a);
+  passed &= (Registry::get_handler(id_a) == &handler_a);
+  passed &= (Registry::get_handler(id_b) == &handler_b);
+  passed &= (Registry::get_num_handlers() == 2);
+  HandlerID unknown_id = 1;
+  while (unknown_id == id_a || unknown_id == id_b) {
+    unknown_id++;
+  }
+  passed &= !Registry::get_handler(unknown_id);
+  return passed;
+}
+
+bool test_closure_registry() {
+  auto *registry = ClosureRegistry::get();
+  if (!registry->has_symbols()) {
+    std::cout << "the binary is stripped" << std::endl;
+    return false;
+  }
+
+  bool passed = true;
+  // The ID follows the symbol, not the code address.
+  auto id = registry->to_id(&add_one);
+  passed &= (id == ClosureRegistry::hash_symbol("_Z7add_oneRi"));
+  passed &= (registry->from_id<decltype(&add_one)>(id) == &add_one);
+
+  auto *closure = +[](Obj &obj, int x) { return obj.add(x); };
+  auto closure_id = registry->to_id(closure);
+  passed &= (closure_id != id);
+  passed &= (registry->from_id<decltype(closure)>(closure_id) == closure);
+
+  passed &= !registry->get_fn(ClosureRegistry::hash_symbol("no_such_symbol"));
+  return passed;
+}
+
+bool test_remote_dispatch() {
+  auto obj = make_proclet<Obj>(false, std::nullopt, kRemoteIP);
+  bool passed = true;
+  passed &= (obj.run(+[](Obj &obj, int x) { return obj.add(x); }, 1) == 43);
+  passed &= (obj.run(&Obj::add, 2) == 44);
+  return passed;
+}
+
+void do_work() {
+  if (test_handler_registry() && test_closure_registry() &&
+      test_remote_dispatch()) {
+    std::cout << "Passed" << std::endl;
+  } else {
+    std::cout << "Failed" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
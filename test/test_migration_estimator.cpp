@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <tuple>
+
+#include "nu/commons.hpp"
+#include "nu/migration_estimator.hpp"
+#include "nu/runtime.hpp"
+
+using namespace nu;
+
+constexpr uint32_t kNumSamples = 200;
+constexpr NodeIP kSlowIP = 1;
+constexpr NodeIP kFastIP = 2;
+constexpr NodeIP kUnseenIP = 3;
+constexpr float kSlowBwGbps = 25;
+constexpr float kSlowFixedCostUs = 40;
+constexpr float kFastBwGbps = 100;
+constexpr float kFastFixedCostUs = 20;
+constexpr float kTolerance = 0.05;
+
+float time_us(float bw_gbps, float fixed_cost_us, uint64_t size) {
+  return fixed_cost_us + size / (bw_gbps / 8) / 1000;
+}
+
+bool is_close(float x, float expected) {
+  return std::abs(x - expected) <= kTolerance * expected;
+}
+
+void do_work() {
+  bool passed = true;
+  auto estimator = std::make_unique<MigrationEstimator>();
+
+  // Starts from the hard-coded model.
+  passed &= is_close(estimator->get_net_bw_gbps(0), Utility::kNetBwGbps);
+  passed &= is_close(estimator->get_fixed_cost_us(kSlowIP),
+                     Utility::kFixedCostUs);
+
+  for (uint32_t i = 0; i < kNumSamples; i++) {
+    uint64_t size = ((i * 7) % 64 + 1) * kOneMB;
+    for (auto [ip, bw_gbps, fixed_cost_us] :
+         {std::tuple(kSlowIP, kSlowBwGbps, kSlowFixedCostUs),
+          std::tuple(kFastIP, kFastBwGbps, kFastFixedCostUs)}) {
+      MigrationTimeRecord record{
+          .id = i,
+          .dest_ip = ip,
+          .size = size,
+          .predicted_us = estimator->predict_us(ip, size),
+          .actual_us = time_us(bw_gbps, fixed_cost_us, size)};
+      estimator->add(record);
+    }
+  }
+
+  passed &= is_close(estimator->get_net_bw_gbps(kSlowIP), kSlowBwGbps);
+  passed &= is_close(estimator->get_fixed_cost_us(kSlowIP), kSlowFixedCostUs);
+  passed &= is_close(estimator->get_net_bw_gbps(kFastIP), kFastBwGbps);
+  passed &= is_close(estimator->get_fixed_cost_us(kFastIP), kFastFixedCostUs);
+  uint64_t size = 32 * kOneMB;
+  passed &= is_close(estimator->predict_us(kSlowIP, size),
+                     time_us(kSlowBwGbps, kSlowFixedCostUs, size));
+  // An unseen destination falls back to the fit over all of them.
+  auto global_us = estimator->predict_us(0, size);
+  passed &= (estimator->predict_us(kUnseenIP, size) == global_us);
+  passed &= (global_us > time_us(kFastBwGbps, kFastFixedCostUs, size));
+  passed &= (global_us < time_us(kSlowBwGbps, kSlowFixedCostUs, size));
+
+  // The latest predictions have converged to the actual times.
+  auto records = estimator->get_records();
+  passed &= (records.size() ==
+             std::min<uint32_t>(2 * kNumSamples,
+                                MigrationEstimator::kMaxNumRecords));
+  passed &= (records.back().id == kNumSamples - 1);
+  passed &= (records.back().dest_ip == kFastIP);
+  passed &= is_close(records.back().predicted_us, records.back().actual_us);
+
+  if (passed) {
+    std::cout << "Passed" << std::endl;
+  } else {
+    std::cout << "Failed" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <runtime/timer.h>
+}
+#include <runtime.h>
+#include <thread.h>
+
+#include "nu/proclet.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utility_index.hpp"
+#include "nu/utils/time.hpp"
+
+using namespace nu;
+
+// Only meaningful under test_migration_oscillation.sh, which keeps toggling a
+// CPU antagonist meanwhile, so the nodes take turns being under CPU pressure.
+constexpr uint32_t kNumProclets = 64;
+constexpr uint64_t kRunTimeUs = 30 * kOneSecond;
+constexpr uint64_t kComputeTimeUs = 100;
+// A proclet that just moved is the last one picked until its migration
+// penalty wears off, however often the pressure flips.
+constexpr uint32_t kMaxNumMigrations =
+    kRunTimeUs / Utility::kMigrationPenaltyUs + 1;
+
+class HotObj {
+ public:
+  void compute() { Time::delay_us(kComputeTimeUs); }
+};
+
+void do_work() {
+  std::vector<Proclet<HotObj>> objs;
+  for (uint32_t i = 0; i < kNumProclets; i++) {
+    objs.emplace_back(make_proclet<HotObj>());
+  }
+
+  std::vector<rt::Thread> threads;
+  auto start_us = microtime();
+  for (auto &obj : objs) {
+    threads.emplace_back([&, obj = &obj] {
+      while (microtime() - start_us < kRunTimeUs) {
+        obj->run(&HotObj::compute);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+
+  uint32_t max_num_migrations = 0;
+  uint32_t total_num_migrations = 0;
+  for (auto &obj : objs) {
+    auto num_migrations = obj.run(+[](HotObj &_) {
+      rt::Preempt p;
+      rt::PreemptGuard g(&p);
+      return get_runtime()->get_current_proclet_header()->num_migrations;
+    });
+    max_num_migrations = std::max(max_num_migrations, num_migrations);
+    total_num_migrations += num_migrations;
+  }
+
+  std::cout << "total migrations = " << total_num_migrations
+            << ", max migrations per proclet = " << max_num_migrations
+            << std::endl;
+  // No migration at all means the antagonist never got to create pressure.
+  if (total_num_migrations && max_num_migrations <= kMaxNumMigrations) {
+    std::cout << "Passed" << std::endl;
+  } else {
+    std::cout << "Failed" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
@@ -0,0 +1,94 @@
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "nu/proclet.hpp"
+#include "nu/proclet_mgr.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/numa.hpp"
+
+using namespace nu;
+
+constexpr uint32_t kNumRetries = 3;
+constexpr uint64_t kMemLen = 1 << 20;
+
+class Obj {
+ public:
+  uint32_t get_heap_node() {
+    return get_runtime()->get_current_proclet_header()->numa_node;
+  }
+};
+
+// Reads the node of the CPU from sysfs, which lists it as a nodeN entry.
+int32_t get_sysfs_numa_node(int cpu) {
+  auto path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  for (auto &entry : std::filesystem::directory_iterator(path)) {
+    auto name = entry.path().filename().string();
+    if (name.starts_with("node")) {
+      return std::stoi(name.substr(4));
+    }
+  }
+  return 0;
+}
+
+bool test_cur_numa_node() {
+  // The kthread might get moved between the two reads, so retry a few times.
+  for (uint32_t i = 0; i < kNumRetries; i++) {
+    auto cpu = sched_getcpu();
+    auto node = get_cur_numa_node();
+    if (cpu >= 0 && static_cast<int32_t>(node) == get_sysfs_numa_node(cpu)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool test_bind_to_numa_node() {
+  auto *addr = mmap(nullptr, kMemLen, PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+
+  bool passed = true;
+  auto num_nodes = get_num_numa_nodes();
+  for (uint32_t node = 0; node < num_nodes; node++) {
+    passed &= bind_to_numa_node(addr, kMemLen, node, /* move = */ true);
+  }
+  passed &= !bind_to_numa_node(addr, kMemLen, num_nodes, /* move = */ false);
+  munmap(addr, kMemLen);
+  return passed;
+}
+
+bool test_heap_node() {
+  auto obj = make_proclet<Obj>();
+  return obj.run(&Obj::get_heap_node) < get_num_numa_nodes();
+}
+
+bool test_rebalance_numa() {
+  // A fresh proclet hasn't run enough to show where its heap belongs, so the
+  // pressure handler's cross-socket step moves nothing and it falls back to
+  // migrating over the network.
+  auto obj = make_proclet<Obj>();
+  auto node = obj.run(&Obj::get_heap_node);
+  bool passed = !get_runtime()->proclet_manager()->rebalance_numa();
+  passed &= (obj.run(&Obj::get_heap_node) == node);
+  return passed;
+}
+
+void do_work() {
+  if (test_cur_numa_node() && test_bind_to_numa_node() && test_heap_node() &&
+      test_rebalance_numa()) {
+    std::cout << "Passed" << std::endl;
+  } else {
+    std::cout << "Failed" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
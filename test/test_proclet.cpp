@@ -15,6 +15,8 @@ extern "C" {
 
 using namespace nu;
 
+constexpr uint32_t kNumAdders = 64;
+
 class Obj {
  public:
   void set_vec_a(std::vector<int> vec) { a_ = vec; }
@@ -32,6 +34,15 @@ class Obj {
   std::vector<int> b_;
 };
 
+class Adder {
+ public:
+  Adder(int base) : base_(base) {}
+  int add(int x) { return base_ + x; }
+
+ private:
+  int base_;
+};
+
 void do_work() {
   bool passed = true;
 
@@ -67,6 +78,15 @@ void do_work() {
       std::move(proclet), a, b);
   passed &= match;
 
+  // Proclets can also be created in batches, each of them with its own copy
+  // of the constructor arguments.
+  auto adders = make_proclets<Adder>(kNumAdders, std::make_tuple(10));
+  passed &= (adders.size() == kNumAdders);
+  for (uint32_t i = 0; i < adders.size(); i++) {
+    passed &= (adders[i].run(&Adder::add, static_cast<int>(i)) ==
+               10 + static_cast<int>(i));
+  }
+
   if (passed) {
     std::cout << "Passed" << std::endl;
   } else {
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+
+extern "C" {
+#include <net/ip.h>
+}
+#include <runtime.h>
+
+#include "nu/proclet.hpp"
+#include "nu/replicated_proclet.hpp"
+#include "nu/resource_reporter.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/time.hpp"
+
+using namespace nu;
+
+constexpr uint32_t kNumReplicas = 2;
+constexpr uint32_t kNumKeys = 1000;
+constexpr uint64_t kMaxStalenessUs = 5 * kOneMilliSecond;
+
+class Table {
+ public:
+  void put(uint32_t k, std::string v) { map_[k] = v; }
+  std::optional<std::string> get(uint32_t k) const {
+    auto iter = map_.find(k);
+    if (iter == map_.end()) {
+      return std::nullopt;
+    }
+    return iter->second;
+  }
+  uint32_t size() const { return map_.size(); }
+
+  template <class Archive>
+  void serialize(Archive &ar) {
+    ar(map_);
+  }
+
+ private:
+  std::map<uint32_t, std::string> map_;
+};
+
+bool check_all(ReplicatedProclet<Table> &table) {
+  for (uint32_t i = 0; i < kNumKeys; i++) {
+    auto optional = table.run(&Table::get, i);
+    if (!optional || *optional != std::to_string(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t get_num_nodes() {
+  MigrationGuard migration_guard;
+  RuntimeSlabGuard slab_guard;
+  return get_runtime()->resource_reporter()->get_global_free_resources().size();
+}
+
+bool run_sync_test() {
+  auto table = make_replicated_proclet<Table>(std::tuple<>(), kNumReplicas,
+                                              kSyncReplication);
+  // Replicas never share a node.
+  if (table.get_num_replicas() != std::min(kNumReplicas, get_num_nodes() - 1)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < kNumKeys; i++) {
+    table.run(&Table::put, i, std::to_string(i));
+  }
+  if (!check_all(table)) {
+    return false;
+  }
+
+  // Reads from another proclet should see the same content.
+  auto proclet = make_proclet<ErasedType>();
+  return proclet.run(
+      +[](ErasedType &, ReplicatedProclet<Table> table) {
+        return check_all(table) &&
+               table.read(+[](const Table &t) { return t.size(); }) ==
+                   kNumKeys;
+      },
+      table);
+}
+
+bool run_bounded_staleness_test() {
+  auto table = make_replicated_proclet<Table>(
+      std::tuple<>(), kNumReplicas, kBoundedStaleness, kMaxStalenessUs);
+  for (uint32_t i = 0; i < kNumKeys; i++) {
+    table.write(
+        +[](Table &t, uint32_t k) { t.put(k, std::to_string(k)); }, i);
+  }
+  Time::sleep(2 * kMaxStalenessUs);
+  return check_all(table);
+}
+
+void do_work() {
+  if (run_sync_test() && run_bounded_staleness_test()) {
+    std::cout << "Passed" << std::endl;
+  } else {
+    std::cout << "Failed" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
@@ -1,7 +1,9 @@
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include <sync.h>
 
@@ -13,7 +15,8 @@ using namespace nu;
 constexpr static uint64_t kBufSize = (4ULL << 30);
 constexpr static uint64_t kMinSlabClassSize =
     (1ULL << SlabAllocator::kMinSlabClassShift);
-constexpr static uint64_t kMaxSlabClassSize = (1ULL << 27);
+constexpr static uint64_t kMaxSlabClassSize =
+    (1ULL << SlabAllocator::kMaxSlabClassShift);
 uint16_t slab_id = kRuntimeSlabId + 1;
 
 static_assert(kBufSize >= kMaxSlabClassSize);
@@ -53,7 +56,8 @@ bool run_with_size(uint64_t obj_size, uint64_t class_size) {
 bool run_min_size() { return run_with_size(1, kMinSlabClassSize); }
 
 bool run_mid_size() {
-  return run_with_size(110, 128) & run_with_size(200, 256);
+  return run_with_size(110, 112) & run_with_size(200, 224) &
+         run_with_size(260, 320) & run_with_size(5000, 5120);
 }
 
 bool run_max_size() {
@@ -75,9 +79,202 @@ bool run_more_than_buf_size() {
   return true;
 }
 
+bool run_large() {
+  constexpr uint64_t kObjSize = 33ULL << 20;
+
+  auto *buf = new uint8_t[kBufSize];
+  std::unique_ptr<uint8_t[]> buf_gc(buf);
+  auto slab = std::make_unique<SlabAllocator>(slab_id++, buf, kBufSize);
+
+  // Large objects are page-granular rather than rounded up to a class.
+  auto *ptr = slab->allocate(kObjSize);
+  if ((reinterpret_cast<uintptr_t>(ptr) - sizeof(PtrHeader)) % kPageSize) {
+    return false;
+  }
+  if (slab->get_usage() > kObjSize + 2 * kPageSize) {
+    return false;
+  }
+
+  // Growing at the top of the heap stays in place.
+  if (SlabAllocator::reallocate(ptr, 2 * kObjSize) != ptr) {
+    return false;
+  }
+
+  // So does growing into the adjacent free span.
+  auto *other = slab->allocate(kObjSize);
+  slab->free(ptr);
+  if (slab->allocate(kObjSize) != ptr) {
+    return false;
+  }
+  if (SlabAllocator::reallocate(ptr, 2 * kObjSize) != ptr) {
+    return false;
+  }
+
+  // Freeing the top of the heap gives it back.
+  slab->free(ptr);
+  slab->free(other);
+  return slab->get_usage() < 2 * kPageSize;
+}
+
+bool run_headerless() {
+  constexpr uint64_t kNumObjs = 1 << 16;
+
+  // Small objects in the runtime heap are carved without headers.
+  auto *slab = get_runtime()->runtime_slab();
+  std::vector<void *> ptrs(kNumObjs);
+  auto usage = slab->get_usage();
+  for (auto &ptr : ptrs) {
+    ptr = slab->allocate(kMinSlabClassSize);
+    if (reinterpret_cast<uintptr_t>(ptr) % kAlignment) {
+      return false;
+    }
+  }
+  auto delta = slab->get_usage() - usage;
+  for (auto ptr : ptrs) {
+    SlabAllocator::free(ptr);
+  }
+  return delta < kNumObjs * kMinSlabClassSize * 3 / 2;
+}
+
+bool run_scavenge() {
+  constexpr uint64_t kNumObjs = 4096;
+  constexpr uint64_t kObjSize = 4000;
+
+  auto *buf = new uint8_t[kBufSize];
+  std::unique_ptr<uint8_t[]> buf_gc(buf);
+  auto slab = std::make_unique<SlabAllocator>(slab_id++, buf, kBufSize);
+
+  std::vector<void *> ptrs(kNumObjs);
+  for (auto &ptr : ptrs) {
+    ptr = slab->allocate(kObjSize);
+    memset(ptr, 0xFF, kObjSize);
+  }
+  auto usage = slab->get_usage();
+  for (auto ptr : ptrs) {
+    slab->free(ptr);
+  }
+
+  slab->scavenge();
+  if (slab->get_resident_usage() > usage / 2) {
+    return false;
+  }
+
+  // Released chunks are reused before the slab grows.
+  for (uint64_t i = 0; i < kNumObjs / 2; i++) {
+    ptrs[i] = slab->allocate(kObjSize);
+    memset(ptrs[i], 0xFF, kObjSize);
+  }
+  return slab->get_usage() == usage;
+}
+
+bool run_stats() {
+  constexpr uint64_t kNumObjs = 1000;
+  constexpr uint64_t kObjSize = 100;
+
+  auto *buf = new uint8_t[kBufSize];
+  std::unique_ptr<uint8_t[]> buf_gc(buf);
+  auto slab = std::make_unique<SlabAllocator>(slab_id++, buf, kBufSize);
+  slab->set_profiling_rate(1);
+
+  std::vector<void *> ptrs(kNumObjs);
+  for (auto &ptr : ptrs) {
+    ptr = slab->allocate(kObjSize);
+  }
+  auto count_live = [&] {
+    uint64_t num_live = 0;
+    for (auto &c : slab->stats().classes) {
+      num_live += c.num_live;
+    }
+    return num_live;
+  };
+  if (count_live() != kNumObjs) {
+    return false;
+  }
+  auto profile = slab->get_profile();
+  if (profile.empty() || profile[0].num_bytes < kNumObjs * kObjSize) {
+    return false;
+  }
+
+  auto usage = slab->get_usage();
+  for (auto ptr : ptrs) {
+    slab->free(ptr);
+  }
+  auto stats = slab->stats();
+  return !count_live() && stats.peak_usage == usage;
+}
+
+bool run_regions() {
+  constexpr uint64_t kRegionSize = 1 << 20;
+  constexpr uint64_t kObjSize = 4000;
+
+  auto bufs = std::make_unique<uint8_t[]>(2 * kRegionSize);
+  auto slab =
+      std::make_unique<SlabAllocator>(slab_id++, bufs.get(), kRegionSize);
+  std::vector<void *> ptrs;
+  void *ptr;
+  while ((ptr = slab->allocate(kObjSize))) {
+    ptrs.push_back(ptr);
+  }
+  auto num_objs = ptrs.size();
+
+  auto *region = bufs.get() + kRegionSize;
+  if (!slab->add_region(region, kRegionSize)) {
+    return false;
+  }
+  while ((ptr = slab->allocate(kObjSize))) {
+    if (ptr < region || ptr >= region + kRegionSize) {
+      return false;
+    }
+    ptrs.push_back(ptr);
+  }
+  if (ptrs.size() <= num_objs || slab->get_num_regions() != 2 ||
+      slab->get_usage() > 2 * kRegionSize) {
+    return false;
+  }
+
+  for (auto ptr : ptrs) {
+    slab->free(ptr);
+  }
+  // Both regions' chunks are reusable again.
+  for (auto &ptr : ptrs) {
+    ptr = slab->allocate(kObjSize);
+    if (!ptr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool run_aligned() {
+  constexpr uint64_t kAligns[] = {64, 256, 4096};
+  constexpr uint64_t kSizes[] = {8, 100, 3000, 300000};
+
+  auto *buf = new uint8_t[kBufSize];
+  std::unique_ptr<uint8_t[]> buf_gc(buf);
+  auto slab = std::make_unique<SlabAllocator>(slab_id++, buf, kBufSize);
+
+  std::vector<void *> ptrs;
+  for (auto align : kAligns) {
+    for (auto size : kSizes) {
+      auto *ptr = slab->allocate_aligned(size, align);
+      if (!ptr || reinterpret_cast<uintptr_t>(ptr) % align) {
+        return false;
+      }
+      memset(ptr, 0, size);
+      ptrs.push_back(ptr);
+    }
+  }
+  for (auto ptr : ptrs) {
+    slab->free(ptr);
+  }
+  return true;
+}
+
 bool run() {
   return run_min_size() & run_mid_size() & run_max_size() &
-         run_more_than_buf_size();
+         run_more_than_buf_size() & run_large() & run_headerless() &
+         run_scavenge() & run_stats() & run_regions() &
+         run_aligned();
 }
 
 int main(int argc, char **argv) {
@@ -7,6 +7,7 @@
 #include <unordered_map>
 
 #include "nu/runtime.hpp"
+#include "nu/utils/compaction.hpp"
 #include "nu/utils/farmhash.hpp"
 #include "nu/utils/sync_hash_map.hpp"
 
@@ -59,6 +60,54 @@ void do_work() {
     }
   }
 
+  // Punch holes into the heap and make sure compaction keeps the rest intact.
+  for (auto iter = std_map.begin(); iter != std_map.end();) {
+    if (!map_ptr->remove(iter->first)) {
+      passed = false;
+      goto done;
+    }
+    iter = std_map.erase(iter);
+    if (iter != std_map.end()) {
+      ++iter;
+    }
+  }
+  {
+    // The runtime heap's fragmentation depends on everything else allocated
+    // from it, so force compaction and check that it moved something.
+    std::unordered_map<std::string, V *> addrs;
+    for (auto &[k, _] : std_map) {
+      addrs[k] = map_ptr->get(k);
+    }
+    {
+      CompactionRatioGuard guard(0);
+      if (!map_ptr->compact(NBuckets)) {
+        passed = false;
+        goto done;
+      }
+    }
+
+    bool moved = false;
+    for (auto &[k, v] : std_map) {
+      auto optional = map_ptr->get_copy(k);
+      if (!optional || v != *optional) {
+        passed = false;
+        goto done;
+      }
+      // Pairs only ever move down.
+      auto *addr = map_ptr->get(k);
+      if (reinterpret_cast<uintptr_t>(addr) >
+          reinterpret_cast<uintptr_t>(addrs[k])) {
+        passed = false;
+        goto done;
+      }
+      moved |= (addr != addrs[k]);
+    }
+    if (!moved) {
+      passed = false;
+      goto done;
+    }
+  }
+
   for (auto &[k, _] : std_map) {
     if (!map_ptr->remove(k)) {
       passed = false;
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "nu/commons.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utility_index.hpp"
+
+using namespace nu;
+
+constexpr uint32_t kNumProclets = 1000;
+constexpr uint32_t kTopK = 10;
+
+// The index never dereferences the headers, so any heap address works.
+ProcletHeader *fake_header(uint32_t idx) {
+  return reinterpret_cast<ProcletHeader *>(kMinProcletHeapVAddr +
+                                           idx * kMinProcletHeapSize);
+}
+
+Utility make_utility(uint32_t idx, float cpu_util, float mem_util) {
+  Utility utility;
+  utility.header = fake_header(idx);
+  utility.cpu_pressure_util = cpu_util;
+  utility.mem_pressure_util = mem_util;
+  return utility;
+}
+
+std::vector<ProcletHeader *> get_top(UtilityIndex *index,
+                                     UtilityIndex::Kind kind, uint32_t k) {
+  std::vector<ProcletHeader *> top;
+  index->for_each_top(kind, [&](ProcletHeader *header) {
+    top.push_back(header);
+    return top.size() < k;
+  });
+  return top;
+}
+
+void do_work() {
+  bool passed = true;
+  auto index = std::make_unique<UtilityIndex>();
+  std::map<ProcletHeader *, float> cpu_utils;
+  std::map<ProcletHeader *, float> mem_utils;
+
+  for (uint32_t i = 0; i < kNumProclets; i++) {
+    auto cpu_util = static_cast<float>((i * 7919) % kNumProclets + 1);
+    auto mem_util = static_cast<float>(kNumProclets - i);
+    index->update(make_utility(i, cpu_util, mem_util));
+    cpu_utils[fake_header(i)] = cpu_util;
+    mem_utils[fake_header(i)] = mem_util;
+  }
+
+  // Utilities come out in descending bucket order.
+  auto all = get_top(index.get(), UtilityIndex::kCpuPressure, kNumProclets + 1);
+  passed &= (all.size() == kNumProclets);
+  for (uint32_t i = 1; i < all.size(); i++) {
+    passed &= (UtilityIndex::to_bucket(cpu_utils[all[i - 1]]) >=
+               UtilityIndex::to_bucket(cpu_utils[all[i]]));
+  }
+  auto top = get_top(index.get(), UtilityIndex::kMemPressure, kTopK);
+  passed &= (top.size() == kTopK);
+  auto top_mem_bucket = UtilityIndex::to_bucket(kNumProclets);
+  for (auto *header : top) {
+    passed &= (UtilityIndex::to_bucket(mem_utils[header]) == top_mem_bucket);
+  }
+
+  // Promotions, demotions, and removals take effect right away.
+  index->update(make_utility(kNumProclets - 1, 1e6, 1e9));
+  passed &= (get_top(index.get(), UtilityIndex::kCpuPressure, 1).front() ==
+             fake_header(kNumProclets - 1));
+  passed &= (get_top(index.get(), UtilityIndex::kMemPressure, 1).front() ==
+             fake_header(kNumProclets - 1));
+  index->update(make_utility(kNumProclets - 1, 0, 0));
+  top = get_top(index.get(), UtilityIndex::kMemPressure, 1);
+  passed &= (top.front() != fake_header(kNumProclets - 1));
+  passed &= (UtilityIndex::to_bucket(mem_utils[top.front()]) == top_mem_bucket);
+  index->remove(fake_header(0));
+  index->remove(fake_header(0));
+  all = get_top(index.get(), UtilityIndex::kMemPressure, kNumProclets);
+  passed &= (all.size() == kNumProclets - 1);
+  passed &= std::ranges::find(all, fake_header(0)) == all.end();
+
+  if (passed) {
+    std::cout << "Passed" << std::endl;
+  } else {
+    std::cout << "Failed" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
@@ -0,0 +1,60 @@
+#!/bin/bash
+
+source shared.sh
+
+PRIMARY_CTRL_IP="18.18.1.1"
+STANDBY_CTRL_IP="18.18.1.4"
+CTRL_IPS="$PRIMARY_CTRL_IP,$STANDBY_CTRL_IP"
+SERVER_IP="18.18.1.2"
+MAIN_SERVER_IP="18.18.1.3"
+LPID=1
+BIN="$SHARED_SCRIPT_DIR/bin/test_ctrl_failover"
+# Seconds into the main server's 20-second run.
+KILL_PRIMARY_AFTER_SECS=8
+
+function cleanup {
+    kill_process test_
+    kill_controller
+    kill_iokerneld
+}
+
+function force_cleanup {
+    echo -e "\nPlease wait for proper cleanups..."
+    cleanup
+    exit 1
+}
+
+trap force_cleanup INT
+
+kill_iokerneld
+kill_controller
+sleep 5
+source setup.sh >/dev/null 2>&1
+rerun_iokerneld
+
+sudo stdbuf -o0 sh -c "bin/ctrl_main -r $CTRL_IPS" 1>/dev/null 2>&1 &
+disown -r
+sleep 3
+sudo stdbuf -o0 sh -c "bin/ctrl_main -i $STANDBY_CTRL_IP -r $CTRL_IPS" 2>&1 \
+    | grep "taking over" &
+disown -r
+sleep 3
+
+sudo stdbuf -o0 sh -c "$BIN -l $LPID -i $SERVER_IP -t $CTRL_IPS" 1>/dev/null 2>&1 &
+disown -r
+sleep 3
+
+{ sleep $KILL_PRIMARY_AFTER_SECS; sudo pkill -9 -f "ctrl_main -r"; } &
+sudo stdbuf -o0 sh -c "$BIN -m -l $LPID -i $MAIN_SERVER_IP -t $CTRL_IPS" \
+    2>/dev/null | tee /dev/stderr | grep -q "Passed"
+ret=$?
+wait
+
+cleanup
+
+if [[ $ret -eq 0 ]]; then
+    say_passed
+else
+    say_failed
+fi
+exit $ret
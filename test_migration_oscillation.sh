@@ -0,0 +1,83 @@
+#!/bin/bash
+
+source shared.sh
+
+CTRL_IP="18.18.1.1"
+SERVER_IPS=("18.18.1.2" "18.18.1.4")
+MAIN_SERVER_IP="18.18.1.3"
+ANTAGONIST_IP="18.18.1.5"
+LPID=1
+BIN="$SHARED_SCRIPT_DIR/bin/test_migration_oscillation"
+ANTAGONIST="$SHARED_SCRIPT_DIR/bin/bench_real_cpu_pressure"
+ANTAGONIST_CONF="/tmp/test_migration_oscillation.conf"
+# The antagonist spins for this long and then stays away for as long.
+TOGGLE_SECS=2
+
+function cleanup {
+    kill_process test_
+    kill_process bench_real_cpu
+    kill_controller
+    kill_iokerneld
+    sudo rm -f $ANTAGONIST_CONF
+}
+
+function force_cleanup {
+    echo -e "\nPlease wait for proper cleanups..."
+    cleanup
+    exit 1
+}
+
+function toggle_antagonist {
+    while true; do
+        sudo stdbuf -o0 sh -c "$ANTAGONIST $ANTAGONIST_CONF" 1>/dev/null 2>&1 &
+        sleep 1
+        sudo pkill -SIGHUP bench_real_cpu
+        sleep $TOGGLE_SECS
+        kill_process bench_real_cpu
+        sleep $TOGGLE_SECS
+    done
+}
+
+trap force_cleanup INT
+
+kill_iokerneld
+kill_controller
+sleep 5
+source setup.sh >/dev/null 2>&1
+rerun_iokerneld
+
+cat >$ANTAGONIST_CONF <<CONF
+host_addr $ANTAGONIST_IP
+host_netmask 255.255.255.0
+host_gateway 18.18.1.1
+runtime_kthreads 46
+runtime_guaranteed_kthreads 0
+runtime_spinning_kthreads 0
+runtime_priority be
+CONF
+
+run_controller 1>/dev/null 2>&1 &
+disown -r
+sleep 3
+
+for server_ip in ${SERVER_IPS[@]}; do
+    sudo stdbuf -o0 sh -c "$BIN -l $LPID -i $server_ip" 1>/dev/null 2>&1 &
+    disown -r
+done
+sleep 3
+
+toggle_antagonist &
+toggler_pid=$!
+sudo stdbuf -o0 sh -c "$BIN -m -l $LPID -i $MAIN_SERVER_IP" \
+    2>/dev/null | tee /dev/stderr | grep -q "Passed"
+ret=$?
+kill $toggler_pid
+
+cleanup
+
+if [[ $ret -eq 0 ]]; then
+    say_passed
+else
+    say_failed
+fi
+exit $ret